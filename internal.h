@@ -0,0 +1,181 @@
+#ifndef INTERNAL_H
+#define INTERNAL_H
+
+#include "jimage.h"
+#include "zip.h"
+
+#include <jni.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// layouts of yajava.c the tests build and read
+
+// runtime index, a mmap-able file of probed runtimes
+//   [header][entry * count][root * roots_len][string pool]
+// strings are offsets into the pool, offset 0 is the empty string (NULL)
+#define INDEX_FILE "runtimes.idx"
+#define INDEX_MAGIC 0x49524a59 // "YJRI"
+#define INDEX_VERSION 6
+
+struct index_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t roots_len;
+  uint32_t strings_len;
+  uint32_t reserved;
+};
+struct index_entry {
+  // libjvm fingerprint
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_ns;
+  // release file fingerprint, mtime -1 without one
+  uint64_t release_size;
+  int64_t release_mtime_ns;
+
+  int32_t major_version;
+  int32_t jni_version;
+  uint32_t home;
+  uint32_t libjvm_path;
+  uint32_t version;
+  uint32_t full_version;
+  uint32_t vendor;
+  uint32_t arch;
+  uint32_t gcs;
+  uint32_t features;
+  uint32_t props;
+  uint32_t reserved;
+};
+struct index_root { // a discovery root when it was last scanned
+  int64_t mtime_ns; // -1 when missing
+  uint32_t path;
+  uint32_t reserved;
+};
+struct index {
+  void *map;
+  size_t size;
+  struct index_header *header;
+  struct index_entry *entries;
+  struct index_root *roots;
+  const char *strings;
+};
+
+// page cache prefetch profile of a launch
+//   [header][file * files_len][range * ranges_len][string pool]
+#define PREFETCH_MAGIC 0x50464a59 // YJFP
+#define PREFETCH_VERSION 2
+#define PREFETCH_GAP 16 // pages between two ranges read as one
+
+struct prefetch_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t page_size;
+  uint32_t files_len;
+  uint32_t ranges_len;
+  uint32_t strings_len;
+  // vm creation time of the launches, cold and warm page cache
+  uint32_t cold_n;
+  uint32_t warm_n;
+  int64_t cold_us;
+  int64_t warm_us;
+};
+struct prefetch_file {
+  uint64_t size;
+  int64_t mtime_ns;
+  uint32_t path;
+  uint32_t ranges_start;
+  uint32_t ranges_len;
+  uint32_t reserved;
+};
+struct prefetch_range { // in pages
+  uint32_t page;
+  uint32_t pages;
+};
+
+// the jars `yajava pack` merges
+// an entry of the merged jars, by name the first of the class path wins
+struct pack_entry {
+  struct zip_entry entry;
+  uint32_t jar;
+  int32_t next; // the same service file in a later jar, -1 for none
+  bool kept;    // of a jar left on the class path, shadows later jars
+  bool written;
+};
+struct pack {
+  struct zip *jars;
+  bool *merged; // jars merged into the pack
+  size_t jars_len;
+  struct pack_entry *entries;
+  size_t len;
+  uint32_t *slots; // entry index + 1, 0 for empty
+  size_t slots_len;
+  size_t ordered;
+};
+
+// the startup class list of --preload
+#define PRELOAD_THREADS 8
+
+// a class of the startup class list, by package
+struct preload_class {
+  char *name; // binary name, a.b.C
+  uint32_t package_len;
+  uint32_t index; // in the list
+};
+struct preload_group { // the classes of a package
+  uint32_t start;
+  uint32_t len;
+  uint32_t first; // index of its first class in the list
+};
+struct yj_preload {
+  uint64_t key;
+  char path[PATH_MAX]; // the class list
+  char tmp[PATH_MAX + 16]; // -XX:DumpLoadedClassList of the recording run
+  bool record;
+  char *list;
+  size_t list_len;
+  struct preload_class *classes;
+  uint32_t classes_len;
+  struct preload_group *groups; // in order of first use
+  uint32_t groups_len;
+  JavaVM *vm;
+  pthread_t threads[PRELOAD_THREADS];
+  size_t threads_len;
+  uint32_t next;    // next group to load
+  uint32_t running; // helper threads not done yet
+  int state;        // PRELOAD_*, why the helpers stopped
+  bool stats;       // report once the helpers are done
+  uint32_t loaded;
+  uint32_t failed;
+  long start_us;
+  long busy_us; // load time of the helpers, moved off the main thread
+  bool joined;
+};
+
+// the system modules of a runtime, read from lib/modules
+#define MODULES_NAME_MAX 1024
+
+struct module_info { // a decoded module-info.class
+  unsigned char *buf;
+  size_t len;
+  uint32_t *pool; // offsets of the constants in buf
+  uint16_t pool_len;
+  const unsigned char *attr; // the Module attribute
+  size_t attr_len;
+  const unsigned char *packages; // the ModulePackages attribute
+  size_t packages_len;
+  char name[MODULES_NAME_MAX];
+  char version[MODULES_NAME_MAX];
+  uint16_t flags;
+};
+struct modules_image { // the module-info.class of each module of lib/modules
+  struct jimage img;
+  struct module_info *mods; // sorted by name
+  size_t len;
+};
+
+#endif /* INTERNAL_H */
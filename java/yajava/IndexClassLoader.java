@@ -0,0 +1,252 @@
+package yajava;
+
+import java.io.File;
+import java.io.IOException;
+import java.io.InputStream;
+import java.net.URL;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.channels.FileChannel;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Paths;
+import java.nio.file.StandardOpenOption;
+import java.security.CodeSigner;
+import java.security.CodeSource;
+import java.security.SecureClassLoader;
+import java.util.HashSet;
+import java.util.Set;
+import java.util.jar.Attributes;
+import java.util.jar.JarEntry;
+import java.util.jar.JarFile;
+import java.util.jar.Manifest;
+import java.util.zip.ZipFile;
+
+/**
+ * System class loader of launches with a long class path, set by yajava
+ * through {@code -Djava.system.class.loader}. The class index written by the
+ * launcher maps each package to the jars holding it, in class path order; a
+ * class of an indexed package is read from the first of those jars that has
+ * it instead of probing every jar of the class path.
+ *
+ * <p>Everything else goes to the parent, the built-in application class
+ * loader with the same class path: packages of the runtime, classes the
+ * index does not know and all resources.
+ */
+public final class IndexClassLoader extends SecureClassLoader {
+
+  static {
+    registerAsParallelCapable();
+  }
+
+  // layout of the index, see the CLASSINDEX section of yajava.c
+  private static final int MAGIC = 0x58434a59; // YJCX
+  private static final int VERSION = 2;
+  private static final int HEADER_SIZE = 40;
+  private static final int JAR_SIZE = 24;
+  private static final int PACKAGE_SIZE = 20;
+
+  private final ByteBuffer index;
+  private final int slotsOff;
+  private final int slotsLen;
+  private final int packagesOff;
+  private final int refsOff;
+  private final int stringsOff;
+  private final String[] paths;
+  private final JarFile[] jars;
+  private final CodeSource[] sources;
+  private final Set<String> runtimePackages = new HashSet<>();
+
+  public IndexClassLoader(ClassLoader parent) {
+    super(parent);
+    ByteBuffer buf = map(System.getProperty("yajava.class.index"));
+    int jarsLen = 0;
+
+    if (buf != null && buf.capacity() >= HEADER_SIZE
+        && buf.getInt(0) == MAGIC && buf.getInt(4) == VERSION) {
+      jarsLen = buf.getInt(16);
+    } else {
+      buf = null;
+    }
+    index = buf;
+    paths = new String[jarsLen];
+    jars = new JarFile[jarsLen];
+    sources = new CodeSource[jarsLen];
+    if (buf == null) {
+      slotsOff = slotsLen = packagesOff = refsOff = stringsOff = 0;
+      return;
+    }
+
+    slotsLen = buf.getInt(24);
+    slotsOff = HEADER_SIZE + jarsLen * JAR_SIZE;
+    packagesOff = slotsOff + slotsLen * 4;
+    refsOff = packagesOff + buf.getInt(20) * PACKAGE_SIZE;
+    stringsOff = refsOff + buf.getInt(28) * 4;
+    for (int i = 0; i < jarsLen; i++) {
+      paths[i] = string(buf.getInt(HEADER_SIZE + i * JAR_SIZE + 16));
+    }
+
+    // the runtime keeps its packages, as with parent first delegation
+    for (Module module : ModuleLayer.boot().modules()) {
+      runtimePackages.addAll(module.getPackages());
+    }
+  }
+
+  private static ByteBuffer map(String path) {
+    if (path == null) {
+      return null;
+    }
+    try (FileChannel channel =
+        FileChannel.open(Paths.get(path), StandardOpenOption.READ)) {
+      return channel.map(FileChannel.MapMode.READ_ONLY, 0, channel.size())
+          .order(ByteOrder.LITTLE_ENDIAN);
+    } catch (IOException | RuntimeException e) {
+      return null;
+    }
+  }
+
+  @Override
+  protected Class<?> loadClass(String name, boolean resolve)
+      throws ClassNotFoundException {
+    synchronized (getClassLoadingLock(name)) {
+      Class<?> c = findLoadedClass(name);
+      int dot = name.lastIndexOf('.');
+
+      if (c == null && index != null && dot > 0) {
+        String pkg = name.substring(0, dot);
+        int p = runtimePackages.contains(pkg) ? -1 : find(pkg);
+        if (p >= 0) {
+          c = define(name, pkg, p);
+        }
+      }
+      if (c == null) {
+        return super.loadClass(name, resolve);
+      }
+      if (resolve) {
+        resolveClass(c);
+      }
+      return c;
+    }
+  }
+
+  // the package record, -1 if no jar holds the package
+  private int find(String pkg) {
+    byte[] name = pkg.replace('.', '/').getBytes(StandardCharsets.UTF_8);
+    int hash = hash(name);
+    int mask = slotsLen - 1;
+
+    for (int i = hash & mask;; i = (i + 1) & mask) {
+      int slot = index.getInt(slotsOff + i * 4);
+      if (slot == 0) {
+        return -1;
+      }
+      int rec = packagesOff + (slot - 1) * PACKAGE_SIZE;
+      if (index.getInt(rec + 8) == hash && index.getInt(rec + 4) == name.length
+          && nameEquals(index.getInt(rec), name)) {
+        return rec;
+      }
+    }
+  }
+
+  private Class<?> define(String name, String pkg, int rec) {
+    String entryName = name.replace('.', '/').concat(".class");
+    int refs = index.getInt(rec + 12);
+    int refsLen = index.getInt(rec + 16);
+
+    for (int i = 0; i < refsLen; i++) {
+      int jar = index.getInt(refsOff + (refs + i) * 4);
+      JarFile file = jar(jar);
+      JarEntry entry = file == null ? null : file.getJarEntry(entryName);
+      if (entry == null) {
+        continue;
+      }
+
+      byte[] bytes;
+      try (InputStream in = file.getInputStream(entry)) {
+        bytes = in.readAllBytes();
+      } catch (IOException e) {
+        return null;
+      }
+      if (getDefinedPackage(pkg) == null) {
+        definePackage(pkg, file);
+      }
+      CodeSigner[] signers = entry.getCodeSigners();
+      CodeSource source = signers == null ? sources[jar]
+          : new CodeSource(sources[jar].getLocation(), signers);
+      return defineClass(name, bytes, 0, bytes.length, source);
+    }
+    return null;
+  }
+
+  // with the versions of the manifest, as URLClassLoader defines them
+  private void definePackage(String pkg, JarFile file) {
+    Attributes attrs = null;
+    try {
+      Manifest manifest = file.getManifest();
+      attrs = manifest == null ? null : manifest.getMainAttributes();
+    } catch (IOException e) {
+      // without versions
+    }
+    try {
+      if (attrs == null) {
+        definePackage(pkg, null, null, null, null, null, null, null);
+      } else {
+        definePackage(pkg,
+            attrs.getValue(Attributes.Name.SPECIFICATION_TITLE),
+            attrs.getValue(Attributes.Name.SPECIFICATION_VERSION),
+            attrs.getValue(Attributes.Name.SPECIFICATION_VENDOR),
+            attrs.getValue(Attributes.Name.IMPLEMENTATION_TITLE),
+            attrs.getValue(Attributes.Name.IMPLEMENTATION_VERSION),
+            attrs.getValue(Attributes.Name.IMPLEMENTATION_VENDOR), null);
+      }
+    } catch (IllegalArgumentException e) {
+      // defined by another thread meanwhile
+    }
+  }
+
+  private synchronized JarFile jar(int i) {
+    if (jars[i] == null && paths[i] != null) {
+      File file = new File(paths[i]);
+      try {
+        jars[i] = new JarFile(file, true, ZipFile.OPEN_READ,
+            JarFile.runtimeVersion());
+        URL url = file.toURI().toURL();
+        sources[i] = new CodeSource(url, (CodeSigner[]) null);
+      } catch (IOException e) {
+        // left to the parent
+        paths[i] = null;
+      }
+    }
+    return jars[i];
+  }
+
+  // FNV-1a, as the launcher hashes package names
+  private static int hash(byte[] name) {
+    int h = 0x811c9dc5;
+    for (byte b : name) {
+      h ^= b & 0xff;
+      h *= 0x01000193;
+    }
+    return h;
+  }
+
+  private boolean nameEquals(int off, byte[] name) {
+    for (int i = 0; i < name.length; i++) {
+      if (index.get(stringsOff + off + i) != name[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  private String string(int off) {
+    int end = stringsOff + off;
+    while (index.get(end) != 0) {
+      end++;
+    }
+    byte[] bytes = new byte[end - stringsOff - off];
+    for (int i = 0; i < bytes.length; i++) {
+      bytes[i] = index.get(stringsOff + off + i);
+    }
+    return new String(bytes, StandardCharsets.UTF_8);
+  }
+}
@@ -0,0 +1,384 @@
+#include "jimage.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#define JIMAGE_HEADER_LEN 28
+#define JIMAGE_HASH_MULTIPLIER 0x01000193
+
+// location attributes, a byte of kind << 3 | (length - 1), then the value
+// big endian in length bytes
+#define JIMAGE_ATTR_END 0
+#define JIMAGE_ATTR_MODULE 1
+#define JIMAGE_ATTR_PARENT 2
+#define JIMAGE_ATTR_BASE 3
+#define JIMAGE_ATTR_EXTENSION 4
+#define JIMAGE_ATTR_OFFSET 5
+#define JIMAGE_ATTR_COMPRESSED 6
+#define JIMAGE_ATTR_UNCOMPRESSED 7
+#define JIMAGE_ATTR_COUNT 8
+
+// a compressed resource starts with u4 magic, u8 size, u8 uncompressed
+// size, u4 decompressor name, u4 decompressor config, u1 is terminal
+#define JIMAGE_RESOURCE_MAGIC 0xcafefafa
+#define JIMAGE_RESOURCE_HEADER_LEN 29
+#define JIMAGE_DECOMPRESS_MAX 4 // stacked compressors
+
+#define JIMAGE_LE32(p)                                                         \
+  ((uint32_t)(p)[0] | ((uint32_t)(p)[1] << 8) | ((uint32_t)(p)[2] << 16) |     \
+   ((uint32_t)(p)[3] << 24))
+#define JIMAGE_BE32(p)                                                         \
+  ((uint32_t)(p)[3] | ((uint32_t)(p)[2] << 8) | ((uint32_t)(p)[1] << 16) |     \
+   ((uint32_t)(p)[0] << 24))
+
+static uint32_t jimage_u4(struct jimage *img, const unsigned char *p) {
+  return img->swap ? JIMAGE_BE32(p) : JIMAGE_LE32(p);
+}
+
+static uint64_t jimage_u8(struct jimage *img, const unsigned char *p) {
+  uint64_t lo = jimage_u4(img, img->swap ? p + 4 : p);
+  uint64_t hi = jimage_u4(img, img->swap ? p : p + 4);
+  return hi << 32 | lo;
+}
+
+// the hash of the jimage perfect hash table
+static uint32_t jimage_hash(const char *s, uint32_t seed) {
+  const unsigned char *p = (const unsigned char *)s;
+
+  for (; *p != '\0'; p++) {
+    seed = (seed * JIMAGE_HASH_MULTIPLIER) ^ *p;
+  }
+  return seed & 0x7fffffff;
+}
+
+static const char *jimage_string(struct jimage *img, uint64_t offset) {
+  return offset < img->strings_size ? img->strings + offset : "";
+}
+
+bool jimage_open(struct jimage *img, const char *path) {
+  const unsigned char *h;
+  struct stat st;
+  void *map;
+  int fd;
+
+  memset(img, 0, sizeof(struct jimage));
+  if (path == NULL || (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return false;
+  }
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      st.st_size < JIMAGE_HEADER_LEN) {
+    close(fd);
+    return false;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  img->map = map;
+  img->size = st.st_size;
+
+  // the native byte order of the machine which linked the runtime
+  h = img->map;
+  if (JIMAGE_LE32(h) != JIMAGE_MAGIC) {
+    img->swap = true;
+  }
+  if (jimage_u4(img, h) != JIMAGE_MAGIC ||
+      jimage_u4(img, h + 4) >> 16 != JIMAGE_MAJOR_VERSION) {
+    TRACE("not a jimage: %s", path);
+    jimage_close(img);
+    return false;
+  }
+
+  img->table_length = jimage_u4(img, h + 16);
+  img->locations_size = jimage_u4(img, h + 20);
+  img->strings_size = jimage_u4(img, h + 24);
+  img->index_size = JIMAGE_HEADER_LEN + (size_t)img->table_length * 8 +
+                    img->locations_size + img->strings_size;
+  if (img->index_size > img->size || img->strings_size == 0) {
+    TRACE("invalid jimage index: %s", path);
+    jimage_close(img);
+    return false;
+  }
+
+  img->redirect = h + JIMAGE_HEADER_LEN;
+  img->offsets = img->redirect + (size_t)img->table_length * 4;
+  img->locations = img->offsets + (size_t)img->table_length * 4;
+  img->strings = (const char *)img->locations + img->locations_size;
+
+  // every string ends in the table
+  if (img->strings[img->strings_size - 1] != '\0') {
+    TRACE("invalid jimage strings: %s", path);
+    jimage_close(img);
+    return false;
+  }
+  return true;
+}
+
+void jimage_close(struct jimage *img) {
+  if (img->map != NULL) {
+    munmap((void *)img->map, img->size);
+  }
+  memset(img, 0, sizeof(struct jimage));
+}
+
+// decode the location at an offset of the location bytes
+static bool jimage_location_at(struct jimage *img, uint32_t offset,
+                               struct jimage_location *loc) {
+  const unsigned char *p = img->locations + offset;
+  const unsigned char *end = img->locations + img->locations_size;
+  uint64_t attrs[JIMAGE_ATTR_COUNT] = {0};
+
+  if (offset >= img->locations_size) {
+    return false;
+  }
+  while (p < end && *p >> 3 != JIMAGE_ATTR_END) {
+    int kind = *p >> 3, n = (*p & 0x7) + 1;
+    uint64_t value = 0;
+
+    if (kind >= JIMAGE_ATTR_COUNT || p + 1 + n > end) {
+      return false;
+    }
+    for (int i = 1; i <= n; i++) {
+      value = value << 8 | p[i];
+    }
+    attrs[kind] = value;
+    p += 1 + n;
+  }
+
+  loc->module = jimage_string(img, attrs[JIMAGE_ATTR_MODULE]);
+  loc->parent = jimage_string(img, attrs[JIMAGE_ATTR_PARENT]);
+  loc->base = jimage_string(img, attrs[JIMAGE_ATTR_BASE]);
+  loc->extension = jimage_string(img, attrs[JIMAGE_ATTR_EXTENSION]);
+  loc->offset = attrs[JIMAGE_ATTR_OFFSET];
+  loc->compressed = attrs[JIMAGE_ATTR_COMPRESSED];
+  loc->uncompressed = attrs[JIMAGE_ATTR_UNCOMPRESSED];
+  return true;
+}
+
+// the name matches /module/parent/base.extension, empty parts left out
+static bool jimage_location_is(struct jimage_location *loc, const char *name) {
+  size_t len;
+
+  if (loc->module[0] != '\0') {
+    len = strlen(loc->module);
+    if (name[0] != '/' || strncmp(name + 1, loc->module, len) != 0 ||
+        name[len + 1] != '/') {
+      return false;
+    }
+    name += len + 2;
+  }
+  if (loc->parent[0] != '\0') {
+    len = strlen(loc->parent);
+    if (strncmp(name, loc->parent, len) != 0 || name[len] != '/') {
+      return false;
+    }
+    name += len + 1;
+  }
+  len = strlen(loc->base);
+  if (strncmp(name, loc->base, len) != 0) {
+    return false;
+  }
+  name += len;
+  if (loc->extension[0] != '\0') {
+    if (name[0] != '.' || strcmp(name + 1, loc->extension) != 0) {
+      return false;
+    }
+    return true;
+  }
+  return name[0] == '\0';
+}
+
+bool jimage_find(struct jimage *img, const char *name,
+                 struct jimage_location *loc) {
+  uint32_t index;
+  int32_t value;
+
+  if (img->map == NULL || img->table_length == 0) {
+    return false;
+  }
+
+  // a slot of the redirect table is either the index, -1 - index, or the
+  // seed to hash colliding names again with
+  index = jimage_hash(name, JIMAGE_HASH_MULTIPLIER) % img->table_length;
+  value = (int32_t)jimage_u4(img, img->redirect + (size_t)index * 4);
+  if (value == 0) {
+    return false;
+  } else if (value < 0) {
+    index = -1 - value;
+  } else {
+    index = jimage_hash(name, value) % img->table_length;
+  }
+  if (index >= img->table_length) {
+    return false;
+  }
+
+  return jimage_location_at(
+             img, jimage_u4(img, img->offsets + (size_t)index * 4), loc) &&
+         jimage_location_is(loc, name);
+}
+
+bool jimage_next(struct jimage *img, uint32_t *index,
+                 struct jimage_location *loc) {
+  while (*index < img->table_length) {
+    uint32_t offset = jimage_u4(img, img->offsets + (size_t)*index * 4);
+
+    (*index)++;
+    if (jimage_location_at(img, offset, loc)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t jimage_name(struct jimage_location *loc, char *buf, size_t len) {
+  int n = snprintf(buf, len, "%s%s%s%s%s%s%s%s",
+                   loc->module[0] != '\0' ? "/" : "", loc->module,
+                   loc->module[0] != '\0' ? "/" : "", loc->parent,
+                   loc->parent[0] != '\0' ? "/" : "", loc->base,
+                   loc->extension[0] != '\0' ? "." : "", loc->extension);
+  return n < 0 ? 0 : n;
+}
+
+// zip is the compressor of `jlink --compress`, compact-cp only goes with
+// it and is left to the vm
+static unsigned char *jimage_decompress(struct jimage *img,
+                                        const unsigned char *data, size_t len,
+                                        size_t *out_len) {
+  unsigned char *buf = NULL;
+
+  for (int i = 0; i < JIMAGE_DECOMPRESS_MAX; i++) {
+    const unsigned char *p = buf != NULL ? buf : data;
+    unsigned char *out;
+    uLongf out_size;
+    uint64_t size, usize;
+    const char *name;
+
+    if (len < JIMAGE_RESOURCE_HEADER_LEN ||
+        jimage_u4(img, p) != JIMAGE_RESOURCE_MAGIC) {
+      *out_len = len;
+      return buf;
+    }
+    size = jimage_u8(img, p + 4);
+    usize = jimage_u8(img, p + 12);
+    name = jimage_string(img, jimage_u4(img, p + 20));
+    if (strcmp(name, "zip") != 0 ||
+        size > len - JIMAGE_RESOURCE_HEADER_LEN ||
+        (out = malloc(usize + 1)) == NULL) {
+      TRACE("jimage resource compressed by %s", name);
+      free(buf);
+      return NULL;
+    }
+
+    out_size = usize;
+    if (uncompress(out, &out_size, p + JIMAGE_RESOURCE_HEADER_LEN, size) !=
+            Z_OK ||
+        out_size != usize) {
+      free(out);
+      free(buf);
+      return NULL;
+    }
+    free(buf);
+    buf = out;
+    len = usize;
+  }
+  free(buf);
+  return NULL;
+}
+
+unsigned char *jimage_read(struct jimage *img, struct jimage_location *loc,
+                           size_t *out_len) {
+  uint64_t stored = loc->compressed != 0 ? loc->compressed : loc->uncompressed;
+  const unsigned char *data;
+  unsigned char *buf;
+  size_t len;
+
+  if (loc->offset > img->size - img->index_size ||
+      stored > img->size - img->index_size - loc->offset) {
+    return NULL;
+  }
+  data = img->map + img->index_size + loc->offset;
+
+  if (loc->compressed != 0) {
+    buf = jimage_decompress(img, data, stored, &len);
+    if (buf == NULL || len != loc->uncompressed) {
+      free(buf);
+      return NULL;
+    }
+  } else {
+    if ((buf = malloc(stored + 1)) == NULL) {
+      return NULL;
+    }
+    memcpy(buf, data, stored);
+    len = stored;
+  }
+
+  buf[len] = '\0';
+  if (out_len != NULL) {
+    *out_len = len;
+  }
+  return buf;
+}
+
+// /packages/java.lang holds u4 pairs of is empty and the module name, for
+// each module with the package
+const char *jimage_package_module(struct jimage *img, const char *package) {
+  struct jimage_location loc;
+  const char *module = NULL;
+  char name[512];
+  unsigned char *refs;
+  size_t len;
+
+  if (snprintf(name, sizeof(name), "/packages/%s", package) >=
+      (int)sizeof(name)) {
+    return NULL;
+  }
+  for (char *p = name + 10; *p != '\0'; p++) {
+    *p = *p == '/' ? '.' : *p;
+  }
+  if (!jimage_find(img, name, &loc) ||
+      (refs = jimage_read(img, &loc, &len)) == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i + 8 <= len; i += 8) {
+    if (jimage_u4(img, refs + i) == 0 || module == NULL) {
+      module = jimage_string(img, jimage_u4(img, refs + i + 4));
+    }
+    if (jimage_u4(img, refs + i) == 0) {
+      break;
+    }
+  }
+  free(refs);
+  return module;
+}
+
+bool jimage_find_class(struct jimage *img, const char *class_file,
+                       struct jimage_location *loc) {
+  const char *slash = strrchr(class_file, '/');
+  const char *module;
+  char name[1024];
+
+  if (slash == NULL || slash - class_file >= 512) {
+    return false;
+  }
+  snprintf(name, sizeof(name), "%.*s", (int)(slash - class_file), class_file);
+  if ((module = jimage_package_module(img, name)) == NULL) {
+    return false;
+  }
+  if (snprintf(name, sizeof(name), "/%s/%s", module, class_file) >=
+      (int)sizeof(name)) {
+    return false;
+  }
+  return jimage_find(img, name, loc);
+}
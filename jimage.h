@@ -0,0 +1,66 @@
+#ifndef JIMAGE_H
+#define JIMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// lib/modules of a java 9+ runtime: a header, a perfect hash of the
+// resource names (redirect and offset tables), the encoded locations and
+// their strings, then the resources
+#define JIMAGE_MAGIC 0xcafedada
+#define JIMAGE_MAJOR_VERSION 1
+
+struct jimage {
+  const unsigned char *map;
+  size_t size;
+  bool swap; // written in the other byte order
+  uint32_t table_length;
+  const unsigned char *redirect; // s4[table_length]
+  const unsigned char *offsets;  // u4[table_length], into the locations
+  const unsigned char *locations;
+  uint32_t locations_size;
+  const char *strings;
+  uint32_t strings_size;
+  size_t index_size; // the resources follow the index
+};
+
+// /module/parent/base.extension, the strings point into the mapping
+struct jimage_location {
+  const char *module;
+  const char *parent;
+  const char *base;
+  const char *extension;
+  uint64_t offset;       // of the content, from the end of the index
+  uint64_t compressed;   // size as stored, 0 if not compressed
+  uint64_t uncompressed; // size of the resource
+};
+
+bool jimage_open(struct jimage *img, const char *path);
+
+void jimage_close(struct jimage *img);
+
+// the location of a full name, /java.base/java/lang/Object.class
+bool jimage_find(struct jimage *img, const char *name,
+                 struct jimage_location *loc);
+
+// iterate the locations, *index starts at 0
+bool jimage_next(struct jimage *img, uint32_t *index,
+                 struct jimage_location *loc);
+
+// the full name of a location, the length it needs like snprintf
+size_t jimage_name(struct jimage_location *loc, char *buf, size_t len);
+
+// read (and decompress) the resource, free() the result
+unsigned char *jimage_read(struct jimage *img, struct jimage_location *loc,
+                           size_t *out_len);
+
+// the module holding a package, java/lang or java.lang, NULL if none
+const char *jimage_package_module(struct jimage *img, const char *package);
+
+// the location of a class file, java/lang/Object.class, in whichever
+// module holds its package
+bool jimage_find_class(struct jimage *img, const char *class_file,
+                       struct jimage_location *loc);
+
+#endif /* JIMAGE_H */
@@ -3,13 +3,17 @@
 
 #include <limits.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
 #include <libgen.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <sys/stat.h>
 #include <sys/wait.h>
 
 #define USAGE_TEXT                                                             \
@@ -18,26 +22,59 @@
   "commands:\n"                                                                \
   "    <empty>   [options] ... run java application with params passthru\n"    \
   "    run       [options] ... run java application with params passthru\n"    \
-  "    discovery [base-path]   discovery java runtime(s) in given base path\n" \
-  "    show                    show current activated java runtime\n"
+  "    Foo.java  [args] ...    run a single-file source program, compiled\n"   \
+  "                            once per content and runtime\n"               \
+  "    discovery [-t] [-l] [-d depth] [path ...]\n"                            \
+  "                            discovery java runtime(s) in given path(s)\n"   \
+  "                            -t  print time spent on each path\n"            \
+  "                            -l  print vendor, arch, gcs and features\n"     \
+  "                            -d  directory levels to search, default 2\n"    \
+  "    show                    show current activated java runtime\n"          \
+  "    archive ls|stats|gc [--max-size size]\n"                                \
+  "                            list, report page sharing of, or trim the\n"    \
+  "                            archives of --auto-archive\n"                   \
+  "    pack      [options] ... run java application, then merge its class\n"  \
+  "                            path into one jar in class load order, used\n" \
+  "                            by later launches of the same class path\n"    \
+  "    which-class [options] [class ...]\n"                                    \
+  "                            the class path entry providing each class and\n" \
+  "                            the entries it shadows; without classes, the\n" \
+  "                            duplicate classes, split packages and unused\n" \
+  "                            entries of the class path\n"                    \
+  "\n"                                                                         \
+  "run options:\n"                                                             \
+  "    --in-process            create the jvm in the launcher process\n"       \
+  "    --metrics               report process metrics of the jvm on exit\n"    \
+  "    --plan-stats            report whether the cached launch plan is used\n"\
+  "    --auto-archive          record and use a CDS/AOT archive of the app\n"  \
+  "    --prefetch-stats        report page cache prefetch, cold/warm startup\n"\
+  "    --preload               load the recorded startup classes of the app\n"\
+  "                            on helper threads while main runs\n"          \
+  "    --preload-stats         report the class loading moved off main\n"    \
+  "    --class-index           load the class path through an index of the\n"\
+  "                            packages of its jars\n"                      \
+  "    --source release        run the file as a source program of release\n"
 #define DEFAULT_EXEC_NAME "yajava"
 #define DEFAULT_CMD "run"
 #define CMD_MAXLEN 16
-
-#if __linux__
-#define DEFAULT_JVM_DISCOVERY_PATH "/usr/lib/jvm"
-#elif __APPLE__
-#define DEFAULT_JVM_DISCOVERY_PATH "/Library/Java/JavaVirtualMachines"
-#else
-#error "platform not supported"
-#endif
+#define TABLE_COLS 8
 
 struct table {
-  char *rows[4];
+  char *rows[TABLE_COLS];
   struct table *next;
 };
 
 void print_usages(char *exec);
+bool is_script(const char *path);
+char *format_caps(unsigned int gcs, unsigned int features);
+char *format_size(long long bytes);
+char *format_time(long epoch_us);
+int archive_main(int argc, char **argv, char *exec);
+int pack_main(int argc, char **argv, char *exec);
+int which_main(int argc, char **argv, char *exec);
+
+// from yajava.c
+bool arg_parse_size(const char *s, size_t *out);
 
 struct table *table_new();
 void table_print(struct table *table, FILE *out);
@@ -68,20 +105,20 @@ int main(int argc, char **argv) {
 
   cmd_len = strlen(cmd);
 
-  if (strncmp(cmd, "run", cmd_len) == 0 || cmd[0] == '-') {
+  // a source file, `yajava Foo.java` or a script run as #!/usr/bin/env yajava
+  bool source = (cmd_len > 5 && strcmp(cmd + cmd_len - 5, ".java") == 0) ||
+                is_script(cmd);
+
+  if (strncmp(cmd, "run", cmd_len) == 0 || cmd[0] == '-' ||
+      cmd[0] == '@' || source) {
 
     struct yj_run_args run_args;
     struct yj_java_runtime runtime;
+    struct yj_cmdline cmdline;
     int arg_count;
     char **arg_start;
 
-    // find runtime
-    if (yj_find_runtime(&runtime) != YJ_OK) {
-      printf("error: no java runtime found\n");
-      exit(1);
-    }
-
-    if (cmd[0] == '-') {
+    if (cmd[0] == '-' || cmd[0] == '@' || source) {
       arg_count = argc - 1;
       arg_start = argv + 1;
     } else {
@@ -89,33 +126,98 @@ int main(int argc, char **argv) {
       arg_start = argv + 2;
     }
 
-    if (yj_parse_run_args(arg_count, arg_start, &run_args) == YJ_OK) {
-      yj_run_async(&runtime, &run_args);
+    // JDK_JAVA_OPTIONS and @argfiles
+    int exit_code = 1;
+    if (yj_expand_cmdline(arg_count, arg_start, &cmdline) != YJ_OK) {
+      yj_free_cmdline(&cmdline);
+      return exit_code;
+    }
+    arg_count = cmdline.argc;
+    arg_start = cmdline.argv;
+
+    if (yj_parse_run_args(arg_count, arg_start, &run_args) != YJ_OK) {
+      yj_free_run_args(&run_args);
+      yj_free_cmdline(&cmdline);
+      return exit_code;
+    }
+
+    // find runtime, from the launch plan of a warm start, or resolved when
+    // cold: the application may ask for a newer one
+    if (yj_plan_load(arg_count, arg_start, &run_args, &runtime) != YJ_OK &&
+        yj_find_runtime_for(&run_args, &runtime) != YJ_OK) {
+      printf("error: no java runtime found\n");
+      exit(1);
     }
 
-    wait(NULL);
+    if (run_args.in_process) {
+      yj_run_in_process(&runtime, &run_args, &exit_code);
+    } else {
+      yj_run_fork(&runtime, &run_args, &exit_code);
+    }
 
     yj_free_runtime(&runtime);
     yj_free_run_args(&run_args);
+    yj_free_cmdline(&cmdline);
+    return exit_code;
   } else if (strncmp(cmd, "discovery", cmd_len) == 0) {
-    char *base_path;
-    if (argc > 2 && argv[2] != NULL) {
-      base_path = argv[2];
-    } else {
-      base_path = DEFAULT_JVM_DISCOVERY_PATH;
+    struct yj_discovery discovery;
+    bool timing = false;
+    bool details = false;
+    int depth = 0;
+    int i = 2;
+
+    for (; i < argc && argv[i][0] == '-'; i++) {
+      if (strcmp(argv[i], "-t") == 0) {
+        timing = true;
+      } else if (strcmp(argv[i], "-l") == 0) {
+        details = true;
+      } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+        depth = atoi(argv[++i]);
+      } else {
+        printf("unknown option: %s\n\n", argv[i]);
+        print_usages(exec_name);
+        exit(1);
+      }
+    }
+
+    // paths given on the command line replace the configured ones
+    yj_discovery_defaults(&discovery);
+    if (i < argc) {
+      yj_free_discovery(&discovery);
+      discovery.roots_len = argc - i;
+      discovery.roots = calloc(argc - i, sizeof(struct yj_discovery_root));
+      for (int j = 0; j < argc - i; j++) {
+        discovery.roots[j].path = strdup(argv[i + j]);
+      }
+    }
+    if (depth > 0) {
+      discovery.max_depth = depth;
     }
 
     struct yj_java_runtime *out = NULL;
     size_t out_len = 0;
-    if (yj_java_discovery(base_path, &out, &out_len) != YJ_OK) {
+    if (yj_java_discovery_roots(&discovery, &out, &out_len) != YJ_OK) {
       printf("discovery failed\n");
       exit(1);
     }
 
+    if (timing) {
+      for (size_t j = 0; j < discovery.roots_len; j++) {
+        struct yj_discovery_root *root = &discovery.roots[j];
+        fprintf(stderr, "%8.3fms %3zu %s\n", root->elapsed_us / 1000.0,
+                root->found, root->path);
+      }
+    }
+
     if (out == NULL || out_len == 0) {
-      printf("No jdk found, searched path: %s\n", base_path);
+      printf("No jdk found, searched path:");
+      for (size_t j = 0; j < discovery.roots_len; j++) {
+        printf(" %s", discovery.roots[j].path);
+      }
+      printf("\n");
       exit(1);
     }
+    yj_free_discovery(&discovery);
 
     struct table *table, *tail;
     char idx_buf[10] = {0};
@@ -128,7 +230,15 @@ int main(int argc, char **argv) {
     tail->rows[0] = strdup("NO");
     tail->rows[1] = strdup("VERSION");
     tail->rows[2] = strdup("FULL_VERSION");
-    tail->rows[3] = strdup("HOME");
+    if (details) {
+      tail->rows[3] = strdup("VENDOR");
+      tail->rows[4] = strdup("ARCH");
+      tail->rows[5] = strdup("GCS");
+      tail->rows[6] = strdup("FEATURES");
+      tail->rows[7] = strdup("HOME");
+    } else {
+      tail->rows[3] = strdup("HOME");
+    }
     for (int i = 0; i < out_len; i++) {
       if (tail->next == NULL) {
         tail->next = table_new();
@@ -141,7 +251,19 @@ int main(int argc, char **argv) {
       tail->rows[1] = rt->version == NULL ? NULL : strdup(rt->version);
       tail->rows[2] =
           rt->full_version == NULL ? NULL : strdup(rt->full_version);
-      tail->rows[3] = rt->home == NULL ? NULL : strdup(rt->home);
+      if (details) {
+        char *caps = format_caps(rt->gcs, rt->features);
+        char *sep = strchr(caps, ' ');
+        *sep = '\0';
+        tail->rows[3] = strdup(rt->vendor == NULL ? "-" : rt->vendor);
+        tail->rows[4] = strdup(rt->arch == NULL ? "-" : rt->arch);
+        tail->rows[5] = strdup(caps);
+        tail->rows[6] = strdup(sep + 1);
+        tail->rows[7] = rt->home == NULL ? NULL : strdup(rt->home);
+        free(caps);
+      } else {
+        tail->rows[3] = rt->home == NULL ? NULL : strdup(rt->home);
+      }
 
       yj_free_runtime(rt);
       rt++;
@@ -162,9 +284,25 @@ int main(int argc, char **argv) {
     }
 
     printf("version: %s\n", runtime.version);
+    printf("full version: %s\n", runtime.full_version);
+    printf("vendor: %s\n", runtime.vendor == NULL ? "" : runtime.vendor);
     printf("home: %s\n", runtime.home);
+    printf("arch: %s\n", runtime.arch == NULL ? "" : runtime.arch);
+
+    char *caps = format_caps(runtime.gcs, runtime.features);
+    char *sep = strchr(caps, ' ');
+    *sep = '\0';
+    printf("gcs: %s\n", caps);
+    printf("features: %s\n", sep + 1);
+    free(caps);
 
     yj_free_runtime(&runtime);
+  } else if (strncmp(cmd, "archive", cmd_len) == 0) {
+    return archive_main(argc - 2, argv + 2, exec_name);
+  } else if (strncmp(cmd, "pack", cmd_len) == 0) {
+    return pack_main(argc - 2, argv + 2, exec_name);
+  } else if (strncmp(cmd, "which-class", cmd_len) == 0) {
+    return which_main(argc - 2, argv + 2, exec_name);
   } else {
     printf("unknown command: %s\n\n", cmd);
     print_usages(exec_name);
@@ -175,37 +313,327 @@ int main(int argc, char **argv) {
 
 void print_usages(char *exec) { printf(USAGE_TEXT, exec); }
 
+// an executable file starting with #!, the kernel runs a script by its path
+bool is_script(const char *path) {
+  struct stat st;
+  char head[2];
+  bool script;
+  int fd;
+
+  if (strchr(path, '/') == NULL || stat(path, &st) != 0 ||
+      !S_ISREG(st.st_mode) || access(path, X_OK) != 0 ||
+      (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return false;
+  }
+  script = read(fd, head, 2) == 2 && head[0] == '#' && head[1] == '!';
+  close(fd);
+  return script;
+}
+
 struct table *table_new() {
   struct table *table = malloc(sizeof(struct table));
   memset(table, 0, sizeof(struct table));
   return table;
 }
 
+// "<gcs> <features>", comma separated, "-" for none
+char *format_caps(unsigned int gcs, unsigned int features) {
+  // clang-format off
+  static const struct { unsigned int bit; const char *name; } gc_names[] = {
+      {YJ_GC_SERIAL, "serial"}, {YJ_GC_PARALLEL, "parallel"},
+      {YJ_GC_G1, "g1"},         {YJ_GC_CMS, "cms"},
+      {YJ_GC_ZGC, "z"},         {YJ_GC_SHENANDOAH, "shenandoah"},
+      {YJ_GC_EPSILON, "epsilon"}};
+  static const struct { unsigned int bit; const char *name; } feat_names[] = {
+      {YJ_FEAT_CDS, "cds"}, {YJ_FEAT_AOT_CACHE, "aot"},
+      {YJ_FEAT_JFR, "jfr"}, {YJ_FEAT_NMT, "nmt"},
+      {YJ_FEAT_OPENJ9, "openj9"}};
+  // clang-format on
+  char *out = calloc(256, sizeof(char));
+  size_t len = 0;
+
+  for (size_t i = 0; i < sizeof(gc_names) / sizeof(gc_names[0]); i++) {
+    if (gcs & gc_names[i].bit) {
+      len += sprintf(out + len, "%s%s", len > 0 ? "," : "", gc_names[i].name);
+    }
+  }
+  if (len == 0) {
+    out[len++] = '-';
+  }
+  out[len++] = ' ';
+
+  size_t mark = len;
+  for (size_t i = 0; i < sizeof(feat_names) / sizeof(feat_names[0]); i++) {
+    if (features & feat_names[i].bit) {
+      len += sprintf(out + len, "%s%s", len > mark ? "," : "",
+                     feat_names[i].name);
+    }
+  }
+  if (len == mark) {
+    out[len++] = '-';
+  }
+  return out;
+}
+
+// archive ls, archive stats, archive gc [--max-size size]
+int archive_main(int argc, char **argv, char *exec) {
+  static const char *kinds[] = {"-", "cds", "base", "aot"};
+  struct yj_archive_info *infos = NULL;
+  struct table *table, *tail;
+  char store[PATH_MAX] = {0};
+  long long max_size = 0, total = 0;
+  unsigned long long hits = 0;
+  long rss = 0, pss = 0;
+  size_t len = 0;
+  bool stats;
+
+  if (argc < 1) {
+    print_usages(exec);
+    return 1;
+  }
+
+  if (strcmp(argv[0], "gc") == 0) {
+    size_t removed = 0;
+    long long freed = 0;
+    size_t size = 0;
+    char *str;
+
+    if (argc >= 2 && (argc != 3 || strcmp(argv[1], "--max-size") != 0)) {
+      print_usages(exec);
+      return 1;
+    }
+    if (argc == 3 && (!arg_parse_size(argv[2], &size) || size == 0)) {
+      printf("error: invalid size: %s\n", argv[2]);
+      return 1;
+    }
+    if (yj_archive_gc(size, &removed, &freed) != YJ_OK) {
+      printf("error: no archive store\n");
+      return 1;
+    }
+    str = format_size(freed);
+    printf("removed %zu files, %s freed\n", removed, str);
+    free(str);
+    return 0;
+  }
+
+  stats = strcmp(argv[0], "stats") == 0;
+  if ((!stats && strcmp(argv[0], "ls") != 0) ||
+      yj_archive_store(store, PATH_MAX, &max_size) != YJ_OK ||
+      yj_archive_list(&infos, &len, stats) != YJ_OK) {
+    print_usages(exec);
+    return 1;
+  }
+
+  tail = table = table_new();
+  tail->rows[0] = strdup("KIND");
+  tail->rows[1] = strdup("SIZE");
+  tail->rows[2] = strdup("HITS");
+  if (stats) {
+    tail->rows[3] = strdup("PROCS");
+    tail->rows[4] = strdup("RSS");
+    tail->rows[5] = strdup("PSS");
+    tail->rows[6] = strdup("SHARED");
+    tail->rows[7] = strdup("APP");
+  } else {
+    tail->rows[3] = strdup("LAST_USED");
+    tail->rows[4] = strdup("APP");
+    tail->rows[5] = strdup("FILE");
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    struct yj_archive_info *info = &infos[i];
+    char buf[32];
+
+    tail->next = table_new();
+    tail = tail->next;
+    tail->rows[0] = strdup(kinds[info->kind <= 3 ? info->kind : 0]);
+    tail->rows[1] = format_size(info->size);
+    snprintf(buf, sizeof(buf), "%llu", info->hits);
+    tail->rows[2] = strdup(buf);
+    if (stats) {
+      snprintf(buf, sizeof(buf), "%d", info->procs);
+      tail->rows[3] = strdup(buf);
+      tail->rows[4] = format_size(info->rss_kb * 1024LL);
+      tail->rows[5] = format_size(info->pss_kb * 1024LL);
+      tail->rows[6] = format_size(info->shared_kb * 1024LL);
+      tail->rows[7] = strdup(info->app == NULL ? "-" : info->app);
+    } else {
+      tail->rows[3] = format_time(info->used_us);
+      tail->rows[4] = strdup(info->app == NULL ? "-" : info->app);
+      tail->rows[5] = strdup(basename(info->path));
+    }
+
+    total += info->size;
+    hits += info->hits;
+    rss += info->rss_kb;
+    pss += info->pss_kb;
+  }
+
+  table_print(table, stdout);
+  table_free(table);
+
+  if (stats) {
+    char *total_str = format_size(total), *max_str = format_size(max_size);
+    char *saved_str = format_size((rss - pss) * 1024LL);
+    printf("\n%zu archives, %s of %s in %s, %llu hits\n", len, total_str,
+           max_str, store, hits);
+    // what the mapping processes would hold without sharing, less what
+    // they account for proportionally
+    printf("saved by page sharing: %s\n", saved_str);
+    free(total_str);
+    free(max_str);
+    free(saved_str);
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    yj_free_archive_info(&infos[i]);
+  }
+  free(infos);
+  return 0;
+}
+
+// pack [options] <main class> [args], a run recording the class load order
+int pack_main(int argc, char **argv, char *exec) {
+  struct yj_run_args run_args;
+  struct yj_java_runtime runtime;
+  struct yj_cmdline cmdline;
+  struct yj_pack_info info;
+  int exit_code = 1;
+  char *size;
+
+  if (argc < 1) {
+    print_usages(exec);
+    return 1;
+  }
+  if (yj_expand_cmdline(argc, argv, &cmdline) != YJ_OK) {
+    yj_free_cmdline(&cmdline);
+    return exit_code;
+  }
+  if (yj_parse_run_args(cmdline.argc, cmdline.argv, &run_args) != YJ_OK) {
+    yj_free_run_args(&run_args);
+    yj_free_cmdline(&cmdline);
+    return exit_code;
+  }
+  if (yj_find_runtime_for(&run_args, &runtime) != YJ_OK) {
+    printf("error: no java runtime found\n");
+    exit(1);
+  }
+
+  if (yj_pack(&runtime, &run_args, &exit_code, &info) == YJ_OK) {
+    size = format_size(info.size);
+    fprintf(stderr,
+            "packed %d jars, %zu entries, %zu classes in load order, %s: %s\n",
+            info.jars, info.entries, info.ordered, size, info.path);
+    if (info.kept > 0) {
+      fprintf(stderr, "%d class path entries kept as they are\n", info.kept);
+    }
+    free(size);
+  } else if (exit_code == 0) {
+    exit_code = 1;
+  }
+
+  yj_free_pack_info(&info);
+  yj_free_runtime(&runtime);
+  yj_free_run_args(&run_args);
+  yj_free_cmdline(&cmdline);
+  return exit_code;
+}
+
+// which-class [options] [class ...], the class path as run options give it,
+// the classes where a launch takes its main class and arguments
+int which_main(int argc, char **argv, char *exec) {
+  struct yj_run_args run_args;
+  struct yj_java_runtime runtime;
+  struct yj_cmdline cmdline;
+  char **names;
+  int exit_code = 1, len = 0;
+
+  if (yj_expand_cmdline(argc, argv, &cmdline) != YJ_OK) {
+    yj_free_cmdline(&cmdline);
+    return exit_code;
+  }
+  if (yj_parse_run_args(cmdline.argc, cmdline.argv, &run_args) != YJ_OK) {
+    yj_free_run_args(&run_args);
+    yj_free_cmdline(&cmdline);
+    return exit_code;
+  }
+  if (yj_find_runtime_for(&run_args, &runtime) != YJ_OK) {
+    printf("error: no java runtime found\n");
+    exit(1);
+  }
+
+  names = calloc(run_args.app_args_len + 1, sizeof(char *));
+  if (run_args.app_main_class != NULL) {
+    names[len++] = run_args.app_main_class;
+  }
+  for (int i = 0; i < run_args.app_args_len; i++) {
+    names[len++] = run_args.app_args[i];
+  }
+  if (yj_which_class(&runtime, &run_args, names, len, &exit_code) != YJ_OK) {
+    printf("error: the class path can not be read\n");
+  }
+
+  free(names);
+  yj_free_runtime(&runtime);
+  yj_free_run_args(&run_args);
+  yj_free_cmdline(&cmdline);
+  return exit_code;
+}
+
+// 512, 1.5K, 12.0M...
+char *format_size(long long bytes) {
+  static const char units[] = "BKMGT";
+  double size = bytes;
+  char *out = calloc(32, sizeof(char));
+  int unit = 0;
+
+  while (size >= 1024 && unit < 4) {
+    size /= 1024;
+    unit++;
+  }
+  if (unit == 0) {
+    snprintf(out, 32, "%lld", bytes);
+  } else {
+    snprintf(out, 32, "%.1f%c", size, units[unit]);
+  }
+  return out;
+}
+
+char *format_time(long epoch_us) {
+  char *out = calloc(32, sizeof(char));
+  time_t t = epoch_us / 1000000;
+  struct tm tm;
+
+  if (epoch_us <= 0 || localtime_r(&t, &tm) == NULL) {
+    out[0] = '-';
+  } else {
+    strftime(out, 32, "%Y-%m-%d %H:%M", &tm);
+  }
+  return out;
+}
+
 void table_print(struct table *table, FILE *out) {
 
   // calculate max length of each columns
-  int c1, c2, c3, c4;
-  c1 = c2 = c3 = c4 = 0;
+  int widths[TABLE_COLS] = {0};
+  int cols = 0;
   struct table *tail = table;
 
-#define max_strlen(a, str)                                                     \
-  (a) >= (str == NULL ? 0 : strlen(str)) ? (a) : strlen(str)
-
   while (tail != NULL) {
-    c1 = max_strlen(c1, tail->rows[0]);
-    c2 = max_strlen(c2, tail->rows[1]);
-    c3 = max_strlen(c3, tail->rows[2]);
-    c4 = max_strlen(c4, tail->rows[3]);
-
+    for (int i = 0; i < TABLE_COLS; i++) {
+      int len = tail->rows[i] == NULL ? 0 : strlen(tail->rows[i]);
+      widths[i] = widths[i] >= len ? widths[i] : len;
+      cols = tail->rows[i] != NULL && i >= cols ? i + 1 : cols;
+    }
     tail = tail->next;
   }
 
-#undef max_strlen
   tail = table;
-
   while (tail != NULL) {
-    printf("%-*s %-*s %-*s %-*s\n", c1, tail->rows[0], c2, tail->rows[1], c3,
-           tail->rows[2], c4, tail->rows[3]);
+    for (int i = 0; i < cols; i++) {
+      fprintf(out, i + 1 < cols ? "%-*s " : "%-*s\n", widths[i],
+              tail->rows[i] == NULL ? "" : tail->rows[i]);
+    }
     tail = tail->next;
   }
 }
@@ -217,17 +645,10 @@ void table_free(struct table *table) {
   tmp = NULL;
 
   while (tail != NULL) {
-    if (tail->rows[0] != NULL)
-      free(tail->rows[0]);
-
-    if (tail->rows[1] != NULL)
-      free(tail->rows[1]);
-
-    if (tail->rows[2] != NULL)
-      free(tail->rows[2]);
-
-    if (tail->rows[3] != NULL)
-      free(tail->rows[3]);
+    for (int i = 0; i < TABLE_COLS; i++) {
+      if (tail->rows[i] != NULL)
+        free(tail->rows[i]);
+    }
 
     tmp = tail->next;
     free(tail);
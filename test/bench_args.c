@@ -0,0 +1,70 @@
+#include "../yajava.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <time.h>
+
+// parse time of a long command line, mostly -D and -X options with some
+// module options and agents, the shape generated launch scripts have:
+//   bench_args [arguments] [rounds]
+
+static double now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv) {
+  int args_len = argc > 1 ? atoi(argv[1]) : 5000;
+  int rounds = argc > 2 ? atoi(argv[2]) : 200;
+  char **cmd = calloc(args_len + 8, sizeof(char *));
+  struct yj_run_args args;
+  char buf[128];
+  double start, elapsed;
+  int len = 0;
+
+  cmd[len++] = "--in-process";
+  cmd[len++] = "-cp";
+  cmd[len++] = "lib/app.jar:lib/dep.jar";
+  while (len < args_len - 2) {
+    switch (len % 10) {
+    case 0:
+      snprintf(buf, sizeof(buf), "-XX:MaxInlineLevel=%d", len);
+      break;
+    case 1:
+      snprintf(buf, sizeof(buf), "--add-opens=java.base/pkg%d=ALL-UNNAMED",
+               len);
+      break;
+    case 2:
+      snprintf(buf, sizeof(buf), "-javaagent:agent%d.jar", len);
+      break;
+    case 3:
+      snprintf(buf, sizeof(buf), "-ea:com.example.pkg%d...", len);
+      break;
+    default:
+      snprintf(buf, sizeof(buf), "-Dapp.property.%d=value-%d", len, len);
+      break;
+    }
+    cmd[len++] = strdup(buf);
+  }
+  cmd[len++] = "com.example.Main";
+  cmd[len++] = "app-arg";
+
+  // warm up, then the average of the rounds
+  yj_parse_run_args(len, cmd, &args);
+  yj_free_run_args(&args);
+
+  start = now_us();
+  for (int i = 0; i < rounds; i++) {
+    yj_parse_run_args(len, cmd, &args);
+    yj_free_run_args(&args);
+  }
+  elapsed = now_us() - start;
+
+  printf("%d arguments, %d rounds: %.1f us per parse and free\n", len, rounds,
+         elapsed / rounds);
+  return 0;
+}
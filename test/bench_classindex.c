@@ -0,0 +1,262 @@
+#include "../yajava.h"
+#include "../zip.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libgen.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+// class loading from a synthetic class path of jars, one package each, with
+// the default application class loader against the class index:
+//   bench_classindex [jars] [java home]
+// without a java home only the index build and check are timed.
+
+#define BENCH_CLASSES 4       // per jar
+#define BENCH_MAX_LOADS 9000  // code of a method is limited to 64k
+#define BENCH_CP_MAX (1 << 20)
+
+// from yajava.c
+uint64_t classpath_key(char **paths, size_t len);
+bool classindex_fresh(const char *path, uint64_t key, char **paths,
+                      size_t len);
+bool classindex_build(const char *path, uint64_t key, char **paths,
+                      size_t len);
+
+struct pool {
+  unsigned char *buf;
+  size_t len;
+  uint16_t count; // the next constant index
+};
+
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void put8(unsigned char *buf, size_t *len, uint8_t v) {
+  buf[(*len)++] = v;
+}
+
+static void put16(unsigned char *buf, size_t *len, uint16_t v) {
+  put8(buf, len, v >> 8);
+  put8(buf, len, v & 0xff);
+}
+
+static uint16_t pool_utf8(struct pool *p, const char *s) {
+  put8(p->buf, &p->len, 1);
+  put16(p->buf, &p->len, strlen(s));
+  memcpy(p->buf + p->len, s, strlen(s));
+  p->len += strlen(s);
+  return p->count++;
+}
+
+// Class, String (one index), NameAndType, Fieldref, Methodref (two)
+static uint16_t pool_ref(struct pool *p, uint8_t tag, uint16_t a, uint16_t b) {
+  put8(p->buf, &p->len, tag);
+  put16(p->buf, &p->len, a);
+  if (tag != 7 && tag != 8) {
+    put16(p->buf, &p->len, b);
+  }
+  return p->count++;
+}
+
+static uint16_t pool_member(struct pool *p, uint8_t tag, const char *cls,
+                            const char *name, const char *desc) {
+  uint16_t c = pool_ref(p, 7, pool_utf8(p, cls), 0);
+  uint16_t nt = pool_ref(p, 12, pool_utf8(p, name), pool_utf8(p, desc));
+  return pool_ref(p, tag, c, nt);
+}
+
+// class file of the constant pool and the methods given
+static size_t class_file(unsigned char *out, struct pool *p, uint16_t this,
+                         uint16_t super, const unsigned char *methods,
+                         size_t methods_len, uint16_t methods_count) {
+  size_t len = 0;
+
+  put16(out, &len, 0xcafe);
+  put16(out, &len, 0xbabe);
+  put16(out, &len, 0);
+  put16(out, &len, 52); // no StackMapTable needed, the code does not branch
+  put16(out, &len, p->count);
+  memcpy(out + len, p->buf, p->len);
+  len += p->len;
+  put16(out, &len, 0x0021);
+  put16(out, &len, this);
+  put16(out, &len, super);
+  put16(out, &len, 0); // interfaces
+  put16(out, &len, 0); // fields
+  put16(out, &len, methods_count);
+  memcpy(out + len, methods, methods_len);
+  len += methods_len;
+  put16(out, &len, 0); // attributes
+  return len;
+}
+
+// an empty class, Class.forName loads and initializes it
+static size_t empty_class(unsigned char *out, const char *name) {
+  unsigned char buf[512];
+  struct pool p = {buf, 0, 1};
+  uint16_t this = pool_ref(&p, 7, pool_utf8(&p, name), 0);
+  uint16_t super = pool_ref(&p, 7, pool_utf8(&p, "java/lang/Object"), 0);
+  return class_file(out, &p, this, super, NULL, 0, 0);
+}
+
+// bench.Main: Class.forName of every class, then the nanoseconds it took
+static size_t main_class(unsigned char *out, char **names, size_t len) {
+  struct pool p = {malloc(len * 64 + 4096), 0, 1};
+  unsigned char *code = malloc(len * 8 + 64), *method = malloc(len * 8 + 128);
+  size_t code_len = 0, method_len = 0, size;
+  uint16_t this = pool_ref(&p, 7, pool_utf8(&p, "bench/Main"), 0);
+  uint16_t super = pool_ref(&p, 7, pool_utf8(&p, "java/lang/Object"), 0);
+  uint16_t nano = pool_member(&p, 10, "java/lang/System", "nanoTime", "()J");
+  uint16_t for_name =
+      pool_member(&p, 10, "java/lang/Class", "forName",
+                  "(Ljava/lang/String;)Ljava/lang/Class;");
+  uint16_t sysout = pool_member(&p, 9, "java/lang/System", "out",
+                                "Ljava/io/PrintStream;");
+  uint16_t println =
+      pool_member(&p, 10, "java/io/PrintStream", "println", "(J)V");
+
+  put8(code, &code_len, 0xb8); // invokestatic nanoTime
+  put16(code, &code_len, nano);
+  put8(code, &code_len, 0x40); // lstore_1
+  for (size_t i = 0; i < len; i++) {
+    put8(code, &code_len, 0x13); // ldc_w
+    put16(code, &code_len, pool_ref(&p, 8, pool_utf8(&p, names[i]), 0));
+    put8(code, &code_len, 0xb8); // invokestatic forName
+    put16(code, &code_len, for_name);
+    put8(code, &code_len, 0x57); // pop
+  }
+  put8(code, &code_len, 0xb2); // getstatic out
+  put16(code, &code_len, sysout);
+  put8(code, &code_len, 0xb8);
+  put16(code, &code_len, nano);
+  put8(code, &code_len, 0x1f); // lload_1
+  put8(code, &code_len, 0x65); // lsub
+  put8(code, &code_len, 0xb6); // invokevirtual println
+  put16(code, &code_len, println);
+  put8(code, &code_len, 0xb1); // return
+
+  put16(method, &method_len, 0x0009);
+  put16(method, &method_len, pool_utf8(&p, "main"));
+  put16(method, &method_len, pool_utf8(&p, "([Ljava/lang/String;)V"));
+  put16(method, &method_len, 1);
+  put16(method, &method_len, pool_utf8(&p, "Code"));
+  put16(method, &method_len, (12 + code_len) >> 16);
+  put16(method, &method_len, (12 + code_len) & 0xffff);
+  put16(method, &method_len, 5); // max stack
+  put16(method, &method_len, 3); // max locals
+  put16(method, &method_len, code_len >> 16);
+  put16(method, &method_len, code_len & 0xffff);
+  memcpy(method + method_len, code, code_len);
+  method_len += code_len;
+  put16(method, &method_len, 0); // exception table
+  put16(method, &method_len, 0); // attributes
+
+  size = class_file(out, &p, this, super, method, method_len, 1);
+  free(p.buf);
+  free(code);
+  free(method);
+  return size;
+}
+
+// nanoseconds bench.Main reports, -1 if the run failed
+static double run(const char *yajava, const char *root, const char *home,
+                  bool index) {
+  char cmd[PATH_MAX * 4];
+  long long ns = -1;
+  FILE *out;
+
+  snprintf(cmd, sizeof(cmd),
+           "cd '%s' && YAJAVA_RUNTIME='%s' YAJAVA_PLAN=off "
+           "'%s' %s -cp 'main.jar:lib/*' bench.Main",
+           root, home, yajava, index ? "--class-index" : "");
+  if ((out = popen(cmd, "r")) == NULL) {
+    return -1;
+  }
+  if (fscanf(out, "%lld", &ns) != 1) {
+    ns = -1;
+  }
+  pclose(out);
+  return ns / 1e6;
+}
+
+int main(int argc, char **argv) {
+  char root[] = "/tmp/yajava-bench-XXXXXX";
+  char path[PATH_MAX], name[64], yajava[PATH_MAX];
+  size_t jars = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+  const char *home = argc > 2 ? argv[2] : NULL;
+  unsigned char *buf = malloc(BENCH_MAX_LOADS * 96 + 65536);
+  char **paths = calloc(jars, sizeof(char *));
+  char **loads = calloc(BENCH_MAX_LOADS, sizeof(char *));
+  size_t loads_len = 0, len;
+  struct zip_writer w;
+  uint64_t key;
+  double start, cold, warm;
+
+  if (mkdtemp(root) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(path, PATH_MAX, "%s/cache", root);
+  setenv("YAJAVA_CACHE_DIR", path, 1);
+  snprintf(path, PATH_MAX, "%s/lib", root);
+  mkdir(path, 0755);
+
+  for (size_t i = 0; i < jars; i++) {
+    snprintf(path, PATH_MAX, "%s/lib/dep-%05zu.jar", root, i);
+    paths[i] = strdup(path);
+    zip_writer_open(&w, path);
+    for (int c = 0; c < BENCH_CLASSES; c++) {
+      snprintf(name, sizeof(name), "p%zu/C%d", i, c);
+      len = empty_class(buf, name);
+      strcat(name, ".class");
+      zip_writer_add(&w, name, strlen(name), buf, len);
+      if (loads_len < BENCH_MAX_LOADS) {
+        snprintf(name, sizeof(name), "p%zu.C%d", i, c);
+        loads[loads_len++] = strdup(name);
+      }
+    }
+    zip_writer_close(&w);
+  }
+  snprintf(path, PATH_MAX, "%s/main.jar", root);
+  zip_writer_open(&w, path);
+  len = main_class(buf, loads, loads_len);
+  zip_writer_add(&w, "bench/Main.class", 16, buf, len);
+  zip_writer_close(&w);
+
+  printf("%zu jars, %zu classes loaded\n", jars, loads_len);
+
+  key = classpath_key(paths, jars);
+  snprintf(path, PATH_MAX, "%s/index", root);
+  start = now_ms();
+  classindex_build(path, key, paths, jars);
+  cold = now_ms() - start;
+  start = now_ms();
+  classindex_fresh(path, key, paths, jars);
+  warm = now_ms() - start;
+  printf("index build:           %9.2f ms\n", cold);
+  printf("index check:           %9.2f ms\n", warm);
+
+  if (home != NULL) {
+    snprintf(yajava, PATH_MAX, "%s/yajava", dirname(argv[0]));
+    if (realpath(yajava, path) != NULL) {
+      snprintf(yajava, PATH_MAX, "%s", path);
+    }
+    printf("default class loader:  %9.2f ms\n",
+           run(yajava, root, home, false));
+    printf("class index loader:    %9.2f ms\n", run(yajava, root, home, true));
+  }
+
+  snprintf(path, PATH_MAX, "rm -rf '%s'", root);
+  return system(path) == 0 ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+#include "../yajava.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// class path handling with 50k entries, the way it was done before against
+// the hash set, the parallel check and the validation cache:
+//   bench_classpath [entries]
+
+#define BENCH_DIRS 50
+
+// from yajava.c
+struct list;
+typedef bool (*list_comparator)(void *list_data, void *user_data);
+struct list *list_new();
+void list_free(struct list *list, void (*free)(void *data));
+void list_add(struct list *list, void *data);
+bool list_contains(struct list *list, void *data, list_comparator comparator);
+bool list_compare_str(void *list_data, void *user_data);
+bool arg_build_java_opts(struct yj_java_runtime *runtime,
+                         struct yj_run_args *args, JavaVMInitArgs *out);
+
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// linear dedup of a linked list and a stat per entry in order
+static size_t legacy(char *cp) {
+  struct list *list = list_new();
+  char *str = strdup(cp), *s = str, *saveptr, *token;
+  struct stat st;
+  size_t len = 0;
+
+  while ((token = strtok_r(s, ":", &saveptr)) != NULL) {
+    s = NULL;
+    if (!list_contains(list, token, list_compare_str)) {
+      list_add(list, strdup(token));
+      len++;
+    }
+  }
+  free(str);
+
+  str = strdup(cp);
+  s = str;
+  while ((token = strtok_r(s, ":", &saveptr)) != NULL) {
+    s = NULL;
+    stat(token, &st);
+  }
+  free(str);
+  list_free(list, free);
+  return len;
+}
+
+static bool current(char *cp, size_t *len) {
+  struct yj_java_runtime runtime = {0};
+  struct yj_run_args args;
+  JavaVMInitArgs vm_args = {0};
+  char *argv[] = {"-cp", cp, "bench.Main"};
+  bool ok;
+
+  runtime.major_version = 21;
+  if (yj_parse_run_args(3, argv, &args) != YJ_OK) {
+    return false;
+  }
+  *len = args.classpathes_len;
+  ok = arg_build_java_opts(&runtime, &args, &vm_args);
+  for (int i = 0; i < vm_args.nOptions; i++) {
+    free(vm_args.options[i].optionString);
+  }
+  free(vm_args.options);
+  yj_free_run_args(&args);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  char root[] = "/tmp/yajava-bench-XXXXXX";
+  char cache[PATH_MAX], path[PATH_MAX];
+  struct timeval old[2] = {{1600000000, 0}, {1600000000, 0}};
+  size_t entries = argc > 1 ? strtoul(argv[1], NULL, 10) : 50000;
+  size_t per_dir = (entries + BENCH_DIRS - 1) / BENCH_DIRS;
+  size_t cp_max = (entries + entries / 5) * 64, pos = 0, len = 0;
+  char *cp;
+  double start;
+
+  if (mkdtemp(root) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(cache, PATH_MAX, "%s/cache", root);
+  setenv("YAJAVA_CACHE_DIR", cache, 1);
+
+  // jars spread over directories, a fifth of them twice
+  cp = malloc(cp_max);
+  cp[0] = '\0';
+  for (size_t d = 0; d < BENCH_DIRS; d++) {
+    snprintf(path, PATH_MAX, "%s/lib%zu", root, d);
+    mkdir(path, 0755);
+  }
+  for (size_t i = 0; i < entries; i++) {
+    snprintf(path, PATH_MAX, "%s/lib%zu/dep-%zu.jar", root, i / per_dir, i);
+    close(open(path, O_WRONLY | O_CREAT, 0644));
+    pos += snprintf(cp + pos, cp_max - pos, "%s%s", i > 0 ? ":" : "", path);
+  }
+  for (size_t i = 0; i < entries / 5; i++) {
+    snprintf(path, PATH_MAX, "%s/lib%zu/dep-%zu.jar", root,
+             (i * 5) / per_dir, i * 5);
+    pos += snprintf(cp + pos, cp_max - pos, ":%s", path);
+  }
+  for (size_t d = 0; d < BENCH_DIRS; d++) {
+    snprintf(path, PATH_MAX, "%s/lib%zu", root, d);
+    utimes(path, old);
+  }
+
+  printf("%zu entries, %zu bytes of class path\n", entries + entries / 5, pos);
+
+  start = now_ms();
+  len = legacy(cp);
+  printf("list dedup, serial stat:     %9.2f ms, %zu entries\n",
+         now_ms() - start, len);
+
+  start = now_ms();
+  if (!current(cp, &len)) {
+    fprintf(stderr, "class path check failed\n");
+    return 1;
+  }
+  printf("set dedup, parallel stat:    %9.2f ms, %zu entries\n",
+         now_ms() - start, len);
+
+  start = now_ms();
+  current(cp, &len);
+  printf("set dedup, validation cache: %9.2f ms, %zu entries\n",
+         now_ms() - start, len);
+
+  snprintf(path, PATH_MAX, "rm -rf '%s'", root);
+  free(cp);
+  return system(path) == 0 ? 0 : 1;
+}
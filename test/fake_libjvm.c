@@ -0,0 +1,115 @@
+// a libjvm.so stand-in for the vm probe tests, copied into fake homes
+//   <root>/jdk-<major>/lib/server/libjvm.so  reports <major>.0.1
+//   a home named *hang* never returns from JNI_CreateJavaVM
+// FAKE_LIBJVM_DELAY_MS delays every vm creation
+#define _GNU_SOURCE
+#include <jni.h>
+
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char version[32];
+
+static jint JNICALL get_version(JNIEnv *env) {
+  return 0x000a0000; // JNI_VERSION_10
+}
+
+static jclass JNICALL find_class(JNIEnv *env, const char *name) {
+  return (jclass)version;
+}
+
+static jmethodID JNICALL get_static_method_id(JNIEnv *env, jclass clazz,
+                                              const char *name,
+                                              const char *sig) {
+  return (jmethodID)version;
+}
+
+static jstring JNICALL new_string_utf(JNIEnv *env, const char *utf) {
+  return (jstring)strdup(utf);
+}
+
+static const char *JNICALL get_string_utf_chars(JNIEnv *env, jstring str,
+                                                jboolean *is_copy) {
+  return (const char *)str;
+}
+
+static void JNICALL release_string_utf_chars(JNIEnv *env, jstring str,
+                                             const char *chars) {}
+
+static void JNICALL delete_local_ref(JNIEnv *env, jobject obj) {
+  if (obj != (jobject)version) {
+    free(obj);
+  }
+}
+
+// System.getProperty("java.version"), other keys are not set
+static jobject JNICALL get_property(JNIEnv *env, jclass clazz,
+                                    jmethodID method_id, ...) {
+  va_list ap;
+  const char *key;
+
+  va_start(ap, method_id);
+  key = va_arg(ap, const char *);
+  va_end(ap);
+  return strcmp(key, "java.version") == 0 ? (jobject)version : NULL;
+}
+
+static jint JNICALL detach_current_thread(JavaVM *vm) { return JNI_OK; }
+
+static jint JNICALL destroy_java_vm(JavaVM *vm) { return JNI_OK; }
+
+static struct JNINativeInterface_ env_fns;
+static struct JNIInvokeInterface_ vm_fns;
+static JNIEnv env_impl = &env_fns;
+static JavaVM vm_impl = &vm_fns;
+
+JNIEXPORT jint JNICALL JNI_CreateJavaVM(JavaVM **vm, void **env, void *args) {
+  Dl_info info;
+  const char *home, *delay;
+
+  if (dladdr((void *)JNI_CreateJavaVM, &info) == 0 ||
+      info.dli_fname == NULL) {
+    return JNI_ERR;
+  }
+  if (strstr(info.dli_fname, "hang") != NULL) {
+    for (;;) {
+      pause();
+    }
+  }
+  if ((delay = getenv("FAKE_LIBJVM_DELAY_MS")) != NULL) {
+    usleep(atoi(delay) * 1000);
+  }
+  if ((home = strstr(info.dli_fname, "jdk-")) == NULL) {
+    return JNI_ERR;
+  }
+  snprintf(version, sizeof(version), "%d.0.1", atoi(home + 4));
+
+  env_fns.GetVersion = get_version;
+  env_fns.FindClass = find_class;
+  env_fns.GetStaticMethodID = get_static_method_id;
+  env_fns.NewStringUTF = new_string_utf;
+  env_fns.CallStaticObjectMethod = get_property;
+  env_fns.GetStringUTFChars = get_string_utf_chars;
+  env_fns.ReleaseStringUTFChars = release_string_utf_chars;
+  env_fns.DeleteLocalRef = delete_local_ref;
+  vm_fns.DetachCurrentThread = detach_current_thread;
+  vm_fns.DestroyJavaVM = destroy_java_vm;
+
+  *vm = &vm_impl;
+  *env = &env_impl;
+  return JNI_OK;
+}
+
+JNIEXPORT jint JNICALL JNI_GetDefaultJavaVMInitArgs(void *args) {
+  return JNI_OK;
+}
+
+JNIEXPORT jint JNICALL JNI_GetCreatedJavaVMs(JavaVM **vms, jsize len,
+                                             jsize *n) {
+  *n = 0;
+  return JNI_OK;
+}
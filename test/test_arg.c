@@ -1,15 +1,43 @@
+#include "../internal.h"
 #include "../yajava.h"
 #include "utest.h"
 
 #include <assert.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
 
+// from yajava.c
+bool jvm_supports_option(struct yj_java_runtime *runtime, const char *opt);
+bool jvm_version_cacheable(struct yj_run_args *args);
+uint64_t plan_key(int argc, char **argv);
+bool archive_key(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                 int base_len, uint64_t *base_key, uint64_t *out);
+bool archive_touch(const char *path, const char *app, const char *base,
+                   bool hit);
+bool arg_parse_size(const char *s, size_t *out);
+bool prefetch_valid(const char *profile, size_t len);
+size_t prefetch_ranges(const unsigned char *now, const unsigned char *before,
+                       size_t pages, struct prefetch_range *out);
+bool preload_parse(struct yj_preload *pl);
+void preload_free(struct yj_preload *pl);
+bool wildcard_is(const char *entry);
+bool classpath_check(char **paths, size_t len);
+uint32_t arg_hash(const char *s, size_t len, uint32_t seed);
+const char *arg_opt_name(size_t i);
+const void *arg_lookup(const char *name, size_t len);
+bool source_types(const char *src, size_t len, char *main_class, char *pub,
+                  size_t maxlen);
+int jar_required_release(struct yj_run_args *args);
+
 void print_args(char **arg, size_t len) {
   for (int i = 0; i < len; i++) {
     printf("%s ", arg[i]);
@@ -142,3 +170,595 @@ UTEST(args, app_cp_main) {
   ASSERT_STREQ(args.app_main_class, "hello.Main");
   yj_free_run_args(&args);
 }
+
+UTEST(args, app_module) {
+  struct yj_run_args args;
+  char *arg[] = {"-p", "mods",
+                 "--upgrade-module-path", "upgr",
+                 "--add-modules", "java.sql",
+                 "--module", "com.app/com.app.Main",
+                 "x"};
+  int res = yj_parse_run_args(sizeof(arg) / sizeof(char *), arg, &args);
+
+  ASSERT_EQ(0, res);
+  ASSERT_STREQ("com.app/com.app.Main", args.app_module);
+  ASSERT_TRUE(args.app_main_class == NULL);
+  ASSERT_EQ(1, args.module_pathes_len);
+  ASSERT_STREQ("mods", args.module_pathes[0]);
+  ASSERT_EQ(1, args.upgrade_module_pathes_len);
+  ASSERT_EQ(1, args.add_modules_len);
+  ASSERT_EQ(1, args.app_args_len);
+  ASSERT_STREQ("x", args.app_args[0]);
+
+  // without its module-info.class a modular application still needs 9
+  ASSERT_EQ(9, jar_required_release(&args));
+  yj_free_run_args(&args);
+}
+
+UTEST(args, launcher_flags) {
+  struct yj_run_args args;
+  char *arg[] = {"--in-process", "--metrics", "--preload", "-Xss4m",
+                 "hello.Main"};
+  print_args(arg, sizeof(arg) / sizeof(char *));
+  int res = yj_parse_run_args(sizeof(arg) / sizeof(char *), arg, &args);
+  if (res != 0) {
+    printf("ERROR");
+  }
+
+  ASSERT_TRUE(args.in_process);
+  ASSERT_TRUE(args.print_metrics);
+  ASSERT_TRUE(args.preload);
+  ASSERT_FALSE(args.preload_stats);
+  ASSERT_EQ(1, args.vmopts_len);
+  ASSERT_STREQ("hello.Main", args.app_main_class);
+  yj_free_run_args(&args);
+}
+
+UTEST(args, supported_options) {
+  struct yj_java_runtime runtime = {0};
+
+  // unknown capabilities, everything passes through
+  ASSERT_TRUE(jvm_supports_option(&runtime, "-XX:+UseZGC"));
+
+  runtime.gcs = YJ_GC_SERIAL | YJ_GC_PARALLEL | YJ_GC_G1 | YJ_GC_ZGC;
+  runtime.features = YJ_FEAT_JFR | YJ_FEAT_NMT;
+  ASSERT_TRUE(jvm_supports_option(&runtime, "-XX:+UseZGC"));
+  ASSERT_FALSE(jvm_supports_option(&runtime, "-XX:+UseShenandoahGC"));
+  ASSERT_FALSE(jvm_supports_option(&runtime, "-XX:AOTCache=app.aot"));
+  ASSERT_TRUE(jvm_supports_option(&runtime, "-XX:StartFlightRecording"));
+  ASSERT_TRUE(jvm_supports_option(&runtime, "-XX:NativeMemoryTracking=summary"));
+  ASSERT_TRUE(jvm_supports_option(&runtime, "-Xmx1g"));
+}
+
+UTEST(args, version_cacheable) {
+  struct yj_run_args args;
+  char *plain[] = {"-Xmx1g", "-Dfoo=bar", "-version"};
+  char *vm_info[] = {"-Xint", "-version"};
+  char *vm_prop[] = {"-Djava.vm.name=x", "-version"};
+
+  unsetenv("JAVA_TOOL_OPTIONS");
+  unsetenv("_JAVA_OPTIONS");
+  unsetenv("JDK_JAVA_OPTIONS");
+
+  yj_parse_run_args(3, plain, &args);
+  ASSERT_TRUE(jvm_version_cacheable(&args));
+  yj_free_run_args(&args);
+
+  yj_parse_run_args(2, vm_info, &args);
+  ASSERT_FALSE(jvm_version_cacheable(&args));
+  yj_free_run_args(&args);
+
+  yj_parse_run_args(2, vm_prop, &args);
+  ASSERT_FALSE(jvm_version_cacheable(&args));
+  yj_free_run_args(&args);
+}
+
+UTEST(args, plan_key) {
+  char *a[] = {"-cp", "app.jar", "hello.Main"};
+  char *b[] = {"-cp", "app.jar", "hello.Main2"};
+  char *c[] = {"-cp", "app.jarhello.Main"};
+
+  ASSERT_EQ(plan_key(3, a), plan_key(3, a));
+  ASSERT_NE(plan_key(3, a), plan_key(3, b));
+  ASSERT_NE(plan_key(3, a), plan_key(2, c));
+
+  setenv("YAJAVA_RUNTIME", "17", 1);
+  uint64_t k17 = plan_key(3, a);
+  setenv("YAJAVA_RUNTIME", "21", 1);
+  ASSERT_NE(k17, plan_key(3, a));
+  unsetenv("YAJAVA_RUNTIME");
+}
+
+UTEST(args, archive_key) {
+  struct yj_java_runtime runtime = {0};
+  struct yj_run_args args;
+  char *jar[] = {"--auto-archive", "-cp", "/proc/self/exe", "hello.Main"};
+  char *dir[] = {"--auto-archive", "-cp", "/tmp", "hello.Main"};
+  char *own[] = {"-XX:SharedArchiveFile=app.jsa", "-cp", "/proc/self/exe",
+                 "hello.Main"};
+  char *cwd[] = {"--auto-archive", "hello.Main"};
+  char *other[] = {"--auto-archive", "-cp", "/proc/self/exe", "hello.Other"};
+  char *modules[] = {"--auto-archive", "--add-modules", "java.sql",
+                     "-cp",            "/proc/self/exe", "hello.Main"};
+  char *module_path[] = {"--auto-archive", "-p", "/tmp",
+                         "-cp",            "/proc/self/exe", "hello.Main"};
+  uint64_t k1, k2;
+
+  runtime.home = "/opt/jdk-21";
+  runtime.full_version = "21.0.2+13";
+  runtime.major_version = 21;
+  runtime.features = YJ_FEAT_CDS;
+
+  yj_parse_run_args(4, jar, &args);
+  ASSERT_TRUE(args.auto_archive);
+  ASSERT_TRUE(archive_key(&runtime, &args, 0, NULL, &k1));
+  ASSERT_TRUE(archive_key(&runtime, &args, 0, NULL, &k2));
+  ASSERT_EQ(k1, k2);
+
+  runtime.full_version = "21.0.3+9";
+  ASSERT_TRUE(archive_key(&runtime, &args, 0, NULL, &k2));
+  ASSERT_NE(k1, k2);
+
+  // no dynamic archives before 13, none at all with OpenJ9
+  runtime.major_version = 11;
+  ASSERT_FALSE(archive_key(&runtime, &args, 0, NULL, &k2));
+  runtime.major_version = 21;
+  runtime.features = YJ_FEAT_CDS | YJ_FEAT_OPENJ9;
+  ASSERT_FALSE(archive_key(&runtime, &args, 0, NULL, &k2));
+  runtime.features = YJ_FEAT_CDS;
+  yj_free_run_args(&args);
+
+  yj_parse_run_args(4, dir, &args);
+  ASSERT_FALSE(archive_key(&runtime, &args, 0, NULL, &k2));
+  yj_free_run_args(&args);
+
+  yj_parse_run_args(4, own, &args);
+  ASSERT_FALSE(archive_key(&runtime, &args, 0, NULL, &k2));
+  yj_free_run_args(&args);
+
+  // the default class path is the working directory
+  unsetenv("CLASSPATH");
+  yj_parse_run_args(2, cwd, &args);
+  ASSERT_EQ(0, args.classpathes_len);
+  ASSERT_FALSE(archive_key(&runtime, &args, 0, NULL, &k2));
+  yj_free_run_args(&args);
+
+  // another main class or module selection on the same class path
+  yj_parse_run_args(4, jar, &args);
+  ASSERT_TRUE(archive_key(&runtime, &args, 0, NULL, &k1));
+  yj_free_run_args(&args);
+  yj_parse_run_args(4, other, &args);
+  ASSERT_TRUE(archive_key(&runtime, &args, 0, NULL, &k2));
+  ASSERT_NE(k1, k2);
+  yj_free_run_args(&args);
+
+  yj_parse_run_args(6, modules, &args);
+  ASSERT_TRUE(archive_key(&runtime, &args, 0, NULL, &k2));
+  ASSERT_NE(k1, k2);
+  yj_free_run_args(&args);
+
+  yj_parse_run_args(6, module_path, &args);
+  ASSERT_TRUE(archive_key(&runtime, &args, 0, NULL, &k2));
+  ASSERT_NE(k1, k2);
+  yj_free_run_args(&args);
+}
+
+// an archive of 100 bytes, used `age` seconds ago without meta
+static void write_archive(const char *cache, const char *name, int age) {
+  char path[PATH_MAX], data[100] = {0};
+  struct timeval tv[2];
+  FILE *f;
+
+  snprintf(path, sizeof(path), "%s/archives/%s", cache, name);
+  f = fopen(path, "w");
+  fwrite(data, 1, sizeof(data), f);
+  fclose(f);
+  if (age > 0) {
+    gettimeofday(&tv[0], NULL);
+    tv[0].tv_sec -= age;
+    tv[1] = tv[0];
+    utimes(path, tv);
+  }
+}
+
+static bool archive_exists(const char *cache, const char *name) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/archives/%s", cache, name);
+  return access(path, F_OK) == 0;
+}
+
+UTEST(args, archive_gc) {
+  char cache[] = "/tmp/yajava-cache-XXXXXX";
+  char path[PATH_MAX];
+  size_t removed, size;
+  long long freed;
+
+  ASSERT_TRUE(arg_parse_size("512k", &size));
+  ASSERT_EQ(512 * 1024, size);
+  ASSERT_FALSE(arg_parse_size("1gb", &size));
+  ASSERT_FALSE(arg_parse_size("m", &size));
+
+  ASSERT_TRUE(mkdtemp(cache) != NULL);
+  setenv("YAJAVA_CACHE_DIR", cache, 1);
+  snprintf(path, sizeof(path), "%s/archives", cache);
+  mkdir(path, 0755);
+
+  // least recently used first, a base goes with its top layers
+  write_archive(cache, "old.jsa", 300);
+  write_archive(cache, "new.jsa", 100);
+  write_archive(cache, "base-1.jsa", 0);
+  snprintf(path, sizeof(path), "%s/archives/base-1.jsa", cache);
+  archive_touch(path, NULL, NULL, false);
+  usleep(2000);
+  write_archive(cache, "top.jsa", 0);
+  snprintf(path, sizeof(path), "%s/archives/top.jsa", cache);
+  archive_touch(path, "app.jar", "base-1.jsa", false);
+  usleep(2000);
+  write_archive(cache, "other.jsa", 0);
+  snprintf(path, sizeof(path), "%s/archives/other.jsa", cache);
+  archive_touch(path, "other.jar", NULL, false);
+
+  ASSERT_EQ(0, yj_archive_gc(450, &removed, &freed));
+  ASSERT_EQ(1, removed);
+  ASSERT_EQ(100, freed);
+  ASSERT_FALSE(archive_exists(cache, "old.jsa"));
+  ASSERT_TRUE(archive_exists(cache, "new.jsa"));
+
+  ASSERT_EQ(0, yj_archive_gc(250, &removed, &freed));
+  ASSERT_EQ(3, removed);
+  ASSERT_EQ(300, freed);
+  ASSERT_FALSE(archive_exists(cache, "new.jsa"));
+  ASSERT_FALSE(archive_exists(cache, "base-1.jsa"));
+  ASSERT_FALSE(archive_exists(cache, "base-1.jsa.meta"));
+  ASSERT_FALSE(archive_exists(cache, "top.jsa"));
+  ASSERT_TRUE(archive_exists(cache, "other.jsa"));
+
+  ASSERT_EQ(0, yj_archive_gc(1024, &removed, &freed));
+  ASSERT_EQ(0, removed);
+  unsetenv("YAJAVA_CACHE_DIR");
+}
+
+UTEST(prefetch, ranges) {
+  unsigned char now[64] = {0}, before[64] = {0};
+  struct prefetch_range out[64 / (PREFETCH_GAP + 2) + 1];
+
+  ASSERT_EQ(0, prefetch_ranges(now, NULL, 64, out));
+
+  // pages 0-2 and 10 are one range, 40 is too far from them
+  now[0] = now[1] = now[2] = now[10] = now[40] = 1;
+  ASSERT_EQ(2, prefetch_ranges(now, NULL, 64, out));
+  ASSERT_EQ(0, out[0].page);
+  ASSERT_EQ(11, out[0].pages);
+  ASSERT_EQ(40, out[1].page);
+  ASSERT_EQ(1, out[1].pages);
+
+  // what was cached before the launch is not what startup read
+  before[0] = before[1] = before[2] = before[10] = 1;
+  ASSERT_EQ(1, prefetch_ranges(now, before, 64, out));
+  ASSERT_EQ(40, out[0].page);
+
+  // mincore only defines the low bit
+  memset(now, 0xfe, sizeof(now));
+  ASSERT_EQ(0, prefetch_ranges(now, NULL, 64, out));
+}
+
+UTEST(prefetch, valid) {
+  struct {
+    struct prefetch_header header;
+    struct prefetch_file file;
+    struct prefetch_range range;
+    char strings[8];
+  } p = {0};
+  char *buf = (char *)&p;
+
+  p.header.magic = PREFETCH_MAGIC;
+  p.header.version = PREFETCH_VERSION;
+  p.header.page_size = 4096;
+  p.header.files_len = 1;
+  p.header.ranges_len = 1;
+  p.header.strings_len = sizeof(p.strings);
+  p.file.path = 1;
+  p.file.ranges_len = 1;
+  memcpy(p.strings, "\0/a.jar", 8);
+  ASSERT_TRUE(prefetch_valid(buf, sizeof(p)));
+
+  ASSERT_FALSE(prefetch_valid(NULL, 0));
+  ASSERT_FALSE(prefetch_valid(buf, sizeof(p.header) - 1));
+  ASSERT_FALSE(prefetch_valid(buf, sizeof(p) - 1));
+  p.file.ranges_start = 1; // past the ranges
+  ASSERT_FALSE(prefetch_valid(buf, sizeof(p)));
+  p.file.ranges_start = 0;
+  p.file.path = 8; // past the strings
+  ASSERT_FALSE(prefetch_valid(buf, sizeof(p)));
+  p.file.path = 1;
+  p.strings[7] = 'r'; // not terminated
+  ASSERT_FALSE(prefetch_valid(buf, sizeof(p)));
+  p.strings[7] = '\0';
+  p.header.version = PREFETCH_VERSION + 1;
+  ASSERT_FALSE(prefetch_valid(buf, sizeof(p)));
+}
+
+UTEST(preload, parse) {
+  static const char list[] =
+      "# NOTE: Do not modify this file.\n"
+      "java/lang/Object id: 0\n"
+      "java/lang/String id: 1\n"
+      "app/Main id: 2 super: 0 source: /tmp/app.jar\n"
+      "java/util/List id: 3\n"
+      "@lambda-proxy java/lang/Runnable run ()V\n"
+      "@lambda-form-invoker [LF_RESOLVE] java.lang.invoke.Invokers$Holder\n"
+      "java/lang/Class id: 4\n"
+      "Top id: 5\n"
+      "java/util/Map\n"
+      "java/util/Cut";
+  static const char *classes[] = {"Top", "java.lang.Object",
+                                  "java.lang.String", "java.lang.Class",
+                                  "java.util.List", "java.util.Map"};
+  static const uint32_t starts[] = {1, 4, 0}, lens[] = {3, 2, 1};
+  static const uint32_t firsts[] = {0, 2, 4};
+  struct yj_preload pl = {0};
+
+  pl.list = strdup(list);
+  pl.list_len = strlen(list);
+  ASSERT_TRUE(preload_parse(&pl));
+
+  // classes by package, each in list order; packages in order of first use
+  ASSERT_EQ(6u, pl.classes_len);
+  for (uint32_t i = 0; i < pl.classes_len; i++) {
+    ASSERT_STREQ(classes[i], pl.classes[i].name);
+  }
+  ASSERT_EQ(3u, pl.groups_len);
+  for (uint32_t i = 0; i < pl.groups_len; i++) {
+    ASSERT_EQ(starts[i], pl.groups[i].start);
+    ASSERT_EQ(lens[i], pl.groups[i].len);
+    ASSERT_EQ(firsts[i], pl.groups[i].first);
+  }
+  ASSERT_EQ(0u, pl.classes[0].package_len);
+  ASSERT_EQ(9u, pl.classes[1].package_len);
+  preload_free(&pl);
+
+  // nothing of the builtin loaders
+  pl.list = strdup("app/Main id: 0 super: 1 source: /tmp/app.jar\n@x\n");
+  pl.list_len = strlen(pl.list);
+  ASSERT_FALSE(preload_parse(&pl));
+  preload_free(&pl);
+}
+
+UTEST(args, classpath_wildcard) {
+  struct yj_run_args args;
+  char dir[] = "/tmp/yajava-wildcard-XXXXXX";
+  char cache[] = "/tmp/yajava-cache-XXXXXX";
+  char path[64], cp[64];
+  char *names[] = {"b.jar", "a.JAR", "c.Jar", "d.txt"};
+  char *arg[] = {"-cp", cp, "hello.Main"};
+
+  ASSERT_TRUE(wildcard_is("*"));
+  ASSERT_TRUE(wildcard_is("lib/*"));
+  ASSERT_FALSE(wildcard_is("lib/*.jar"));
+  ASSERT_FALSE(wildcard_is("lib*"));
+
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  ASSERT_TRUE(mkdtemp(cache) != NULL);
+  setenv("YAJAVA_CACHE_DIR", cache, 1);
+  for (int i = 0; i < 4; i++) {
+    snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+    fclose(fopen(path, "w"));
+  }
+  snprintf(path, sizeof(path), "%s/sub.jar", dir);
+  mkdir(path, 0755);
+  snprintf(cp, sizeof(cp), "%s/*:x", dir);
+
+  // listed, then from the cache once the directory is old enough
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ(0, yj_parse_run_args(3, arg, &args));
+    ASSERT_EQ(3, args.classpathes_len);
+    snprintf(path, sizeof(path), "%s/a.JAR", dir);
+    ASSERT_STREQ(path, args.classpathes[0]);
+    snprintf(path, sizeof(path), "%s/b.jar", dir);
+    ASSERT_STREQ(path, args.classpathes[1]);
+    ASSERT_STREQ("x", args.classpathes[2]);
+    yj_free_run_args(&args);
+  }
+  unsetenv("YAJAVA_CACHE_DIR");
+}
+
+UTEST(args, classpath_long) {
+  struct yj_run_args args;
+  char cache[] = "/tmp/yajava-cache-XXXXXX";
+  char *cp = malloc(1000 * 16);
+  char *arg[] = {"-cp", cp, "hello.Main"};
+  size_t pos = 0;
+
+  // 500 entries, each of them twice
+  for (int i = 0; i < 1000; i++) {
+    pos += sprintf(cp + pos, "%se%d", i > 0 ? ":" : "", i % 500);
+  }
+  ASSERT_EQ(0, yj_parse_run_args(3, arg, &args));
+  ASSERT_EQ(500, args.classpathes_len);
+  ASSERT_STREQ("e0", args.classpathes[0]);
+  ASSERT_STREQ("e499", args.classpathes[499]);
+  yj_free_run_args(&args);
+  free(cp);
+
+  // checked from threads, the first missing entry is found
+  char *paths[200];
+  for (int i = 0; i < 200; i++) {
+    paths[i] = i == 150 || i == 170 ? "/nonexistent" : "/tmp";
+  }
+  ASSERT_TRUE(mkdtemp(cache) != NULL);
+  setenv("YAJAVA_CACHE_DIR", cache, 1);
+  ASSERT_FALSE(classpath_check(paths, 200));
+  ASSERT_TRUE(classpath_check(paths, 150));
+  unsetenv("YAJAVA_CACHE_DIR");
+}
+
+UTEST(args, argfile) {
+  struct yj_cmdline cmd;
+  char path[] = "/tmp/yajava-args-XXXXXX";
+  char at[64], page[4096];
+  char *argv[] = {at, "Main", "@kept"};
+  const char *text = "# comment\n-Dx=\"a b\" -Dy=c\\d\n"
+                     "'-Dz=line\\\n   cont\\t' @@lit\n";
+  int fd = mkstemp(path);
+
+  unsetenv("JDK_JAVA_OPTIONS");
+  ASSERT_TRUE(fd >= 0);
+  ASSERT_EQ((ssize_t)strlen(text), write(fd, text, strlen(text)));
+  close(fd);
+  snprintf(at, sizeof(at), "@%s", path);
+
+  ASSERT_EQ(0, yj_expand_cmdline(3, argv, &cmd));
+  ASSERT_EQ(6, cmd.argc);
+  ASSERT_STREQ("-Dx=a b", cmd.argv[0]);
+  ASSERT_STREQ("-Dy=c\\d", cmd.argv[1]);
+  ASSERT_STREQ("-Dz=linecont\t", cmd.argv[2]);
+  ASSERT_STREQ("@@lit", cmd.argv[3]); // literal within a file
+  ASSERT_STREQ("Main", cmd.argv[4]);
+  ASSERT_STREQ("@kept", cmd.argv[5]); // an application argument
+  yj_free_cmdline(&cmd);
+
+  // a page of arguments, the last one ends with the file
+  memset(page, 'x', sizeof(page));
+  page[0] = '-';
+  page[1] = 'D';
+  page[2047] = ' ';
+  fd = open(path, O_WRONLY | O_TRUNC);
+  ASSERT_EQ((ssize_t)sizeof(page), write(fd, page, sizeof(page)));
+  close(fd);
+  setenv("JDK_JAVA_OPTIONS", "-Xmx1g '-Dq=r s'", 1);
+  ASSERT_EQ(0, yj_expand_cmdline(2, argv, &cmd));
+  ASSERT_EQ(5, cmd.argc);
+  ASSERT_STREQ("-Xmx1g", cmd.argv[0]);
+  ASSERT_STREQ("-Dq=r s", cmd.argv[1]);
+  ASSERT_EQ(2047, (int)strlen(cmd.argv[2]));
+  ASSERT_EQ(2048, (int)strlen(cmd.argv[3]));
+  yj_free_cmdline(&cmd);
+
+  setenv("JDK_JAVA_OPTIONS", "-jar app.jar", 1);
+  ASSERT_NE(0, yj_expand_cmdline(2, argv, &cmd));
+  yj_free_cmdline(&cmd);
+  unsetenv("JDK_JAVA_OPTIONS");
+  unlink(path);
+}
+
+// a seed without collisions and the slots of arg_opts for it
+static void print_arg_slots() {
+  unsigned char slots[256];
+  const char *name;
+
+  for (uint32_t seed = 0x811c9dc5U; seed < 0x811c9dc5U + 10000000; seed++) {
+    size_t i;
+    memset(slots, 0, sizeof(slots));
+    for (i = 0; (name = arg_opt_name(i)) != NULL; i++) {
+      uint32_t h = arg_hash(name, strlen(name), seed) & 255;
+      if (slots[h] != 0) {
+        break;
+      }
+      slots[h] = i + 1;
+    }
+    if (name == NULL) {
+      printf("#define ARG_SEED 0x%08xU\n", seed);
+      for (i = 0; i < 256; i++) {
+        printf("%s%2d,%s", i % 16 == 0 ? "    " : " ", slots[i],
+               i % 16 == 15 ? "\n" : "");
+      }
+      return;
+    }
+  }
+}
+
+UTEST(args, option_table) {
+  const char *name;
+  size_t i;
+
+  for (i = 0; (name = arg_opt_name(i)) != NULL; i++) {
+    if (arg_lookup(name, strlen(name)) == NULL) {
+      printf("%s is not in its slot, arg_slots for yajava.c:\n", name);
+      print_arg_slots();
+      break;
+    }
+  }
+  ASSERT_TRUE(name == NULL);
+  ASSERT_TRUE(arg_lookup("-jarx", 5) == NULL);
+  ASSERT_TRUE(arg_lookup("-ja", 3) == NULL);
+}
+
+UTEST(args, options) {
+  struct yj_run_args args;
+  char *arg[] = {"-p", "mods", "--add-modules=a,b", "--add-opens",
+                 "java.base/java.lang=ALL-UNNAMED", "-javaagent:agent.jar",
+                 "-verbose:gc", "-ea:com.example...", "-d64", "-splash:s.png",
+                 "--enable-native-access=ALL-UNNAMED", "--module=app/a.Main",
+                 "x", "-y"};
+  char *missing[] = {"--module-path"};
+  char *many[40];
+  char buf[40][16];
+
+  ASSERT_EQ(0, yj_parse_run_args(14, arg, &args));
+  ASSERT_EQ(1, args.module_pathes_len);
+  ASSERT_STREQ("mods", args.module_pathes[0]);
+  ASSERT_STREQ("a,b", args.add_modules[0]);
+  ASSERT_STREQ("ALL-UNNAMED", args.native_access_modules[0]);
+  ASSERT_STREQ("-javaagent:agent.jar", args.javagents[0]);
+  ASSERT_STREQ("s.png", args.splash);
+  ASSERT_TRUE(args.verbose_gc);
+  ASSERT_FALSE(args.verbose_class);
+  ASSERT_EQ(3, args.vmopts_len);
+  ASSERT_STREQ("--add-opens=java.base/java.lang=ALL-UNNAMED", args.vmopts[0]);
+  ASSERT_STREQ("-verbose:gc", args.vmopts[1]);
+  ASSERT_STREQ("-ea:com.example...", args.vmopts[2]);
+  ASSERT_STREQ("app/a.Main", args.app_module);
+  ASSERT_EQ(2, args.app_args_len);
+  ASSERT_STREQ("-y", args.app_args[1]);
+  yj_free_run_args(&args);
+
+  ASSERT_NE(0, yj_parse_run_args(1, missing, &args));
+  yj_free_run_args(&args);
+
+  // the arrays of the arena grow past their first size
+  for (int i = 0; i < 40; i++) {
+    snprintf(buf[i], sizeof(buf[i]), "-Dp%d=%d", i, i);
+    many[i] = buf[i];
+  }
+  ASSERT_EQ(0, yj_parse_run_args(40, many, &args));
+  ASSERT_EQ(40, args.sys_props_len);
+  ASSERT_STREQ("-Dp0=0", args.sys_props[0]);
+  ASSERT_STREQ("-Dp39=39", args.sys_props[39]);
+  yj_free_run_args(&args);
+}
+
+UTEST(args, source_file) {
+  struct yj_run_args args;
+  const char *src =
+      "#!/usr/bin/env yajava\n"
+      "// class Comment {\n"
+      "package a.b; /* class Block */\n"
+      "import java.util.*;\n"
+      "final class Helper { String s = \"class Str {\"; char c = '{'; }\n"
+      "public class Hello { String t = \"\"\"\n class Text\"\"\"; }\n";
+  char main_class[64], pub[64];
+  char *arg[] = {"--source", "21", "script", "x"};
+
+  ASSERT_TRUE(source_types(src, strlen(src), main_class, pub, 64));
+  ASSERT_STREQ("a.b.Helper", main_class);
+  ASSERT_STREQ("Hello", pub);
+  ASSERT_FALSE(source_types("void main() {}", 14, main_class, pub, 64));
+
+  // types of an implicitly declared class do not make it a normal file
+  src = "record Point(int x) {}\nvoid main() {}\n";
+  ASSERT_FALSE(source_types(src, strlen(src), main_class, pub, 64));
+  src = "import java.util.*;\nenum E { A; }\nString s = \"x\";\n";
+  ASSERT_FALSE(source_types(src, strlen(src), main_class, pub, 64));
+  src = "@SuppressWarnings(\"all\") record P(int x) {}\n"
+        "@interface Tag { String value() default \")\"; }\n";
+  ASSERT_TRUE(source_types(src, strlen(src), main_class, pub, 64));
+  ASSERT_STREQ("P", main_class);
+
+  // with --source any file is the program, the arguments follow it
+  ASSERT_EQ(0, yj_parse_run_args(4, arg, &args));
+  ASSERT_STREQ("21", args.source_release);
+  ASSERT_STREQ("script", args.app_source);
+  ASSERT_TRUE(args.app_main_class == NULL);
+  ASSERT_EQ(1, args.app_args_len);
+  yj_free_run_args(&args);
+}
@@ -1,16 +1,44 @@
 #include "../yajava.h"
+#include "../internal.h"
 #include "utest.h"
 
+#include <errno.h>
+#include <dirent.h>
 #include <limits.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <unistd.h>
 
+#include <time.h>
+
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 
+#ifdef __linux__
+#include <elf.h>
+#endif
+
+// from yajava.c
+bool jvm_is_release_string(const char *s, size_t len);
+bool jvm_probe_release(char *home, char *lib_path,
+                       struct yj_java_runtime *runtime);
+bool jvm_probe_libjvm(char *home, char *lib_path,
+                      struct yj_java_runtime *runtime);
+#ifdef __linux__
+bool jvm_elf_rodata(const char *map, size_t size, const char **start,
+                    const char **end);
+#endif
+bool index_open(struct index *idx);
+void index_close(struct index *idx);
+bool index_write(struct yj_java_runtime *runtimes, size_t len,
+                 const char **roots, int64_t *mtimes, size_t roots_len);
+bool index_lookup(struct index *idx, char *home, char *lib_path,
+                  struct yj_java_runtime *runtime);
+
 UTEST_MAIN();
 
 bool _file_exists(const char *path) {
@@ -25,6 +53,93 @@ bool _file_exists(const char *path) {
   return true;
 }
 
+static void _write_file(const char *dir, const char *name, const void *data,
+                        size_t len) {
+  char path[PATH_MAX];
+  FILE *f;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  if ((f = fopen(path, "wb")) != NULL) {
+    fwrite(data, 1, len, f);
+    fclose(f);
+  }
+}
+
+static void _remove_file(const char *dir, const char *name) {
+  char path[PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  unlink(path);
+}
+
+// move the mtime of a file age seconds into the past
+static void _age_file(const char *dir, const char *name, int age) {
+  char path[PATH_MAX];
+  struct timeval tv[2];
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  gettimeofday(&tv[0], NULL);
+  tv[0].tv_sec -= age;
+  tv[1] = tv[0];
+  utimes(path, tv);
+}
+
+static void _remove_tree(const char *path) {
+  char child[PATH_MAX];
+  struct dirent *entry;
+  DIR *dir;
+
+  if ((dir = opendir(path)) != NULL) {
+    while ((entry = readdir(dir)) != NULL) {
+      if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        _remove_tree(child);
+      }
+    }
+    closedir(dir);
+  }
+  remove(path);
+}
+
+// <home>/lib/server/libjvm.so and a release file the static probe reads
+static void _release_home(const char *home, const char *version) {
+  char path[PATH_MAX], release[100];
+
+  snprintf(path, sizeof(path), "%s", home);
+  for (char *p = path + 1; *p != '\0'; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      mkdir(path, 0755);
+      *p = '/';
+    }
+  }
+  mkdir(path, 0755);
+  snprintf(release, sizeof(release), "JAVA_VERSION=\"%s\"\n", version);
+  _write_file(home, "release", release, strlen(release));
+  snprintf(path, sizeof(path), "%s/lib", home);
+  mkdir(path, 0755);
+  snprintf(path, sizeof(path), "%s/lib/server", home);
+  mkdir(path, 0755);
+  _write_file(path, "libjvm.so", "ELF", 3);
+}
+
+static bool _has_runtime(struct yj_java_runtime *runtimes, size_t len,
+                         const char *full_version) {
+  for (size_t i = 0; i < len; i++) {
+    if (strcmp(runtimes[i].full_version, full_version) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void _free_runtimes(struct yj_java_runtime *runtimes, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    yj_free_runtime(&runtimes[i]);
+  }
+  free(runtimes);
+}
+
 UTEST(discovery, path) {
   struct yj_java_runtime *runtimes = NULL;
   size_t runtimes_len = 0;
@@ -34,11 +149,13 @@ UTEST(discovery, path) {
       printf("error\n");
       exit(1);
     }
-  } else {
+  } else if (_file_exists("/usr/lib/jvm")) {
     if (yj_java_discovery("/usr/lib/jvm", &runtimes, &runtimes_len) != YJ_OK) {
       printf("error\n");
       exit(1);
     }
+  } else {
+    UTEST_SKIP("no /opt/jdk or /usr/lib/jvm");
   }
 
   for (int i = 0; i < runtimes_len; i++) {
@@ -48,6 +165,7 @@ UTEST(discovery, path) {
     printf("     HOME: %s\n", r->home);
     printf("      JNI: 0x%x\n", r->jni_version);
     printf("      LIB: %s\n", r->libjvm_path);
+    printf("   VENDOR: %s\n", r->vendor);
 
     if (r->home != NULL) {
       free(r->home);
@@ -61,6 +179,634 @@ UTEST(discovery, path) {
     if (r->name != NULL) {
       free(r->name);
     }
+    if (r->vendor != NULL) {
+      free(r->vendor);
+    }
   }
   free(runtimes);
 }
+
+// roots from YAJAVA_DISCOVERY_PATH, homes up to YAJAVA_DISCOVERY_DEPTH
+// levels below each
+static size_t _discover(struct yj_discovery *discovery, const char *depth,
+                        struct yj_java_runtime **runtimes) {
+  size_t runtimes_len = 0;
+
+  if (depth != NULL) {
+    setenv("YAJAVA_DISCOVERY_DEPTH", depth, 1);
+  } else {
+    unsetenv("YAJAVA_DISCOVERY_DEPTH");
+  }
+  if (yj_discovery_defaults(discovery) != YJ_OK ||
+      yj_java_discovery_roots(discovery, runtimes, &runtimes_len) != YJ_OK) {
+    return 0;
+  }
+  return runtimes_len;
+}
+
+UTEST(discovery, roots) {
+  char tmp[] = "/tmp/yajava-roots-XXXXXX";
+  char roots[PATH_MAX * 2], path[PATH_MAX];
+  struct yj_discovery discovery;
+  struct yj_java_runtime *runtimes = NULL;
+  char *home = getenv("HOME") == NULL ? NULL : strdup(getenv("HOME"));
+  size_t len;
+
+  ASSERT_TRUE(mkdtemp(tmp) != NULL);
+  snprintf(path, sizeof(path), "%s/cache", tmp);
+  setenv("YAJAVA_CACHE_DIR", path, 1);
+
+  //   a/jdk-17                 depth 1
+  //   a/vendor/jdk-21          depth 2
+  //   a/x/y/jdk-11             depth 3
+  //   a/broken                 no libjvm, not a home
+  //   b                        the root is a home itself
+  snprintf(path, sizeof(path), "%s/a/jdk-17", tmp);
+  _release_home(path, "17.0.2");
+  snprintf(path, sizeof(path), "%s/a/vendor/jdk-21", tmp);
+  _release_home(path, "21.0.1");
+  snprintf(path, sizeof(path), "%s/a/x/y/jdk-11", tmp);
+  _release_home(path, "11.0.20");
+  snprintf(path, sizeof(path), "%s/a/broken", tmp);
+  mkdir(path, 0755);
+  _write_file(path, "release", "JAVA_VERSION=\"8\"\n", 16);
+  snprintf(path, sizeof(path), "%s/b", tmp);
+  _release_home(path, "22.0.1");
+
+  snprintf(roots, sizeof(roots), "%s/a:%s/missing:%s/b", tmp, tmp, tmp);
+  setenv("YAJAVA_DISCOVERY_PATH", roots, 1);
+
+  // the default depth reaches a/vendor/jdk-21, not a/x/y/jdk-11
+  len = _discover(&discovery, NULL, &runtimes);
+  ASSERT_EQ(3u, discovery.roots_len);
+  EXPECT_EQ(2, discovery.max_depth);
+  snprintf(path, sizeof(path), "%s/missing", tmp);
+  EXPECT_STREQ(path, discovery.roots[1].path);
+  EXPECT_EQ(2u, discovery.roots[0].found);
+  EXPECT_EQ(0u, discovery.roots[1].found);
+  EXPECT_EQ(1u, discovery.roots[2].found);
+  EXPECT_EQ(3u, len);
+  EXPECT_TRUE(_has_runtime(runtimes, len, "17.0.2"));
+  EXPECT_TRUE(_has_runtime(runtimes, len, "21.0.1"));
+  EXPECT_TRUE(_has_runtime(runtimes, len, "22.0.1"));
+  EXPECT_FALSE(_has_runtime(runtimes, len, "11.0.20"));
+  _free_runtimes(runtimes, len);
+  yj_free_discovery(&discovery);
+
+  len = _discover(&discovery, "1", &runtimes);
+  EXPECT_EQ(1u, discovery.roots[0].found);
+  EXPECT_EQ(2u, len);
+  EXPECT_FALSE(_has_runtime(runtimes, len, "21.0.1"));
+  _free_runtimes(runtimes, len);
+  yj_free_discovery(&discovery);
+
+  len = _discover(&discovery, "3", &runtimes);
+  EXPECT_EQ(3u, discovery.roots[0].found);
+  EXPECT_EQ(4u, len);
+  EXPECT_TRUE(_has_runtime(runtimes, len, "11.0.20"));
+  _free_runtimes(runtimes, len);
+  yj_free_discovery(&discovery);
+
+  // ~ is the home directory
+  setenv("HOME", tmp, 1);
+  setenv("YAJAVA_DISCOVERY_PATH", "~/b", 1);
+  len = _discover(&discovery, NULL, &runtimes);
+  ASSERT_EQ(1u, discovery.roots_len);
+  snprintf(path, sizeof(path), "%s/b", tmp);
+  EXPECT_STREQ(path, discovery.roots[0].path);
+  EXPECT_EQ(1u, len);
+  _free_runtimes(runtimes, len);
+  yj_free_discovery(&discovery);
+
+  if (home != NULL) {
+    setenv("HOME", home, 1);
+    free(home);
+  }
+  unsetenv("YAJAVA_DISCOVERY_PATH");
+  unsetenv("YAJAVA_DISCOVERY_DEPTH");
+  unsetenv("YAJAVA_CACHE_DIR");
+  _remove_tree(tmp);
+}
+
+UTEST(discovery, select_constraint) {
+  struct yj_java_runtime runtime = {0};
+
+  ASSERT_NE(YJ_OK, yj_select_runtime("17+unknown=1", &runtime));
+  ASSERT_NE(YJ_OK, yj_select_runtime("/nonexistent/java/home", &runtime));
+
+  if (yj_select_runtime(">=8", &runtime) == YJ_OK) {
+    printf("SELECTED %s %s\n", runtime.full_version, runtime.home);
+    ASSERT_TRUE(runtime.major_version >= 8);
+    yj_free_runtime(&runtime);
+  }
+}
+
+UTEST(discovery, select_new_home) {
+  char tmp[] = "/tmp/yajava-select-XXXXXX";
+  char path[PATH_MAX];
+  struct yj_java_runtime runtime = {0};
+  struct index idx;
+
+  ASSERT_TRUE(mkdtemp(tmp) != NULL);
+  snprintf(path, sizeof(path), "%s/cache", tmp);
+  setenv("YAJAVA_CACHE_DIR", path, 1);
+  snprintf(path, sizeof(path), "%s/a", tmp);
+  setenv("YAJAVA_DISCOVERY_PATH", path, 1);
+  snprintf(path, sizeof(path), "%s/a/jdk-17", tmp);
+  _release_home(path, "17.0.2");
+
+  ASSERT_EQ(YJ_OK, yj_select_runtime(">=8", &runtime));
+  EXPECT_STREQ("17.0.2", runtime.full_version);
+  yj_free_runtime(&runtime);
+
+  // the scanned root is recorded with the runtimes
+  ASSERT_TRUE(index_open(&idx));
+  EXPECT_EQ(1u, idx.header->count);
+  EXPECT_EQ(1u, idx.header->roots_len);
+  index_close(&idx);
+
+  // a home added to the root is found, not the indexed one served
+  snprintf(path, sizeof(path), "%s/a/jdk-21", tmp);
+  _release_home(path, "21.0.1");
+  ASSERT_EQ(YJ_OK, yj_select_runtime(">=8", &runtime));
+  EXPECT_STREQ("21.0.1", runtime.full_version);
+  yj_free_runtime(&runtime);
+  ASSERT_EQ(YJ_OK, yj_select_runtime("<21", &runtime));
+  EXPECT_STREQ("17.0.2", runtime.full_version);
+  yj_free_runtime(&runtime);
+
+  // and a removed one is not selected
+  snprintf(path, sizeof(path), "%s/a/jdk-21", tmp);
+  _remove_tree(path);
+  ASSERT_EQ(YJ_OK, yj_select_runtime(">=8", &runtime));
+  EXPECT_STREQ("17.0.2", runtime.full_version);
+  yj_free_runtime(&runtime);
+
+  unsetenv("YAJAVA_DISCOVERY_PATH");
+  unsetenv("YAJAVA_CACHE_DIR");
+  _remove_tree(tmp);
+}
+
+UTEST(probe, release_string) {
+  const char *good[] = {"17.0.2+8-86", "21+35-LTS", "11.0.20.1+1", "9+181"};
+  const char *bad[] = {"17.0.2",   "1.8.0_392", "8+1",     "17.+8",
+                       "017.0.2+8", "17.0.2+",  "17+8 ",   "+8",
+                       "22-ea+27",  "21+35-LTS!"};
+
+  for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+    EXPECT_TRUE(jvm_is_release_string(good[i], strlen(good[i])));
+  }
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    EXPECT_FALSE(jvm_is_release_string(bad[i], strlen(bad[i])));
+  }
+
+  // bounded by len, not by the terminator
+  EXPECT_TRUE(jvm_is_release_string("17.0.2+8-86 and more", 11));
+  EXPECT_FALSE(jvm_is_release_string("17.0.2+8-86", 6));
+}
+
+UTEST(probe, release_file) {
+  char home[] = "/tmp/yajava-release-XXXXXX";
+  char lib[PATH_MAX];
+  struct yj_java_runtime runtime = {0};
+  const char *quoted = "IMPLEMENTOR=\"Eclipse Adoptium\"\n"
+                       "# JAVA_VERSION=\"8\"\n"
+                       "JAVA_VERSION=\"17.0.2\"\n";
+  const char *unquoted = "  JAVA_VERSION = 21.0.1  \n"
+                         "IMPLEMENTOR=Oracle Corporation\n";
+  const char *no_vendor = "JAVA_VERSION=\"11.0.20\"\n";
+  const char *no_version = "IMPLEMENTOR=\"Eclipse Adoptium\"\n"
+                           "JAVA_VERSION_DATE=\"2023-01-17\"\n";
+
+  ASSERT_TRUE(mkdtemp(home) != NULL);
+  snprintf(lib, sizeof(lib), "%s/lib/server/libjvm.so", home);
+
+  // no release file at all
+  ASSERT_FALSE(jvm_probe_release(home, lib, &runtime));
+
+  _write_file(home, "release", quoted, strlen(quoted));
+  ASSERT_TRUE(jvm_probe_release(home, lib, &runtime));
+  EXPECT_EQ(17, runtime.major_version);
+  EXPECT_STREQ("17.0.2", runtime.full_version);
+  EXPECT_STREQ("Eclipse Adoptium", runtime.vendor);
+  EXPECT_STREQ(home, runtime.home);
+  EXPECT_STREQ(lib, runtime.libjvm_path);
+  yj_free_runtime(&runtime);
+
+  _write_file(home, "release", unquoted, strlen(unquoted));
+  ASSERT_TRUE(jvm_probe_release(home, lib, &runtime));
+  EXPECT_EQ(21, runtime.major_version);
+  EXPECT_STREQ("21.0.1", runtime.full_version);
+  EXPECT_STREQ("Oracle Corporation", runtime.vendor);
+  yj_free_runtime(&runtime);
+
+  _write_file(home, "release", no_vendor, strlen(no_vendor));
+  ASSERT_TRUE(jvm_probe_release(home, lib, &runtime));
+  EXPECT_EQ(11, runtime.major_version);
+  EXPECT_TRUE(runtime.vendor == NULL);
+  yj_free_runtime(&runtime);
+
+  // JAVA_VERSION_DATE is not JAVA_VERSION
+  _write_file(home, "release", no_version, strlen(no_version));
+  EXPECT_FALSE(jvm_probe_release(home, lib, &runtime));
+
+  _remove_file(home, "release");
+  rmdir(home);
+}
+
+#ifdef __linux__
+// a minimal ELF64 image: null, .rodata and .shstrtab sections, with a
+// decoy release string in .data that the scan must not pick up
+static size_t _elf_image(char *buf, size_t size, const char *rodata,
+                         size_t rodata_len, const char *data) {
+  const char names[] = "\0.rodata\0.shstrtab\0.data";
+  Elf64_Ehdr *eh = (Elf64_Ehdr *)buf;
+  Elf64_Shdr *sh;
+  size_t off = sizeof(Elf64_Ehdr);
+  size_t rodata_off, data_off, names_off;
+
+  memset(buf, 0, size);
+  memcpy(eh->e_ident, ELFMAG, SELFMAG);
+  eh->e_ident[EI_CLASS] = ELFCLASS64;
+  eh->e_ident[EI_DATA] = ELFDATA2LSB;
+  eh->e_ident[EI_VERSION] = EV_CURRENT;
+  eh->e_type = ET_DYN;
+  eh->e_version = EV_CURRENT;
+  eh->e_ehsize = sizeof(Elf64_Ehdr);
+  eh->e_shentsize = sizeof(Elf64_Shdr);
+
+  data_off = off;
+  memcpy(buf + off, data, strlen(data) + 1);
+  off += strlen(data) + 1;
+  rodata_off = off;
+  memcpy(buf + off, rodata, rodata_len);
+  off += rodata_len;
+  names_off = off;
+  memcpy(buf + off, names, sizeof(names));
+  off += sizeof(names);
+  off = (off + 7) & ~(size_t)7;
+
+  eh->e_shoff = off;
+  eh->e_shnum = 4;
+  eh->e_shstrndx = 2;
+  sh = (Elf64_Shdr *)(buf + off);
+  sh[1].sh_name = 1;
+  sh[1].sh_type = SHT_PROGBITS;
+  sh[1].sh_offset = rodata_off;
+  sh[1].sh_size = rodata_len;
+  sh[2].sh_name = 9;
+  sh[2].sh_type = SHT_STRTAB;
+  sh[2].sh_offset = names_off;
+  sh[2].sh_size = sizeof(names);
+  sh[3].sh_name = 19;
+  sh[3].sh_type = SHT_PROGBITS;
+  sh[3].sh_offset = data_off;
+  sh[3].sh_size = strlen(data) + 1;
+  return off + 4 * sizeof(Elf64_Shdr);
+}
+
+UTEST(probe, libjvm_rodata) {
+  char home[] = "/tmp/yajava-libjvm-XXXXXX";
+  char lib[PATH_MAX];
+  uint64_t words[128];
+  char *image = (char *)words;
+  const char rodata[] = "OpenJDK\0-Xmx\00017.0.2\00017.0.2+8-86\0";
+  const char *start, *end;
+  struct yj_java_runtime runtime = {0};
+  size_t len;
+
+  len = _elf_image(image, sizeof(words), rodata, sizeof(rodata), "11.0.1+99");
+  ASSERT_TRUE(jvm_elf_rodata(image, len, &start, &end));
+  EXPECT_EQ(sizeof(rodata), (size_t)(end - start));
+  EXPECT_EQ(0, memcmp(start, rodata, sizeof(rodata)));
+
+  // not an ELF64 image, or section headers past the end
+  EXPECT_FALSE(jvm_elf_rodata(image, sizeof(Elf64_Ehdr) - 1, &start, &end));
+  EXPECT_FALSE(jvm_elf_rodata(image, len - 1, &start, &end));
+  image[EI_CLASS] = ELFCLASS32;
+  EXPECT_FALSE(jvm_elf_rodata(image, len, &start, &end));
+
+  ASSERT_TRUE(mkdtemp(home) != NULL);
+  snprintf(lib, sizeof(lib), "%s/libjvm.so", home);
+
+  // the decoy in .data comes first in the file, only .rodata is scanned
+  len = _elf_image(image, sizeof(words), rodata, sizeof(rodata), "11.0.1+99");
+  _write_file(home, "libjvm.so", image, len);
+  ASSERT_TRUE(jvm_probe_libjvm(home, lib, &runtime));
+  EXPECT_EQ(17, runtime.major_version);
+  EXPECT_STREQ("17.0.2", runtime.full_version);
+  EXPECT_TRUE(runtime.vendor == NULL);
+  yj_free_runtime(&runtime);
+
+  // no release string in .rodata
+  len = _elf_image(image, sizeof(words), "OpenJDK\0-Xmx", 13, "21+35");
+  _write_file(home, "libjvm.so", image, len);
+  EXPECT_FALSE(jvm_probe_libjvm(home, lib, &runtime));
+
+  // empty file
+  _write_file(home, "libjvm.so", image, 0);
+  EXPECT_FALSE(jvm_probe_libjvm(home, lib, &runtime));
+
+  _remove_file(home, "libjvm.so");
+  rmdir(home);
+}
+#endif
+
+// the index entry of home is served while libjvm and the release file stay
+static bool _index_hit(char *home, char *lib, const char *full_version) {
+  struct index idx;
+  struct yj_java_runtime runtime = {0};
+  bool hit;
+
+  if (!index_open(&idx)) {
+    return false;
+  }
+  hit = index_lookup(&idx, home, lib, &runtime);
+  index_close(&idx);
+  if (hit) {
+    hit = runtime.full_version != NULL &&
+          strcmp(runtime.full_version, full_version) == 0;
+    yj_free_runtime(&runtime);
+  }
+  return hit;
+}
+
+UTEST(index, round_trip) {
+  char cache[] = "/tmp/yajava-index-XXXXXX";
+  char home[] = "/tmp/yajava-home-XXXXXX";
+  char lib[PATH_MAX], other[PATH_MAX], path[PATH_MAX];
+  const char *release = "JAVA_VERSION=\"17.0.2\"\n"
+                        "IMPLEMENTOR=\"Eclipse Adoptium\"\n";
+  struct yj_java_runtime runtime = {0};
+  struct index idx;
+
+  ASSERT_TRUE(mkdtemp(cache) != NULL);
+  ASSERT_TRUE(mkdtemp(home) != NULL);
+  setenv("YAJAVA_CACHE_DIR", cache, 1);
+  snprintf(lib, sizeof(lib), "%s/libjvm.so", home);
+  snprintf(other, sizeof(other), "%s/other.so", home);
+  _write_file(home, "libjvm.so", "ELF", 3);
+  _write_file(home, "release", release, strlen(release));
+  _age_file(home, "libjvm.so", 100);
+  _age_file(home, "release", 100);
+  ASSERT_TRUE(jvm_probe_release(home, lib, &runtime));
+
+  ASSERT_FALSE(index_open(&idx));
+  ASSERT_TRUE(index_write(&runtime, 1, NULL, NULL, 0));
+  ASSERT_TRUE(index_open(&idx));
+  EXPECT_EQ(INDEX_VERSION, idx.header->version);
+  EXPECT_EQ(1u, idx.header->count);
+  index_close(&idx);
+  EXPECT_TRUE(_index_hit(home, lib, "17.0.2"));
+  EXPECT_FALSE(_index_hit(home, other, "17.0.2"));
+
+  // libjvm mtime, libjvm size
+  _age_file(home, "libjvm.so", 200);
+  EXPECT_FALSE(_index_hit(home, lib, "17.0.2"));
+  ASSERT_TRUE(index_write(&runtime, 1, NULL, NULL, 0));
+  EXPECT_TRUE(_index_hit(home, lib, "17.0.2"));
+  _write_file(home, "libjvm.so", "ELF64", 5);
+  _age_file(home, "libjvm.so", 200);
+  EXPECT_FALSE(_index_hit(home, lib, "17.0.2"));
+
+  // release file mtime, release file gone, release file back
+  ASSERT_TRUE(index_write(&runtime, 1, NULL, NULL, 0));
+  EXPECT_TRUE(_index_hit(home, lib, "17.0.2"));
+  _age_file(home, "release", 200);
+  EXPECT_FALSE(_index_hit(home, lib, "17.0.2"));
+  ASSERT_TRUE(index_write(&runtime, 1, NULL, NULL, 0));
+  _remove_file(home, "release");
+  EXPECT_FALSE(_index_hit(home, lib, "17.0.2"));
+  ASSERT_TRUE(index_write(&runtime, 1, NULL, NULL, 0));
+  EXPECT_TRUE(_index_hit(home, lib, "17.0.2"));
+  _write_file(home, "release", release, strlen(release));
+  EXPECT_FALSE(_index_hit(home, lib, "17.0.2"));
+
+  yj_free_runtime(&runtime);
+  snprintf(path, sizeof(path), "%s/%s", cache, INDEX_FILE);
+  unlink(path);
+  rmdir(cache);
+  _remove_file(home, "release");
+  _remove_file(home, "libjvm.so");
+  rmdir(home);
+}
+
+UTEST(index, corrupt) {
+  char cache[] = "/tmp/yajava-index-XXXXXX";
+  char home[] = "/tmp/yajava-home-XXXXXX";
+  char lib[PATH_MAX], path[PATH_MAX];
+  const char *release = "JAVA_VERSION=\"21.0.1\"\n";
+  struct yj_java_runtime runtime = {0};
+  struct index_header *header;
+  struct index idx;
+  char *data, *copy;
+  size_t size;
+  FILE *f;
+
+  ASSERT_TRUE(mkdtemp(cache) != NULL);
+  ASSERT_TRUE(mkdtemp(home) != NULL);
+  setenv("YAJAVA_CACHE_DIR", cache, 1);
+  snprintf(lib, sizeof(lib), "%s/libjvm.so", home);
+  snprintf(path, sizeof(path), "%s/%s", cache, INDEX_FILE);
+  _write_file(home, "libjvm.so", "ELF", 3);
+  _write_file(home, "release", release, strlen(release));
+  ASSERT_TRUE(jvm_probe_release(home, lib, &runtime));
+  ASSERT_TRUE(index_write(&runtime, 1, NULL, NULL, 0));
+  yj_free_runtime(&runtime);
+
+  f = fopen(path, "rb");
+  ASSERT_TRUE(f != NULL);
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  rewind(f);
+  data = malloc(size);
+  copy = malloc(size);
+  ASSERT_EQ(size, fread(data, 1, size, f));
+  fclose(f);
+  ASSERT_TRUE(index_open(&idx));
+  index_close(&idx);
+
+  // truncated, to the header and by one byte
+  _write_file(cache, INDEX_FILE, data, sizeof(struct index_header) - 1);
+  EXPECT_FALSE(index_open(&idx));
+  _write_file(cache, INDEX_FILE, data, sizeof(struct index_header));
+  EXPECT_FALSE(index_open(&idx));
+  _write_file(cache, INDEX_FILE, data, size - 1);
+  EXPECT_FALSE(index_open(&idx));
+
+  // magic, version, entry count
+  memcpy(copy, data, size);
+  header = (struct index_header *)copy;
+  header->magic = ~INDEX_MAGIC;
+  _write_file(cache, INDEX_FILE, copy, size);
+  EXPECT_FALSE(index_open(&idx));
+  memcpy(copy, data, size);
+  header->version = INDEX_VERSION - 1;
+  _write_file(cache, INDEX_FILE, copy, size);
+  EXPECT_FALSE(index_open(&idx));
+  memcpy(copy, data, size);
+  header->count++;
+  _write_file(cache, INDEX_FILE, copy, size);
+  EXPECT_FALSE(index_open(&idx));
+
+  // a pool without the terminating nul
+  memcpy(copy, data, size);
+  copy[size - 1] = 'x';
+  _write_file(cache, INDEX_FILE, copy, size);
+  EXPECT_FALSE(index_open(&idx));
+
+  // the original is still fine
+  _write_file(cache, INDEX_FILE, data, size);
+  EXPECT_TRUE(_index_hit(home, lib, "21.0.1"));
+
+  free(data);
+  free(copy);
+  unlink(path);
+  rmdir(cache);
+  _remove_file(home, "release");
+  _remove_file(home, "libjvm.so");
+  rmdir(home);
+}
+
+#ifdef FAKE_LIBJVM
+static long _now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// <root>/<name>/lib/server/libjvm.so, the fake libjvm or with a release file
+// a placeholder the static probe reads instead
+static void _fake_home(const char *root, const char *name,
+                       const char *release) {
+  char dir[PATH_MAX], buf[8192];
+  FILE *in, *out;
+  size_t n;
+
+  snprintf(dir, sizeof(dir), "%s/%s", root, name);
+  mkdir(dir, 0755);
+  if (release != NULL) {
+    _write_file(dir, "release", release, strlen(release));
+  }
+  snprintf(dir, sizeof(dir), "%s/%s/lib", root, name);
+  mkdir(dir, 0755);
+  snprintf(dir, sizeof(dir), "%s/%s/lib/server", root, name);
+  mkdir(dir, 0755);
+  if (release != NULL) {
+    _write_file(dir, "libjvm.so", "ELF", 3);
+    return;
+  }
+
+  // a copy, not a link: the fake tells the homes apart by its own path
+  snprintf(buf, sizeof(buf), "%s/libjvm.so", dir);
+  if ((in = fopen(FAKE_LIBJVM, "rb")) == NULL ||
+      (out = fopen(buf, "wb")) == NULL) {
+    if (in != NULL) {
+      fclose(in);
+    }
+    return;
+  }
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    fwrite(buf, 1, n, out);
+  }
+  fclose(in);
+  fclose(out);
+}
+
+UTEST(probe, vm_timeout) {
+  char root[] = "/tmp/yajava-probe-XXXXXX";
+  char cache[PATH_MAX], home[PATH_MAX], lib[PATH_MAX + 32];
+  struct yj_java_runtime *runtimes = NULL;
+  struct yj_java_runtime runtime = {0};
+  size_t runtimes_len = 0;
+  struct index idx;
+  long start, elapsed;
+
+  ASSERT_TRUE(mkdtemp(root) != NULL);
+  snprintf(cache, sizeof(cache), "%s-cache", root);
+  setenv("YAJAVA_CACHE_DIR", cache, 1);
+  setenv("YAJAVA_PROBE_TIMEOUT", "500", 1);
+  setenv("YAJAVA_PROBE_JOBS", "1", 1);
+  unsetenv("FAKE_LIBJVM_DELAY_MS");
+
+  _fake_home(root, "jdk-17", NULL);
+  _fake_home(root, "hang-jdk-11", NULL);
+  _fake_home(root, "jdk-21", "JAVA_VERSION=\"21.0.2\"\n");
+
+  // the hung probe holds the only worker until it is killed, the others
+  // are still reported
+  start = _now_ms();
+  ASSERT_EQ(YJ_OK, yj_java_discovery(root, &runtimes, &runtimes_len));
+  elapsed = _now_ms() - start;
+  EXPECT_EQ(2u, runtimes_len);
+  EXPECT_TRUE(_has_runtime(runtimes, runtimes_len, "17.0.1"));
+  EXPECT_TRUE(_has_runtime(runtimes, runtimes_len, "21.0.2"));
+  EXPECT_GE(elapsed, 500);
+  EXPECT_LT(elapsed, 5000);
+  _free_runtimes(runtimes, runtimes_len);
+
+  // killed and reaped, no child left behind
+  EXPECT_EQ(-1, waitpid(-1, NULL, WNOHANG));
+  EXPECT_EQ(ECHILD, errno);
+
+  // the finished probes are merged into the index, the hung one is not
+  ASSERT_TRUE(index_open(&idx));
+  EXPECT_EQ(2u, idx.header->count);
+  snprintf(home, sizeof(home), "%s/jdk-17", root);
+  snprintf(lib, sizeof(lib), "%s/lib/server/libjvm.so", home);
+  EXPECT_TRUE(index_lookup(&idx, home, lib, &runtime));
+  yj_free_runtime(&runtime);
+  snprintf(home, sizeof(home), "%s/hang-jdk-11", root);
+  snprintf(lib, sizeof(lib), "%s/lib/server/libjvm.so", home);
+  EXPECT_FALSE(index_lookup(&idx, home, lib, &runtime));
+  index_close(&idx);
+
+  _remove_tree(root);
+  _remove_tree(cache);
+}
+
+UTEST(probe, vm_jobs) {
+  char root[] = "/tmp/yajava-probe-XXXXXX";
+  char cache[PATH_MAX];
+  struct yj_java_runtime *runtimes = NULL;
+  size_t runtimes_len = 0;
+  long start, elapsed;
+
+  ASSERT_TRUE(mkdtemp(root) != NULL);
+  snprintf(cache, sizeof(cache), "%s-cache", root);
+  setenv("YAJAVA_CACHE_DIR", cache, 1);
+  setenv("YAJAVA_PROBE_TIMEOUT", "5000", 1);
+  setenv("FAKE_LIBJVM_DELAY_MS", "300", 1);
+  _fake_home(root, "jdk-11", NULL);
+  _fake_home(root, "jdk-17", NULL);
+  _fake_home(root, "jdk-21", NULL);
+
+  // one worker, the probes run one after another
+  setenv("YAJAVA_PROBE_JOBS", "1", 1);
+  start = _now_ms();
+  ASSERT_EQ(YJ_OK, yj_java_discovery(root, &runtimes, &runtimes_len));
+  elapsed = _now_ms() - start;
+  EXPECT_EQ(3u, runtimes_len);
+  EXPECT_GE(elapsed, 900);
+  _free_runtimes(runtimes, runtimes_len);
+
+  // three workers, side by side (a fresh cache, no index hits)
+  _remove_tree(cache);
+  setenv("YAJAVA_PROBE_JOBS", "3", 1);
+  start = _now_ms();
+  ASSERT_EQ(YJ_OK, yj_java_discovery(root, &runtimes, &runtimes_len));
+  elapsed = _now_ms() - start;
+  EXPECT_EQ(3u, runtimes_len);
+  EXPECT_TRUE(_has_runtime(runtimes, runtimes_len, "11.0.1"));
+  EXPECT_TRUE(_has_runtime(runtimes, runtimes_len, "17.0.1"));
+  EXPECT_TRUE(_has_runtime(runtimes, runtimes_len, "21.0.1"));
+  EXPECT_LT(elapsed, 900);
+  _free_runtimes(runtimes, runtimes_len);
+
+  unsetenv("FAKE_LIBJVM_DELAY_MS");
+  unsetenv("YAJAVA_PROBE_JOBS");
+  unsetenv("YAJAVA_PROBE_TIMEOUT");
+  _remove_tree(root);
+  _remove_tree(cache);
+}
+#endif
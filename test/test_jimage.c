@@ -0,0 +1,419 @@
+#include "../internal.h"
+#include "../jimage.h"
+#include "../yajava.h"
+#include "utest.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+// from yajava.c
+bool module_info_parse(unsigned char *buf, size_t len, struct module_info *mi);
+bool modules_load(struct yj_java_runtime *runtime, struct modules_image *mi);
+void modules_free(struct modules_image *mi);
+bool modules_validate(struct modules_image *mi);
+
+#define TEST_HOME "/tmp/yajava-test-jimage"
+#define HASH_MULTIPLIER 0x01000193
+
+struct buf {
+  unsigned char *data;
+  size_t len;
+};
+
+static void put(struct buf *b, const void *p, size_t len) {
+  b->data = realloc(b->data, b->len + len);
+  memcpy(b->data + b->len, p, len);
+  b->len += len;
+}
+
+static void put1(struct buf *b, uint8_t v) { put(b, &v, 1); }
+
+static void put2(struct buf *b, uint16_t v) {
+  put1(b, v >> 8);
+  put1(b, v & 0xff);
+}
+
+static void put4(struct buf *b, uint32_t v) {
+  put2(b, v >> 16);
+  put2(b, v & 0xffff);
+}
+
+// a module-info.class, constants and the Module attribute written by hand
+struct class_file {
+  struct buf pool;
+  uint16_t count;
+};
+
+static uint16_t cp_utf8(struct class_file *cf, const char *s) {
+  put1(&cf->pool, 1);
+  put2(&cf->pool, strlen(s));
+  put(&cf->pool, s, strlen(s));
+  return cf->count++;
+}
+
+static uint16_t cp_ref(struct class_file *cf, int tag, const char *s) {
+  uint16_t name = cp_utf8(cf, s);
+  put1(&cf->pool, tag);
+  put2(&cf->pool, name);
+  return cf->count++;
+}
+
+static struct buf module_info(const char *name, bool base) {
+  struct class_file cf = {{0}, 1};
+  struct buf attr = {0}, packages = {0}, out = {0};
+  uint16_t module_attr = cp_utf8(&cf, "Module");
+  uint16_t packages_attr = cp_utf8(&cf, "ModulePackages");
+  uint16_t this_class = cp_ref(&cf, 7, "module-info");
+
+  cp_utf8(&cf, "unused");
+  put1(&cf.pool, 5); // a Long takes two entries
+  put4(&cf.pool, 0);
+  put4(&cf.pool, 42);
+  cf.count += 2;
+
+  put2(&attr, cp_ref(&cf, 19, name));
+  put2(&attr, 0);
+  put2(&attr, cp_utf8(&cf, "21.0.2"));
+  if (base) {
+    put2(&attr, 0); // requires
+    put2(&attr, 2); // exports
+    put2(&attr, cp_ref(&cf, 20, "java/lang"));
+    put2(&attr, 0);
+    put2(&attr, 0);
+    put2(&attr, cp_ref(&cf, 20, "jdk/internal/misc"));
+    put2(&attr, 0);
+    put2(&attr, 1);
+    put2(&attr, cp_ref(&cf, 19, "java.sql"));
+    put2(&attr, 0); // opens
+    put2(&attr, 1); // uses
+    put2(&attr, cp_ref(&cf, 7, "java/lang/System$LoggerFinder"));
+    put2(&attr, 0); // provides
+
+    put2(&packages, 3);
+    put2(&packages, cp_ref(&cf, 20, "java/lang"));
+    put2(&packages, cp_ref(&cf, 20, "jdk/internal/misc"));
+    put2(&packages, cp_ref(&cf, 20, "sun/nio"));
+  } else {
+    put2(&attr, 2); // requires
+    put2(&attr, cp_ref(&cf, 19, "java.base"));
+    put2(&attr, 0x8000);
+    put2(&attr, 0);
+    put2(&attr, cp_ref(&cf, 19, "java.logging"));
+    put2(&attr, 0x0020);
+    put2(&attr, 0);
+    put2(&attr, 1); // exports
+    put2(&attr, cp_ref(&cf, 20, "java/sql"));
+    put2(&attr, 0);
+    put2(&attr, 0);
+    put2(&attr, 0); // opens
+    put2(&attr, 1); // uses
+    put2(&attr, cp_ref(&cf, 7, "java/sql/Driver"));
+    put2(&attr, 0); // provides
+
+    put2(&packages, 1);
+    put2(&packages, cp_ref(&cf, 20, "java/sql"));
+  }
+
+  put4(&out, 0xcafebabe);
+  put2(&out, 0);
+  put2(&out, 65);
+  put2(&out, cf.count);
+  put(&out, cf.pool.data, cf.pool.len);
+  put2(&out, 0x8000); // ACC_MODULE
+  put2(&out, this_class);
+  put2(&out, 0);
+  put2(&out, 0); // interfaces, fields, methods
+  put2(&out, 0);
+  put2(&out, 0);
+  put2(&out, 2);
+  put2(&out, module_attr);
+  put4(&out, attr.len);
+  put(&out, attr.data, attr.len);
+  put2(&out, packages_attr);
+  put4(&out, packages.len);
+  put(&out, packages.data, packages.len);
+  free(cf.pool.data);
+  free(attr.data);
+  free(packages.data);
+  return out;
+}
+
+struct resource {
+  const char *name;
+  struct buf content;
+  bool zip; // stored with the zip compressor
+};
+
+static uint32_t hash(const char *s, uint32_t seed) {
+  for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+    seed = (seed * HASH_MULTIPLIER) ^ *p;
+  }
+  return seed & 0x7fffffff;
+}
+
+static uint32_t string_add(struct buf *strings, const char *s, size_t len) {
+  uint32_t offset = strings->len;
+
+  if (len == 0) {
+    return 0;
+  }
+  put(strings, s, len);
+  put1(strings, 0);
+  return offset;
+}
+
+static void attr(struct buf *b, int kind, uint64_t value) {
+  int n = 1;
+
+  while (n < 8 && (value >> (n * 8)) != 0) {
+    n++;
+  }
+  put1(b, kind << 3 | (n - 1));
+  for (int i = n - 1; i >= 0; i--) {
+    put1(b, value >> (i * 8));
+  }
+}
+
+static void le4(struct buf *b, uint32_t v) { put(b, &v, 4); }
+
+static void le8(struct buf *b, uint64_t v) { put(b, &v, 8); }
+
+// a jimage of little endian tables: names split as jlink splits them and
+// a perfect hash built the way jlink builds it
+static void write_jimage(const char *path, struct resource *res, int len) {
+  struct buf strings = {0}, locations = {0}, content = {0}, out = {0};
+  int32_t redirect[16] = {0};
+  uint32_t offsets[16] = {0}, slots[16];
+  bool used[16] = {false};
+  FILE *f;
+
+  put1(&strings, 0);
+  for (int i = 0; i < len; i++) {
+    const char *name = res[i].name, *module = name + 1;
+    const char *slash = strchr(module, '/'), *last = strrchr(name, '/');
+    const char *dot = strrchr(name, '.');
+    const char *base = last + 1;
+    struct buf data = res[i].content;
+
+    if (dot < last) {
+      dot = NULL;
+    }
+    slots[i] = locations.len;
+    attr(&locations, 1, string_add(&strings, module, slash - module));
+    if (last > slash) {
+      attr(&locations, 2, string_add(&strings, slash + 1, last - slash - 1));
+    }
+    attr(&locations, 3,
+         string_add(&strings, base, dot ? dot - base : strlen(base)));
+    if (dot != NULL) {
+      attr(&locations, 4, string_add(&strings, dot + 1, strlen(dot + 1)));
+    }
+    attr(&locations, 5, content.len);
+    if (res[i].zip) {
+      struct buf header = {0};
+      uLongf zlen = compressBound(data.len);
+      unsigned char *z = malloc(zlen);
+
+      compress(z, &zlen, data.data, data.len);
+      le4(&header, 0xcafefafa);
+      le8(&header, zlen);
+      le8(&header, data.len);
+      le4(&header, string_add(&strings, "zip", 3));
+      le4(&header, 0);
+      put1(&header, 1);
+      put(&header, z, zlen);
+      free(z);
+      attr(&locations, 6, header.len);
+      put(&content, header.data, header.len);
+      free(header.data);
+    } else {
+      put(&content, data.data, data.len);
+    }
+    attr(&locations, 7, data.len);
+    put1(&locations, 0);
+  }
+
+  // colliding names get a seed, single ones their slot
+  for (int b = 0; b < len; b++) {
+    int in[16], n = 0;
+
+    for (int i = 0; i < len; i++) {
+      if (hash(res[i].name, HASH_MULTIPLIER) % len == (uint32_t)b) {
+        in[n++] = i;
+      }
+    }
+    for (int32_t seed = 1; n > 1; seed++) {
+      bool taken[16];
+      bool ok = true;
+
+      memcpy(taken, used, sizeof(taken));
+      for (int j = 0; j < n && ok; j++) {
+        uint32_t s = hash(res[in[j]].name, seed) % len;
+        ok = !taken[s];
+        taken[s] = true;
+      }
+      if (ok) {
+        for (int j = 0; j < n; j++) {
+          offsets[hash(res[in[j]].name, seed) % len] = slots[in[j]];
+        }
+        memcpy(used, taken, sizeof(used));
+        redirect[b] = seed;
+        break;
+      }
+    }
+  }
+  for (int b = 0; b < len; b++) {
+    for (int i = 0; i < len; i++) {
+      int s = 0;
+
+      if (hash(res[i].name, HASH_MULTIPLIER) % len != (uint32_t)b ||
+          redirect[b] != 0) {
+        continue;
+      }
+      while (used[s]) {
+        s++;
+      }
+      used[s] = true;
+      offsets[s] = slots[i];
+      redirect[b] = -1 - s;
+    }
+  }
+
+  le4(&out, 0xcafedada);
+  le4(&out, 1 << 16);
+  le4(&out, 0);
+  le4(&out, len);
+  le4(&out, len);
+  le4(&out, locations.len);
+  le4(&out, strings.len);
+  for (int i = 0; i < len; i++) {
+    le4(&out, redirect[i]);
+  }
+  for (int i = 0; i < len; i++) {
+    le4(&out, offsets[i]);
+  }
+  put(&out, locations.data, locations.len);
+  put(&out, strings.data, strings.len);
+  put(&out, content.data, content.len);
+
+  f = fopen(path, "wb");
+  fwrite(out.data, 1, out.len, f);
+  fclose(f);
+  free(strings.data);
+  free(locations.data);
+  free(content.data);
+  free(out.data);
+}
+
+static struct buf text(const char *s) {
+  struct buf b = {0};
+  put(&b, s, strlen(s));
+  return b;
+}
+
+static void write_test_image(void) {
+  struct buf refs = {0};
+  struct resource res[] = {
+      {"/java.base/module-info.class", module_info("java.base", true), true},
+      {"/java.sql/module-info.class", module_info("java.sql", false), false},
+      {"/java.base/java/lang/Object.class", text("object"), false},
+      {"/java.sql/java/sql/Driver.class", text("driver"), true},
+      {"/java.base/META-INF/MANIFEST", text("no extension"), false},
+      {"/packages/java.lang", {0}, false},
+  };
+
+  // is empty and module name of the package, the string table of the
+  // image starts with "" then the names of the first location
+  le4(&refs, 0);
+  le4(&refs, 1);
+  res[5].content = refs;
+
+  mkdir(TEST_HOME, 0755);
+  mkdir(TEST_HOME "/lib", 0755);
+  write_jimage(TEST_HOME "/lib/modules", res, 6);
+  for (int i = 0; i < 6; i++) {
+    free(res[i].content.data);
+  }
+}
+
+UTEST_MAIN();
+
+UTEST(jimage, lookup) {
+  struct jimage img;
+  struct jimage_location loc;
+  char name[256];
+  unsigned char *data;
+  uint32_t index = 0;
+  size_t len;
+  int count = 0;
+
+  write_test_image();
+  ASSERT_TRUE(jimage_open(&img, TEST_HOME "/lib/modules"));
+
+  ASSERT_TRUE(jimage_find(&img, "/java.base/java/lang/Object.class", &loc));
+  ASSERT_STREQ("java.base", loc.module);
+  ASSERT_STREQ("java/lang", loc.parent);
+  ASSERT_STREQ("Object", loc.base);
+  ASSERT_STREQ("class", loc.extension);
+  data = jimage_read(&img, &loc, &len);
+  ASSERT_EQ(6u, len);
+  ASSERT_STREQ("object", (char *)data);
+  free(data);
+
+  // a name hashing to a used slot is told apart by the location
+  ASSERT_FALSE(jimage_find(&img, "/java.base/java/lang/Objects.class", &loc));
+  ASSERT_FALSE(jimage_find(&img, "/java.sql/java/lang/Object.class", &loc));
+  ASSERT_TRUE(jimage_find(&img, "/java.base/META-INF/MANIFEST", &loc));
+
+  // compressed with zip
+  ASSERT_TRUE(jimage_find(&img, "/java.sql/java/sql/Driver.class", &loc));
+  ASSERT_NE(0u, loc.compressed);
+  data = jimage_read(&img, &loc, &len);
+  ASSERT_STREQ("driver", (char *)data);
+  free(data);
+
+  while (jimage_next(&img, &index, &loc)) {
+    ASSERT_LT(jimage_name(&loc, name, sizeof(name)), sizeof(name));
+    ASSERT_TRUE(jimage_find(&img, name, &loc));
+    count++;
+  }
+  ASSERT_EQ(6, count);
+
+  ASSERT_STREQ("java.base", jimage_package_module(&img, "java/lang"));
+  ASSERT_TRUE(jimage_package_module(&img, "java.util") == NULL);
+  ASSERT_TRUE(jimage_find_class(&img, "java/lang/Object.class", &loc));
+  ASSERT_FALSE(jimage_find_class(&img, "java/lang/String.class", &loc));
+  jimage_close(&img);
+
+  ASSERT_FALSE(jimage_open(&img, "/proc/self/status"));
+}
+
+UTEST(jimage, modules) {
+  struct yj_java_runtime runtime = {0};
+  struct modules_image image;
+
+  write_test_image();
+  runtime.home = TEST_HOME;
+  runtime.major_version = 21;
+  ASSERT_TRUE(modules_load(&runtime, &image));
+  ASSERT_EQ(2u, image.len);
+  ASSERT_STREQ("java.base", image.mods[0].name);
+  ASSERT_STREQ("21.0.2", image.mods[0].version);
+  ASSERT_STREQ("java.sql", image.mods[1].name);
+
+  // java.sql requires java.logging, not in the image
+  ASSERT_FALSE(modules_validate(&image));
+  modules_free(&image);
+
+  runtime.major_version = 8;
+  ASSERT_FALSE(modules_load(&runtime, &image));
+}
@@ -0,0 +1,580 @@
+#include "../yajava.h"
+#include "../internal.h"
+#include "../zip.h"
+#include "utest.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+// from yajava.c
+bool jar_manifest_value(const char *manifest, const char *key, char *out,
+                        size_t maxlen);
+int jar_class_release(const unsigned char *head, size_t len);
+char *jar_expand_class_path(const char *jar, const char *class_path);
+bool jar_read_manifest(struct yj_run_args *args);
+bool classindex_fresh(const char *path, uint64_t key, char **paths,
+                      size_t len);
+bool classindex_build(const char *path, uint64_t key, char **paths,
+                      size_t len);
+uint64_t pack_key(char **paths, size_t len);
+bool pack_file(uint64_t key, const char *ext, char *out, size_t maxlen,
+               bool create);
+char *pack_lookup(struct yj_run_args *args, int len);
+int pack_open(struct pack *pk, char **paths, int len, struct stat *sts);
+char *pack_class_path(struct pack *pk, char **paths, int first,
+                      const char *jar);
+struct pack_entry *pack_find(struct pack *pk, const char *name, size_t len);
+void pack_insert(struct pack *pk, uint32_t jar, struct zip_entry *entry);
+bool pack_write_index(const char *path, uint64_t key, struct pack *pk,
+                      char **paths, struct stat *sts, const char *jar,
+                      const char *class_path);
+
+struct test_entry {
+  const char *name;
+  const void *data;
+  size_t len;
+  int method;
+};
+
+static void put16(FILE *f, uint16_t v) {
+  fputc(v & 0xff, f);
+  fputc(v >> 8, f);
+}
+
+static void put32(FILE *f, uint32_t v) {
+  put16(f, v & 0xffff);
+  put16(f, v >> 16);
+}
+
+// a minimal zip writer, just enough to produce test jars
+static void write_zip(const char *path, struct test_entry *entries,
+                      size_t len) {
+  FILE *f = fopen(path, "wb");
+  long offsets[16];
+  unsigned char *packed[16];
+  size_t packed_len[16];
+  long cd_start, cd_end;
+
+  for (size_t i = 0; i < len; i++) {
+    struct test_entry *e = &entries[i];
+    uint32_t crc = crc32(0, e->data, e->len);
+
+    if (e->method == ZIP_DEFLATED) {
+      z_stream zs = {0};
+      packed[i] = malloc(e->len + 64);
+      deflateInit2(&zs, 9, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+      zs.next_in = (Bytef *)e->data;
+      zs.avail_in = e->len;
+      zs.next_out = packed[i];
+      zs.avail_out = e->len + 64;
+      deflate(&zs, Z_FINISH);
+      packed_len[i] = zs.total_out;
+      deflateEnd(&zs);
+    } else {
+      packed[i] = malloc(e->len);
+      memcpy(packed[i], e->data, e->len);
+      packed_len[i] = e->len;
+    }
+
+    offsets[i] = ftell(f);
+    put32(f, 0x04034b50);
+    put16(f, 20);
+    put16(f, 0);
+    put16(f, e->method);
+    put32(f, 0);
+    put32(f, crc);
+    put32(f, packed_len[i]);
+    put32(f, e->len);
+    put16(f, strlen(e->name));
+    put16(f, 0);
+    fwrite(e->name, 1, strlen(e->name), f);
+    fwrite(packed[i], 1, packed_len[i], f);
+  }
+
+  cd_start = ftell(f);
+  for (size_t i = 0; i < len; i++) {
+    struct test_entry *e = &entries[i];
+    put32(f, 0x02014b50);
+    put16(f, 20);
+    put16(f, 20);
+    put16(f, 0);
+    put16(f, e->method);
+    put32(f, 0);
+    put32(f, crc32(0, e->data, e->len));
+    put32(f, packed_len[i]);
+    put32(f, e->len);
+    put16(f, strlen(e->name));
+    put16(f, 0);
+    put16(f, 0);
+    put16(f, 0);
+    put16(f, 0);
+    put32(f, 0);
+    put32(f, offsets[i]);
+    fwrite(e->name, 1, strlen(e->name), f);
+    free(packed[i]);
+  }
+  cd_end = ftell(f);
+
+  put32(f, 0x06054b50);
+  put16(f, 0);
+  put16(f, 0);
+  put16(f, len);
+  put16(f, len);
+  put32(f, cd_end - cd_start);
+  put32(f, cd_start);
+  put16(f, 0);
+  fclose(f);
+}
+
+static const char manifest[] =
+    "Manifest-Version: 1.0\r\n"
+    "Main-Class: com.example.a.rather.long.package.name.which.gets.wrapp\r\n"
+    " ed.Main\r\n"
+    "Created-By: 21 (Oracle Corporation)\r\n"
+    "\r\n"
+    "Name: com/example/\r\n"
+    "Class-Path: ignored.jar\r\n";
+
+static const unsigned char class_17[] = {0xca, 0xfe, 0xba, 0xbe, 0,
+                                         0,    0,    61,   0,    10};
+
+UTEST_MAIN();
+
+UTEST(zip, read_entries) {
+  char path[] = "/tmp/yajava_test_zipXXXXXX";
+  struct zip zip;
+  struct zip_entry entry;
+  unsigned char head[8];
+  char *data;
+  size_t len;
+
+  struct test_entry entries[] = {
+      {"META-INF/MANIFEST.MF", manifest, strlen(manifest), ZIP_DEFLATED},
+      {"com/example/Main.class", class_17, sizeof(class_17), ZIP_STORED}};
+
+  close(mkstemp(path));
+  write_zip(path, entries, 2);
+
+  ASSERT_TRUE(zip_open(&zip, path));
+  ASSERT_EQ(zip.entries, 2);
+
+  ASSERT_TRUE(zip_find(&zip, "META-INF/MANIFEST.MF", &entry));
+  ASSERT_EQ(entry.method, ZIP_DEFLATED);
+  data = zip_read(&zip, &entry, &len);
+  ASSERT_TRUE(data != NULL);
+  ASSERT_EQ(len, strlen(manifest));
+  ASSERT_STREQ(data, manifest);
+  free(data);
+
+  ASSERT_TRUE(zip_find(&zip, "com/example/Main.class", &entry));
+  ASSERT_EQ(zip_read_head(&zip, &entry, head, sizeof(head)), 8);
+  ASSERT_EQ(jar_class_release(head, 8), 17);
+
+  ASSERT_FALSE(zip_find(&zip, "com/example/Other.class", &entry));
+
+  zip_close(&zip);
+  unlink(path);
+}
+
+UTEST(zip, write_stored) {
+  char path[] = "/tmp/yajava_test_zipXXXXXX";
+  struct zip_writer w;
+  struct zip zip;
+  struct zip_entry entry;
+  size_t pos = 0, len;
+  char name[32];
+  char *data;
+
+  close(mkstemp(path));
+  ASSERT_TRUE(zip_writer_open(&w, path));
+  ASSERT_TRUE(zip_writer_add(&w, "META-INF/MANIFEST.MF", 20, manifest,
+                             strlen(manifest)));
+  ASSERT_TRUE(zip_writer_add(&w, "com/example/", 12, "", 0));
+  ASSERT_TRUE(zip_writer_add(&w, "com/example/Main.class", 22, class_17,
+                             sizeof(class_17)));
+  ASSERT_TRUE(zip_writer_close(&w));
+
+  // entries in the order they were added
+  ASSERT_TRUE(zip_open(&zip, path));
+  ASSERT_EQ(zip.entries, 3);
+  ASSERT_TRUE(zip_next(&zip, &pos, &entry));
+  ASSERT_TRUE(zip_entry_is(&entry, "META-INF/MANIFEST.MF"));
+  ASSERT_EQ(entry.method, ZIP_STORED);
+  ASSERT_EQ(entry.crc, crc32(0, (const Bytef *)manifest, strlen(manifest)));
+  data = zip_read(&zip, &entry, &len);
+  ASSERT_STREQ(data, manifest);
+  free(data);
+  ASSERT_TRUE(zip_next(&zip, &pos, &entry));
+  ASSERT_TRUE(zip_entry_is(&entry, "com/example/"));
+  ASSERT_EQ(entry.usize, 0);
+  ASSERT_TRUE(zip_next(&zip, &pos, &entry));
+  ASSERT_TRUE(zip_entry_is(&entry, "com/example/Main.class"));
+  ASSERT_EQ(memcmp(zip_data(&zip, &entry), class_17, sizeof(class_17)), 0);
+  ASSERT_FALSE(zip_next(&zip, &pos, &entry));
+  zip_close(&zip);
+
+  // more entries than the end record counts, zip64
+  ASSERT_TRUE(zip_writer_open(&w, path));
+  for (int i = 0; i < 70000; i++) {
+    snprintf(name, sizeof(name), "c/C%d.class", i);
+    ASSERT_TRUE(zip_writer_add(&w, name, strlen(name), name, strlen(name)));
+  }
+  ASSERT_TRUE(zip_writer_close(&w));
+  ASSERT_TRUE(zip_open(&zip, path));
+  ASSERT_EQ(zip.entries, 70000);
+  ASSERT_TRUE(zip_find(&zip, "c/C69999.class", &entry));
+  data = zip_read(&zip, &entry, &len);
+  ASSERT_STREQ(data, "c/C69999.class");
+  free(data);
+  zip_close(&zip);
+  unlink(path);
+}
+
+UTEST(classindex, build) {
+  char jar1[] = "/tmp/yajava_test_zipXXXXXX";
+  char jar2[] = "/tmp/yajava_test_zipXXXXXX";
+  char path[] = "/tmp/yajava_test_zipXXXXXX";
+  char *paths[] = {jar1, jar2};
+  struct timespec times[2] = {{0, UTIME_OMIT}, {1600000000, 0}};
+  struct stat st;
+
+  struct test_entry entries1[] = {
+      {"com/example/Main.class", class_17, sizeof(class_17), ZIP_STORED},
+      {"META-INF/versions/11/com/example/Main.class", class_17,
+       sizeof(class_17), ZIP_STORED}};
+  struct test_entry entries2[] = {
+      {"com/example/Util.class", class_17, sizeof(class_17), ZIP_DEFLATED},
+      {"org/other/Other.class", class_17, sizeof(class_17), ZIP_STORED}};
+
+  close(mkstemp(jar1));
+  close(mkstemp(jar2));
+  close(mkstemp(path));
+  write_zip(jar1, entries1, 2);
+  write_zip(jar2, entries2, 2);
+
+  ASSERT_FALSE(classindex_fresh(path, 42, paths, 2));
+  ASSERT_TRUE(classindex_build(path, 42, paths, 2));
+  ASSERT_TRUE(classindex_fresh(path, 42, paths, 2));
+  ASSERT_FALSE(classindex_fresh(path, 43, paths, 2));
+  ASSERT_FALSE(classindex_fresh(path, 42, paths, 1));
+  ASSERT_EQ(stat(path, &st), 0);
+  ASSERT_TRUE(st.st_size > 0);
+
+  // a changed jar makes it stale
+  utimensat(AT_FDCWD, jar2, times, 0);
+  ASSERT_FALSE(classindex_fresh(path, 42, paths, 2));
+
+  unlink(jar1);
+  unlink(jar2);
+  unlink(path);
+}
+
+UTEST(which, class_path) {
+  char jar1[] = "/tmp/yajava_test_zipXXXXXX";
+  char jar2[] = "/tmp/yajava_test_zipXXXXXX";
+  char cp[64];
+  char *found[] = {"com.example.Main", "org/other/Other.class"};
+  char *missing[] = {"com.example.Main", "com.example.Missing"};
+  char *arg[] = {"-cp", cp};
+  struct yj_java_runtime runtime = {0};
+  struct yj_run_args args;
+  int exit_code = -1;
+
+  struct test_entry entries1[] = {
+      {"com/example/Main.class", class_17, sizeof(class_17), ZIP_STORED}};
+  struct test_entry entries2[] = {
+      {"com/example/Main.class", class_17, sizeof(class_17), ZIP_DEFLATED},
+      {"org/other/Other.class", class_17, sizeof(class_17), ZIP_STORED}};
+
+  close(mkstemp(jar1));
+  close(mkstemp(jar2));
+  write_zip(jar1, entries1, 1);
+  write_zip(jar2, entries2, 2);
+  snprintf(cp, sizeof(cp), "%s:%s", jar1, jar2);
+  runtime.home = "/nonexistent";
+  runtime.major_version = 21;
+  ASSERT_EQ(0, yj_parse_run_args(2, arg, &args));
+
+  ASSERT_EQ(0, yj_which_class(&runtime, &args, found, 2, &exit_code));
+  ASSERT_EQ(0, exit_code);
+  ASSERT_EQ(0, yj_which_class(&runtime, &args, missing, 2, &exit_code));
+  ASSERT_EQ(1, exit_code);
+  ASSERT_EQ(0, yj_which_class(&runtime, &args, NULL, 0, &exit_code));
+  ASSERT_EQ(0, exit_code);
+
+  yj_free_run_args(&args);
+  unlink(jar1);
+  unlink(jar2);
+}
+
+UTEST(zip, not_a_zip) {
+  struct zip zip;
+  ASSERT_FALSE(zip_open(&zip, "/nonexistent.jar"));
+  ASSERT_FALSE(zip_open(&zip, "/proc/self/status"));
+}
+
+UTEST(jar, manifest_value) {
+  char value[256];
+
+  ASSERT_TRUE(jar_manifest_value(manifest, "Main-Class", value, 256));
+  ASSERT_STREQ(value,
+               "com.example.a.rather.long.package.name.which.gets.wrapped.Main");
+  ASSERT_TRUE(jar_manifest_value(manifest, "created-by", value, 256));
+  ASSERT_STREQ(value, "21 (Oracle Corporation)");
+
+  // attributes of per-entry sections are not main attributes
+  ASSERT_FALSE(jar_manifest_value(manifest, "Class-Path", value, 256));
+  ASSERT_FALSE(jar_manifest_value(manifest, "Main-Class", value, 8));
+}
+
+UTEST(jar, class_release) {
+  const unsigned char java8[] = {0xca, 0xfe, 0xba, 0xbe, 0, 0, 0, 52};
+  const unsigned char bad[] = {0xca, 0xfe, 0xba, 0xbf, 0, 0, 0, 52};
+
+  ASSERT_EQ(jar_class_release(java8, 8), 8);
+  ASSERT_EQ(jar_class_release(bad, 8), 0);
+  ASSERT_EQ(jar_class_release(java8, 4), 0);
+}
+
+UTEST(jar, expand_class_path) {
+  char dir[] = "/tmp/yajava_test_cpXXXXXX";
+  char jar[PATH_MAX], lib[PATH_MAX], spaced[PATH_MAX], expect[PATH_MAX * 3];
+  char *cp;
+
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  snprintf(jar, sizeof(jar), "%s/app.jar", dir);
+  snprintf(lib, sizeof(lib), "%s/lib", dir);
+  mkdir(lib, 0755);
+  snprintf(lib, sizeof(lib), "%s/lib/a.jar", dir);
+  snprintf(spaced, sizeof(spaced), "%s/b c.jar", dir);
+  close(open(lib, O_CREAT | O_WRONLY, 0644));
+  close(open(spaced, O_CREAT | O_WRONLY, 0644));
+
+  cp = jar_expand_class_path(jar, "lib/a.jar b%20c.jar missing.jar");
+  snprintf(expect, sizeof(expect), "%s:%s:%s", jar, lib, spaced);
+  ASSERT_STREQ(cp, expect);
+  free(cp);
+
+  cp = jar_expand_class_path(jar, NULL);
+  ASSERT_STREQ(cp, jar);
+  free(cp);
+
+  // remote urls are left to the class loader
+  ASSERT_TRUE(jar_expand_class_path(jar, "http://example.com/a.jar") == NULL);
+
+  unlink(lib);
+  unlink(spaced);
+  snprintf(lib, sizeof(lib), "%s/lib", dir);
+  rmdir(lib);
+  rmdir(dir);
+}
+
+UTEST(jar, read_manifest) {
+  char path[] = "/tmp/yajava_test_mfXXXXXX";
+  static const char agent[] = "Manifest-Version: 1.0\r\n"
+                              "Main-Class: app.Main\r\n"
+                              "Launcher-Agent-Class: app.Agent\r\n"
+                              "\r\n";
+  static const char opens[] = "Manifest-Version: 1.0\r\n"
+                              "Main-Class: app.Main\r\n"
+                              "Add-Opens: java.base/java.lang\r\n"
+                              "\r\n";
+  struct test_entry entries[] = {
+      {"META-INF/MANIFEST.MF", opens, strlen(opens), ZIP_STORED}};
+  struct yj_run_args args;
+  char *argv[] = {"-jar", path};
+
+  close(mkstemp(path));
+  write_zip(path, entries, 1);
+  yj_parse_run_args(2, argv, &args);
+  ASSERT_TRUE(jar_read_manifest(&args));
+  ASSERT_STREQ(args.manifest->main_class, "app.Main");
+  ASSERT_STREQ(args.manifest->add_opens, "java.base/java.lang");
+  ASSERT_STREQ(args.manifest->java_class_path, path);
+  ASSERT_TRUE(args.manifest->native);
+  yj_free_run_args(&args);
+
+  // an agent in the vm needs LauncherHelper
+  entries[0].data = agent;
+  entries[0].len = strlen(agent);
+  entries[0].method = ZIP_DEFLATED;
+  write_zip(path, entries, 1);
+  yj_parse_run_args(2, argv, &args);
+  ASSERT_TRUE(jar_read_manifest(&args));
+  ASSERT_STREQ(args.manifest->launcher_agent, "app.Agent");
+  ASSERT_FALSE(args.manifest->native);
+  yj_free_run_args(&args);
+
+  unlink(path);
+}
+
+static void pack_close(struct pack *pk) {
+  for (size_t i = 0; i < pk->jars_len; i++) {
+    zip_close(&pk->jars[i]);
+  }
+  free(pk->jars);
+  free(pk->merged);
+  free(pk->entries);
+  free(pk->slots);
+  memset(pk, 0, sizeof(struct pack));
+}
+
+UTEST(pack, precedence) {
+  char jar1[] = "/tmp/yajava_test_packXXXXXX";
+  char jar2[] = "/tmp/yajava_test_packXXXXXX";
+  char jar3[] = "/tmp/yajava_test_packXXXXXX";
+  char dir[] = "/tmp/yajava_test_packXXXXXX";
+  char cp[256];
+  struct pack pk = {0};
+  struct pack_entry *e;
+  struct zip_entry entry;
+  struct stat sts[3];
+  char *cp_kept[] = {jar1, jar2, jar3};
+  char *cp_dir[] = {jar1, dir, jar3};
+  char *cp_dir_first[] = {dir, jar1, jar3};
+  char *class_path;
+
+  struct test_entry entries1[] = {
+      {"a/A.class", class_17, sizeof(class_17), ZIP_STORED}};
+  struct test_entry signed_entries[] = {
+      {"META-INF/SIGNER.SF", "", 0, ZIP_STORED},
+      {"b/B.class", class_17, sizeof(class_17), ZIP_STORED}};
+  struct test_entry entries3[] = {
+      {"b/B.class", class_17, sizeof(class_17), ZIP_DEFLATED},
+      {"c/C.class", class_17, sizeof(class_17), ZIP_STORED}};
+
+  close(mkstemp(jar1));
+  close(mkstemp(jar2));
+  close(mkstemp(jar3));
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  write_zip(jar1, entries1, 1);
+  write_zip(jar2, signed_entries, 2);
+  write_zip(jar3, entries3, 2);
+
+  // a signed jar stays on the class path and shadows the later jars
+  ASSERT_EQ(0, pack_open(&pk, cp_kept, 3, sts));
+  ASSERT_TRUE(pk.merged[0]);
+  ASSERT_FALSE(pk.merged[1]);
+  ASSERT_TRUE(pk.merged[2]);
+  pk.slots_len = 16;
+  pk.slots = calloc(pk.slots_len, sizeof(uint32_t));
+  pk.entries = calloc(8, sizeof(struct pack_entry));
+  for (int i = 0; i < 3; i++) {
+    size_t pos = 0;
+    while (zip_next(&pk.jars[i], &pos, &entry)) {
+      pack_insert(&pk, i, &entry);
+    }
+  }
+  ASSERT_TRUE((e = pack_find(&pk, "b/B.class", 9)) != NULL);
+  ASSERT_EQ(1u, e->jar);
+  ASSERT_TRUE(e->kept);
+  ASSERT_TRUE((e = pack_find(&pk, "c/C.class", 9)) != NULL);
+  ASSERT_EQ(2u, e->jar);
+  ASSERT_FALSE(e->kept);
+  class_path = pack_class_path(&pk, cp_kept, 0, "/pack.jar");
+  snprintf(cp, sizeof(cp), "/pack.jar:%s", jar2);
+  ASSERT_STREQ(cp, class_path);
+  free(class_path);
+  pack_close(&pk);
+
+  // the jars after a directory that follows a merged jar are not merged
+  ASSERT_EQ(0, pack_open(&pk, cp_dir, 3, sts));
+  ASSERT_TRUE(pk.merged[0]);
+  ASSERT_FALSE(pk.merged[1]);
+  ASSERT_FALSE(pk.merged[2]);
+  ASSERT_TRUE(pk.jars[2].map == NULL);
+  class_path = pack_class_path(&pk, cp_dir, 0, "/pack.jar");
+  snprintf(cp, sizeof(cp), "/pack.jar:%s:%s", dir, jar3);
+  ASSERT_STREQ(cp, class_path);
+  free(class_path);
+  pack_close(&pk);
+
+  // a directory in front of all of them stays in front of the pack
+  ASSERT_EQ(1, pack_open(&pk, cp_dir_first, 3, sts));
+  ASSERT_TRUE(pk.merged[2]);
+  class_path = pack_class_path(&pk, cp_dir_first, 1, "/pack.jar");
+  snprintf(cp, sizeof(cp), "%s:/pack.jar", dir);
+  ASSERT_STREQ(cp, class_path);
+  free(class_path);
+  pack_close(&pk);
+
+  cp_dir[1] = "/nonexistent";
+  ASSERT_EQ(-2, pack_open(&pk, cp_dir, 3, sts));
+  pack_close(&pk);
+
+  unlink(jar1);
+  unlink(jar2);
+  unlink(jar3);
+  rmdir(dir);
+}
+
+UTEST(pack, lookup) {
+  char jar1[] = "/tmp/yajava_test_packXXXXXX";
+  char jar2[] = "/tmp/yajava_test_packXXXXXX";
+  char cache[] = "/tmp/yajava_test_cacheXXXXXX";
+  char jar_path[PATH_MAX], index_path[PATH_MAX];
+  char cp[128];
+  char *arg[] = {"-cp", cp};
+  struct timespec times[2] = {{0, UTIME_OMIT}, {1600000000, 0}};
+  struct yj_run_args args;
+  struct pack pk = {0};
+  struct stat sts[2];
+  char *class_path, *found;
+  uint64_t key;
+
+  struct test_entry entries[] = {
+      {"a/A.class", class_17, sizeof(class_17), ZIP_STORED}};
+
+  close(mkstemp(jar1));
+  close(mkstemp(jar2));
+  ASSERT_TRUE(mkdtemp(cache) != NULL);
+  setenv("YAJAVA_CACHE_DIR", cache, 1);
+  write_zip(jar1, entries, 1);
+  write_zip(jar2, entries, 1);
+  snprintf(cp, sizeof(cp), "%s:%s", jar1, jar2);
+  ASSERT_EQ(0, yj_parse_run_args(2, arg, &args));
+
+  key = pack_key(args.classpathes, 2);
+  ASSERT_TRUE(pack_file(key, ".jar", jar_path, PATH_MAX, true));
+  ASSERT_TRUE(pack_file(key, ".idx", index_path, PATH_MAX, false));
+  ASSERT_TRUE(pack_lookup(&args, 2) == NULL);
+
+  write_zip(jar_path, entries, 1);
+  ASSERT_EQ(0, pack_open(&pk, args.classpathes, 2, sts));
+  class_path = pack_class_path(&pk, args.classpathes, 0, jar_path);
+  ASSERT_TRUE(pack_write_index(index_path, key, &pk, args.classpathes, sts,
+                               jar_path, class_path));
+  pack_close(&pk);
+
+  // used while the sources are unchanged, for the same class path only
+  ASSERT_TRUE((found = pack_lookup(&args, 2)) != NULL);
+  ASSERT_STREQ(class_path, found);
+  free(found);
+  ASSERT_TRUE(pack_lookup(&args, 1) == NULL);
+  setenv("YAJAVA_PACK", "off", 1);
+  ASSERT_TRUE(pack_lookup(&args, 2) == NULL);
+  unsetenv("YAJAVA_PACK");
+
+  // a changed jar makes it stale
+  utimensat(AT_FDCWD, jar2, times, 0);
+  ASSERT_TRUE(pack_lookup(&args, 2) == NULL);
+
+  free(class_path);
+  yj_free_run_args(&args);
+  unlink(jar_path);
+  unlink(index_path);
+  unlink(jar1);
+  unlink(jar2);
+  unsetenv("YAJAVA_CACHE_DIR");
+}
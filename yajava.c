@@ -1,21 +1,42 @@
 #include "yajava.h"
+#include "internal.h"
+#include "jimage.h"
 #include "trace.h"
+#include "zip.h"
 
 #include <assert.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
+#include <ctype.h>
 #include <dirent.h>
+#include <errno.h>
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <unistd.h>
 
-#include <sys/shm.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#ifdef __linux__
+#include <elf.h>
+#include <sys/syscall.h>
+#endif
+
 #include <jni.h>
 #include <jni_md.h>
 
@@ -38,6 +59,7 @@
 #define JNI_VERSION_19 0x00130000
 #define JNI_VERSION_20 0x00140000
 #define JNI_VERSION_21 0x00150000
+#define JNI_VERSION_24 0x00180000
 
 /*
   some useful java property keys, used by java -XshowSettings
@@ -70,16 +92,27 @@
 #ifdef __linux__
 // clang-format off
 #define LIB_JVM_PATH                                                           \
-  "%s/lib/server/libjvm.so",                                                   \
-  "%s/lib/amd64/server/libjvm.so",                                             \
-  "%s/jre/lib/amd64/server/libjvm.so"
+  "lib/server/libjvm.so",                                                      \
+  "lib/amd64/server/libjvm.so",                                                \
+  "jre/lib/amd64/server/libjvm.so"
+#define DISCOVERY_ROOTS                                                        \
+  "/usr/lib/jvm",                                                              \
+  "/opt",                                                                      \
+  "~/.sdkman/candidates/java",                                                 \
+  "~/.jdks"
 // clang-format on
 #elif __APPLE__
 // clang-format off
 #define LIB_JVM_PATH                                                           \
-  "%s/lib/server/libjvm.dylib",                                                \
-  "%s/jre/lib/server/libjvm.dylib"
+  "lib/server/libjvm.dylib",                                                   \
+  "jre/lib/server/libjvm.dylib"
+#define DISCOVERY_ROOTS                                                        \
+  "/Library/Java/JavaVirtualMachines",                                         \
+  "~/Library/Java/JavaVirtualMachines",                                        \
+  "~/.sdkman/candidates/java",                                                 \
+  "~/.jdks"
 // clang-format on
+#define MACOS_BUNDLE_HOME "Contents/Home"
 #else
 #error platform not supported yet
 #endif
@@ -90,6 +123,91 @@
 #define FILE_PATH_SEPRATOR '/'
 #endif
 
+#define RELEASE_FILE "release"
+#define RELEASE_MAXLEN 16384
+
+#define PROBE_TIMEOUT_MS 10000
+#define JVM_ARGS_FRAME 256 // local references per frame of main args
+#define DISCOVERY_DEPTH 2
+
+#define CONFIG_DIR_NAME "yajava"
+#define CONFIG_FILE "yajava.conf"
+#define CONFIG_JAVA_VERSION_FILE ".java-version"
+#define CONFIG_MAXLEN 65536
+
+#define CACHE_DIR_NAME "yajava"
+
+#define PLAN_DIR "plans"
+#define PLAN_MAGIC 0x504c4a59 // "YJLP"
+#define PLAN_VERSION 2
+
+#define ARCHIVE_DIR "archives"
+#define ARCHIVE_MIN_DYNAMIC 13 // -XX:ArchiveClassesAtExit
+#define ARCHIVE_MIN_AOT 24     // -XX:AOTMode, JEP 483
+#define ARCHIVE_BASE_PREFIX "base-"
+#define ARCHIVE_META_EXT ".meta"
+#define ARCHIVE_META_MAGIC 0x4d414a59 // YJAM
+#define ARCHIVE_META_VERSION 2
+#define ARCHIVE_MAX_SIZE (1024LL * 1024 * 1024)
+#define ARCHIVE_STALE_US (3600L * 1000000) // unfinished writes
+#define ARCHIVE_APP_MAX 240
+
+#define PREFETCH_DIR "prefetch"
+#define PREFETCH_THREADS 4
+#define PREFETCH_MAX_PROFILE (16 * 1024 * 1024)
+
+#define PRELOAD_DIR "preload"
+#define PRELOAD_MAX_LIST (64 * 1024 * 1024)
+#define PRELOAD_MAX_US (30L * 1000000) // startup is over, helpers give up
+#define PRELOAD_RUNNING 0 // until the list is exhausted
+#define PRELOAD_READY 1   // main returned
+#define PRELOAD_TIMEOUT 2
+
+#define SOURCE_DIR "source"
+#define SOURCE_MAX (16 * 1024 * 1024)
+#define SOURCE_NAME_MAX 512
+#define SOURCE_LAUNCHER "com.sun.tools.javac.launcher.Main" // 11 to 21
+#define SOURCE_LAUNCHER_22 "com.sun.tools.javac.launcher.SourceLauncher"
+
+#define JAR_MANIFEST "META-INF/MANIFEST.MF"
+#define JAR_MANIFEST_MAXLEN (1 << 20)
+#define CLASS_MAGIC 0xcafebabe
+#define CLASS_MAJOR_BASE 44 // major 52 is java 8
+
+#define WILDCARD_DIR "wildcard"
+#define WILDCARD_MAGIC 0x57434a59 // YJCW
+#define WILDCARD_VERSION 2
+#define WILDCARD_DENTS_BUF (64 * 1024)
+#define WILDCARD_MAX_CACHE (64 * 1024 * 1024)
+
+#define CLASSPATH_DIR "classpath"
+#define CLASSPATH_MAGIC 0x50434a59 // YJCP
+#define CLASSPATH_VERSION 2
+#define CLASSPATH_THREADS 8
+#define CLASSPATH_PARALLEL_MIN 64 // entries before threads pay off
+#define CLASSPATH_MAX_CACHE (16 * 1024 * 1024)
+
+#define PACK_DIR "packs"
+#define PACK_MAGIC 0x4b504a59 // YJPK
+#define PACK_VERSION 2
+#define PACK_JAR_EXT ".jar"
+#define PACK_INDEX_EXT ".idx"
+#define PACK_LOG_EXT ".log"
+#define PACK_MAX_INDEX (64 * 1024 * 1024)
+#define PACK_MAX_LOG (256 * 1024 * 1024)
+#define PACK_SERVICES "META-INF/services/"
+#define PACK_MANIFEST                                                          \
+  "Manifest-Version: 1.0\r\nCreated-By: yajava pack\r\n\r\n"
+
+#define CLASSINDEX_DIR "classindex"
+#define CLASSINDEX_MAGIC 0x58434a59 // YJCX
+#define CLASSINDEX_VERSION 2
+#define CLASSINDEX_THREADS 8
+#define CLASSINDEX_MAX (256 * 1024 * 1024)
+#define CLASSINDEX_LOADER "yajava.IndexClassLoader"
+#define CLASSINDEX_LOADER_CLASS "yajava/IndexClassLoader.class"
+#define CLASSINDEX_LOADER_JAR "yajava-loader.jar"
+
 #define CLASSPATH_BUF_SIZE 32
 #define CLASSPATH_SEPRATOR ":"
 
@@ -123,9 +241,21 @@ bool list_compare_str(void *list_data, void *user_data);
     }                                                                          \
   } while (0)
 
+struct set {
+  size_t len;
+  size_t cap; // a power of two
+  const char **slots;
+};
+void set_init(struct set *set, size_t hint);
+void set_free(struct set *set);
+bool set_add(struct set *set, const char *s);
+
 struct jvm_home_path {
   char home[PATH_MAX];
   char lib_path[PATH_MAX];
+  dev_t dev; // of the home directory, symlinked homes share it
+  ino_t ino;
+  bool via_link; // reached through a symlink
 };
 struct jvm_opt_arr {
   JavaVMOption *opts;
@@ -140,27 +270,600 @@ struct jvm_ipc_runtime { // runtime helper struct for ipc data exchange
   jint jni_version;
   char full_version[100];
   char version[10];
+  char vendor[100];
 };
 
 int jvm_runtime_compare(const void *a, const void *b);
+#define VERSION_PARTS 6
+struct jvm_constraint {
+  enum { CMP_ANY, CMP_EQ, CMP_GT, CMP_GE, CMP_LT, CMP_LE } op;
+  int version[VERSION_PARTS];
+  int version_len;
+  char vendor[64];
+  char home[PATH_MAX]; // a java home given as path
+  char **vmopts;       // preferred in runtimes which support them
+  int vmopts_len;
+};
+bool jvm_parse_constraint(const char *in, struct jvm_constraint *c);
+bool jvm_match_constraint(struct jvm_constraint *c,
+                          struct yj_java_runtime *runtime);
+int jvm_version_split(const char *version, int *parts, int maxlen);
+int jvm_version_compare(const char *v1, const char *v2);
+bool jvm_match_vendor(const char *want, struct yj_java_runtime *runtime);
+bool jvm_explicit_constraint(char *out, size_t maxlen);
+yj_result jvm_select(struct jvm_constraint *c, bool lowest,
+                     struct yj_java_runtime *runtime);
 int jvm_print_version(JNIEnv *env, int version, struct yj_run_args *args);
+bool jvm_print_version_cached(struct yj_java_runtime *runtime,
+                              struct yj_run_args *args);
+bool jvm_version_cacheable(struct yj_run_args *args);
+void jvm_cache_version_props(JNIEnv *env, struct yj_java_runtime *runtime);
 bool jvm_find_lib(char *home, char *lib_path, size_t maxlen);
 bool jvm_bind_init_fn(struct yj_java_init_fn *fn, char *lib_path);
 bool jvm_retrive_version(JNIEnv *env, char **out);
-bool jvm_compair_home_lib_pair(void *list_data, void *user_data);
-void jvm_exec_main_class(struct yj_run_args *args, JNIEnv *env);
+char *jvm_get_sys_props(JNIEnv *env, const char *key);
+bool jvm_compare_home_inode(void *list_data, void *user_data);
+bool jvm_scan_dir(int dirfd, char *path, int depth, int max_depth,
+                  struct list *pairs, bool via_link);
+bool jvm_scan_home(int dirfd, char *path, struct list *pairs, bool via_link);
+bool jvm_probe_pairs(struct list *pairs, struct yj_discovery *discovery,
+                     int64_t *mtimes, struct yj_java_runtime **out,
+                     size_t *out_len);
+jobjectArray jvm_new_string_array(JNIEnv *env, char **strs, int len);
+int jvm_exec_main_class(struct yj_run_args *args, JNIEnv *env);
+yj_result jvm_module_action(JNIEnv *env, struct yj_run_args *args);
 void jvm_print_args(JavaVMInitArgs *args);
 bool jvm_opt_arr_add(struct jvm_opt_arr *arr, char *opt, char *extra);
 bool jvm_create_runtime(char *home, char *lib_path,
                         struct yj_java_runtime *runtime);
 bool jvm_create_runtime_fork(char *home, char *lib_path,
                              struct yj_java_runtime *runtime);
+struct jvm_probe { // a vm probe running in a child process
+  char *home;
+  char *lib_path;
+  struct yj_java_runtime *runtime;
+  pid_t pid;
+  int fd;
+  long deadline;
+  size_t received;
+  struct jvm_ipc_runtime buf;
+  bool ok;
+};
+size_t jvm_probe_vm_all(struct jvm_probe *probes, size_t len);
+bool jvm_probe_vm_start(struct jvm_probe *probe, long timeout_ms);
+void jvm_probe_vm_child(struct jvm_probe *probe, int fd);
+void jvm_probe_vm_finish(struct jvm_probe *probe, bool timeout);
+bool jvm_probe_static(char *home, char *lib_path,
+                      struct yj_java_runtime *runtime);
+bool jvm_probe_runtime(char *home, char *lib_path,
+                       struct yj_java_runtime *runtime);
+bool jvm_probe_release(char *home, char *lib_path,
+                       struct yj_java_runtime *runtime);
+bool jvm_probe_libjvm(char *home, char *lib_path,
+                      struct yj_java_runtime *runtime);
+void jvm_probe_caps(struct yj_java_runtime *runtime);
+bool jvm_supports_option(struct yj_java_runtime *runtime, const char *opt);
+bool jvm_supports_options(struct jvm_constraint *c,
+                          struct yj_java_runtime *runtime);
+bool jvm_fill_runtime(char *home, char *lib_path, const char *full_version,
+                      const char *vendor, jint jni_version,
+                      struct yj_java_runtime *runtime);
+bool jvm_is_release_string(const char *s, size_t len);
+#ifdef __linux__
+bool jvm_elf_rodata(const char *map, size_t size, const char **start,
+                    const char **end);
+#endif
+int jvm_parse_major_version(const char *full_version, char **version);
+jint jvm_jni_version_of(int major_version);
 jclass jvm_find_main_class(struct yj_run_args *args, JNIEnv *env);
+jclass jvm_load_main_class(JNIEnv *env, const char *name);
+struct jvm_main_ctx { // vm main thread context
+  struct yj_java_runtime *runtime;
+  struct yj_run_args *args;
+  yj_result result;
+};
+void *jvm_main_thread(void *data);
+bool jvm_stack_size(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                    size_t *out);
+void jvm_report_metrics(pid_t pid, int exit_code, long start_us,
+                        struct rusage *usage);
+void JNICALL jvm_exit_hook(jint code);
+bool jvm_args_add(JavaVMInitArgs *args, char *opt);
+long metrics_start_us;
+struct yj_run_args *exit_args; // of the in-process launch, for the exit hook
+
+bool index_open(struct index *idx);
+void index_close(struct index *idx);
+const char *index_str(struct index *idx, uint32_t off);
+struct index_entry *index_find(struct index *idx, const char *home);
+bool index_is_fresh(struct index *idx, struct index_entry *entry);
+void index_release_stat(const char *home, uint64_t *size, int64_t *mtime_ns);
+bool index_load(struct index *idx, struct index_entry *entry,
+                struct yj_java_runtime *runtime);
+uint32_t index_put_str(char *pool, uint32_t *pool_len, const char *s);
+bool index_write(struct yj_java_runtime *runtimes, size_t len,
+                 const char **roots, int64_t *mtimes, size_t roots_len);
+bool index_update(struct index *idx, struct yj_java_runtime *runtimes,
+                  size_t len, struct yj_discovery *discovery, int64_t *mtimes);
+int64_t index_root_mtime(const char *path);
+bool index_roots_fresh(struct index *idx, struct yj_discovery *discovery,
+                       int64_t *mtimes);
+bool index_lookup(struct index *idx, char *home, char *lib_path,
+                  struct yj_java_runtime *runtime);
+
+bool cache_path(const char *name, char *out, size_t maxlen, bool create);
+
+// launch plan, the resolved runtime and vm options of a command line
+//   [header][input * inputs_len][option * options_len][string pool]
+// inputs are files the plan was built from, it is dropped when one changes
+struct plan_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  int64_t build_us; // time the resolution took, what a hit saves
+
+  int32_t major_version;
+  int32_t jni_version;
+  uint32_t gcs;
+  uint32_t features;
+  uint32_t name;
+  uint32_t home;
+  uint32_t libjvm_path;
+  uint32_t version_str;
+  uint32_t full_version;
+  uint32_t vendor;
+  uint32_t arch;
+  uint32_t props;
+
+  uint32_t inputs_len;
+  uint32_t options_len;
+  uint32_t strings_len;
+  uint32_t reserved;
+};
+struct plan_input {
+  int64_t mtime_ns; // zero when the file did not exist
+  uint64_t size;
+  uint32_t path;
+  uint32_t reserved;
+};
+struct yj_plan {
+  uint64_t key;
+  long start_us; // resolution of a miss started
+  char path[PATH_MAX];
+  void *map;
+  size_t size;
+  struct plan_header *header; // NULL on a miss
+  const struct plan_input *inputs;
+  const uint32_t *options;
+  const char *strings;
+};
+uint64_t plan_hash(uint64_t h, const void *data, size_t len);
+uint64_t plan_key(int argc, char **argv);
+const char *plan_str(struct yj_plan *plan, uint32_t off);
+bool plan_open(struct yj_plan *plan);
+void plan_close(struct yj_plan *plan);
+bool plan_vm_args(struct yj_run_args *args, struct yj_java_runtime *runtime,
+                  JavaVMInitArgs *out);
+bool plan_write(struct yj_plan *plan, struct yj_java_runtime *runtime,
+                struct yj_run_args *args, JavaVMInitArgs *vm_args,
+                long build_us);
+
+// per application CDS/AOT archives of --auto-archive
+struct yj_archive {
+  enum {
+    ARCHIVE_USE,    // map the archive
+    ARCHIVE_DUMP,   // dump a dynamic archive at exit
+    ARCHIVE_BASE,   // record the class list of the shared base archive
+    ARCHIVE_RECORD, // record an AOT configuration
+  } mode;
+  bool aot;            // an AOT cache of 24+, a dynamic CDS archive before
+  char path[PATH_MAX]; // the archive
+  char base[PATH_MAX]; // static base layer, empty without archive.base
+  int base_len;        // leading class path entries in the base layer
+  char tmp[PATH_MAX];  // written by this launch, moved to path when done
+  char conf[PATH_MAX]; // AOT configuration or class list of this launch
+  char java[PATH_MAX]; // java of the runtime, assembles AOT cache and base
+  char app[ARCHIVE_APP_MAX];
+  bool done;
+};
+// <archive>.meta
+struct archive_meta {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t hits;
+  int64_t created_us; // wall clock
+  int64_t used_us;
+  char app[ARCHIVE_APP_MAX];
+  char base[32]; // file name of the base layer of a top layer
+};
+bool archive_key(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                 int base_len, uint64_t *base_key, uint64_t *out);
+int archive_base_len(struct yj_run_args *args);
+void archive_prepare(struct yj_java_runtime *runtime, struct yj_run_args *args);
+bool archive_vm_args(struct yj_archive *archive, JavaVMInitArgs *out);
+bool archive_is_mapped(const char *path);
+void archive_finish(struct yj_run_args *args);
+void archive_build(struct yj_run_args *args, char **opts, int opts_len,
+                   int cp_len, const char *path);
+const char *archive_base_name(struct yj_archive *archive);
+bool archive_touch(const char *path, const char *app, const char *base,
+                   bool hit);
+bool archive_touch_meta(const char *meta_path, const char *app,
+                        const char *base, bool hit);
+bool archive_evict(struct yj_archive_info *info);
+bool archive_read_meta(const char *path, struct archive_meta *meta);
+long long archive_max_size();
+int archive_cmp_used(const void *a, const void *b);
+void archive_sharing(struct yj_archive_info *infos, size_t len);
+
+// page cache prefetch, the profile layout is in internal.h
+struct prefetch_cached { // pages of a file cached before the launch
+  unsigned char *vec;
+  off_t size;
+};
+struct yj_prefetch {
+  uint64_t key;
+  char path[PATH_MAX]; // the profile
+  char **files;        // files of this launch
+  size_t files_len;
+  char *profile; // NULL when there is none yet
+  size_t profile_len;
+  bool stale; // record the profile once started, set from the threads
+  bool recorded;
+  struct prefetch_cached *cached; // per file, when recording
+  bool joined;
+  pthread_t threads[PREFETCH_THREADS];
+  size_t threads_len;
+  uint32_t next; // next file of the profile to prefetch
+  size_t pages;
+  size_t cold_pages; // not in the page cache when the launch started
+  size_t ranges;
+  long issue_start_us;
+  long issue_us;
+};
+bool prefetch_start(struct yj_java_runtime *runtime, struct yj_run_args *args);
+bool prefetch_valid(const char *profile, size_t len);
+void prefetch_snapshot(struct yj_prefetch *pf);
+unsigned char *prefetch_mincore(int fd, off_t size, size_t page_size);
+size_t prefetch_ranges(const unsigned char *now, const unsigned char *before,
+                       size_t pages, struct prefetch_range *out);
+const struct prefetch_file *prefetch_old_file(struct yj_prefetch *pf,
+                                              const char *path,
+                                              struct stat *st);
+void *prefetch_thread(void *data);
+size_t prefetch_resident(int fd, off_t off, off_t len, off_t size,
+                         size_t page_size);
+void prefetch_join(struct yj_run_args *args, long create_us);
+bool prefetch_record(struct yj_run_args *args);
+void prefetch_free(struct yj_prefetch *pf);
+
+bool preload_prepare(struct yj_java_runtime *runtime, struct yj_run_args *args);
+bool preload_parse(struct yj_preload *pl);
+int preload_class_cmp(const void *a, const void *b);
+int preload_group_cmp(const void *a, const void *b);
+bool preload_vm_args(struct yj_preload *pl, JavaVMInitArgs *out);
+bool preload_start(struct yj_run_args *args, JavaVM *vm);
+void *preload_thread(void *data);
+void preload_stop(struct yj_preload *pl, int state);
+void preload_join(struct yj_run_args *args);
+void preload_report(struct yj_preload *pl);
+void preload_finish(struct yj_run_args *args);
+void preload_free(struct yj_preload *pl);
+
+bool source_prepare(struct yj_java_runtime *runtime, struct yj_run_args *args);
+bool source_types(const char *src, size_t len, char *main_class, char *pub,
+                  size_t maxlen);
+size_t source_annotation(const char *src, size_t i, size_t len);
+bool source_word(const char *src, size_t start, size_t end, const char *word);
+size_t source_skip(const char *src, size_t i, size_t len);
+bool source_compile(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                    const char *src, size_t len, const char *name,
+                    const char *path);
+char *source_join(char **values, int len, char sep);
+void source_clean(const char *path);
+
+// flags of module-info.class
+#define MODULE_ACC_MODULE 0x8000 // of the class
+#define MODULE_ACC_OPEN 0x0020
+#define MODULE_ACC_TRANSITIVE 0x0020
+#define MODULE_ACC_STATIC_PHASE 0x0040
+#define MODULE_ACC_SYNTHETIC 0x1000
+#define MODULE_ACC_MANDATED 0x8000
+// constant pool tags
+#define MODULE_CP_UTF8 1
+#define MODULE_CP_CLASS 7
+#define MODULE_CP_MODULE 19
+#define MODULE_CP_PACKAGE 20
+struct module_reader { // big endian reads, err once past the end
+  const unsigned char *p;
+  const unsigned char *end;
+  bool err;
+};
+struct module_package {
+  char *name;
+  const char *module;
+};
+uint16_t module_u2(struct module_reader *r);
+uint32_t module_u4(struct module_reader *r);
+void module_skip(struct module_reader *r, size_t n);
+bool module_info_parse(unsigned char *buf, size_t len, struct module_info *mi);
+bool module_info_str(struct module_info *mi, uint16_t index, char *out,
+                     size_t maxlen);
+char **module_info_names(struct module_info *mi, struct module_reader *r,
+                         uint16_t len);
+void module_info_free(struct module_info *mi);
+int module_info_cmp(const void *a, const void *b);
+int module_package_cmp(const void *a, const void *b);
+bool modules_answer(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                    int *exit_code);
+bool modules_load(struct yj_java_runtime *runtime, struct modules_image *mi);
+void modules_free(struct modules_image *mi);
+void modules_list(struct modules_image *mi);
+bool modules_describe(struct module_info *mi);
+bool modules_validate(struct modules_image *mi);
+void modules_flags_str(uint16_t flags, bool requires, char *out,
+                       size_t maxlen);
+void modules_free_names(char **names, size_t len);
+bool source_stock(struct yj_java_runtime *runtime, struct yj_run_args *args);
+
+bool jar_read_manifest(struct yj_run_args *args);
+char *jar_manifest_get(const char *manifest, const char *key);
+char *jar_expand_class_path(const char *jar, const char *class_path);
+void jar_add_module_opts(const char *value, const char *opt,
+                         struct jvm_opt_arr *opts);
+void jar_free_manifest(struct yj_manifest *manifest);
+int jar_required_release(struct yj_run_args *args);
+bool jar_manifest_value(const char *manifest, const char *key, char *out,
+                        size_t maxlen);
+int jar_class_release(const unsigned char *head, size_t len);
+void jar_class_file(const char *class_name, char *out, size_t maxlen);
+int jar_class_release_in(const char *classpath, const char *class_file);
+
+struct yj_argfile {
+  char *buf;
+  size_t len;
+  bool mapped; // an argfile, else a copy of JDK_JAVA_OPTIONS
+  struct yj_argfile *next;
+};
+struct argfile_state {
+  bool value;    // the next argument is the value of an option
+  bool terminal; // the value ends the launcher options, -jar app.jar
+  bool main;     // past the launcher options
+};
+bool argfile_is_space(char c);
+bool argfile_add(struct yj_cmdline *cmd, char *arg);
+void argfile_check(struct argfile_state *st, const char *arg);
+char *argfile_next(char **pos, char *end);
+yj_result argfile_expand(const char *path, struct yj_cmdline *cmd,
+                         struct argfile_state *st);
+char *argfile_env_next(char **pos, bool *unmatched);
+yj_result argfile_env(struct yj_cmdline *cmd, struct argfile_state *st);
+
+struct wildcard_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t strings_len;
+  // the directory listed
+  uint64_t dev;
+  uint64_t ino;
+  int64_t mtime_ns;
+};
+bool wildcard_is(const char *entry);
+bool wildcard_is_jar(const char *name);
+int wildcard_cmp(const void *a, const void *b);
+bool wildcard_expand(const char *entry, struct set *seen,
+                     struct yj_run_args *args);
+bool wildcard_accept(int dirfd, const char *name, unsigned char type);
+bool wildcard_scan(int dirfd, char ***out, size_t *out_len);
+bool wildcard_cache_file(const char *dir, char *out, size_t maxlen,
+                         bool create);
+bool wildcard_cache_load(const char *dir, struct stat *st, char ***out,
+                         size_t *out_len);
+void wildcard_cache_store(const char *dir, struct stat *st, char **names,
+                          size_t len);
+
+// validated class path, the directories of its entries
+//   [header][classpath_dir * dirs_len][string pool]
+struct classpath_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t dirs_len;
+  uint32_t strings_len;
+};
+struct classpath_dir {
+  uint64_t dev;
+  uint64_t ino;
+  int64_t mtime_ns;
+  uint32_t path;
+  uint32_t reserved;
+};
+struct classpath_check {
+  char **paths;
+  size_t len;
+  size_t next;
+  size_t missing; // first missing entry, len if none
+  bool links;
+};
+bool classpath_check(char **paths, size_t len);
+void *classpath_thread(void *data);
+uint64_t classpath_key(char **paths, size_t len);
+void classpath_dir_of(const char *path, char *out, size_t maxlen);
+bool classpath_cache_file(uint64_t key, char *out, size_t maxlen,
+                          bool create);
+bool classpath_cache_fresh(const char *path, uint64_t key);
+void classpath_cache_store(const char *path, uint64_t key, char **paths,
+                           size_t len);
+
+// packs/<key>.idx, what a pack was built from and the class path to use
+//   [header][pack_source * sources_len][string pool]
+struct pack_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t sources_len;
+  uint32_t strings_len;
+  uint32_t class_path;
+  uint32_t reserved;
+};
+struct pack_source {
+  int64_t mtime_ns;
+  uint64_t size;
+  uint32_t path;
+  uint32_t dir; // a directory left on the class path, not compared
+};
+uint64_t pack_key(char **paths, size_t len);
+bool pack_file(uint64_t key, const char *ext, char *out, size_t maxlen,
+               bool create);
+char *pack_lookup(struct yj_run_args *args, int len);
+int pack_open(struct pack *pk, char **paths, int len, struct stat *sts);
+char *pack_class_path(struct pack *pk, char **paths, int first,
+                      const char *jar);
+bool pack_mergeable(struct zip *zip);
+bool pack_skip(const char *name, size_t len);
+struct pack_entry *pack_find(struct pack *pk, const char *name, size_t len);
+void pack_insert(struct pack *pk, uint32_t jar, struct zip_entry *entry);
+bool pack_put(struct pack *pk, struct zip_writer *w, struct pack_entry *e);
+bool pack_put_ordered(struct pack *pk, struct zip_writer *w,
+                      const char *log_path);
+bool pack_write_index(const char *path, uint64_t key, struct pack *pk,
+                      char **paths, struct stat *sts, const char *jar,
+                      const char *class_path);
+
+// classindex/<key>, the packages of a class path and the jars holding them
+// in class path order, mapped by the bundled IndexClassLoader
+//   [header][classindex_jar * jars_len][uint32_t slots * slots_len]
+//   [classindex_package * packages_len][uint32_t jars * refs_len][strings]
+struct classindex_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t jars_len;
+  uint32_t packages_len;
+  uint32_t slots_len; // a power of two, package index + 1, 0 for empty
+  uint32_t refs_len;
+  uint32_t strings_len;
+  uint32_t reserved;
+};
+struct classindex_jar {
+  int64_t mtime_ns;
+  uint64_t size;
+  uint32_t path;
+  uint32_t reserved;
+};
+struct classindex_package {
+  uint32_t name; // `com/example`, not nul-terminated for the loader
+  uint32_t name_len;
+  uint32_t hash;
+  uint32_t refs;
+  uint32_t refs_len;
+};
+// the packages of a jar, from the scan threads
+struct classindex_scan_jar {
+  struct stat st;
+  char **packages;
+  uint32_t *ids; // of the packages in the index
+  size_t len;
+};
+struct classindex_scan {
+  char **paths;
+  size_t len;
+  size_t next;
+  struct classindex_scan_jar *jars;
+};
+bool classindex_prepare(struct yj_java_runtime *runtime,
+                        struct yj_run_args *args, int len, char *loader,
+                        size_t maxlen);
+bool classindex_loader_jar(struct yj_java_runtime *runtime, char *out,
+                           size_t maxlen);
+bool classindex_file(uint64_t key, char *out, size_t maxlen, bool create);
+bool classindex_fresh(const char *path, uint64_t key, char **paths,
+                      size_t len);
+bool classindex_build(const char *path, uint64_t key, char **paths,
+                      size_t len);
+void *classindex_thread(void *data);
+uint32_t classindex_hash(const char *s, size_t len);
+
+#define WHICH_THREADS 8
+#define WHICH_NAME_MAX 1024
+struct which_entry { // a class path entry, scanned by one thread
+  char *path;
+  char **classes; // binary names with slashes, no .class
+  size_t len;
+  size_t resources; // files which are not classes, see which_is_resource
+  size_t provided;  // classes no earlier entry or the runtime shadows
+  bool found;
+};
+struct which_class {
+  const char *name;
+  uint32_t entry;
+  uint32_t next;      // the next entry with the class, + 1
+  uint32_t last;      // of the first one, the last with the class
+  bool shadowed;      // an earlier entry has the class
+  const char *module; // of the runtime holding the package, if any
+};
+struct which_package {
+  char *name;
+  uint32_t *entries; // in class path order
+  uint32_t len;
+  uint32_t classes;
+  const char *module;
+};
+struct which_index { // the classes of a class path as a launch sees it
+  struct which_entry *entries;
+  size_t entries_len;
+  size_t next; // the entry to scan next
+  struct which_class *classes;
+  size_t classes_len;
+  size_t unique;
+  uint32_t *slots; // class + 1 by name
+  size_t slots_len;
+  struct which_package *packages;
+  size_t packages_len;
+  uint32_t *package_slots;
+  size_t package_slots_len;
+  struct jimage image;
+};
+bool which_build(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                 struct which_index *wi);
+void which_class_path(struct yj_run_args *args, struct which_index *wi);
+void *which_thread(void *data);
+void which_scan_jar(struct which_entry *entry);
+void which_scan_dir(struct which_entry *entry, char *path, size_t base,
+                    size_t *cap);
+bool which_is_resource(const char *name, size_t len);
+void which_add_class(struct which_entry *entry, const char *name, size_t len,
+                     size_t *cap);
+uint32_t which_find(struct which_index *wi, const char *name);
+struct which_package *which_package(struct which_index *wi,
+                                    const char *name, size_t len);
+void which_dotted(const char *name, char *out, size_t maxlen);
+void which_answer(struct which_index *wi, const char *query, bool *found);
+void which_report(struct which_index *wi);
+void which_free(struct which_index *wi);
+
+bool config_get(const char *key, char *out, size_t maxlen);
+bool config_user_path(char *out, size_t maxlen);
+bool config_file_value(const char *path, const char *key, char *out,
+                       size_t maxlen);
+bool conf_value(const char *content, const char *key, char *out,
+                size_t maxlen);
+
+long time_now_ms();
+long time_now_us();
+long time_epoch_us();
+bool str_icontains(const char *s, const char *sub);
+long env_long(const char *name, long def);
 
 bool file_exists(const char *path);
-bool file_abs(struct dirent *dir, const char *base, char *out, size_t maxlen);
 bool file_is_dir(const char *path);
 bool file_is_file(const char *path);
+int64_t stat_mtime_ns(const struct stat *st);
+char *file_read_all(const char *path, size_t maxlen, size_t *out_len);
+bool file_write_all(int fd, const void *buf, size_t len);
+bool file_mkdirs(const char *path, mode_t mode);
+bool file_remove_tree(const char *path);
 
 struct arg_ctx {
   struct yj_run_args *args;
@@ -168,20 +871,72 @@ struct arg_ctx {
   char **argv;
   int consumed;
   char *cur_arg;
+  bool terminal; // the application follows the value of cur_arg
+};
+
+// kinds of arg_opt
+#define ARG_BOOL 1      // sets a bool field
+#define ARG_SET 2       // sets an int field to value
+#define ARG_STR 3       // the value, or the suffix, to a string field
+#define ARG_LIST 4      // the value, or the whole option, to a list field
+#define ARG_CLASSPATH 5 // entries of the value to classpathes
+#define ARG_VM_LONG 6   // --name=value to vmopts
+#define ARG_VM_OPT 7    // the option as it is to vmopts
+#define ARG_VERBOSE 8   // -verbose[:class|gc|jni|module] to vmopts
+#define ARG_DESCRIBE 9  // --describe-module name
+#define ARG_IGNORE 10
+
+#define ARG_F_VALUE 0x01    // followed by a value, or --name=value
+#define ARG_F_SUFFIX 0x02   // -name or -name:suffix
+#define ARG_F_TERMINAL 0x04 // the application follows the value
+
+#define ARG_SLOTS 256 // a power of two
+#define ARG_SEED 0x811ca2fbU
+#define ARG_LIST_MIN 8
+#define ARENA_MIN 1024
+
+struct arg_opt {
+  const char *name;
+  unsigned char len;
+  unsigned char kind;
+  unsigned char flags;
+  unsigned short field;     // offset in yj_run_args
+  unsigned short len_field; // offset of the length of an ARG_LIST field
+  int value;
+};
+
+// a chunk of the arena of yj_run_args
+struct yj_arena {
+  struct yj_arena *next; // the chunk filled before
+  size_t len;
+  size_t cap;
+  char data[];
 };
+struct yj_arena *arena_new(size_t cap);
+void *arena_alloc(struct yj_arena **arena, size_t size);
+char *arena_strdup(struct yj_arena **arena, const char *s);
+void arena_free(struct yj_arena *arena);
 
 #define arg_match(arg, ...) arg_match_any(arg, __VA_ARGS__, 0)
 int arg_parse_run_options(struct arg_ctx *ctx);
+int arg_parse_option(struct arg_ctx *ctx);
+uint32_t arg_hash(const char *s, size_t len, uint32_t seed);
+const char *arg_opt_name(size_t i);
+const struct arg_opt *arg_lookup(const char *name, size_t len);
+void arg_list_add(struct yj_run_args *args, char ***list, int *len, char *s);
+void arg_add_classpath(struct yj_run_args *args, const char *value);
 int arg_parse_classpathes(char *in, struct list *list);
 char *arg_pop(struct arg_ctx *ctx);
-char *arg_pop_value(struct arg_ctx *ctx);
-void arg_back(struct arg_ctx *ctx);
 bool arg_has(struct arg_ctx *ctx);
 bool arg_build_java_opts(struct yj_java_runtime *runtime,
                          struct yj_run_args *args, JavaVMInitArgs *out);
+void arg_add_vm_opts(struct jvm_opt_arr *opts, const char *name, char **values,
+                     int len);
 bool arg_match_any(char *arg, ...);
 bool arg_match_start(char *arg, char *start);
 bool arg_is_long(char *arg);
+bool arg_parse_size(const char *s, size_t *out);
+bool arg_is_source(struct yj_run_args *args, const char *arg);
 
 // Utilities
 // Some use full macros
@@ -201,6 +956,8 @@ bool arg_is_long(char *arg);
 
 #define SAFE_STRDUP(src) ((src) == NULL ? NULL : strdup(src))
 
+#define SAFE_STRLEN(src) ((src) == NULL ? 0 : strlen(src))
+
 #define ERROR_LOG(...) fprintf(stderr, __VA_ARGS__);
 
 // Public functions
@@ -227,11 +984,13 @@ yj_result yj_parse_run_args(int argc, char **argv, struct yj_run_args *args) {
   pc.argv = argv;
   pc.consumed = 0;
 
-#define OPTS 1
-#define MAIN 2
-#define ARGS 3
+  // the copies of the arguments, with room for the arrays pointing to them
+  size_t arena_hint = ARENA_MIN;
+  for (int i = 0; i < argc; i++) {
+    arena_hint += strlen(argv[i]) + 1 + 2 * sizeof(char *);
+  }
+  args->arena = arena_new(arena_hint);
 
-  int pos = OPTS;
   while (arg_has(&pc)) {
     char *arg = arg_pop(&pc);
     pc.cur_arg = arg;
@@ -240,138 +999,298 @@ yj_result yj_parse_run_args(int argc, char **argv, struct yj_run_args *args) {
       break;
     }
 
-    if (strlen(arg) == 0) {
+    if (arg[0] == '\0') {
       continue; // skip empty argument
     }
 
-    // parse jar
-    if (pos == OPTS && arg_match(arg, "-jar")) {
-      char *app_jar = arg_pop_value(&pc);
-      if (pc.args->app_jar != NULL) {
-        free(pc.args->app_jar);
-      }
-      TRACE("add arg -jar: %s", app_jar);
-      pc.args->app_jar = strdup(app_jar);
-      pos = ARGS;
-    } else if (pos == OPTS && arg_match(arg, "-m", "--module")) {
-      char *module_name = arg_pop_value(&pc);
-      pc.args->app_module = module_name;
-      // TODO <module>[/<mainclass>] extract main class
-      pos = ARGS;
-    } else if (pos == OPTS && arg[0] == '-') { // options
-      // class path
-      if (arg_match(arg, "-cp", "-classpath", "--class-path", "--classpath")) {
-
-        char *classpath = arg_pop_value(&pc);
-        struct list *classpath_list = list_new();
-
-        if (arg_parse_classpathes(classpath, classpath_list) != 0) {
-          list_free(classpath_list, free);
-          return YJ_ERR_ARGS;
+    // main class or source file, the application arguments follow
+    if (arg[0] != '-') {
+      if (arg_is_source(args, arg)) {
+        args->app_source = arena_strdup(&args->arena, arg);
+      } else {
+        args->app_main_class = arena_strdup(&args->arena, arg);
+      }
+      break;
+    }
+
+    if ((err_code = arg_parse_option(&pc)) != YJ_OK) {
+      return err_code;
+    }
+    if (pc.terminal) {
+      break;
+    }
+  }
+
+  int arg_left = pc.argc - pc.consumed;
+  if (arg_left > 0) {
+    args->app_args = arena_alloc(&args->arena, arg_left * sizeof(char *));
+    args->app_args_len = arg_left;
+    for (int i = 0; i < arg_left; i++) {
+      args->app_args[i] = arena_strdup(&args->arena, argv[pc.consumed + i]);
+    }
+  }
+
+  return err_code;
+}
+
+yj_result yj_expand_cmdline(int argc, char **argv, struct yj_cmdline *out) {
+  struct argfile_state st = {0};
+  bool expand = true;
+  yj_result res;
+
+  if (argv == NULL || out == NULL) {
+    return YJ_ERR_NULL;
+  }
+  memset(out, 0, sizeof(struct yj_cmdline));
+  if ((res = argfile_env(out, &st)) != YJ_OK) {
+    return res;
+  }
+
+  for (int i = 0; i < argc; i++) {
+    char *arg = argv[i];
+
+    // `#!/path/to/yajava --source 17` passes its options as one argument
+    if (i == 0 && strncmp(arg, "--source ", 9) == 0) {
+      char *pos = arg, *end = arg + strlen(arg), *token;
+      while ((token = argfile_next(&pos, end)) != NULL) {
+        argfile_check(&st, token);
+        if (!argfile_add(out, token)) {
+          return YJ_ERR_NULL;
         }
+      }
+      continue;
+    }
 
-        int last_len = args->classpathes_len;
-        args->classpathes_len += classpath_list->len;
-        args->classpathes =
-            realloc(args->classpathes, sizeof(char *) * args->classpathes_len);
-
-        list_each(char *data, classpath_list, idx, {
-          TRACE("add classpath: %d -> %s", idx, data);
-          args->classpathes[last_len + idx] = strdup(data);
-        });
-        list_free(classpath_list, free);
-
-      } else if (arg_match(arg, "-?", "-h", "-help")) {
-        TRACE("received help arg: %s\n", arg);
-        args->print_help = YA_PRINT_HELP | YA_PRINT_ERR;
-      } else if (arg_match(arg, "--help")) {
-        args->print_help = YA_PRINT_HELP | YA_PRINT_OUT;
-      } else if (arg_match(arg, "-X")) {
-        args->print_help = YA_PRINT_HELP | YA_PRINT_ERR; // TODO | YA_PRINT_EXT;
-      } else if (arg_match(arg, "--help-extra")) {
-        args->print_help = YA_PRINT_HELP | YA_PRINT_OUT; // TODO | YA_PRINT_EXT;
-      } else if (arg_match(arg, "-version")) {
-        args->print_version = YA_PRINT_VERSION | YA_PRINT_ERR;
-      } else if (arg_match(arg, "--version")) {
-        args->print_version = YA_PRINT_VERSION | YA_PRINT_OUT;
-      } else if (arg_match(arg, "-showversion")) {
-        args->print_version =
-            YA_PRINT_VERSION | YA_PRINT_ERR | YA_PRINT_CONTINUE;
-      } else if (arg_match(arg, "--show-version")) {
-        args->print_version =
-            YA_PRINT_VERSION | YA_PRINT_OUT | YA_PRINT_CONTINUE;
-      } else if (arg_match(arg, "--dry-run")) {
-        args->dry_run = true;
-      } else if (arg_match(arg, "--validate-modules")) {
-        args->validate_modules = true;
-      } else if (arg_match(arg, "--list-modules")) {
-        args->list_modules = true;
-      } else if (arg_match(arg, "--list-modules")) {
-        args->list_modules = true;
-      } else if (arg_match(arg, "--show-module-resolution")) {
-        args->show_module_resolution = true;
-      } else if (arg_match_start(arg, "-X")) {
-        char *opt = strdup(pc.cur_arg);
-        args->vmopts =
-            realloc(args->vmopts, (args->vmopts_len + 1) * sizeof(char *));
-        args->vmopts[args->vmopts_len++] = opt;
-      } else if (arg_match_start(arg, "-D")) {
-        char *opt = strdup(pc.cur_arg);
-        args->sys_props = realloc(args->sys_props,
-                                  (args->sys_props_len + 1) * sizeof(char *));
-        args->sys_props[args->sys_props_len++] = opt;
-      }
-    } else if (pos == ARGS) {
-      arg_back(&pc);
-      int arg_left = pc.argc - pc.consumed;
-      if (arg_left > 0) {
-        pc.args->app_args = malloc(arg_left * sizeof(char *));
-        pc.args->app_args_len = arg_left;
-
-        for (int i = 0; i < arg_left; i++) {
-          pc.args->app_args[i] = strdup(pc.argv[pc.consumed + i]);
+    if (expand && !st.main && arg[0] == '@') {
+      if (arg[1] != '@') {
+        if ((res = argfile_expand(arg + 1, out, &st)) != YJ_OK) {
+          return res;
         }
-        pc.consumed += arg_left;
+        continue;
       }
+      arg++; // @@ for an argument starting with @
+    } else if (expand && !st.main && strcmp(arg, "--disable-@files") == 0) {
+      expand = false;
+      continue;
+    }
+
+    argfile_check(&st, arg);
+    if (!argfile_add(out, arg)) {
+      return YJ_ERR_NULL;
+    }
+  }
+  if (out->argv == NULL) {
+    argfile_add(out, NULL);
+    out->argc = 0;
+  }
+  return YJ_OK;
+}
+
+yj_result yj_free_cmdline(struct yj_cmdline *cmd) {
+  struct yj_argfile *file, *next;
+
+  if (cmd == NULL) {
+    return YJ_ERR_NULL;
+  }
+  for (file = cmd->files; file != NULL; file = next) {
+    next = file->next;
+    if (file->mapped) {
+      munmap(file->buf, file->len);
     } else {
-      // main class
-      pc.args->app_main_class = strdup(arg);
-      pos = ARGS;
+      free(file->buf);
     }
+    free(file);
   }
+  free(cmd->argv);
+  memset(cmd, 0, sizeof(struct yj_cmdline));
+  return YJ_OK;
+}
 
-#undef OPTS
-#undef MAIN
-#undef ARGS
+yj_result yj_plan_load(int argc, char **argv, struct yj_run_args *args,
+                       struct yj_java_runtime *runtime) {
+  struct yj_plan *plan;
+  char name[64] = {0};
+  char *env;
+  long start = time_now_us();
 
-err:
-  return err_code;
+  if (argv == NULL || args == NULL || runtime == NULL) {
+    return YJ_ERR_NULL;
+  }
+
+  if ((env = getenv("YAJAVA_PLAN")) != NULL && strcmp(env, "off") == 0) {
+    return YJ_ERR_NO_FILE;
+  }
+
+  // the application arguments do not change the plan, a key of their own
+  // would leave a file behind for each argument list
+  plan = calloc(1, sizeof(struct yj_plan));
+  plan->key = plan_key(argc - args->app_args_len, argv);
+  plan->start_us = start;
+  args->plan = plan;
+
+  snprintf(name, sizeof(name), "%s%c%016llx", PLAN_DIR, FILE_PATH_SEPRATOR,
+           (unsigned long long)plan->key);
+  if (!cache_path(name, plan->path, PATH_MAX, false)) {
+    SAFE_FREE(args->plan);
+    return YJ_ERR_NO_FILE;
+  }
+
+  if (!plan_open(plan)) {
+    plan->start_us = time_now_us(); // the resolution starts now
+    return YJ_ERR_NO_FILE;
+  }
+
+  struct plan_header *h = plan->header;
+  memset(runtime, 0, sizeof(struct yj_java_runtime));
+  runtime->name = SAFE_STRDUP(plan_str(plan, h->name));
+  runtime->home = SAFE_STRDUP(plan_str(plan, h->home));
+  runtime->libjvm_path = SAFE_STRDUP(plan_str(plan, h->libjvm_path));
+  runtime->version = SAFE_STRDUP(plan_str(plan, h->version_str));
+  runtime->full_version = SAFE_STRDUP(plan_str(plan, h->full_version));
+  runtime->vendor = SAFE_STRDUP(plan_str(plan, h->vendor));
+  runtime->arch = SAFE_STRDUP(plan_str(plan, h->arch));
+  runtime->props = SAFE_STRDUP(plan_str(plan, h->props));
+  runtime->major_version = h->major_version;
+  runtime->jni_version = h->jni_version;
+  runtime->gcs = h->gcs;
+  runtime->features = h->features;
+
+  if (args->plan_stats) {
+    long load_us = time_now_us() - start;
+    fprintf(stderr, "plan hit %016llx: load %.3fms, saved %.3fms\n",
+            (unsigned long long)plan->key, load_us / 1000.0,
+            (h->build_us - load_us) / 1000.0);
+  }
+  return YJ_OK;
 }
 
 yj_result yj_create_runtime(char *home, struct yj_java_runtime *runtime) {
   char lib_path[PATH_MAX] = {0};
+  struct index idx = {0};
+  yj_result res = YJ_ERR_NO_RUNTIME;
+
   TRACE("try create with home: %s", home);
   if (!jvm_find_lib(home, lib_path, PATH_MAX)) {
     return YJ_ERR_NO_RUNTIME;
   }
-  if (jvm_create_runtime_fork(home, lib_path, runtime)) {
-    return YJ_OK;
+
+  index_open(&idx);
+  if (index_lookup(&idx, home, lib_path, runtime)) {
+    res = YJ_OK;
+  } else if (jvm_probe_runtime(home, lib_path, runtime)) {
+    index_update(&idx, runtime, 1, NULL, NULL);
+    res = YJ_OK;
   }
-  return YJ_ERR_NO_RUNTIME;
+  index_close(&idx);
+
+  return res;
 }
 
 yj_result yj_find_runtime(struct yj_java_runtime *runtime) {
 
-  char *java_home;
+  char constraint[PATH_MAX] = {0};
+  char *env;
+
+  // 1. env YAJAVA_RUNTIME
+  // 2. project .java-version / yajava.conf, then the user yajava.conf
+  if (jvm_explicit_constraint(constraint, sizeof(constraint))) {
+    return yj_select_runtime(constraint, runtime);
+  }
+
+  // 3. env JAVA_HOME
+  if ((env = getenv("JAVA_HOME")) != NULL && strlen(env) > 0) {
+    return yj_create_runtime(env, runtime);
+  }
+
+  // 4. the newest one we know
+  return yj_select_runtime("", runtime);
+}
+
+yj_result yj_find_runtime_for(struct yj_run_args *args,
+                              struct yj_java_runtime *runtime) {
+
+  char constraint[PATH_MAX] = {0};
+  char mode[32] = "compatible";
+  struct jvm_constraint c = {0};
+  char *env;
+  int release;
+  yj_result res;
+
+  if (args == NULL || runtime == NULL) {
+    return YJ_ERR_NULL;
+  }
+
+  if ((env = getenv("YAJAVA_RUNTIME_AUTO")) != NULL && strlen(env) > 0) {
+    snprintf(mode, sizeof(mode), "%s", env);
+  } else {
+    config_get("runtime.auto", mode, sizeof(mode));
+  }
+
+  if (strcmp(mode, "off") == 0 ||
+      (release = jar_required_release(args)) <= 0) {
+    return yj_find_runtime(runtime);
+  }
+  TRACE("application requires java %d, mode %s", release, mode);
+
+  // an explicit choice is kept, even if it can not run the application
+  if (jvm_explicit_constraint(constraint, sizeof(constraint))) {
+    res = yj_select_runtime(constraint, runtime);
+    if (res == YJ_OK && runtime->major_version < release) {
+      fprintf(stderr,
+              "warning: java %d is selected by %s, the application "
+              "requires java %d\n",
+              runtime->major_version, constraint, release);
+    }
+    return res;
+  }
+
+  c.op = CMP_GE;
+  c.version[0] = release;
+  c.version_len = 1;
+  c.vmopts = args->vmopts;
+  c.vmopts_len = args->vmopts_len;
+
+  if (strcmp(mode, "lowest") == 0 || strcmp(mode, "highest") == 0) {
+    res = jvm_select(&c, strcmp(mode, "lowest") == 0, runtime);
+  } else {
+    // compatible: keep the default runtime unless it is too old
+    res = yj_find_runtime(runtime);
+    if (res == YJ_OK && runtime->major_version >= release) {
+      return res;
+    }
+    if (res == YJ_OK) {
+      TRACE("default runtime %s is too old", runtime->home);
+      yj_free_runtime(runtime);
+    }
+    res = jvm_select(&c, true, runtime);
+  }
+
+  if (res != YJ_OK) {
+    fprintf(stderr, "warning: no java runtime >= %d found\n", release);
+    return yj_find_runtime(runtime);
+  }
+  return res;
+}
+
+yj_result yj_select_runtime(const char *constraint,
+                            struct yj_java_runtime *runtime) {
+
+  struct jvm_constraint c = {0};
+
+  if (constraint == NULL || runtime == NULL) {
+    return YJ_ERR_NULL;
+  }
+
+  if (!jvm_parse_constraint(constraint, &c)) {
+    fprintf(stderr, "invalid runtime constraint: %s\n", constraint);
+    return YJ_ERR_ARGS;
+  }
 
-  // from env JAVA_HOME
-  java_home = getenv("JAVA_HOME");
-  if (java_home != NULL) {
-    return yj_create_runtime(java_home, runtime);
+  if (strlen(c.home) > 0) {
+    return yj_create_runtime(c.home, runtime);
   }
 
-  // from configuration
-  return YJ_ERR_NO_RUNTIME;
+  return jvm_select(&c, false, runtime);
 }
 
 yj_result yj_free_runtime(struct yj_java_runtime *runtime) {
@@ -384,6 +1303,9 @@ yj_result yj_free_runtime(struct yj_java_runtime *runtime) {
   SAFE_FREE(runtime->version);
   SAFE_FREE(runtime->full_version);
   SAFE_FREE(runtime->libjvm_path);
+  SAFE_FREE(runtime->vendor);
+  SAFE_FREE(runtime->arch);
+  SAFE_FREE(runtime->props);
 
   return YJ_OK;
 }
@@ -401,6 +1323,132 @@ yj_result yj_run_async(struct yj_java_runtime *runtime,
   return YJ_OK;
 }
 
+yj_result yj_run_fork(struct yj_java_runtime *runtime,
+                      struct yj_run_args *args, int *exit_code) {
+  struct rusage usage = {0};
+  long start = time_now_us();
+  int status = 0;
+  pid_t pid;
+
+  // -showversion goes on with the launch
+  bool go_on = (args->print_version & YA_PRINT_CONTINUE) == YA_PRINT_CONTINUE;
+  if (jvm_print_version_cached(runtime, args) && !go_on) {
+    *exit_code = 0;
+    return YJ_OK;
+  }
+  // the system modules are read without a vm
+  if (modules_answer(runtime, args, exit_code)) {
+    return YJ_OK;
+  }
+
+  if (!source_prepare(runtime, args)) {
+    *exit_code = 1;
+    return YJ_ERR_ARGS;
+  }
+  archive_prepare(runtime, args);
+  preload_prepare(runtime, args);
+
+  fflush(NULL);
+  pid = fork();
+  if (pid == 0) {
+    if (yj_run(runtime, args) == YJ_OK) {
+      exit(0);
+    }
+    exit(1);
+  } else if (pid == -1) {
+    printf("failed to launch java application, err: create sub-process\n");
+    return YJ_ERR_RUNTIME;
+  }
+
+  while (wait4(pid, &status, 0, &usage) == -1) {
+    if (errno != EINTR) {
+      return YJ_ERR_RUNTIME;
+    }
+  }
+
+  if (WIFEXITED(status)) {
+    *exit_code = WEXITSTATUS(status);
+  } else if (WIFSIGNALED(status)) {
+    *exit_code = 128 + WTERMSIG(status);
+  } else {
+    *exit_code = 1;
+  }
+
+  archive_finish(args);
+  preload_finish(args);
+  if (args->print_metrics) {
+    jvm_report_metrics(pid, *exit_code, start, &usage);
+  }
+  return YJ_OK;
+}
+
+yj_result yj_run_in_process(struct yj_java_runtime *runtime,
+                            struct yj_run_args *args, int *exit_code) {
+  struct jvm_main_ctx ctx = {0};
+  pthread_attr_t attr;
+  pthread_t tid;
+  size_t stack_size = 0;
+
+  metrics_start_us = time_now_us();
+
+  // -showversion goes on with the launch
+  bool go_on = (args->print_version & YA_PRINT_CONTINUE) == YA_PRINT_CONTINUE;
+  if (jvm_print_version_cached(runtime, args) && !go_on) {
+    *exit_code = 0;
+    return YJ_OK;
+  }
+  // the system modules are read without a vm
+  if (modules_answer(runtime, args, exit_code)) {
+    return YJ_OK;
+  }
+
+  if (!source_prepare(runtime, args)) {
+    *exit_code = 1;
+    return YJ_ERR_ARGS;
+  }
+  archive_prepare(runtime, args);
+  preload_prepare(runtime, args);
+
+  ctx.runtime = runtime;
+  ctx.args = args;
+  exit_args = args;
+
+  // like the stock launcher, -Xss also sizes the main thread
+  if (!jvm_stack_size(runtime, args, &stack_size)) {
+    stack_size = 0;
+  }
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  if (stack_size > 0) {
+    if (stack_size < PTHREAD_STACK_MIN) {
+      stack_size = PTHREAD_STACK_MIN;
+    }
+    pthread_attr_setstacksize(&attr, stack_size);
+  }
+
+  TRACE("start vm main thread, stack size: %zu", stack_size);
+  if (pthread_create(&tid, &attr, jvm_main_thread, &ctx) == 0) {
+    pthread_join(tid, NULL);
+  } else {
+    // continue in the current thread if we can not create a new one
+    TRACE("create vm main thread failed, continue in current thread");
+    jvm_main_thread(&ctx);
+  }
+  pthread_attr_destroy(&attr);
+
+  *exit_code = ctx.result == YJ_OK ? 0 : 1;
+
+  archive_finish(args);
+  preload_finish(args);
+  if (args->print_metrics) {
+    struct rusage usage = {0};
+    getrusage(RUSAGE_SELF, &usage);
+    jvm_report_metrics(getpid(), *exit_code, metrics_start_us, &usage);
+  }
+  return YJ_OK;
+}
+
 yj_result yj_run(struct yj_java_runtime *runtime, struct yj_run_args *args) {
 
   struct yj_java_init_fn fn = {0};
@@ -408,44 +1456,77 @@ yj_result yj_run(struct yj_java_runtime *runtime, struct yj_run_args *args) {
   JavaVM *vm = NULL;
   JNIEnv *env = NULL;
   jint res = JNI_OK;
+  long create_start;
 
-  if (!jvm_bind_init_fn(&fn, runtime->libjvm_path)) {
-    res = YJ_ERR_DYN_BIND;
+  // warm the page cache while the vm binds and boots
+  prefetch_start(runtime, args);
+
+  // plan: the vm options, taken from the launch plan when it is warm
+  if (!plan_vm_args(args, runtime, &vm_args) ||
+      !archive_vm_args(args->archive, &vm_args) ||
+      !preload_vm_args(args->preloader, &vm_args)) {
+    res = YJ_ERR_ARGS;
     goto err;
   }
 
-  if (!arg_build_java_opts(runtime, args, &vm_args)) {
-    res = YJ_ERR_ARGS;
+  // execute
+  if (!jvm_bind_init_fn(&fn, runtime->libjvm_path)) {
+    res = YJ_ERR_DYN_BIND;
     goto err;
   }
 
   jvm_print_args(&vm_args);
+  create_start = time_now_us();
   if ((res = fn.CreateJavaVM(&vm, (void **)&env, &vm_args)) != JNI_OK) {
     printf("create jvm error,err %d\n", res);
     res = YJ_ERR_RUNTIME;
     goto err;
   }
+  prefetch_join(args, time_now_us() - create_start);
+
+  // a rejected archive is dropped, the next launch records it again
+  if (args->archive != NULL && args->archive->mode == ARCHIVE_USE &&
+      !archive_is_mapped(args->archive->path)) {
+    TRACE("archive rejected by the vm: %s", args->archive->path);
+    unlink(args->archive->path);
+  }
 
   if ((args->print_version & YA_PRINT_VERSION) == YA_PRINT_VERSION) {
-    jvm_print_version(env, runtime->major_version, args);
+    if (jvm_print_version(env, runtime->major_version, args) == YJ_OK &&
+        jvm_version_cacheable(args)) {
+      jvm_cache_version_props(env, runtime);
+    }
     if ((args->print_version & YA_PRINT_CONTINUE) != YA_PRINT_CONTINUE) {
       goto err;
     }
   }
 
-  if (!args->dry_run) {
-    if (args->app_jar == NULL && args->app_main_class == NULL) {
+  if (args->list_modules || args->describe_module || args->validate_modules) {
+    if (jvm_module_action(env, args) != YJ_OK) {
+      res = YJ_ERR_JAVA;
+    }
+  } else if (!args->dry_run) {
+    if (args->app_jar == NULL && args->app_main_class == NULL &&
+        args->app_module == NULL) {
       printf("help\n");
     } else {
-      jvm_exec_main_class(args, env);
+      // startup classes load on helper threads while main runs
+      preload_start(args, vm);
+      if (jvm_exec_main_class(args, env) != 0) {
+        res = YJ_ERR_JAVA;
+      }
+      preload_join(args);
     }
   }
 
+  // uncaught exception of main is reported by the thread detach
+  (*vm)->DetachCurrentThread(vm);
   if ((*vm)->DestroyJavaVM(vm)) {
     goto err;
   }
 
 err:
+  prefetch_join(args, 0);
   for (int i = 0; i < vm_args.nOptions; i++) {
     JavaVMOption opt = vm_args.options[i];
     free(opt.optionString);
@@ -456,7 +1537,7 @@ err:
     dlclose(fn.handle);
   }
 
-  return YJ_OK;
+  return res;
 }
 
 yj_result yj_java_discovery(char *path, struct yj_java_runtime **out,
@@ -466,100 +1547,117 @@ yj_result yj_java_discovery(char *path, struct yj_java_runtime **out,
     return YJ_ERR_NULL;
   }
 
-  DIR *d = NULL;
-  struct dirent *dir = NULL;
-
-  char lib_path[PATH_MAX] = {0};
-  char base_path[PATH_MAX] = {0};
-
-  int lib_path_maxlen = PATH_MAX;
-  int base_max_maxlen = PATH_MAX;
-
-  struct list *runtime_list = list_new();
+  struct yj_discovery_root root = {0};
+  struct yj_discovery discovery = {0};
 
   if (!file_exists(path)) {
     return YJ_ERR_NO_FILE;
   }
 
-  if (realpath(path, base_path) == NULL) {
-    return YJ_ERR_NO_FILE;
-  }
+  root.path = path;
+  discovery.roots = &root;
+  discovery.roots_len = 1;
+  discovery.max_depth = 1;
+  return yj_java_discovery_roots(&discovery, out, out_len);
+}
 
-  d = opendir(base_path);
-  if (d != NULL) {
-    while ((dir = readdir(d)) != NULL) {
+yj_result yj_java_discovery_roots(struct yj_discovery *discovery,
+                                  struct yj_java_runtime **out,
+                                  size_t *out_len) {
 
-      // ignore current dir and parent dir
-      if (strcmp(".", dir->d_name) == 0 || strcmp("..", dir->d_name) == 0) {
-        continue;
-      }
+  if (discovery == NULL || out == NULL || out_len == NULL) {
+    return YJ_ERR_NULL;
+  }
 
-      char path[PATH_MAX] = {0};
+  struct list *pairs = list_new();
+  int64_t *mtimes = calloc(discovery->roots_len + 1, sizeof(int64_t));
+  int max_depth =
+      discovery->max_depth > 0 ? discovery->max_depth : DISCOVERY_DEPTH;
 
-      // skip non-directory
-      if ((dir->d_type != DT_DIR && dir->d_type != DT_LNK) ||
-          !file_abs(dir, base_path, path, PATH_MAX) || !file_is_dir(path)) {
-        continue;
-      }
+  for (size_t i = 0; i < discovery->roots_len; i++) {
+    struct yj_discovery_root *root = &discovery->roots[i];
+    char path[PATH_MAX] = {0};
+    size_t before = pairs->len;
+    long start = time_now_us();
+    int fd;
 
-      TRACE("path: %s", path);
-#if __APPLE__
-      if (!jvm_find_lib(path, lib_path, lib_path_maxlen)) {
-        if (strlen(path) > PATH_MAX - 15) {
-          continue;
-        }
-        strcat(path, "/Contents/Home");
-        if (!jvm_find_lib(path, lib_path, lib_path_maxlen)) {
-          continue;
-        }
-      }
-#else
-      if (!jvm_find_lib(path, lib_path, lib_path_maxlen)) {
-        continue;
-      }
-#endif
+    root->found = 0;
+    root->elapsed_us = 0;
 
-      struct jvm_home_path pair = {0};
-      memcpy(&pair.home, path, strlen(path) * sizeof(char));
-      memcpy(&pair.lib_path, lib_path, strlen(lib_path) * sizeof(char));
+    // before the scan, a home added while scanning marks the root changed
+    if (mtimes != NULL) {
+      mtimes[i] = index_root_mtime(root->path);
+    }
 
-      if (!list_contains(runtime_list, &pair, jvm_compair_home_lib_pair)) {
-        struct jvm_home_path *to_save;
-        to_save = malloc(sizeof(struct jvm_home_path));
-        memset(to_save, 0, sizeof(struct jvm_home_path));
-        memcpy(to_save, &pair, sizeof(struct jvm_home_path));
+    if (root->path == NULL || realpath(root->path, path) == NULL ||
+        (fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+      TRACE("skip root: %s", root->path);
+      continue;
+    }
 
-        list_add(runtime_list, to_save);
-      }
+    // the root itself could be a home, e.g. /opt/jdk
+    if (!jvm_scan_home(fd, path, pairs, false)) {
+      jvm_scan_dir(fd, path, 1, max_depth, pairs, false);
     }
-    closedir(d);
-  }
+    close(fd);
 
-  if (runtime_list != NULL) {
-    struct list_node *node = runtime_list->head;
-    struct yj_java_runtime *runtimes =
-        malloc(sizeof(struct yj_java_runtime) * runtime_list->len);
+    root->found = pairs->len - before;
+    root->elapsed_us = time_now_us() - start;
+    TRACE("root %s: %zu found in %ldus", path, root->found, root->elapsed_us);
+  }
 
-    int i = 0;
-    while (node != NULL) {
-      struct jvm_home_path *pair;
-      struct yj_java_runtime *ir;
+  jvm_probe_pairs(pairs, mtimes == NULL ? NULL : discovery, mtimes, out,
+                  out_len);
+  list_free(pairs, free);
+  free(mtimes);
+  return YJ_OK;
+}
 
-      pair = node->data;
+yj_result yj_discovery_defaults(struct yj_discovery *discovery) {
+  char *defaults[] = {DISCOVERY_ROOTS};
+  struct list *roots = list_new();
+  char *env, *home = getenv("HOME");
 
-      ir = &runtimes[i];
-      jvm_create_runtime_fork(pair->home, pair->lib_path, ir);
+  if (discovery == NULL) {
+    return YJ_ERR_NULL;
+  }
+  memset(discovery, 0, sizeof(struct yj_discovery));
 
-      i++;
-      node = node->next;
+  // $YAJAVA_DISCOVERY_PATH replaces the platform defaults
+  if ((env = getenv("YAJAVA_DISCOVERY_PATH")) != NULL && strlen(env) > 0) {
+    arg_parse_classpathes(env, roots);
+  } else {
+    for (int i = 0; i < sizeof(defaults) / sizeof(char *); i++) {
+      list_add(roots, strdup(defaults[i]));
     }
-    *out = runtimes;
-    *out_len = runtime_list->len;
-    list_free(runtime_list, free);
   }
 
-  qsort(*out, *out_len, sizeof(struct yj_java_runtime), jvm_runtime_compare);
+  discovery->roots = calloc(roots->len == 0 ? 1 : roots->len,
+                            sizeof(struct yj_discovery_root));
+  list_each(char *root, roots, idx, {
+    char path[PATH_MAX] = {0};
+    if (root[0] == '~' && home != NULL) {
+      snprintf(path, PATH_MAX, "%s%s", home, root + 1);
+    } else {
+      snprintf(path, PATH_MAX, "%s", root);
+    }
+    discovery->roots[discovery->roots_len++].path = strdup(path);
+  });
+  list_free(roots, free);
+
+  discovery->max_depth = env_long("YAJAVA_DISCOVERY_DEPTH", DISCOVERY_DEPTH);
+  return YJ_OK;
+}
 
+yj_result yj_free_discovery(struct yj_discovery *discovery) {
+  if (discovery == NULL) {
+    return YJ_OK;
+  }
+  for (size_t i = 0; i < discovery->roots_len; i++) {
+    SAFE_FREE(discovery->roots[i].path);
+  }
+  SAFE_FREE(discovery->roots);
+  discovery->roots_len = 0;
   return YJ_OK;
 }
 
@@ -569,37 +1667,21 @@ yj_result yj_free_run_args(struct yj_run_args *arg) {
     return YJ_OK;
   }
 
-#define SAFE_FREE_ARR(v)                                                       \
-  if ((v) != NULL) {                                                           \
-    for (int i = 0; i < v##_len; i++) {                                        \
-      free(v[i]);                                                              \
-      v[i] = NULL;                                                             \
-    }                                                                          \
-    free(v);                                                                   \
-    v = NULL;                                                                  \
-    v##_len = 0;                                                               \
+  if (arg->plan != NULL) {
+    plan_close(arg->plan);
+    SAFE_FREE(arg->plan);
   }
-
-  SAFE_FREE(arg->app_jar);
-  SAFE_FREE(arg->app_module)
-  SAFE_FREE(arg->app_main_class);
-  SAFE_FREE(arg->module_name);
-
-  SAFE_FREE_ARR(arg->app_args);
-
-  SAFE_FREE_ARR(arg->vmopts);
-
-  SAFE_FREE_ARR(arg->classpathes);
-  SAFE_FREE_ARR(arg->add_modules);
-  SAFE_FREE_ARR(arg->module_pathes);
-  SAFE_FREE_ARR(arg->upgrade_module_pathes);
-  SAFE_FREE_ARR(arg->agentlibs);
-  SAFE_FREE_ARR(arg->agentpathes);
-  SAFE_FREE_ARR(arg->javagents);
-  SAFE_FREE_ARR(arg->native_access_modules);
-  SAFE_FREE_ARR(arg->sys_props);
-
-#undef SAFE_FREE_ARR
+  SAFE_FREE(arg->archive);
+  jar_free_manifest(arg->manifest);
+  SAFE_FREE(arg->manifest);
+  prefetch_free(arg->prefetch);
+  SAFE_FREE(arg->prefetch);
+  preload_free(arg->preloader);
+  SAFE_FREE(arg->preloader);
+
+  // the strings and arrays of the arguments
+  arena_free(arg->arena);
+  memset(arg, 0, sizeof(struct yj_run_args));
   return YJ_OK;
 }
 
@@ -618,7 +1700,7 @@ bool jvm_find_lib(char *home, char *lib_path, size_t maxlen) {
   for (int i = 0; i < sizeof(patterns) / sizeof(char *); i++) {
     pattern = patterns[i];
     memset(buf, 0, buf_len);
-    snprintf(buf, buf_len, pattern, home);
+    snprintf(buf, buf_len, "%s%c%s", home, FILE_PATH_SEPRATOR, pattern);
     TRACE("try %s", buf);
     if (file_exists(buf) && file_is_file(buf)) {
       path_len = strnlen(buf, buf_len - 1);
@@ -653,14 +1735,247 @@ bool jvm_bind_init_fn(struct yj_java_init_fn *fn, char *lib_path) {
   return true;
 }
 
-bool jvm_compair_home_lib_pair(void *list_data, void *user_data) {
+bool jvm_compare_home_inode(void *list_data, void *user_data) {
   struct jvm_home_path *lpair = list_data;
   struct jvm_home_path *upair = user_data;
 
-  return strncmp(lpair->home, upair->home, PATH_MAX) == 0;
+  return lpair->dev == upair->dev && lpair->ino == upair->ino;
+}
+
+// check whether the directory is a java home, all lookups relative to dirfd
+bool jvm_scan_home(int dirfd, char *path, struct list *pairs, bool via_link) {
+  char *patterns[] = {LIB_JVM_PATH};
+  const char *prefix = "";
+  struct stat st;
+  int i, len, n = sizeof(patterns) / sizeof(char *);
+
+  for (i = 0; i < n; i++) {
+    if (fstatat(dirfd, patterns[i], &st, 0) == 0 && S_ISREG(st.st_mode)) {
+      break;
+    }
+  }
+#if __APPLE__
+  // bundle layout, <name>.jdk/Contents/Home
+  for (int j = 0; i == n && j < n; j++) {
+    char rel[PATH_MAX] = {0};
+    snprintf(rel, PATH_MAX, "%s%c%s", MACOS_BUNDLE_HOME, FILE_PATH_SEPRATOR,
+             patterns[j]);
+    if (fstatat(dirfd, rel, &st, 0) == 0 && S_ISREG(st.st_mode)) {
+      prefix = MACOS_BUNDLE_HOME;
+      i = j;
+      break;
+    }
+  }
+#endif
+  if (i == n || fstat(dirfd, &st) != 0) {
+    return false;
+  }
+
+  struct jvm_home_path pair = {0};
+  pair.dev = st.st_dev;
+  pair.ino = st.st_ino;
+  pair.via_link = via_link;
+  if (strlen(prefix) > 0) {
+    len = snprintf(pair.home, PATH_MAX, "%s%c%s", path, FILE_PATH_SEPRATOR,
+                   prefix);
+  } else {
+    len = snprintf(pair.home, PATH_MAX, "%s", path);
+  }
+  if (len < 0 || len >= PATH_MAX ||
+      (len = snprintf(pair.lib_path, PATH_MAX, "%s%c%s", pair.home,
+                      FILE_PATH_SEPRATOR, patterns[i])) < 0 ||
+      len >= PATH_MAX) {
+    TRACE("path too long: %s", path);
+    return false;
+  }
+
+  // the same home reached twice (symlinks), prefer the real path
+  list_each(struct jvm_home_path * found, pairs, idx, {
+    if (jvm_compare_home_inode(found, &pair)) {
+      if (found->via_link && !pair.via_link) {
+        memcpy(found, &pair, sizeof(struct jvm_home_path));
+      }
+      TRACE("duplicated home: %s", path);
+      return true;
+    }
+  });
+
+  TRACE("found home: %s", pair.home);
+  struct jvm_home_path *to_save = malloc(sizeof(struct jvm_home_path));
+  memcpy(to_save, &pair, sizeof(struct jvm_home_path));
+  list_add(pairs, to_save);
+  return true;
+}
+
+bool jvm_scan_dir(int dirfd, char *path, int depth, int max_depth,
+                  struct list *pairs, bool via_link) {
+  struct dirent *dir;
+  DIR *d;
+  int fd;
+
+  if ((fd = dup(dirfd)) < 0 || (d = fdopendir(fd)) == NULL) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+
+  while ((dir = readdir(d)) != NULL) {
+    char sub_path[PATH_MAX] = {0};
+    int sub_fd;
+
+    // ignore current dir and parent dir
+    if (strcmp(".", dir->d_name) == 0 || strcmp("..", dir->d_name) == 0) {
+      continue;
+    }
+
+    // skip non-directory, the open below rejects the rest
+    if (dir->d_type != DT_DIR && dir->d_type != DT_LNK &&
+        dir->d_type != DT_UNKNOWN) {
+      continue;
+    }
+
+    sub_fd = openat(dirfd, dir->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (sub_fd < 0) {
+      continue;
+    }
+
+    if (snprintf(sub_path, PATH_MAX, "%s%c%s", path, FILE_PATH_SEPRATOR,
+                 dir->d_name) < PATH_MAX) {
+      bool link = via_link || dir->d_type == DT_LNK;
+      if (!jvm_scan_home(sub_fd, sub_path, pairs, link) && depth < max_depth) {
+        jvm_scan_dir(sub_fd, sub_path, depth + 1, max_depth, pairs, link);
+      }
+    }
+    close(sub_fd);
+  }
+  closedir(d);
+  return true;
+}
+
+// resolve found homes to runtimes: index hit > static probe > vm probe,
+// the roots they were found in are recorded with the runtimes
+bool jvm_probe_pairs(struct list *pairs, struct yj_discovery *discovery,
+                     int64_t *mtimes, struct yj_java_runtime **out,
+                     size_t *out_len) {
+
+  *out = NULL;
+  *out_len = 0;
+
+  if (pairs != NULL && pairs->len > 0) {
+    struct list_node *node = pairs->head;
+    struct yj_java_runtime *runtimes =
+        malloc(sizeof(struct yj_java_runtime) * pairs->len);
+    struct index idx = {0};
+    bool changed = false;
+
+    struct jvm_probe *probes = calloc(pairs->len, sizeof(struct jvm_probe));
+    size_t probes_len = 0;
+
+    index_open(&idx);
+
+    int i = 0;
+    while (node != NULL) {
+      struct jvm_home_path *pair;
+      struct yj_java_runtime *ir;
+
+      pair = node->data;
+      node = node->next;
+
+      // only re-probe runtimes which are new or changed
+      ir = &runtimes[i];
+      if (index_lookup(&idx, pair->home, pair->lib_path, ir)) {
+        i++;
+      } else if (jvm_probe_static(pair->home, pair->lib_path, ir)) {
+        changed = true;
+        i++;
+      } else {
+        probes[probes_len].home = pair->home;
+        probes[probes_len].lib_path = pair->lib_path;
+        probes_len++;
+      }
+    }
+
+    // the rest need a vm, boot them concurrently
+    if (probes_len > 0) {
+      struct yj_java_runtime *vm_runtimes =
+          calloc(probes_len, sizeof(struct yj_java_runtime));
+      for (size_t j = 0; j < probes_len; j++) {
+        probes[j].runtime = &vm_runtimes[j];
+      }
+      jvm_probe_vm_all(probes, probes_len);
+      for (size_t j = 0; j < probes_len; j++) {
+        if (probes[j].ok) {
+          runtimes[i++] = vm_runtimes[j];
+          changed = true;
+        }
+      }
+      free(vm_runtimes);
+    }
+    free(probes);
+
+    if (changed || (discovery != NULL &&
+                    !index_roots_fresh(&idx, discovery, mtimes))) {
+      index_update(&idx, runtimes, i, discovery, mtimes);
+    }
+    index_close(&idx);
+
+    *out = runtimes;
+    *out_len = i;
+  }
+
+  if (*out_len > 0) {
+    qsort(*out, *out_len, sizeof(struct yj_java_runtime), jvm_runtime_compare);
+  }
+  return true;
+}
+
+// the main class of a jar from the system class loader, without the jar,
+// zip and manifest classes LauncherHelper would load for it
+jclass jvm_load_main_class(JNIEnv *env, const char *name) {
+  jclass loader_class = (*env)->FindClass(env, "java/lang/ClassLoader");
+  jmethodID get_loader, load_class;
+  jobject loader;
+  jstring name_str;
+  jclass main_class;
+
+  if (loader_class == NULL) {
+    return NULL;
+  }
+  get_loader = (*env)->GetStaticMethodID(env, loader_class,
+                                         "getSystemClassLoader",
+                                         "()Ljava/lang/ClassLoader;");
+  load_class = (*env)->GetMethodID(env, loader_class, "loadClass",
+                                   "(Ljava/lang/String;)Ljava/lang/Class;");
+  if (get_loader == NULL || load_class == NULL) {
+    return NULL;
+  }
+  loader = (*env)->CallStaticObjectMethod(env, loader_class, get_loader);
+  if (loader == NULL) {
+    return NULL;
+  }
+
+  name_str = (*env)->NewStringUTF(env, name);
+  main_class = (jclass)(*env)->CallObjectMethod(env, loader, load_class,
+                                                name_str);
+  (*env)->DeleteLocalRef(env, name_str);
+  (*env)->DeleteLocalRef(env, loader);
+  return main_class;
 }
 
 jclass jvm_find_main_class(struct yj_run_args *args, JNIEnv *env) {
+  // -jar, the manifest was read natively
+  if (args->app_jar != NULL && jar_read_manifest(args) &&
+      args->manifest->native) {
+    jclass main_class = jvm_load_main_class(env, args->manifest->main_class);
+    if (main_class != NULL && !(*env)->ExceptionCheck(env)) {
+      TRACE("main class %s loaded natively", args->manifest->main_class);
+      return main_class;
+    }
+    // LauncherHelper reports it the way users know
+    (*env)->ExceptionClear(env);
+  }
+
   jclass helper = (*env)->FindClass(env, "sun/launcher/LauncherHelper");
   jmethodID method =
       (*env)->GetStaticMethodID(env, helper, "checkAndLoadMain",
@@ -682,40 +1997,207 @@ jclass jvm_find_main_class(struct yj_run_args *args, JNIEnv *env) {
     main_class =
         (*env)->CallStaticObjectMethod(env, helper, method, 0, 1, class_str);
     (*env)->DeleteLocalRef(env, class_str);
+  } else if (args->app_module != NULL) { // module mode 3, module[/class]
+    TRACE("main module is %s\n", args->app_module);
+    jstring module_str = (*env)->NewStringUTF(env, args->app_module);
+    main_class =
+        (*env)->CallStaticObjectMethod(env, helper, method, 0, 3, module_str);
+    (*env)->DeleteLocalRef(env, module_str);
   }
 
   return main_class;
 }
 
-void jvm_exec_main_class(struct yj_run_args *args, JNIEnv *env) {
+// --list-modules, --describe-module and --validate-modules which need the
+// module finders of the vm, see modules_answer
+yj_result jvm_module_action(JNIEnv *env, struct yj_run_args *args) {
+  jclass helper = (*env)->FindClass(env, "sun/launcher/LauncherHelper");
+  jmethodID method = NULL;
+  jboolean ok = JNI_TRUE;
+
+  if (helper == NULL) {
+    (*env)->ExceptionClear(env);
+    return YJ_ERR_JAVA;
+  }
+  if (args->list_modules) {
+    method = (*env)->GetStaticMethodID(env, helper, "listModules", "()V");
+    if (method != NULL) {
+      (*env)->CallStaticVoidMethod(env, helper, method);
+    }
+  } else if (args->describe_module) {
+    method = (*env)->GetStaticMethodID(env, helper, "describeModule",
+                                       "(Ljava/lang/String;)V");
+    if (method != NULL) {
+      jstring name = (*env)->NewStringUTF(env, args->module_name);
+      (*env)->CallStaticVoidMethod(env, helper, method, name);
+      (*env)->DeleteLocalRef(env, name);
+    }
+  } else {
+    // void before java 12
+    method = (*env)->GetStaticMethodID(env, helper, "validateModules", "()Z");
+    if (method != NULL) {
+      ok = (*env)->CallStaticBooleanMethod(env, helper, method);
+    } else {
+      (*env)->ExceptionClear(env);
+      method =
+          (*env)->GetStaticMethodID(env, helper, "validateModules", "()V");
+      if (method != NULL) {
+        (*env)->CallStaticVoidMethod(env, helper, method);
+      }
+    }
+  }
+
+  if (method == NULL) {
+    (*env)->ExceptionClear(env);
+    fprintf(stderr, "error: the runtime has no modules\n");
+    return YJ_ERR_JAVA;
+  }
+  if ((*env)->ExceptionCheck(env)) {
+    (*env)->ExceptionDescribe(env);
+    return YJ_ERR_JAVA;
+  }
+  return ok ? YJ_OK : YJ_ERR_JAVA;
+}
+
+// the strings of a String[] are made in local frames of JVM_ARGS_FRAME
+// references, the local reference table stays small for any number of them
+jobjectArray jvm_new_string_array(JNIEnv *env, char **strs, int len) {
+  jclass string_class = (*env)->FindClass(env, "java/lang/String");
+  jobjectArray arr;
+
+  if (string_class == NULL) {
+    return NULL;
+  }
+  arr = (*env)->NewObjectArray(env, len, string_class, NULL);
+  (*env)->DeleteLocalRef(env, string_class);
+  if (arr == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < len; i += JVM_ARGS_FRAME) {
+    if ((*env)->PushLocalFrame(env, JVM_ARGS_FRAME) != 0) {
+      return NULL;
+    }
+    for (int j = i; j < len && j < i + JVM_ARGS_FRAME; j++) {
+      jstring str = (*env)->NewStringUTF(env, strs[j]);
+      if (str == NULL) {
+        (*env)->PopLocalFrame(env, NULL);
+        return NULL;
+      }
+      (*env)->SetObjectArrayElement(env, arr, j, str);
+    }
+    (*env)->PopLocalFrame(env, NULL);
+  }
+  return arr;
+}
+
+int jvm_exec_main_class(struct yj_run_args *args, JNIEnv *env) {
 
   jclass main_class = jvm_find_main_class(args, env);
   if (main_class == NULL) {
     TRACE("main class not found\n");
-    fprintf(stderr, "main class not found!\n");
-    return;
+    if ((*env)->ExceptionOccurred(env)) {
+      (*env)->ExceptionDescribe(env);
+    } else {
+      fprintf(stderr, "main class not found!\n");
+    }
+    return 1;
   }
 
   // find main method
   // public static void main(String[] args) ([Ljava/lang/String;)V
   jmethodID main_method = (*env)->GetStaticMethodID(env, main_class, "main",
                                                     "([Ljava/lang/String;)V");
-  jclass string_class = (*env)->FindClass(env, "java/lang/String");
-  jobjectArray main_args;
-  if (args->app_args != NULL && args->app_args_len > 0) {
-    main_args =
-        (*env)->NewObjectArray(env, args->app_args_len, string_class, NULL);
-    for (int i = 0; i < args->app_args_len; i++) {
-      char *arg = args->app_args[i];
-      jstring arg_obj = (*env)->NewStringUTF(env, arg);
-      (*env)->SetObjectArrayElement(env, main_args, i, arg_obj);
-    }
-  } else {
-    main_args = (*env)->NewObjectArray(env, 0, string_class, NULL);
+  if (main_method == NULL) {
+    (*env)->ExceptionDescribe(env);
+    return 1;
   }
 
+  // startup is done once the main class is loaded
+  prefetch_record(args);
+
   // build main args array
+  jobjectArray main_args =
+      jvm_new_string_array(env, args->app_args, args->app_args_len);
+  if (main_args == NULL) {
+    (*env)->ExceptionDescribe(env);
+    return 1;
+  }
+
   (*env)->CallStaticVoidMethod(env, main_class, main_method, main_args);
+
+  // exit status 1 on an uncaught exception, like the stock launcher
+  return (*env)->ExceptionOccurred(env) == NULL ? 0 : 1;
+}
+
+// entry of the dedicated vm main thread
+void *jvm_main_thread(void *data) {
+  struct jvm_main_ctx *ctx = data;
+  ctx->result = yj_run(ctx->runtime, ctx->args);
+  return NULL;
+}
+
+// -Xss<size> / -XX:ThreadStackSize=<kb>, or the vm default stack size
+bool jvm_stack_size(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                    size_t *out) {
+  struct yj_java_init_fn fn = {0};
+  JDK1_1InitArgs args1_1 = {0};
+  size_t size = 0;
+
+  for (int i = 0; i < args->vmopts_len; i++) {
+    char *opt = args->vmopts[i];
+    if (arg_match_start(opt, "-Xss")) {
+      arg_parse_size(opt + 4, &size);
+    } else if (arg_match_start(opt, "-XX:ThreadStackSize=") &&
+               arg_parse_size(opt + 20, &size)) {
+      size *= 1024;
+    }
+  }
+
+  if (size == 0 && jvm_bind_init_fn(&fn, runtime->libjvm_path) &&
+      fn.GetDefaultJavaVMInitArgs != NULL) {
+    args1_1.version = JNI_VERSION_1_1;
+    fn.GetDefaultJavaVMInitArgs(&args1_1); // ignore return value
+    if (args1_1.javaStackSize > 0) {
+      size = args1_1.javaStackSize;
+    }
+  }
+  if (fn.handle != NULL) {
+    dlclose(fn.handle);
+  }
+
+  *out = size;
+  return size > 0;
+}
+
+// process level metrics of the process which hosts the vm
+void jvm_report_metrics(pid_t pid, int exit_code, long start_us,
+                        struct rusage *usage) {
+  fprintf(stderr,
+          "[yajava] pid %d exit %d wall %.1fms user %.1fms sys %.1fms "
+          "maxrss %ldKB minflt %ld majflt %ld nvcsw %ld nivcsw %ld\n",
+          pid, exit_code, (time_now_us() - start_us) / 1000.0,
+          usage->ru_utime.tv_sec * 1000.0 + usage->ru_utime.tv_usec / 1000.0,
+          usage->ru_stime.tv_sec * 1000.0 + usage->ru_stime.tv_usec / 1000.0,
+          usage->ru_maxrss, usage->ru_minflt, usage->ru_majflt,
+          usage->ru_nvcsw, usage->ru_nivcsw);
+}
+
+// called by the vm on System.exit() and Runtime.halt()
+void JNICALL jvm_exit_hook(jint code) {
+  struct rusage usage = {0};
+
+  if (exit_args == NULL) {
+    return;
+  }
+  if (exit_args->archive != NULL) {
+    archive_finish(exit_args);
+  }
+  preload_finish(exit_args);
+  if (exit_args->print_metrics) {
+    getrusage(RUSAGE_SELF, &usage);
+    jvm_report_metrics(getpid(), code, metrics_start_us, &usage);
+  }
 }
 
 int jvm_print_version(JNIEnv *env, int version, struct yj_run_args *args) {
@@ -758,6 +2240,161 @@ int jvm_print_version(JNIEnv *env, int version, struct yj_run_args *args) {
   return YJ_OK;
 }
 
+// the properties VersionProps.print (sun.misc.Version on 8) reads
+static const char *version_props[] = {
+    "java.version",          "java.version.date", "java.runtime.name",
+    "java.runtime.version",  "java.vendor.version", "java.vm.name",
+    "java.vm.version",       "java.vm.info",      "jdk.debug"};
+
+// options which change the version output, the cache only holds the
+// output of a plain `java -version`
+bool jvm_version_cacheable(struct yj_run_args *args) {
+  static const char *env_opts[] = {"JAVA_TOOL_OPTIONS", "_JAVA_OPTIONS",
+                                   "JDK_JAVA_OPTIONS"};
+  char *env;
+
+  for (int i = 0; i < sizeof(env_opts) / sizeof(char *); i++) {
+    if ((env = getenv(env_opts[i])) != NULL && strlen(env) > 0) {
+      return false; // "Picked up ..." is printed by the vm
+    }
+  }
+
+  for (int i = 0; i < args->vmopts_len; i++) {
+    char *opt = args->vmopts[i];
+    if (arg_match_start(opt, "-Xint") || arg_match_start(opt, "-Xcomp") ||
+        arg_match_start(opt, "-Xmixed") || arg_match_start(opt, "-Xshare") ||
+        arg_match_start(opt, "-XX:")) {
+      return false;
+    }
+  }
+
+  for (int i = 0; i < args->sys_props_len; i++) {
+    char *prop = args->sys_props[i];
+    for (int j = 0; j < sizeof(version_props) / sizeof(char *); j++) {
+      size_t len = strlen(version_props[j]);
+      if (strncmp(prop + 2, version_props[j], len) == 0 &&
+          (prop[2 + len] == '=' || prop[2 + len] == '\0')) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// remember the properties the vm printed the version from
+void jvm_cache_version_props(JNIEnv *env, struct yj_java_runtime *runtime) {
+  struct index idx = {0};
+  char *props = NULL;
+  size_t len = 0;
+
+  for (int i = 0; i < sizeof(version_props) / sizeof(char *); i++) {
+    char *value = jvm_get_sys_props(env, version_props[i]);
+    if (value == NULL) {
+      continue;
+    }
+    size_t add = strlen(version_props[i]) + strlen(value) + 5;
+    props = realloc(props, len + add);
+    len += snprintf(props + len, add, "%s = %s\n", version_props[i], value);
+    free(value);
+  }
+
+  if (props == NULL) {
+    return;
+  }
+  if (runtime->props != NULL && strcmp(runtime->props, props) == 0) {
+    free(props);
+    return;
+  }
+
+  SAFE_FREE(runtime->props);
+  runtime->props = props;
+  index_open(&idx);
+  index_update(&idx, runtime, 1, NULL, NULL);
+  index_close(&idx);
+  TRACE("cache version properties: %s", runtime->home);
+}
+
+// print -version/--version/-showversion like the vm does, from the cached
+// properties. The flag is cleared, yj_run will not print it again.
+bool jvm_print_version_cached(struct yj_java_runtime *runtime,
+                              struct yj_run_args *args) {
+  char java_version[128] = {0}, version_date[32] = {0};
+  char runtime_name[128] = {0}, runtime_version[128] = {0};
+  char vendor_version[128] = {0}, debug[32] = {0};
+  char vm_name[128] = {0}, vm_version[128] = {0}, vm_info[128] = {0};
+  bool err = (args->print_version & YA_PRINT_ERR) == YA_PRINT_ERR;
+  const char *launcher_name;
+  FILE *out = err ? stderr : stdout;
+
+  if ((args->print_version & YA_PRINT_VERSION) != YA_PRINT_VERSION ||
+      runtime->props == NULL || !jvm_version_cacheable(args)) {
+    return false;
+  }
+
+  if (!conf_value(runtime->props, "java.version", java_version,
+                  sizeof(java_version)) ||
+      !conf_value(runtime->props, "java.runtime.name", runtime_name,
+                  sizeof(runtime_name)) ||
+      !conf_value(runtime->props, "java.runtime.version", runtime_version,
+                  sizeof(runtime_version)) ||
+      !conf_value(runtime->props, "java.vm.name", vm_name, sizeof(vm_name)) ||
+      !conf_value(runtime->props, "java.vm.version", vm_version,
+                  sizeof(vm_version)) ||
+      !conf_value(runtime->props, "java.vm.info", vm_info, sizeof(vm_info))) {
+    return false;
+  }
+  conf_value(runtime->props, "java.version.date", version_date,
+             sizeof(version_date));
+  conf_value(runtime->props, "java.vendor.version", vendor_version,
+             sizeof(vendor_version));
+  conf_value(runtime->props, "jdk.debug", debug, sizeof(debug));
+
+  launcher_name = strstr(runtime_name, "OpenJDK") != NULL ? "openjdk" : "java";
+
+  // sun.misc.Version, always on stderr
+  if (runtime->major_version <= 8) {
+    if (!err) {
+      return false; // --version is not known to 8, let the vm fail
+    }
+    fprintf(out, "%s version \"%s\"\n", launcher_name, java_version);
+    fprintf(out, "%s (build %s)\n", runtime_name, runtime_version);
+    fprintf(out, "%s (build %s, %s)\n", vm_name, vm_version, vm_info);
+    fflush(out);
+    args->print_version = 0;
+    return true;
+  }
+
+  // java.lang.VersionProps
+  bool lts = strstr(runtime_version, "-LTS") != NULL;
+  if (strlen(debug) == 0 || strcmp(debug, "release") == 0) {
+    debug[0] = '\0';
+  } else {
+    strncat(debug, " ", sizeof(debug) - strlen(debug) - 1);
+  }
+
+  if (err) {
+    fprintf(out, "%s version \"%s\"", launcher_name, java_version);
+  } else {
+    fprintf(out, "%s %s", launcher_name, java_version);
+  }
+  if (strlen(version_date) > 0) {
+    fprintf(out, " %s", version_date);
+  }
+  fprintf(out, "%s\n", lts ? " LTS" : "");
+
+  fprintf(out, "%s%s%s (%sbuild %s)\n", runtime_name,
+          strlen(vendor_version) > 0 ? " " : "", vendor_version, debug,
+          runtime_version);
+  fprintf(out, "%s%s%s (%sbuild %s, %s)\n", vm_name,
+          strlen(vendor_version) > 0 ? " " : "", vendor_version, debug,
+          vm_version, vm_info);
+  fflush(out);
+
+  TRACE("version printed from cache: %s", runtime->home);
+  args->print_version = 0;
+  return true;
+}
+
 void jvm_print_args(JavaVMInitArgs *args) {
 
   TRACE("args:");
@@ -780,9 +2417,17 @@ bool jvm_create_runtime(char *home, char *lib_path,
   struct yj_java_init_fn fn = {0};
   jint res = 0;
 
-  int major_version = 0;
   jint jni_version = 0;
   char *full_version = NULL;
+  char *vendor = NULL;
+  bool ok;
+
+  // keep the probe vm as small as possible, we only read a few properties
+  JavaVMOption opts[] = {{"-Xint", NULL},
+                         {"-Xshare:auto", NULL},
+                         {"-Xmx16m", NULL},
+                         {"-XX:+UseSerialGC", NULL},
+                         {"-XX:-UsePerfData", NULL}};
 
   TRACE("%s", "try bind");
   if (!jvm_bind_init_fn(&fn, lib_path)) {
@@ -791,8 +2436,8 @@ bool jvm_create_runtime(char *home, char *lib_path,
   }
 
   TRACE("%s", "bind ok");
-  args.nOptions = 0;
-  args.options = NULL;
+  args.nOptions = sizeof(opts) / sizeof(JavaVMOption);
+  args.options = opts;
   args.ignoreUnrecognized = true;
   args.version = JNI_VERSION_1_2;
 
@@ -810,6 +2455,7 @@ bool jvm_create_runtime(char *home, char *lib_path,
     printf("fetch java version failed\n");
     return false;
   }
+  vendor = jvm_get_sys_props(env, "java.vendor");
 
   TRACE("DestroyJavaVM(%p)", vm);
   (*vm)->DetachCurrentThread(vm);
@@ -817,135 +2463,606 @@ bool jvm_create_runtime(char *home, char *lib_path,
 
   dlclose(fn.handle);
 
-  // parse major version
-  //  1.8.0  -> 8
-  //  17.0.1 -> 17
+  ok = jvm_fill_runtime(home, lib_path, full_version, vendor, jni_version,
+                        runtime);
+  free(full_version);
+  SAFE_FREE(vendor);
+  return ok;
+}
 
-  char *to_free, *str, *saveptr, *token, *ver;
+bool jvm_probe_runtime(char *home, char *lib_path,
+                       struct yj_java_runtime *runtime) {
 
-  to_free = str = strdup(full_version);
-  token = strtok_r(str, ".", &saveptr);
-  str = NULL;
-  if (strcmp("1", token) == 0) {
-    ver = strtok_r(NULL, ".", &saveptr);
-  } else {
-    ver = token;
+  if (jvm_probe_static(home, lib_path, runtime)) {
+    return true;
   }
 
-  major_version = atoi(ver);
+  // 3. boot a (minimal) vm in a child process
+  TRACE("probe by vm: %s", home);
+  return jvm_create_runtime_fork(home, lib_path, runtime);
+}
 
-  // write output runtime
-  memset(runtime, 0, sizeof(struct yj_java_runtime));
-  runtime->home = strdup(home);
-  runtime->version = strdup(ver);
-  runtime->full_version = full_version;
-  runtime->libjvm_path = strdup(lib_path);
-  runtime->jni_version = jni_version;
-  runtime->major_version = major_version;
+bool jvm_probe_static(char *home, char *lib_path,
+                      struct yj_java_runtime *runtime) {
 
-  free(to_free);
-  return true;
+  // 1. $JAVA_HOME/release, no process, no vm
+  if (jvm_probe_release(home, lib_path, runtime)) {
+    TRACE("probe by release file: %s", runtime->full_version);
+    return true;
+  }
+
+  // 2. version string compiled into libjvm read-only data
+  if (jvm_probe_libjvm(home, lib_path, runtime)) {
+    TRACE("probe by libjvm: %s", runtime->full_version);
+    return true;
+  }
+  return false;
 }
 
-bool jvm_create_runtime_fork(char *home, char *lib_path,
-                             struct yj_java_runtime *ir) {
-  pid_t pid;
-  int shm_id;
+bool jvm_probe_release(char *home, char *lib_path,
+                       struct yj_java_runtime *runtime) {
 
-  TRACE("create_runtime(%s, %s)", home, lib_path);
-  // SHARED MEM
-  shm_id =
-      shmget(IPC_PRIVATE, sizeof(struct jvm_ipc_runtime), 0666 | IPC_CREAT);
-  TRACE("shmget(%lu)", sizeof(struct jvm_ipc_runtime));
-  if (shm_id < 0) {
-    printf("error create shared memory: %d\n", shm_id);
+  char path[PATH_MAX] = {0};
+  char version[100] = {0};
+  char vendor[100] = {0};
+  char *release;
+  bool ok;
+
+  snprintf(path, PATH_MAX, "%s%c%s", home, FILE_PATH_SEPRATOR, RELEASE_FILE);
+  if ((release = file_read_all(path, RELEASE_MAXLEN, NULL)) == NULL) {
     return false;
   }
 
-  TRACE("%s", "fork()");
-  pid = fork();
-  if (pid == 0) {
-    // child process
-    struct yj_java_runtime r = {0};
-    struct jvm_ipc_runtime * or ;
-    if (!jvm_create_runtime(home, lib_path, &r)) {
-      printf("create runtime falied\n");
-    }
-
-    // ---> SHARED MEM
-    // START
-    or = shmat(shm_id, NULL, 0);
-    if (or == (void *)-1) {
-      printf("attach shared memory failed\n");
-      exit(0);
-    }
+  if (!conf_value(release, "JAVA_VERSION", version, sizeof(version))) {
+    free(release);
+    return false;
+  }
+  conf_value(release, "IMPLEMENTOR", vendor, sizeof(vendor));
+  free(release);
 
-    // write memory
-    memset(or, 0, sizeof(struct jvm_ipc_runtime));
-    SAFE_STRCPY(or->home, r.home, strlen(r.home));
-    SAFE_STRCPY(or->libjvm_path, r.libjvm_path, strlen(r.libjvm_path));
-    SAFE_STRCPY(or->full_version, r.full_version, strlen(r.full_version));
-    SAFE_STRCPY(or->name, r.name, strlen(r.name));
-    SAFE_STRCPY(or->version, r.version, strlen(r.version));
+  ok = jvm_fill_runtime(home, lib_path, version,
+                        strlen(vendor) > 0 ? vendor : NULL, 0, runtime);
+  return ok;
+}
 
-    or->major_version = r.major_version;
-    or->jni_version = r.jni_version;
+#ifdef __linux__
+// locate .rodata in an ELF64 image, the version string lives there
+bool jvm_elf_rodata(const char *map, size_t size, const char **start,
+                           const char **end) {
+  const Elf64_Ehdr *eh = (const Elf64_Ehdr *)map;
+  const Elf64_Shdr *sh, *strtab;
+
+  if (size < sizeof(Elf64_Ehdr) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+      eh->e_ident[EI_CLASS] != ELFCLASS64 || eh->e_shoff == 0 ||
+      eh->e_shstrndx >= eh->e_shnum ||
+      eh->e_shoff + eh->e_shnum * sizeof(Elf64_Shdr) > size) {
+    return false;
+  }
 
-    if (shmdt(or) == -1) {
-      printf("detach shared memory failed\n");
-      exit(0);
+  sh = (const Elf64_Shdr *)(map + eh->e_shoff);
+  strtab = &sh[eh->e_shstrndx];
+  for (int i = 0; i < eh->e_shnum; i++) {
+    if (strtab->sh_offset + sh[i].sh_name >= size ||
+        sh[i].sh_offset + sh[i].sh_size > size) {
+      continue;
     }
-    // END
-    // ---> SHARED MEM
-
-    // release runtime
-    SAFE_FREE(r.home);
-    SAFE_FREE(r.libjvm_path);
-    SAFE_FREE(r.name);
-    SAFE_FREE(r.full_version);
-    SAFE_FREE(r.version);
+    if (strcmp(map + strtab->sh_offset + sh[i].sh_name, ".rodata") == 0) {
+      *start = map + sh[i].sh_offset;
+      *end = *start + sh[i].sh_size;
+      return true;
+    }
+  }
+  return false;
+}
+#endif
 
-    exit(0);
-  } else if (pid == -1) {
-    printf("failed to retrive java runtime, err: create sub-process\n");
-  } else if (pid > 0) {
-    wait(NULL);
+// VM release strings look like `17.0.2+8-86`, `21+35-LTS` or `11.0.20.1+1`
+bool jvm_is_release_string(const char *s, size_t len) {
+  size_t i = 0;
+  bool plus = false;
 
-    struct jvm_ipc_runtime * or ;
-    // ---> SHARED MEM
-    // START
+  if (len < 4 || len > 64 || s[0] < '1' || s[0] > '9') {
+    return false;
+  }
 
-    or = shmat(shm_id, NULL, 0);
-    if (or == (void *)-1) {
-      printf("attach memory failed in main thread\n");
+  // numeric dotted version
+  while (i < len && (isdigit((unsigned char)s[i]) || s[i] == '.')) {
+    if (s[i] == '.' && (i + 1 >= len || !isdigit((unsigned char)s[i + 1]))) {
       return false;
     }
+    i++;
+  }
+
+  // +build
+  if (i < len && s[i] == '+' && i + 1 < len &&
+      isdigit((unsigned char)s[i + 1])) {
+    plus = true;
+    i++;
+    while (i < len && isdigit((unsigned char)s[i])) {
+      i++;
+    }
+  }
+
+  // -opt
+  if (i < len && s[i] == '-') {
+    i++;
+    while (i < len && (isalnum((unsigned char)s[i]) || s[i] == '.')) {
+      i++;
+    }
+  }
+
+  return plus && i == len && atoi(s) >= 9;
+}
+
+bool jvm_probe_libjvm(char *home, char *lib_path,
+                      struct yj_java_runtime *runtime) {
+
+  struct stat st;
+  char version[100] = {0};
+  const char *map, *start, *end, *p, *q;
+  bool found = false;
+  int fd;
+
+  if ((fd = open(lib_path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return false;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+  start = map;
+  end = map + st.st_size;
+#ifdef __linux__
+  jvm_elf_rodata(map, st.st_size, &start, &end);
+#endif
+
+  // walk the nul-terminated strings
+  for (p = start; p < end && !found; p = q + 1) {
+    if ((q = memchr(p, '\0', end - p)) == NULL) {
+      break;
+    }
+    if (jvm_is_release_string(p, q - p)) {
+      // java.version is the release string up to the build number
+      size_t len = strcspn(p, "+");
+      if (len < sizeof(version)) {
+        memcpy(version, p, len);
+        found = true;
+      }
+    }
+  }
+  munmap((void *)map, st.st_size);
+
+  if (!found) {
+    return false;
+  }
+  return jvm_fill_runtime(home, lib_path, version, NULL, 0, runtime);
+}
+
+bool jvm_fill_runtime(char *home, char *lib_path, const char *full_version,
+                      const char *vendor, jint jni_version,
+                      struct yj_java_runtime *runtime) {
+
+  char *version = NULL;
+  int major_version;
+
+  if (full_version == NULL || strlen(full_version) == 0) {
+    return false;
+  }
+
+  // parse major version
+  //  1.8.0  -> 8
+  //  17.0.1 -> 17
+  if ((major_version = jvm_parse_major_version(full_version, &version)) <= 0) {
+    SAFE_FREE(version);
+    return false;
+  }
+
+  // write output runtime
+  memset(runtime, 0, sizeof(struct yj_java_runtime));
+  runtime->home = strdup(home);
+  runtime->version = version;
+  runtime->full_version = strdup(full_version);
+  runtime->libjvm_path = strdup(lib_path);
+  runtime->vendor = SAFE_STRDUP(vendor);
+  runtime->major_version = major_version;
+  runtime->jni_version =
+      jni_version > 0 ? jni_version : jvm_jni_version_of(major_version);
+  jvm_probe_caps(runtime);
+
+  return true;
+}
+
+// capabilities from the release file and the layout of the home, without
+// a vm. The GC set follows the version and vendor of a HotSpot build.
+void jvm_probe_caps(struct yj_java_runtime *runtime) {
+  char path[PATH_MAX] = {0};
+  char value[RELEASE_MAXLEN] = {0};
+  char *release, *slash;
+  int major = runtime->major_version;
+  bool hotspot = true;
+
+  runtime->gcs = 0;
+  runtime->features = 0;
+  SAFE_FREE(runtime->arch);
+
+  snprintf(path, PATH_MAX, "%s%c%s", runtime->home, FILE_PATH_SEPRATOR,
+           RELEASE_FILE);
+  release = file_read_all(path, RELEASE_MAXLEN, NULL);
+
+  if (release != NULL &&
+      conf_value(release, "OS_ARCH", value, sizeof(value))) {
+    runtime->arch = strdup(strcmp(value, "amd64") == 0 ? "x86_64" : value);
+  } else if (runtime->libjvm_path != NULL &&
+             strstr(runtime->libjvm_path, "/amd64/") != NULL) {
+    runtime->arch = strdup("x86_64");
+  }
+
+  if ((release != NULL &&
+       conf_value(release, "JVM_VARIANT", value, sizeof(value)) &&
+       str_icontains(value, "openj9")) ||
+      (runtime->vendor != NULL && str_icontains(runtime->vendor, "openj9"))) {
+    hotspot = false;
+    runtime->features |= YJ_FEAT_OPENJ9;
+  }
+
+  if (hotspot) {
+    runtime->gcs |= YJ_GC_SERIAL | YJ_GC_PARALLEL | YJ_GC_G1;
+    runtime->features |= YJ_FEAT_NMT;
+    if (major <= 13) {
+      runtime->gcs |= YJ_GC_CMS;
+    }
+    if (major >= 11) {
+      runtime->gcs |= YJ_GC_EPSILON;
+    }
+    // ZGC, experimental before 15, x86_64 and aarch64 only
+    if (major >= 11 &&
+        (runtime->arch == NULL || strcmp(runtime->arch, "x86_64") == 0 ||
+         strcmp(runtime->arch, "aarch64") == 0)) {
+      runtime->gcs |= YJ_GC_ZGC;
+    }
+    // Oracle builds leave Shenandoah out
+    if (major >= 12 &&
+        (runtime->vendor == NULL || !str_icontains(runtime->vendor, "oracle"))) {
+      runtime->gcs |= YJ_GC_SHENANDOAH;
+    }
+    if (major >= 24) {
+      runtime->features |= YJ_FEAT_AOT_CACHE;
+    }
+
+    // the default archive sits next to libjvm
+    if (runtime->libjvm_path != NULL &&
+        (slash = strrchr(runtime->libjvm_path, FILE_PATH_SEPRATOR)) != NULL) {
+      snprintf(path, PATH_MAX, "%.*s%cclasses.jsa",
+               (int)(slash - runtime->libjvm_path), runtime->libjvm_path,
+               FILE_PATH_SEPRATOR);
+      if (file_is_file(path)) {
+        runtime->features |= YJ_FEAT_CDS;
+      }
+    }
+  }
+
+  // jlink images list their modules, java 8 ships jfr.jar (Oracle) or the
+  // jfr settings directory (OpenJDK 8u262 and later)
+  if (release != NULL && conf_value(release, "MODULES", value, sizeof(value))) {
+    char *p = value;
+    while ((p = strstr(p, "jdk.jfr")) != NULL) {
+      if ((p == value || p[-1] == ' ') && (p[7] == ' ' || p[7] == '\0')) {
+        runtime->features |= YJ_FEAT_JFR;
+        break;
+      }
+      p += 7;
+    }
+  } else if (major >= 11) {
+    runtime->features |= hotspot ? YJ_FEAT_JFR : 0;
+  } else {
+    snprintf(path, PATH_MAX, "%s%cjre%clib%cjfr", runtime->home,
+             FILE_PATH_SEPRATOR, FILE_PATH_SEPRATOR, FILE_PATH_SEPRATOR);
+    if (file_is_dir(path) || (strlen(path) + 4 < PATH_MAX &&
+                              file_is_file(strcat(path, ".jar")))) {
+      runtime->features |= YJ_FEAT_JFR;
+    }
+  }
+
+  SAFE_FREE(release);
+}
 
-    memset(ir, 0, sizeof(struct yj_java_runtime));
+// options which only work when the runtime has the gc or the feature. The
+// capabilities are guessed, they only rank runtimes in jvm_select: options
+// are always passed to the vm, which rejects what it does not support.
+bool jvm_supports_option(struct yj_java_runtime *runtime, const char *opt) {
+  // clang-format off
+  static const struct {
+    const char *prefix;
+    unsigned int gc;
+    unsigned int feature;
+  } table[] = {
+      {"-XX:+UseSerialGC", YJ_GC_SERIAL, 0},
+      {"-XX:+UseParallelGC", YJ_GC_PARALLEL, 0},
+      {"-XX:+UseG1GC", YJ_GC_G1, 0},
+      {"-XX:+UseConcMarkSweepGC", YJ_GC_CMS, 0},
+      {"-XX:+UseZGC", YJ_GC_ZGC, 0},
+      {"-XX:+UseShenandoahGC", YJ_GC_SHENANDOAH, 0},
+      {"-XX:+UseEpsilonGC", YJ_GC_EPSILON, 0},
+      {"-XX:AOTCache=", 0, YJ_FEAT_AOT_CACHE},
+      {"-XX:AOTMode=", 0, YJ_FEAT_AOT_CACHE},
+      {"-XX:AOTConfiguration=", 0, YJ_FEAT_AOT_CACHE},
+      {"-XX:StartFlightRecording", 0, YJ_FEAT_JFR},
+      {"-XX:NativeMemoryTracking=", 0, YJ_FEAT_NMT}};
+  // clang-format on
+
+  // nothing known about the runtime, let the vm decide
+  if (runtime == NULL || (runtime->gcs == 0 && runtime->features == 0)) {
+    return true;
+  }
 
-    ir->home = SAFE_STRDUP(or->home);
-    ir->name = SAFE_STRDUP(or->name);
-    ir->version = SAFE_STRDUP(or->version);
-    ir->full_version = SAFE_STRDUP(or->full_version);
-    ir->libjvm_path = SAFE_STRDUP(or->libjvm_path);
-    ir->jni_version = or->jni_version;
-    ir->major_version = or->major_version;
+  for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+    if (strncmp(opt, table[i].prefix, strlen(table[i].prefix)) == 0) {
+      return (runtime->gcs & table[i].gc) == table[i].gc &&
+             (runtime->features & table[i].feature) == table[i].feature;
+    }
+  }
+  return true;
+}
 
-    if (shmdt(or) == -1) {
-      printf("detach memory failed in main thread\n");
+// whether the runtime is guessed to support all options of the constraint
+bool jvm_supports_options(struct jvm_constraint *c,
+                          struct yj_java_runtime *runtime) {
+  for (int i = 0; i < c->vmopts_len; i++) {
+    if (c->vmopts[i] != NULL && !jvm_supports_option(runtime, c->vmopts[i])) {
       return false;
     }
-    // END
-    // ---> SHARED MEM
+  }
+  return true;
+}
+
+int jvm_parse_major_version(const char *full_version, char **version) {
+  char *to_free, *str, *saveptr, *token, *ver;
+  int major_version;
+
+  to_free = str = strdup(full_version);
+  token = strtok_r(str, ".", &saveptr);
+  if (token == NULL) {
+    free(to_free);
+    return 0;
+  }
+
+  if (strcmp("1", token) == 0) {
+    ver = strtok_r(NULL, ".", &saveptr);
+  } else {
+    ver = token;
+  }
+
+  if (ver == NULL) {
+    free(to_free);
+    return 0;
+  }
+
+  // 22-ea -> 22
+  ver[strspn(ver, "0123456789")] = '\0';
+  major_version = atoi(ver);
+  if (version != NULL) {
+    *version = strdup(ver);
+  }
+
+  free(to_free);
+  return major_version;
+}
+
+// the value JNIEnv::GetVersion() reports on each release line
+jint jvm_jni_version_of(int major_version) {
+  if (major_version >= 24) {
+    return JNI_VERSION_24;
+  } else if (major_version >= 21) {
+    return JNI_VERSION_21;
+  } else if (major_version == 20) {
+    return JNI_VERSION_20;
+  } else if (major_version == 19) {
+    return JNI_VERSION_19;
+  } else if (major_version >= 10) {
+    return JNI_VERSION_10;
+  } else if (major_version == 9) {
+    return JNI_VERSION_9;
+  } else if (major_version == 8) {
+    return JNI_VERSION_1_8;
+  }
+  return JNI_VERSION_1_6;
+}
+
+bool jvm_create_runtime_fork(char *home, char *lib_path,
+                             struct yj_java_runtime *ir) {
+  struct jvm_probe probe = {0};
+
+  probe.home = home;
+  probe.lib_path = lib_path;
+  probe.runtime = ir;
+  return jvm_probe_vm_all(&probe, 1) == 1;
+}
+
+// child side of a vm probe, the result is sent back through the pipe
+void jvm_probe_vm_child(struct jvm_probe *probe, int fd) {
+  struct yj_java_runtime r = {0};
+  struct jvm_ipc_runtime or = {0};
+
+  if (!jvm_create_runtime(probe->home, probe->lib_path, &r)) {
+    printf("create runtime falied\n");
+    _exit(1);
+  }
+
+  SAFE_STRCPY(or.home, r.home, strnlen(r.home, sizeof(or.home) - 1));
+  SAFE_STRCPY(or.libjvm_path, r.libjvm_path,
+              strnlen(r.libjvm_path, sizeof(or.libjvm_path) - 1));
+  SAFE_STRCPY(or.full_version, r.full_version,
+              strnlen(r.full_version, sizeof(or.full_version) - 1));
+  SAFE_STRCPY(or.name, r.name, strnlen(r.name, sizeof(or.name) - 1));
+  SAFE_STRCPY(or.version, r.version, strnlen(r.version, sizeof(or.version) - 1));
+  SAFE_STRCPY(or.vendor, r.vendor, strnlen(r.vendor, sizeof(or.vendor) - 1));
+  or.major_version = r.major_version;
+  or.jni_version = r.jni_version;
+
+  if (!file_write_all(fd, &or, sizeof(or))) {
+    _exit(1);
+  }
+  _exit(0);
+}
+
+bool jvm_probe_vm_start(struct jvm_probe *probe, long timeout_ms) {
+  int fds[2];
+
+  if (pipe(fds) != 0) {
+    printf("failed to retrive java runtime, err: create pipe\n");
+    return false;
   }
 
-  if (shmctl(shm_id, IPC_RMID, NULL) == -1) {
-    printf("delete shared memory failed\n");
+  // do not duplicate pending stdio buffers into the child
+  fflush(NULL);
+
+  TRACE("fork() for %s", probe->home);
+  probe->pid = fork();
+  if (probe->pid == 0) {
+    close(fds[0]);
+    jvm_probe_vm_child(probe, fds[1]);
+  } else if (probe->pid == -1) {
+    printf("failed to retrive java runtime, err: create sub-process\n");
+    close(fds[0]);
+    close(fds[1]);
     return false;
   }
+
+  close(fds[1]);
+  probe->fd = fds[0];
+  probe->received = 0;
+  probe->deadline = time_now_ms() + timeout_ms;
   return true;
 }
 
+void jvm_probe_vm_finish(struct jvm_probe *probe, bool timeout) {
+  struct jvm_ipc_runtime * or = &probe->buf;
+  struct yj_java_runtime *ir = probe->runtime;
+
+  if (timeout) {
+    TRACE("probe timeout, kill %d: %s", probe->pid, probe->home);
+    kill(probe->pid, SIGKILL);
+  }
+  close(probe->fd);
+  probe->fd = -1;
+  waitpid(probe->pid, NULL, 0);
+
+  if (timeout || probe->received != sizeof(struct jvm_ipc_runtime) ||
+      strlen(or->full_version) == 0) {
+    fprintf(stderr, "probe java runtime failed: %s\n", probe->home);
+    return;
+  }
+
+  memset(ir, 0, sizeof(struct yj_java_runtime));
+  ir->home = SAFE_STRDUP(or->home);
+  ir->name = strlen(or->name) > 0 ? strdup(or->name) : NULL;
+  ir->version = SAFE_STRDUP(or->version);
+  ir->full_version = SAFE_STRDUP(or->full_version);
+  ir->libjvm_path = SAFE_STRDUP(or->libjvm_path);
+  ir->vendor = strlen(or->vendor) > 0 ? strdup(or->vendor) : NULL;
+  ir->jni_version = or->jni_version;
+  ir->major_version = or->major_version;
+  jvm_probe_caps(ir);
+  probe->ok = true;
+}
+
+// boot every probe in a child process, at most $YAJAVA_PROBE_JOBS at once,
+// results are collected as the children exit
+size_t jvm_probe_vm_all(struct jvm_probe *probes, size_t len) {
+  long timeout_ms = env_long("YAJAVA_PROBE_TIMEOUT", PROBE_TIMEOUT_MS);
+  long jobs = env_long("YAJAVA_PROBE_JOBS", sysconf(_SC_NPROCESSORS_ONLN));
+  struct pollfd *fds;
+  struct jvm_probe **running;
+  size_t next = 0, nrunning = 0, nok = 0;
+
+  if (jobs < 1) {
+    jobs = 1;
+  }
+
+  fds = calloc(jobs, sizeof(struct pollfd));
+  running = calloc(jobs, sizeof(struct jvm_probe *));
+
+  while (next < len || nrunning > 0) {
+
+    // fill up the worker slots
+    while (next < len && nrunning < (size_t)jobs) {
+      struct jvm_probe *probe = &probes[next++];
+      probe->fd = -1;
+      probe->ok = false;
+      if (jvm_probe_vm_start(probe, timeout_ms)) {
+        running[nrunning++] = probe;
+      }
+    }
+    if (nrunning == 0) {
+      break;
+    }
+
+    long now = time_now_ms();
+    long wait_ms = timeout_ms;
+    for (size_t i = 0; i < nrunning; i++) {
+      fds[i].fd = running[i]->fd;
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+      if (running[i]->deadline - now < wait_ms) {
+        wait_ms = running[i]->deadline - now;
+      }
+    }
+
+    if (poll(fds, nrunning, wait_ms < 0 ? 0 : wait_ms) < 0 && errno != EINTR) {
+      break;
+    }
+
+    now = time_now_ms();
+    for (size_t i = 0; i < nrunning;) {
+      struct jvm_probe *probe = running[i];
+      bool done = false, timeout = false;
+
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        size_t left = sizeof(struct jvm_ipc_runtime) - probe->received;
+        ssize_t n = 0;
+        if (left > 0) {
+          n = read(probe->fd, (char *)&probe->buf + probe->received, left);
+        }
+        if (n > 0) {
+          probe->received += n;
+        } else if (n == 0 || errno != EINTR) {
+          done = true; // eof or error
+        }
+      } else if (probe->deadline <= now) {
+        done = timeout = true;
+      }
+
+      if (!done) {
+        i++;
+        continue;
+      }
+
+      jvm_probe_vm_finish(probe, timeout);
+      nok += probe->ok ? 1 : 0;
+
+      // swap with the last running one, fds are rebuilt every round
+      running[i] = running[--nrunning];
+      fds[i] = fds[nrunning];
+    }
+  }
+
+  // only reached on poll failure
+  for (size_t i = 0; i < nrunning; i++) {
+    jvm_probe_vm_finish(running[i], true);
+  }
+
+  free(fds);
+  free(running);
+  return nok;
+}
+
 bool jvm_unwrap_str(JNIEnv *env, jstring jstr, char **out) {
   if (env == NULL || jstr == NULL || out == NULL) {
     return false;
@@ -969,76 +3086,6448 @@ char *jvm_get_sys_props(JNIEnv *env, const char *key) {
     return NULL;
   }
 
-  sys_cls = (*env)->FindClass(env, "java/lang/System");
-  get_prop_m = (*env)->GetStaticMethodID(
-      env, sys_cls, "getProperty", "(Ljava/lang/String;)Ljava/lang/String;");
+  sys_cls = (*env)->FindClass(env, "java/lang/System");
+  get_prop_m = (*env)->GetStaticMethodID(
+      env, sys_cls, "getProperty", "(Ljava/lang/String;)Ljava/lang/String;");
+
+  assert(sys_cls != NULL);
+  assert(get_prop_m != NULL);
+
+  jstring jkey = (*env)->NewStringUTF(env, key);
+  jstring jvalue =
+      (*env)->CallStaticObjectMethod(env, sys_cls, get_prop_m, jkey);
+
+  char *value = NULL;
+
+  if (jvalue != NULL) {
+    jvm_unwrap_str(env, jvalue, &value);
+    (*env)->DeleteLocalRef(env, jvalue);
+  }
+  (*env)->DeleteLocalRef(env, jkey);
+
+  return value;
+}
+
+bool jvm_retrive_version(JNIEnv *env, char **out) {
+  char *version_str = jvm_get_sys_props(env, "java.version");
+  if (version_str == NULL) {
+    return false;
+  }
+  *out = version_str;
+  return true;
+}
+
+int jvm_runtime_compare(const void *a, const void *b) {
+  if (a == NULL) {
+    return -1;
+  }
+
+  if (b == NULL) {
+    return 1;
+  }
+
+  const struct yj_java_runtime *r1 = a;
+  const struct yj_java_runtime *r2 = b;
+
+  // compare major version
+  int m1 = r1->major_version;
+  int m2 = r2->major_version;
+
+  if (m1 == m2) {
+    return jvm_version_compare(r1->full_version, r2->full_version);
+  }
+
+  return m1 - m2;
+}
+
+// 1.8.0_312 -> 8 0 312, 17.0.2 -> 17 0 2
+int jvm_version_split(const char *version, int *parts, int maxlen) {
+  const char *p = version;
+  int n = 0;
+
+  if (version == NULL) {
+    return 0;
+  }
+
+  while (*p != '\0' && n < maxlen) {
+    if (!isdigit((unsigned char)*p)) {
+      break;
+    }
+    parts[n++] = strtol(p, (char **)&p, 10);
+    if (*p != '.' && *p != '_') {
+      break;
+    }
+    p++;
+  }
+
+  // legacy 1.x versions
+  if (n >= 2 && parts[0] == 1 && parts[1] < 9) {
+    memmove(parts, parts + 1, (n - 1) * sizeof(int));
+    n--;
+  }
+  return n;
+}
+
+int jvm_version_compare(const char *v1, const char *v2) {
+  int p1[VERSION_PARTS] = {0}, p2[VERSION_PARTS] = {0};
+
+  jvm_version_split(v1, p1, VERSION_PARTS);
+  jvm_version_split(v2, p2, VERSION_PARTS);
+  for (int i = 0; i < VERSION_PARTS; i++) {
+    if (p1[i] != p2[i]) {
+      return p1[i] - p2[i];
+    }
+  }
+  return 0;
+}
+
+// 17, =17.0.2, >=21, <11, 21+vendor=temurin, temurin-21, /path/to/home
+bool jvm_parse_constraint(const char *in, struct jvm_constraint *c) {
+  char buf[PATH_MAX] = {0};
+  char *p, *q, *saveptr;
+
+  memset(c, 0, sizeof(struct jvm_constraint));
+  c->op = CMP_ANY;
+
+  while (isspace((unsigned char)*in)) {
+    in++;
+  }
+  snprintf(buf, PATH_MAX, "%s", in);
+  for (size_t len = strlen(buf); len > 0 && isspace((unsigned char)buf[len - 1]);
+       len--) {
+    buf[len - 1] = '\0';
+  }
+
+  if (buf[0] == FILE_PATH_SEPRATOR || buf[0] == '.' || buf[0] == '~') {
+    if (buf[0] == '~' && getenv("HOME") != NULL) {
+      snprintf(c->home, PATH_MAX, "%s%s", getenv("HOME"), buf + 1);
+    } else {
+      snprintf(c->home, PATH_MAX, "%s", buf);
+    }
+    return true;
+  }
+
+  // qualifiers
+  p = strtok_r(buf, "+", &saveptr);
+  while ((q = strtok_r(NULL, "+", &saveptr)) != NULL) {
+    if (arg_match_start(q, "vendor=")) {
+      snprintf(c->vendor, sizeof(c->vendor), "%s", q + 7);
+    } else {
+      return false;
+    }
+  }
+  if (p == NULL || strlen(p) == 0) {
+    return true;
+  }
+
+  // vendor-version as written by sdkman/jenv, e.g. temurin-21
+  if (isalpha((unsigned char)p[0]) && (q = strrchr(p, '-')) != NULL &&
+      isdigit((unsigned char)q[1])) {
+    *q = '\0';
+    if (strlen(c->vendor) == 0) {
+      snprintf(c->vendor, sizeof(c->vendor), "%s", p);
+    }
+    p = q + 1;
+  }
+
+  if (arg_match_start(p, ">=")) {
+    c->op = CMP_GE;
+    p += 2;
+  } else if (arg_match_start(p, "<=")) {
+    c->op = CMP_LE;
+    p += 2;
+  } else if (p[0] == '>') {
+    c->op = CMP_GT;
+    p++;
+  } else if (p[0] == '<') {
+    c->op = CMP_LT;
+    p++;
+  } else {
+    c->op = CMP_EQ;
+    p += p[0] == '=' ? 1 : 0;
+  }
+
+  c->version_len = jvm_version_split(p, c->version, VERSION_PARTS);
+  return c->version_len > 0;
+}
+
+bool jvm_match_constraint(struct jvm_constraint *c,
+                          struct yj_java_runtime *runtime) {
+  int parts[VERSION_PARTS] = {0};
+  int cmp = 0;
+
+  if (runtime->full_version == NULL) {
+    return false;
+  }
+
+  if (strlen(c->vendor) > 0 && !jvm_match_vendor(c->vendor, runtime)) {
+    return false;
+  }
+
+  if (c->op == CMP_ANY) {
+    return true;
+  }
+
+  // compare on the parts given by the constraint, 17 matches 17.0.2
+  jvm_version_split(runtime->full_version, parts, VERSION_PARTS);
+  for (int i = 0; i < c->version_len && cmp == 0; i++) {
+    cmp = parts[i] - c->version[i];
+  }
+
+  switch (c->op) {
+  case CMP_EQ:
+    return cmp == 0;
+  case CMP_GT:
+    return cmp > 0;
+  case CMP_GE:
+    return cmp >= 0;
+  case CMP_LT:
+    return cmp < 0;
+  case CMP_LE:
+    return cmp <= 0;
+  default:
+    return true;
+  }
+}
+
+// vendor names as used by version managers, matched against IMPLEMENTOR
+bool jvm_match_vendor(const char *want, struct yj_java_runtime *runtime) {
+  // clang-format off
+  static const char *aliases[][2] = {
+      {"temurin", "adoptium"}, {"zulu", "azul"},
+      {"corretto", "amazon"},  {"liberica", "bellsoft"},
+      {"semeru", "ibm"},       {"sapmachine", "sap"},
+      {"ms", "microsoft"},     {"oracle", "oracle"}};
+  // clang-format on
+  const char *alias = want;
+
+  for (int i = 0; i < sizeof(aliases) / sizeof(aliases[0]); i++) {
+    if (strcasecmp(want, aliases[i][0]) == 0) {
+      alias = aliases[i][1];
+      break;
+    }
+  }
+
+  if (runtime->vendor != NULL && (str_icontains(runtime->vendor, want) ||
+                                  str_icontains(runtime->vendor, alias))) {
+    return true;
+  }
+
+  // fall back to the directory name, e.g. /usr/lib/jvm/temurin-21-jdk
+  const char *name = runtime->home == NULL
+                         ? NULL
+                         : strrchr(runtime->home, FILE_PATH_SEPRATOR);
+  return name != NULL && str_icontains(name, want);
+}
+
+// YAJAVA_RUNTIME, then `runtime` from the configuration
+bool jvm_explicit_constraint(char *out, size_t maxlen) {
+  char *env;
+
+  if ((env = getenv("YAJAVA_RUNTIME")) != NULL && strlen(env) > 0) {
+    TRACE("runtime from YAJAVA_RUNTIME: %s", env);
+    return snprintf(out, maxlen, "%s", env) < (int)maxlen;
+  }
+
+  if (config_get("runtime", out, maxlen)) {
+    TRACE("runtime from configuration: %s", out);
+    return true;
+  }
+  return false;
+}
+
+// the newest (or the oldest with lowest) runtime matching the constraint
+yj_result jvm_select(struct jvm_constraint *c, bool lowest,
+                     struct yj_java_runtime *runtime) {
+  struct index idx = {0};
+  struct index_entry *best = NULL;
+  struct yj_java_runtime candidate;
+  struct yj_discovery discovery;
+  int64_t *mtimes;
+  int sign = lowest ? -1 : 1;
+  bool fit, best_fit = false;
+
+  // fast path, runtimes already in the index while no discovery root
+  // changed since it was scanned
+  yj_discovery_defaults(&discovery);
+  mtimes = calloc(discovery.roots_len + 1, sizeof(int64_t));
+  for (size_t i = 0; mtimes != NULL && i < discovery.roots_len; i++) {
+    mtimes[i] = index_root_mtime(discovery.roots[i].path);
+  }
+  index_open(&idx);
+  if (mtimes == NULL || !index_roots_fresh(&idx, &discovery, mtimes)) {
+    TRACE("discovery roots changed, rescan");
+    index_close(&idx);
+  }
+  free(mtimes);
+  for (uint32_t i = 0; idx.map != NULL && i < idx.header->count; i++) {
+    struct index_entry *e = &idx.entries[i];
+    index_load(&idx, e, &candidate);
+    if (jvm_match_constraint(c, &candidate) && index_is_fresh(&idx, e)) {
+      fit = jvm_supports_options(c, &candidate);
+      if (best == NULL || fit > best_fit ||
+          (fit == best_fit &&
+           sign * jvm_version_compare(index_str(&idx, e->full_version),
+                                      index_str(&idx, best->full_version)) >
+               0)) {
+        best = e;
+        best_fit = fit;
+      }
+    }
+    yj_free_runtime(&candidate);
+  }
+  if (best != NULL) {
+    index_load(&idx, best, runtime);
+    index_close(&idx);
+    yj_free_discovery(&discovery);
+    TRACE("select from index: %s", runtime->home);
+    return YJ_OK;
+  }
+  index_close(&idx);
+
+  // slow path, scan the discovery roots (which refreshes the index)
+  struct yj_java_runtime *found = NULL;
+  size_t found_len = 0;
+  int best_idx = -1;
+
+  yj_java_discovery_roots(&discovery, &found, &found_len);
+  yj_free_discovery(&discovery);
+
+  for (size_t i = 0; i < found_len; i++) {
+    if (!jvm_match_constraint(c, &found[i])) {
+      continue;
+    }
+    fit = jvm_supports_options(c, &found[i]);
+    if (best_idx < 0 || fit > best_fit ||
+        (fit == best_fit &&
+         sign * jvm_version_compare(found[i].full_version,
+                                    found[best_idx].full_version) >
+             0)) {
+      best_idx = i;
+      best_fit = fit;
+    }
+  }
+
+  for (size_t i = 0; i < found_len; i++) {
+    if ((int)i == best_idx) {
+      *runtime = found[i];
+    } else {
+      yj_free_runtime(&found[i]);
+    }
+  }
+  free(found);
+
+  if (best_idx < 0) {
+    TRACE("no runtime matches the constraint");
+    return YJ_ERR_NO_RUNTIME;
+  }
+  TRACE("select from discovery: %s", runtime->home);
+  return YJ_OK;
+}
+
+bool jvm_opt_arr_add(struct jvm_opt_arr *arr, char *opt, char *extra) {
+
+  if (arr == NULL || opt == NULL) {
+    return false;
+  }
+
+  if (arr->maxlen <= arr->len) {
+    arr->maxlen += 5;
+    arr->opts = realloc(arr->opts, arr->maxlen * sizeof(JavaVMOption));
+  }
+
+  JavaVMOption *o = &arr->opts[arr->len++];
+  o->optionString = opt;
+  o->extraInfo = extra;
+
+  return true;
+}
+
+// append to built options, JavaVMInitArgs owns them afterwards
+bool jvm_args_add(JavaVMInitArgs *args, char *opt) {
+  JavaVMOption *opts;
+
+  if (opt == NULL) {
+    return false;
+  }
+  opts = realloc(args->options, (args->nOptions + 1) * sizeof(JavaVMOption));
+  if (opts == NULL) {
+    free(opt);
+    return false;
+  }
+  opts[args->nOptions].optionString = opt;
+  opts[args->nOptions].extraInfo = NULL;
+  args->options = opts;
+  args->nOptions++;
+  return true;
+}
+
+// INDEX
+// persistent runtime index, readers never lock: the file is replaced by
+// rename(2), an opened mapping always sees a complete snapshot
+bool index_open(struct index *idx) {
+  char path[PATH_MAX] = {0};
+  struct stat st;
+  void *map;
+  int fd;
+
+  memset(idx, 0, sizeof(struct index));
+  if (!cache_path(INDEX_FILE, path, PATH_MAX, false)) {
+    return false;
+  }
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return false;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(struct index_header)) {
+    close(fd);
+    return false;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+  struct index_header *header = map;
+  size_t entries_size = (size_t)header->count * sizeof(struct index_entry) +
+                        (size_t)header->roots_len * sizeof(struct index_root);
+  if (header->magic != INDEX_MAGIC || header->version != INDEX_VERSION ||
+      sizeof(struct index_header) + entries_size + header->strings_len !=
+          (size_t)st.st_size ||
+      header->strings_len == 0 ||
+      ((const char *)map)[st.st_size - 1] != '\0') {
+    TRACE("invalid index file: %s", path);
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  idx->map = map;
+  idx->size = st.st_size;
+  idx->header = header;
+  idx->entries = (struct index_entry *)(header + 1);
+  idx->roots = (struct index_root *)(idx->entries + header->count);
+  idx->strings = (const char *)(idx->roots + header->roots_len);
+  TRACE("index opened: %s, %u entries", path, header->count);
+  return true;
+}
+
+void index_close(struct index *idx) {
+  if (idx->map != NULL) {
+    munmap(idx->map, idx->size);
+  }
+  memset(idx, 0, sizeof(struct index));
+}
+
+const char *index_str(struct index *idx, uint32_t off) {
+  if (off == 0 || off >= idx->header->strings_len) {
+    return NULL;
+  }
+  return idx->strings + off;
+}
+
+struct index_entry *index_find(struct index *idx, const char *home) {
+  if (idx->map == NULL || home == NULL) {
+    return NULL;
+  }
+
+  for (uint32_t i = 0; i < idx->header->count; i++) {
+    const char *h = index_str(idx, idx->entries[i].home);
+    if (h != NULL && strcmp(h, home) == 0) {
+      return &idx->entries[i];
+    }
+  }
+  return NULL;
+}
+
+bool index_is_fresh(struct index *idx, struct index_entry *entry) {
+  const char *lib_path = index_str(idx, entry->libjvm_path);
+  const char *home = index_str(idx, entry->home);
+  struct stat st;
+  uint64_t release_size;
+  int64_t release_mtime_ns;
+
+  if (lib_path == NULL || home == NULL ||
+      fstatat(AT_FDCWD, lib_path, &st, 0) != 0) {
+    return false;
+  }
+
+  // the version, vendor and capabilities are read from the release file
+  index_release_stat(home, &release_size, &release_mtime_ns);
+  return entry->dev == (uint64_t)st.st_dev &&
+         entry->ino == (uint64_t)st.st_ino &&
+         entry->size == (uint64_t)st.st_size &&
+         entry->mtime_ns == stat_mtime_ns(&st) &&
+         entry->release_size == release_size &&
+         entry->release_mtime_ns == release_mtime_ns;
+}
+
+void index_release_stat(const char *home, uint64_t *size, int64_t *mtime_ns) {
+  char path[PATH_MAX] = {0};
+  struct stat st;
+
+  snprintf(path, PATH_MAX, "%s%c%s", home, FILE_PATH_SEPRATOR, RELEASE_FILE);
+  if (stat(path, &st) != 0) {
+    *size = 0;
+    *mtime_ns = -1;
+    return;
+  }
+  *size = st.st_size;
+  *mtime_ns = stat_mtime_ns(&st);
+}
+
+bool index_load(struct index *idx, struct index_entry *entry,
+                struct yj_java_runtime *runtime) {
+
+  memset(runtime, 0, sizeof(struct yj_java_runtime));
+  runtime->home = SAFE_STRDUP(index_str(idx, entry->home));
+  runtime->libjvm_path = SAFE_STRDUP(index_str(idx, entry->libjvm_path));
+  runtime->version = SAFE_STRDUP(index_str(idx, entry->version));
+  runtime->full_version = SAFE_STRDUP(index_str(idx, entry->full_version));
+  runtime->vendor = SAFE_STRDUP(index_str(idx, entry->vendor));
+  runtime->major_version = entry->major_version;
+  runtime->jni_version = entry->jni_version;
+  runtime->arch = SAFE_STRDUP(index_str(idx, entry->arch));
+  runtime->gcs = entry->gcs;
+  runtime->features = entry->features;
+  runtime->props = SAFE_STRDUP(index_str(idx, entry->props));
+  return true;
+}
+
+bool index_lookup(struct index *idx, char *home, char *lib_path,
+                  struct yj_java_runtime *runtime) {
+  struct index_entry *entry = index_find(idx, home);
+  const char *entry_lib;
+
+  if (entry == NULL) {
+    return false;
+  }
+
+  entry_lib = index_str(idx, entry->libjvm_path);
+  if (entry_lib == NULL || strcmp(entry_lib, lib_path) != 0 ||
+      !index_is_fresh(idx, entry)) {
+    TRACE("index entry stale: %s", home);
+    return false;
+  }
+
+  TRACE("index hit: %s", home);
+  return index_load(idx, entry, runtime);
+}
+
+uint32_t index_put_str(char *pool, uint32_t *pool_len, const char *s) {
+  uint32_t off;
+  size_t len;
+
+  if (s == NULL || (len = strlen(s)) == 0) {
+    return 0;
+  }
+  off = *pool_len;
+  memcpy(pool + off, s, len + 1);
+  *pool_len += len + 1;
+  return off;
+}
+
+bool index_write(struct yj_java_runtime *runtimes, size_t len,
+                 const char **roots, int64_t *mtimes, size_t roots_len) {
+  char path[PATH_MAX] = {0};
+  char tmp_path[PATH_MAX + 8] = {0};
+  struct index_header header = {0};
+  struct index_entry *entries;
+  struct index_root *index_roots;
+  char *pool;
+  uint32_t pool_len = 1;
+  size_t pool_max = 1;
+  size_t count = 0;
+  bool ok = false;
+  int fd;
+
+  if (!cache_path(INDEX_FILE, path, PATH_MAX, true)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    struct yj_java_runtime *r = &runtimes[i];
+    pool_max += SAFE_STRLEN(r->home) + SAFE_STRLEN(r->libjvm_path) +
+                SAFE_STRLEN(r->version) + SAFE_STRLEN(r->full_version) +
+                SAFE_STRLEN(r->vendor) + SAFE_STRLEN(r->arch) +
+                SAFE_STRLEN(r->props) + 7;
+  }
+  for (size_t i = 0; i < roots_len; i++) {
+    pool_max += SAFE_STRLEN(roots[i]) + 1;
+  }
+
+  entries = calloc(len == 0 ? 1 : len, sizeof(struct index_entry));
+  index_roots = calloc(roots_len == 0 ? 1 : roots_len,
+                       sizeof(struct index_root));
+  pool = calloc(pool_max, sizeof(char));
+  if (entries == NULL || index_roots == NULL || pool == NULL) {
+    goto err;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    struct yj_java_runtime *r = &runtimes[i];
+    struct index_entry *e = &entries[count];
+    struct stat st;
+
+    if (r->home == NULL || r->libjvm_path == NULL ||
+        stat(r->libjvm_path, &st) != 0) {
+      continue;
+    }
+
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->size = st.st_size;
+    e->mtime_ns = stat_mtime_ns(&st);
+    index_release_stat(r->home, &e->release_size, &e->release_mtime_ns);
+    e->major_version = r->major_version;
+    e->jni_version = r->jni_version;
+    e->home = index_put_str(pool, &pool_len, r->home);
+    e->libjvm_path = index_put_str(pool, &pool_len, r->libjvm_path);
+    e->version = index_put_str(pool, &pool_len, r->version);
+    e->full_version = index_put_str(pool, &pool_len, r->full_version);
+    e->vendor = index_put_str(pool, &pool_len, r->vendor);
+    e->arch = index_put_str(pool, &pool_len, r->arch);
+    e->gcs = r->gcs;
+    e->features = r->features;
+    e->props = index_put_str(pool, &pool_len, r->props);
+    count++;
+  }
+
+  for (size_t i = 0; i < roots_len; i++) {
+    index_roots[i].path = index_put_str(pool, &pool_len, roots[i]);
+    index_roots[i].mtime_ns = mtimes[i];
+  }
+
+  header.magic = INDEX_MAGIC;
+  header.version = INDEX_VERSION;
+  header.count = count;
+  header.roots_len = roots_len;
+  header.strings_len = pool_len;
+
+  // write aside and rename over, concurrent readers keep their snapshot
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+  if ((fd = mkstemp(tmp_path)) < 0) {
+    TRACE("create temp index failed: %s", tmp_path);
+    goto err;
+  }
+  fchmod(fd, 0644);
+
+  if (file_write_all(fd, &header, sizeof(header)) &&
+      file_write_all(fd, entries, count * sizeof(struct index_entry)) &&
+      file_write_all(fd, index_roots, roots_len * sizeof(struct index_root)) &&
+      file_write_all(fd, pool, pool_len)) {
+    ok = rename(tmp_path, path) == 0;
+  }
+  close(fd);
+  if (!ok) {
+    unlink(tmp_path);
+  }
+  TRACE("index written: %s, %zu entries, %d", path, count, ok);
+
+err:
+  free(entries);
+  free(index_roots);
+  free(pool);
+  return ok;
+}
+
+// merge runtimes and the roots of a discovery (or NULL) into the index
+bool index_update(struct index *idx, struct yj_java_runtime *runtimes,
+                  size_t len, struct yj_discovery *discovery,
+                  int64_t *mtimes) {
+  size_t total = len + (idx->map == NULL ? 0 : idx->header->count);
+  size_t roots_total = (discovery == NULL ? 0 : discovery->roots_len) +
+                       (idx->map == NULL ? 0 : idx->header->roots_len);
+  struct yj_java_runtime *merged;
+  const char **roots;
+  int64_t *roots_mtime;
+  size_t merged_len = 0, roots_len = 0;
+  bool ok = false;
+
+  merged = calloc(total == 0 ? 1 : total, sizeof(struct yj_java_runtime));
+  roots = calloc(roots_total == 0 ? 1 : roots_total, sizeof(char *));
+  roots_mtime = calloc(roots_total == 0 ? 1 : roots_total, sizeof(int64_t));
+  if (merged == NULL || roots == NULL || roots_mtime == NULL) {
+    goto err;
+  }
+
+  // the roots just scanned, then the ones of earlier scans
+  for (size_t i = 0; discovery != NULL && i < discovery->roots_len; i++) {
+    if (discovery->roots[i].path != NULL) {
+      roots[roots_len] = discovery->roots[i].path;
+      roots_mtime[roots_len++] = mtimes[i];
+    }
+  }
+  for (uint32_t i = 0; idx->map != NULL && i < idx->header->roots_len; i++) {
+    const char *path = index_str(idx, idx->roots[i].path);
+    bool replaced = false;
+
+    for (size_t j = 0; j < roots_len && path != NULL; j++) {
+      replaced = replaced || strcmp(roots[j], path) == 0;
+    }
+    if (!replaced && path != NULL) {
+      roots[roots_len] = path;
+      roots_mtime[roots_len++] = idx->roots[i].mtime_ns;
+    }
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    merged[merged_len++] = runtimes[i];
+  }
+
+  // keep the still valid entries which are not refreshed by caller
+  for (uint32_t i = 0; idx->map != NULL && i < idx->header->count; i++) {
+    struct index_entry *e = &idx->entries[i];
+    const char *home = index_str(idx, e->home);
+    bool replaced = false;
+
+    for (size_t j = 0; j < len && home != NULL; j++) {
+      if (runtimes[j].home != NULL && strcmp(runtimes[j].home, home) == 0) {
+        replaced = true;
+        break;
+      }
+    }
+    if (!replaced && home != NULL && index_is_fresh(idx, e)) {
+      index_load(idx, e, &merged[merged_len++]);
+    }
+  }
+
+  ok = index_write(merged, merged_len, roots, roots_mtime, roots_len);
+
+  // only free the entries we loaded from the old index
+  for (size_t i = len; i < merged_len; i++) {
+    yj_free_runtime(&merged[i]);
+  }
+
+err:
+  free(merged);
+  free(roots);
+  free(roots_mtime);
+  return ok;
+}
+
+// mtime of a discovery root, a home added or removed right below it
+// changes it. -1 for a missing root.
+int64_t index_root_mtime(const char *path) {
+  struct stat st;
+
+  if (path == NULL || stat(path, &st) != 0) {
+    return -1;
+  }
+  return stat_mtime_ns(&st);
+}
+
+// whether every root of the discovery was scanned into the index as it
+// is now
+bool index_roots_fresh(struct index *idx, struct yj_discovery *discovery,
+                       int64_t *mtimes) {
+  if (idx->map == NULL) {
+    return false;
+  }
+
+  for (size_t i = 0; i < discovery->roots_len; i++) {
+    bool found = false;
+
+    for (uint32_t j = 0; j < idx->header->roots_len && !found; j++) {
+      const char *path = index_str(idx, idx->roots[j].path);
+      found = path != NULL && discovery->roots[i].path != NULL &&
+              strcmp(path, discovery->roots[i].path) == 0 &&
+              idx->roots[j].mtime_ns == mtimes[i];
+    }
+    if (!found) {
+      TRACE("discovery root changed: %s", discovery->roots[i].path);
+      return false;
+    }
+  }
+  return true;
+}
+
+// CONFIG
+// yajava.conf: `key = value` lines, `#` comments. Project files are found by
+// walking up from the working directory, the nearest one wins, then the
+// user file $XDG_CONFIG_HOME/yajava/yajava.conf (~/.config/yajava/...).
+// A .java-version next to a project yajava.conf is read as `runtime`.
+bool config_get(const char *key, char *out, size_t maxlen) {
+  char dir[PATH_MAX] = {0};
+  char path[PATH_MAX + 32] = {0};
+
+  if (getcwd(dir, PATH_MAX) != NULL) {
+    while (true) {
+      snprintf(path, sizeof(path), "%s%c%s", dir, FILE_PATH_SEPRATOR,
+               CONFIG_FILE);
+      if (config_file_value(path, key, out, maxlen)) {
+        TRACE("config %s from %s", key, path);
+        return true;
+      }
+
+      if (strcmp(key, "runtime") == 0) {
+        snprintf(path, sizeof(path), "%s%c%s", dir, FILE_PATH_SEPRATOR,
+                 CONFIG_JAVA_VERSION_FILE);
+        char *content = file_read_all(path, CONFIG_MAXLEN, NULL);
+        if (content != NULL) {
+          size_t len = strcspn(content, "\r\n");
+          bool ok = len > 0 && len < maxlen;
+          if (ok) {
+            memcpy(out, content, len);
+            out[len] = '\0';
+            TRACE("config %s from %s", key, path);
+          }
+          free(content);
+          if (ok) {
+            return true;
+          }
+        }
+      }
+
+      char *slash = strrchr(dir, FILE_PATH_SEPRATOR);
+      if (slash == NULL || slash == dir) {
+        if (dir[1] == '\0') {
+          break;
+        }
+        dir[1] = '\0'; // the root directory
+        continue;
+      }
+      *slash = '\0';
+    }
+  }
+
+  if (config_user_path(path, sizeof(path)) &&
+      config_file_value(path, key, out, maxlen)) {
+    TRACE("config %s from %s", key, path);
+    return true;
+  }
+  return false;
+}
+
+bool config_user_path(char *out, size_t maxlen) {
+  char *env;
+
+  if ((env = getenv("XDG_CONFIG_HOME")) != NULL && strlen(env) > 0) {
+    return snprintf(out, maxlen, "%s%c%s%c%s", env, FILE_PATH_SEPRATOR,
+                    CONFIG_DIR_NAME, FILE_PATH_SEPRATOR,
+                    CONFIG_FILE) < (int)maxlen;
+  } else if ((env = getenv("HOME")) != NULL && strlen(env) > 0) {
+    return snprintf(out, maxlen, "%s%c.config%c%s%c%s", env,
+                    FILE_PATH_SEPRATOR, FILE_PATH_SEPRATOR, CONFIG_DIR_NAME,
+                    FILE_PATH_SEPRATOR, CONFIG_FILE) < (int)maxlen;
+  }
+  return false;
+}
+
+bool config_file_value(const char *path, const char *key, char *out,
+                       size_t maxlen) {
+  char *content = file_read_all(path, CONFIG_MAXLEN, NULL);
+  bool ok;
+
+  if (content == NULL) {
+    return false;
+  }
+  ok = conf_value(content, key, out, maxlen);
+  free(content);
+  return ok;
+}
+
+// `key = value` or `KEY="value"`, the last one wins
+bool conf_value(const char *content, const char *key, char *out,
+                size_t maxlen) {
+  size_t key_len = strlen(key);
+  const char *line = content;
+  bool found = false;
+
+  while (line != NULL && *line != '\0') {
+    const char *eol = strchr(line, '\n');
+    const char *end = eol == NULL ? line + strlen(line) : eol;
+    const char *p = line;
+
+    while (p < end && isspace((unsigned char)*p)) {
+      p++;
+    }
+    if (p + key_len < end && *p != '#' && strncmp(p, key, key_len) == 0) {
+      const char *v = p + key_len;
+      while (v < end && (*v == ' ' || *v == '\t')) {
+        v++;
+      }
+      if (v < end && *v == '=') {
+        const char *ve = end;
+        v++;
+        while (v < ve && isspace((unsigned char)*v)) {
+          v++;
+        }
+        while (ve > v && isspace((unsigned char)ve[-1])) {
+          ve--;
+        }
+        if (ve - v >= 2 && *v == '"' && ve[-1] == '"') {
+          v++;
+          ve--;
+        }
+        if ((size_t)(ve - v) < maxlen) {
+          memcpy(out, v, ve - v);
+          out[ve - v] = '\0';
+          found = true;
+        }
+      }
+    }
+    line = eol == NULL ? NULL : eol + 1;
+  }
+  return found;
+}
+
+// JAR
+// the java release an application is compiled for, read from the class
+// file header of its main class without booting a vm
+int jar_required_release(struct yj_run_args *args) {
+  char class_file[PATH_MAX] = {0};
+  const char *main_class = NULL;
+  struct zip zip;
+  struct zip_entry entry;
+  unsigned char head[8];
+  int release = 0;
+
+  if (args->app_jar != NULL) {
+    if (jar_read_manifest(args)) {
+      main_class = args->manifest->main_class;
+    }
+    if (!zip_open(&zip, args->app_jar)) {
+      return 0;
+    }
+    if (main_class != NULL) {
+      jar_class_file(main_class, class_file, sizeof(class_file));
+      if (zip_find(&zip, class_file, &entry)) {
+        release = jar_class_release(
+            head, zip_read_head(&zip, &entry, head, sizeof(head)));
+      }
+    }
+    zip_close(&zip);
+    TRACE("%s: main class %s, release %d", args->app_jar,
+          main_class == NULL ? "-" : main_class, release);
+    return release;
+  }
+
+  if (args->app_main_class != NULL) {
+    jar_class_file(args->app_main_class, class_file, sizeof(class_file));
+
+    if (args->classpathes_len == 0) {
+      release = jar_class_release_in(".", class_file);
+    }
+    for (int i = 0; i < args->classpathes_len && release == 0; i++) {
+      release = jar_class_release_in(args->classpathes[i], class_file);
+    }
+    TRACE("%s: release %d", args->app_main_class, release);
+  }
+
+  // module-info.class of an exploded module or a <module>.jar in the module
+  // path, a modular application needs 9 whatever it is compiled for
+  if (args->app_module != NULL) {
+    size_t len = strcspn(args->app_module, "/");
+
+    snprintf(class_file, sizeof(class_file), "%.*s%cmodule-info.class",
+             (int)len, args->app_module, FILE_PATH_SEPRATOR);
+    for (int i = 0; i < args->module_pathes_len && release == 0; i++) {
+      char jar[PATH_MAX];
+
+      release = jar_class_release_in(args->module_pathes[i], class_file);
+      snprintf(jar, sizeof(jar), "%s%c%.*s.jar", args->module_pathes[i],
+               FILE_PATH_SEPRATOR, (int)len, args->app_module);
+      if (release == 0 && file_is_file(jar)) {
+        release = jar_class_release_in(jar, "module-info.class");
+      }
+    }
+    TRACE("%s: release %d", args->app_module, release);
+    release = release < 9 ? 9 : release;
+  }
+  return release;
+}
+
+// the manifest of the -jar, read once. The application goes without
+// LauncherHelper unless the manifest asks for what only it provides: an
+// agent started in the vm, native access, a JavaFX application, or class
+// path urls which are not local files.
+bool jar_read_manifest(struct yj_run_args *args) {
+  struct yj_manifest *m;
+  struct zip zip;
+  struct zip_entry entry;
+  char *text = NULL, *value;
+
+  if (args->manifest != NULL) {
+    return args->manifest->main_class != NULL;
+  }
+  if (args->app_jar == NULL) {
+    return false;
+  }
+
+  m = calloc(1, sizeof(struct yj_manifest));
+  args->manifest = m;
+  if (!zip_open(&zip, args->app_jar)) {
+    return false;
+  }
+  if (zip_find(&zip, JAR_MANIFEST, &entry) &&
+      entry.usize < JAR_MANIFEST_MAXLEN) {
+    text = zip_read(&zip, &entry, NULL);
+  }
+  zip_close(&zip);
+  if (text == NULL) {
+    return false;
+  }
+
+  m->main_class = jar_manifest_get(text, "Main-Class");
+  m->class_path = jar_manifest_get(text, "Class-Path");
+  m->add_opens = jar_manifest_get(text, "Add-Opens");
+  m->add_exports = jar_manifest_get(text, "Add-Exports");
+  m->launcher_agent = jar_manifest_get(text, "Launcher-Agent-Class");
+
+  m->native = m->main_class != NULL && m->launcher_agent == NULL;
+  if ((value = jar_manifest_get(text, "Enable-Native-Access")) != NULL ||
+      (value = jar_manifest_get(text, "JavaFX-Application-Class")) != NULL) {
+    m->native = false;
+    free(value);
+  }
+  if (m->native) {
+    m->java_class_path = jar_expand_class_path(args->app_jar, m->class_path);
+    m->native = m->java_class_path != NULL;
+  }
+  free(text);
+
+  TRACE("manifest of %s: main %s, class path %s, native %d", args->app_jar,
+        m->main_class, m->java_class_path, m->native);
+  return m->main_class != NULL;
+}
+
+// a main attribute of any length, NULL when missing
+char *jar_manifest_get(const char *manifest, const char *key) {
+  size_t len = strlen(manifest) + 1;
+  char *out = malloc(len);
+
+  if (!jar_manifest_value(manifest, key, out, len)) {
+    free(out);
+    return NULL;
+  }
+  return out;
+}
+
+// the jar followed by its Class-Path entries, relative urls resolved
+// against the directory of the jar. Entries which do not exist are left
+// out like the class loader would; NULL for urls other than file ones.
+char *jar_expand_class_path(const char *jar, const char *class_path) {
+  char dir[PATH_MAX] = {0};
+  char path[PATH_MAX * 2];
+  char *copy, *save = NULL, *url, *slash;
+  size_t len, max;
+  char *out;
+
+  len = strlen(jar);
+  max = len + 1 + (class_path == NULL ? 0 : strlen(class_path) * 2 + PATH_MAX);
+  out = malloc(max);
+  memcpy(out, jar, len + 1);
+  if (class_path == NULL) {
+    return out;
+  }
+
+  snprintf(dir, PATH_MAX, "%s", jar);
+  if ((slash = strrchr(dir, FILE_PATH_SEPRATOR)) != NULL) {
+    slash[1] = '\0';
+  } else {
+    dir[0] = '\0';
+  }
+
+  copy = strdup(class_path);
+  for (url = strtok_r(copy, " ", &save); url != NULL;
+       url = strtok_r(NULL, " ", &save)) {
+    char *p = url, *q = url;
+    const char *colon = strchr(url, ':'), *sep = strchr(url, '/');
+
+    if (strncmp(url, "file:", 5) == 0) {
+      url += 5;
+      if (strncmp(url, "//", 2) == 0) { // file://host/path
+        url = strchr(url + 2, '/');
+      }
+    } else if (colon != NULL && (sep == NULL || colon < sep)) {
+      TRACE("class path url left to the vm: %s", url);
+      free(copy);
+      free(out);
+      return NULL;
+    }
+    if (url == NULL) {
+      continue;
+    }
+
+    // %xx escapes of the url
+    for (p = q = url; *p != '\0'; p++, q++) {
+      if (p[0] == '%' && isxdigit((unsigned char)p[1]) &&
+          isxdigit((unsigned char)p[2])) {
+        char hex[3] = {p[1], p[2], '\0'};
+        *q = (char)strtol(hex, NULL, 16);
+        p += 2;
+      } else {
+        *q = *p;
+      }
+    }
+    *q = '\0';
+
+    snprintf(path, sizeof(path), "%s%s", url[0] == '/' ? "" : dir, url);
+    if (!file_exists(path)) {
+      continue;
+    }
+    if (len + strlen(path) + 2 > max) {
+      max = (len + strlen(path) + 2) * 2;
+      out = realloc(out, max);
+    }
+    out[len++] = ':';
+    memcpy(out + len, path, strlen(path) + 1);
+    len += strlen(path);
+  }
+  free(copy);
+  return out;
+}
+
+// Add-Opens: java.base/java.lang java.base/java.util, for the class path
+void jar_add_module_opts(const char *value, const char *opt,
+                         struct jvm_opt_arr *opts) {
+  char *copy, *save = NULL, *pkg;
+
+  if (value == NULL) {
+    return;
+  }
+  copy = strdup(value);
+  for (pkg = strtok_r(copy, " ", &save); pkg != NULL;
+       pkg = strtok_r(NULL, " ", &save)) {
+    size_t len = strlen(opt) + strlen(pkg) + 16;
+    char *o = malloc(len);
+    snprintf(o, len, "%s=%s=ALL-UNNAMED", opt, pkg);
+    jvm_opt_arr_add(opts, o, NULL);
+  }
+  free(copy);
+}
+
+void jar_free_manifest(struct yj_manifest *manifest) {
+  if (manifest == NULL) {
+    return;
+  }
+  SAFE_FREE(manifest->main_class);
+  SAFE_FREE(manifest->class_path);
+  SAFE_FREE(manifest->add_opens);
+  SAFE_FREE(manifest->add_exports);
+  SAFE_FREE(manifest->launcher_agent);
+  SAFE_FREE(manifest->java_class_path);
+}
+
+// com.example.Main -> com/example/Main.class
+void jar_class_file(const char *class_name, char *out, size_t maxlen) {
+  snprintf(out, maxlen, "%s", class_name);
+  for (char *p = out; *p != '\0'; p++) {
+    *p = *p == '.' ? '/' : *p;
+  }
+  strncat(out, ".class", maxlen - strlen(out) - 1);
+}
+
+// a class file in a directory or a jar of the class path
+int jar_class_release_in(const char *classpath, const char *class_file) {
+  char path[PATH_MAX * 2] = {0};
+  unsigned char head[8];
+  struct zip zip;
+  struct zip_entry entry;
+  int release = 0;
+  int fd;
+
+  if (file_is_dir(classpath)) {
+    snprintf(path, sizeof(path), "%s%c%s", classpath, FILE_PATH_SEPRATOR,
+             class_file);
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) >= 0) {
+      ssize_t n = read(fd, head, sizeof(head));
+      release = jar_class_release(head, n < 0 ? 0 : n);
+      close(fd);
+    }
+  } else if (zip_open(&zip, classpath)) {
+    if (zip_find(&zip, class_file, &entry)) {
+      release = jar_class_release(
+          head, zip_read_head(&zip, &entry, head, sizeof(head)));
+    }
+    zip_close(&zip);
+  }
+  return release;
+}
+
+// u4 magic, u2 minor_version, u2 major_version
+int jar_class_release(const unsigned char *head, size_t len) {
+  uint32_t magic;
+  int major;
+
+  if (len < 8) {
+    return 0;
+  }
+  magic = (uint32_t)head[0] << 24 | head[1] << 16 | head[2] << 8 | head[3];
+  if (magic != CLASS_MAGIC) {
+    return 0;
+  }
+  major = head[6] << 8 | head[7];
+  return major > CLASS_MAJOR_BASE ? major - CLASS_MAJOR_BASE : 1;
+}
+
+// manifest main attributes, lines are wrapped at 72 bytes and continued
+// with a leading space, the main section ends at the first empty line
+bool jar_manifest_value(const char *manifest, const char *key, char *out,
+                        size_t maxlen) {
+  size_t key_len = strlen(key);
+  const char *line = manifest;
+
+  while (line != NULL && *line != '\0' && *line != '\r' && *line != '\n') {
+    const char *end = line + strcspn(line, "\r\n");
+
+    if (strncasecmp(line, key, key_len) == 0 && line[key_len] == ':') {
+      const char *v = line + key_len + 1;
+      size_t len = 0;
+
+      while (v < end && *v == ' ') {
+        v++;
+      }
+      while (true) {
+        if (len + (end - v) >= maxlen) {
+          return false;
+        }
+        memcpy(out + len, v, end - v);
+        len += end - v;
+
+        // continuation line
+        v = end + (end[0] == '\r' && end[1] == '\n' ? 2 : 1);
+        if (*end == '\0' || *v != ' ') {
+          break;
+        }
+        v++;
+        end = v + strcspn(v, "\r\n");
+      }
+      while (len > 0 && isspace((unsigned char)out[len - 1])) {
+        len--;
+      }
+      out[len] = '\0';
+      return len > 0;
+    }
+
+    line = *end == '\0' ? NULL
+                        : end + (end[0] == '\r' && end[1] == '\n' ? 2 : 1);
+  }
+  return false;
+}
+
+// PLAN
+// launch plans, keyed by the command line and everything the resolution of
+// the runtime depends on. A hit skips the runtime selection and the checks
+// of the class path, the vm is created from the stored options right away.
+uint64_t plan_hash(uint64_t h, const void *data, size_t len) {
+  const unsigned char *p = data;
+
+  // FNV-1a
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+uint64_t plan_key(int argc, char **argv) {
+  static const char *envs[] = {"JAVA_HOME", "YAJAVA_RUNTIME",
+                               "YAJAVA_RUNTIME_AUTO", "YAJAVA_DISCOVERY_PATH",
+                               "YAJAVA_DISCOVERY_DEPTH", "YAJAVA_PACK",
+                               "YAJAVA_CLASS_INDEX", "YAJAVA_SOURCE_CACHE"};
+  static const char *configs[] = {"runtime", "runtime.auto"};
+  uint64_t h = 0xcbf29ce484222325ULL;
+  uint32_t version = PLAN_VERSION;
+  char buf[PATH_MAX] = {0};
+  char *env;
+
+  h = plan_hash(h, &version, sizeof(version));
+  for (int i = 0; i < argc; i++) {
+    h = plan_hash(h, argv[i], strlen(argv[i]) + 1);
+  }
+
+  // relative class path entries
+  if (getcwd(buf, PATH_MAX) != NULL) {
+    h = plan_hash(h, buf, strlen(buf) + 1);
+  }
+
+  for (int i = 0; i < sizeof(envs) / sizeof(char *); i++) {
+    env = getenv(envs[i]);
+    h = plan_hash(h, envs[i], strlen(envs[i]) + 1);
+    h = plan_hash(h, env == NULL ? "" : env, env == NULL ? 1 : strlen(env) + 1);
+  }
+
+  for (int i = 0; i < sizeof(configs) / sizeof(char *); i++) {
+    buf[0] = '\0';
+    config_get(configs[i], buf, PATH_MAX);
+    h = plan_hash(h, configs[i], strlen(configs[i]) + 1);
+    h = plan_hash(h, buf, strlen(buf) + 1);
+  }
+  return h;
+}
+
+const char *plan_str(struct yj_plan *plan, uint32_t off) {
+  if (off == 0 || off >= plan->header->strings_len) {
+    return NULL;
+  }
+  return plan->strings + off;
+}
+
+bool plan_open(struct yj_plan *plan) {
+  struct stat st;
+  void *map;
+  int fd;
+
+  if ((fd = open(plan->path, O_RDONLY | O_CLOEXEC)) < 0) {
+    TRACE("plan miss: %s", plan->path);
+    return false;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(struct plan_header)) {
+    close(fd);
+    return false;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+  struct plan_header *h = map;
+  if (h->magic != PLAN_MAGIC || h->version != PLAN_VERSION ||
+      h->key != plan->key || h->strings_len == 0 ||
+      sizeof(struct plan_header) +
+              (size_t)h->inputs_len * sizeof(struct plan_input) +
+              (size_t)h->options_len * sizeof(uint32_t) + h->strings_len !=
+          (size_t)st.st_size ||
+      ((const char *)map)[st.st_size - 1] != '\0') {
+    TRACE("invalid plan: %s", plan->path);
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  plan->map = map;
+  plan->size = st.st_size;
+  plan->header = h;
+  plan->inputs = (const struct plan_input *)(h + 1);
+  plan->options = (const uint32_t *)(plan->inputs + h->inputs_len);
+  plan->strings = (const char *)(plan->options + h->options_len);
+
+  // inputs unchanged since the plan was built
+  for (uint32_t i = 0; i < h->inputs_len; i++) {
+    const struct plan_input *in = &plan->inputs[i];
+    const char *path = plan_str(plan, in->path);
+    bool fresh;
+
+    if (path == NULL) {
+      continue;
+    }
+    if (stat(path, &st) != 0) {
+      fresh = in->mtime_ns == 0 && in->size == 0;
+    } else {
+      fresh = stat_mtime_ns(&st) == in->mtime_ns &&
+              (uint64_t)st.st_size == in->size;
+    }
+    if (!fresh) {
+      TRACE("plan stale, %s changed", path);
+      plan_close(plan);
+      return false;
+    }
+  }
+
+  TRACE("plan hit: %s", plan->path);
+  return true;
+}
+
+void plan_close(struct yj_plan *plan) {
+  if (plan->map != NULL) {
+    munmap(plan->map, plan->size);
+  }
+  plan->map = NULL;
+  plan->size = 0;
+  plan->header = NULL;
+  plan->inputs = NULL;
+  plan->options = NULL;
+  plan->strings = NULL;
+}
+
+// vm options from a warm plan, otherwise built from the arguments and
+// stored as the plan of the command line
+bool plan_vm_args(struct yj_run_args *args, struct yj_java_runtime *runtime,
+                  JavaVMInitArgs *out) {
+  struct yj_plan *plan = args->plan;
+
+  if (plan != NULL && plan->header != NULL) {
+    struct jvm_opt_arr opts = {0};
+
+    for (uint32_t i = 0; i < plan->header->options_len; i++) {
+      const char *opt = plan_str(plan, plan->options[i]);
+      if (opt != NULL) {
+        jvm_opt_arr_add(&opts, strdup(opt), NULL);
+      }
+    }
+    if (args->in_process && (args->print_metrics || args->archive != NULL ||
+                            args->preloader != NULL)) {
+      jvm_opt_arr_add(&opts, strdup("exit"), (void *)jvm_exit_hook);
+    }
+
+    out->nOptions = opts.len;
+    out->options = opts.opts;
+    out->version = plan->header->jni_version > 0 ? plan->header->jni_version
+                                                 : JNI_VERSION_1_2;
+    out->ignoreUnrecognized = false;
+    return true;
+  }
+
+  if (!arg_build_java_opts(runtime, args, out)) {
+    return false;
+  }
+
+  if (plan != NULL) {
+    long build_us = time_now_us() - plan->start_us;
+    bool ok = plan_write(plan, runtime, args, out, build_us);
+    if (args->plan_stats) {
+      fprintf(stderr, "plan miss %016llx: build %.3fms%s\n",
+              (unsigned long long)plan->key, build_us / 1000.0,
+              ok ? "" : ", not saved");
+    }
+  }
+  return true;
+}
+
+bool plan_write(struct yj_plan *plan, struct yj_java_runtime *runtime,
+                struct yj_run_args *args, JavaVMInitArgs *vm_args,
+                long build_us) {
+  char tmp_path[PATH_MAX + 8] = {0};
+  char index_path[PATH_MAX] = {0};
+  char class_file[PATH_MAX] = {0};
+  char main_path[PATH_MAX] = {0};
+  struct plan_header header = {0};
+  struct plan_input *inputs;
+  uint32_t *options;
+  const char **input_paths;
+  size_t inputs_len = 0, options_len = 0;
+  size_t pool_max = 1;
+  uint32_t pool_len = 1;
+  char *pool;
+  bool ok = false;
+  int fd;
+
+  // the plan directory
+  if (!cache_path(PLAN_DIR, tmp_path, PATH_MAX, true) ||
+      !file_mkdirs(tmp_path, 0755)) {
+    return false;
+  }
+
+  // the runtime, the application, directories listed for the class path,
+  // its pack or class index and the runtime index
+  input_paths = calloc(args->classpathes_len + args->wildcard_dirs_len + 7,
+                       sizeof(char *));
+  input_paths[inputs_len++] = runtime->libjvm_path;
+  if (args->app_jar != NULL) {
+    input_paths[inputs_len++] = args->app_jar;
+  }
+  if (args->app_source != NULL) {
+    input_paths[inputs_len++] = args->app_source;
+  }
+  // a main class file in a directory, recompiling it leaves the mtime of
+  // the directory alone but may change the runtime it needs
+  if (args->app_jar == NULL && args->app_main_class != NULL) {
+    jar_class_file(args->app_main_class, class_file, sizeof(class_file));
+    for (int i = args->classpathes_len == 0 ? -1 : 0;
+         i < args->classpathes_len; i++) {
+      const char *dir = i < 0 ? "." : args->classpathes[i];
+      int len = snprintf(main_path, PATH_MAX, "%s%c%s", dir,
+                         FILE_PATH_SEPRATOR, class_file);
+      if (len > 0 && len < PATH_MAX && file_is_file(main_path)) {
+        input_paths[inputs_len++] = main_path;
+        break;
+      }
+    }
+  }
+  for (int i = 0; i < args->classpathes_len; i++) {
+    input_paths[inputs_len++] = args->classpathes[i];
+  }
+  for (int i = 0; i < args->wildcard_dirs_len; i++) {
+    input_paths[inputs_len++] = args->wildcard_dirs[i];
+  }
+  if (args->pack != NULL) {
+    input_paths[inputs_len++] = args->pack;
+  }
+  if (args->class_index != NULL) {
+    input_paths[inputs_len++] = args->class_index;
+  }
+  if (cache_path(INDEX_FILE, index_path, PATH_MAX, false)) {
+    input_paths[inputs_len++] = index_path;
+  }
+
+  pool_max += SAFE_STRLEN(runtime->name) + SAFE_STRLEN(runtime->home) +
+              SAFE_STRLEN(runtime->libjvm_path) +
+              SAFE_STRLEN(runtime->version) +
+              SAFE_STRLEN(runtime->full_version) +
+              SAFE_STRLEN(runtime->vendor) + SAFE_STRLEN(runtime->arch) +
+              SAFE_STRLEN(runtime->props) + 8;
+  for (size_t i = 0; i < inputs_len; i++) {
+    pool_max += SAFE_STRLEN(input_paths[i]) + 1;
+  }
+  for (int i = 0; i < vm_args->nOptions; i++) {
+    pool_max += SAFE_STRLEN(vm_args->options[i].optionString) + 1;
+  }
+
+  pool = calloc(pool_max, sizeof(char));
+  inputs = calloc(inputs_len, sizeof(struct plan_input));
+  options = calloc(vm_args->nOptions + 1, sizeof(uint32_t));
+
+  for (size_t i = 0; i < inputs_len; i++) {
+    struct stat st;
+    if (stat(input_paths[i], &st) == 0) {
+      inputs[i].mtime_ns = stat_mtime_ns(&st);
+      inputs[i].size = st.st_size;
+    }
+    inputs[i].path = index_put_str(pool, &pool_len, input_paths[i]);
+  }
+
+  // hooks are process local, added again when the plan is used
+  for (int i = 0; i < vm_args->nOptions; i++) {
+    if (vm_args->options[i].extraInfo == NULL) {
+      options[options_len++] =
+          index_put_str(pool, &pool_len, vm_args->options[i].optionString);
+    }
+  }
+
+  header.magic = PLAN_MAGIC;
+  header.version = PLAN_VERSION;
+  header.key = plan->key;
+  header.build_us = build_us;
+  header.major_version = runtime->major_version;
+  header.jni_version = vm_args->version;
+  header.gcs = runtime->gcs;
+  header.features = runtime->features;
+  header.name = index_put_str(pool, &pool_len, runtime->name);
+  header.home = index_put_str(pool, &pool_len, runtime->home);
+  header.libjvm_path = index_put_str(pool, &pool_len, runtime->libjvm_path);
+  header.version_str = index_put_str(pool, &pool_len, runtime->version);
+  header.full_version = index_put_str(pool, &pool_len, runtime->full_version);
+  header.vendor = index_put_str(pool, &pool_len, runtime->vendor);
+  header.arch = index_put_str(pool, &pool_len, runtime->arch);
+  header.props = index_put_str(pool, &pool_len, runtime->props);
+  header.inputs_len = inputs_len;
+  header.options_len = options_len;
+  header.strings_len = pool_len;
+
+  // write aside and rename over, like the runtime index
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", plan->path);
+  if ((fd = mkstemp(tmp_path)) >= 0) {
+    fchmod(fd, 0644);
+    if (file_write_all(fd, &header, sizeof(header)) &&
+        file_write_all(fd, inputs, inputs_len * sizeof(struct plan_input)) &&
+        file_write_all(fd, options, options_len * sizeof(uint32_t)) &&
+        file_write_all(fd, pool, pool_len)) {
+      ok = rename(tmp_path, plan->path) == 0;
+    }
+    close(fd);
+    if (!ok) {
+      unlink(tmp_path);
+    }
+  }
+  TRACE("plan written: %s, %d", plan->path, ok);
+
+  free(input_paths);
+  free(inputs);
+  free(options);
+  free(pool);
+  return ok;
+}
+
+// ARCHIVE
+// --auto-archive: the first launch of an application records its classes,
+// later launches map them. Dynamic CDS archives (-XX:ArchiveClassesAtExit)
+// from 13, AOT caches (-XX:AOTMode=record/create, -XX:AOTCache) from 24.
+// Archives are keyed by runtime, vm options and classpath contents, a
+// changed jar simply gets a new archive.
+//
+// Class paths starting with the jars of `archive.base` share a static base
+// archive of them, each application only keeps a dynamic top layer on it,
+// so vms of different applications map the same base pages. The store is
+// kept under `archive.max_size`, least recently used archives go first.
+
+// false when the launch cannot be archived. The key covers the runtime, the
+// vm options, the main class, the module selection and the class path,
+// *base_key only the first base_len entries
+bool archive_key(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                 int base_len, uint64_t *base_key, uint64_t *out) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  struct {
+    int len;
+    char **items;
+  } modules[] = {{args->module_pathes_len, args->module_pathes},
+                 {args->upgrade_module_pathes_len, args->upgrade_module_pathes},
+                 {args->add_modules_len, args->add_modules}};
+  const char *main_class, *module;
+  struct stat st;
+  int64_t mtime;
+
+  if (args->app_jar == NULL && args->app_main_class == NULL) {
+    return false;
+  }
+  // the default class path is the working directory
+  if (args->app_jar == NULL && args->classpathes_len == 0) {
+    TRACE("default class path can not be archived");
+    return false;
+  }
+  if ((runtime->features & YJ_FEAT_OPENJ9) ||
+      runtime->major_version < ARCHIVE_MIN_DYNAMIC ||
+      !(runtime->features & (YJ_FEAT_CDS | YJ_FEAT_AOT_CACHE))) {
+    TRACE("runtime can not archive: %s", runtime->home);
+    return false;
+  }
+
+  h = plan_hash(h, runtime->home, SAFE_STRLEN(runtime->home) + 1);
+  h = plan_hash(h, runtime->full_version,
+                SAFE_STRLEN(runtime->full_version) + 1);
+
+  // the vm checks its flags against the archive, keep them apart
+  for (int i = 0; i < args->vmopts_len; i++) {
+    const char *opt = args->vmopts[i];
+    if (strcmp(opt, "-Xshare:off") == 0 ||
+        strncmp(opt, "-XX:SharedArchiveFile", 21) == 0 ||
+        strncmp(opt, "-XX:ArchiveClassesAtExit", 24) == 0 ||
+        strncmp(opt, "-XX:AOT", 7) == 0) {
+      TRACE("archive managed by the user: %s", opt);
+      return false;
+    }
+    h = plan_hash(h, opt, strlen(opt) + 1);
+  }
+
+  // another main class or module graph loads other classes
+  main_class = args->app_main_class == NULL ? "" : args->app_main_class;
+  module = args->app_module == NULL ? "" : args->app_module;
+  h = plan_hash(h, main_class, strlen(main_class) + 1);
+  h = plan_hash(h, module, strlen(module) + 1);
+  for (size_t i = 0; i < sizeof(modules) / sizeof(modules[0]); i++) {
+    h = plan_hash(h, &modules[i].len, sizeof(modules[i].len));
+    for (int j = 0; j < modules[i].len; j++) {
+      h = plan_hash(h, modules[i].items[j], strlen(modules[i].items[j]) + 1);
+    }
+  }
+
+  // classes from directories are never archived
+  for (int i = -1; i < args->classpathes_len; i++) {
+    const char *path = i < 0 ? args->app_jar : args->classpathes[i];
+    if (i == base_len && base_key != NULL) {
+      *base_key = h;
+    }
+    if (path == NULL) {
+      continue;
+    }
+    if (stat(path, &st) != 0 || S_ISDIR(st.st_mode)) {
+      TRACE("classpath can not be archived: %s", path);
+      return false;
+    }
+    h = plan_hash(h, path, strlen(path) + 1);
+    mtime = stat_mtime_ns(&st);
+    h = plan_hash(h, &mtime, sizeof(mtime));
+    h = plan_hash(h, &st.st_size, sizeof(st.st_size));
+  }
+
+  *out = h;
+  return true;
+}
+
+// how many leading class path entries are the configured base jars, 0 when
+// the class path does not start with all of them
+int archive_base_len(struct yj_run_args *args) {
+  char value[PATH_MAX * 4] = {0};
+  char real[PATH_MAX], cp_real[PATH_MAX];
+  char *save = NULL, *jar;
+  int len = 0;
+
+  if (args->app_jar != NULL || !config_get("archive.base", value,
+                                           sizeof(value))) {
+    return 0;
+  }
+
+  for (jar = strtok_r(value, ":", &save); jar != NULL;
+       jar = strtok_r(NULL, ":", &save)) {
+    if (len >= args->classpathes_len || realpath(jar, real) == NULL ||
+        realpath(args->classpathes[len], cp_real) == NULL ||
+        strcmp(real, cp_real) != 0) {
+      return 0;
+    }
+    len++;
+  }
+  // the application needs jars of its own for a top layer
+  return len < args->classpathes_len ? len : 0;
+}
+
+// use the archive of the application, or have this launch write it
+void archive_prepare(struct yj_java_runtime *runtime,
+                     struct yj_run_args *args) {
+  struct yj_archive *archive;
+  char name[64];
+  uint64_t key, base_key = 0;
+  const char *app;
+  int base_len;
+  bool aot;
+
+  if (!args->auto_archive || args->dry_run || args->archive != NULL ||
+      ((args->print_version & YA_PRINT_VERSION) == YA_PRINT_VERSION &&
+       (args->print_version & YA_PRINT_CONTINUE) != YA_PRINT_CONTINUE)) {
+    return;
+  }
+
+  // AOT caches are a single file, there is no layer to share
+  aot = runtime->major_version >= ARCHIVE_MIN_AOT &&
+        (runtime->features & YJ_FEAT_AOT_CACHE);
+  if (!aot && !(runtime->features & YJ_FEAT_CDS)) {
+    return;
+  }
+  base_len = aot ? 0 : archive_base_len(args);
+  if (!archive_key(runtime, args, base_len, &base_key, &key)) {
+    return;
+  }
+
+  if ((archive = calloc(1, sizeof(struct yj_archive))) == NULL) {
+    return;
+  }
+  archive->aot = aot;
+  snprintf(name, sizeof(name), "%s%c%016llx.%s", ARCHIVE_DIR,
+           FILE_PATH_SEPRATOR, (unsigned long long)key, aot ? "aot" : "jsa");
+  if (!cache_path(name, archive->path, PATH_MAX, true)) {
+    free(archive);
+    return;
+  }
+  if (base_len > 0) {
+    snprintf(name, sizeof(name), "%s%c%s%016llx.jsa", ARCHIVE_DIR,
+             FILE_PATH_SEPRATOR, ARCHIVE_BASE_PREFIX,
+             (unsigned long long)base_key);
+    cache_path(name, archive->base, PATH_MAX, false);
+    archive->base_len = base_len;
+  }
+  snprintf(archive->java, PATH_MAX, "%s%cbin%cjava", runtime->home,
+           FILE_PATH_SEPRATOR, FILE_PATH_SEPRATOR);
+  app = args->app_jar != NULL ? args->app_jar : args->app_main_class;
+  snprintf(archive->app, sizeof(archive->app), "%s",
+           strrchr(app, FILE_PATH_SEPRATOR) != NULL
+               ? strrchr(app, FILE_PATH_SEPRATOR) + 1
+               : app);
+
+  if (archive->base[0] != '\0' && !file_exists(archive->base)) {
+    // the base comes first, from the classes this launch loads
+    archive->mode = ARCHIVE_BASE;
+    snprintf(archive->conf, PATH_MAX, "%.*s.%d.classlist", PATH_MAX - 32,
+             archive->base, (int)getpid());
+    snprintf(archive->tmp, PATH_MAX, "%.*s.%d.tmp", PATH_MAX - 32,
+             archive->base, (int)getpid());
+  } else if (file_exists(archive->path)) {
+    archive->mode = ARCHIVE_USE;
+    archive_touch(archive->path, archive->app, archive_base_name(archive),
+                  true);
+  } else if (aot) {
+    archive->mode = ARCHIVE_RECORD;
+    snprintf(archive->conf, PATH_MAX, "%.*s.%d.aotconf", PATH_MAX - 32,
+             archive->path, (int)getpid());
+    snprintf(archive->tmp, PATH_MAX, "%.*s.%d.tmp", PATH_MAX - 32,
+             archive->path, (int)getpid());
+  } else {
+    archive->mode = ARCHIVE_DUMP;
+    snprintf(archive->tmp, PATH_MAX, "%.*s.%d.tmp", PATH_MAX - 32,
+             archive->path, (int)getpid());
+  }
+  if (archive->base[0] != '\0' && archive->mode != ARCHIVE_BASE) {
+    archive_touch(archive->base, NULL, NULL, true);
+  }
+
+  TRACE("archive %s: %s, base %s",
+        archive->mode == ARCHIVE_USE
+            ? "use"
+            : (archive->mode == ARCHIVE_DUMP
+                   ? "dump"
+                   : (archive->mode == ARCHIVE_BASE ? "base" : "record")),
+        archive->path, archive->base);
+  args->archive = archive;
+}
+
+// the file name of the base layer, NULL without one
+const char *archive_base_name(struct yj_archive *archive) {
+  const char *slash = strrchr(archive->base, FILE_PATH_SEPRATOR);
+
+  if (archive->base[0] == '\0') {
+    return NULL;
+  }
+  return slash == NULL ? archive->base : slash + 1;
+}
+
+// archive options are per launch, never part of the launch plan
+bool archive_vm_args(struct yj_archive *archive, JavaVMInitArgs *out) {
+  char buf[PATH_MAX * 2 + 32];
+  bool base;
+
+  if (archive == NULL) {
+    return true;
+  }
+  base = archive->base[0] != '\0';
+
+  if (archive->mode == ARCHIVE_USE && archive->aot) {
+    snprintf(buf, sizeof(buf), "-XX:AOTCache=%s", archive->path);
+    return jvm_args_add(out, strdup(buf));
+  } else if (archive->mode == ARCHIVE_USE) {
+    snprintf(buf, sizeof(buf), "-XX:SharedArchiveFile=%s%s%s",
+             base ? archive->base : "", base ? ":" : "", archive->path);
+    return jvm_args_add(out, strdup(buf));
+  } else if (archive->mode == ARCHIVE_DUMP) {
+    if (base) {
+      snprintf(buf, sizeof(buf), "-XX:SharedArchiveFile=%s", archive->base);
+      if (!jvm_args_add(out, strdup(buf))) {
+        return false;
+      }
+    }
+    snprintf(buf, sizeof(buf), "-XX:ArchiveClassesAtExit=%s", archive->tmp);
+    return jvm_args_add(out, strdup(buf));
+  } else if (archive->mode == ARCHIVE_BASE) {
+    snprintf(buf, sizeof(buf), "-XX:DumpLoadedClassList=%s", archive->conf);
+    return jvm_args_add(out, strdup(buf));
+  }
+
+  snprintf(buf, sizeof(buf), "-XX:AOTConfiguration=%s", archive->conf);
+  return jvm_args_add(out, strdup("-XX:AOTMode=record")) &&
+         jvm_args_add(out, strdup(buf));
+}
+
+// whether the vm mapped the archive, it silently ignores a stale one
+bool archive_is_mapped(const char *path) {
+#ifdef __linux__
+  char real[PATH_MAX] = {0};
+  char line[PATH_MAX + 128];
+  bool found = false;
+  FILE *maps;
+
+  if (realpath(path, real) == NULL ||
+      (maps = fopen("/proc/self/maps", "re")) == NULL) {
+    return false;
+  }
+  while (!found && fgets(line, sizeof(line), maps) != NULL) {
+    char *name = strchr(line, '/');
+    if (name != NULL) {
+      name[strcspn(name, "\n")] = '\0';
+      found = strcmp(name, real) == 0;
+    }
+  }
+  fclose(maps);
+  return found;
+#else
+  return true;
+#endif
+}
+
+// move what the launch wrote into place, once the vm is gone
+void archive_finish(struct yj_run_args *args) {
+  struct yj_archive *archive = args->archive;
+  char opt_list[PATH_MAX + 32], opt_out[PATH_MAX + 32];
+  char *opts[3];
+  struct stat st;
+
+  if (archive == NULL || archive->done) {
+    return;
+  }
+  archive->done = true;
+
+  if (archive->mode == ARCHIVE_DUMP) {
+    if (stat(archive->tmp, &st) == 0 && st.st_size > 0 &&
+        rename(archive->tmp, archive->path) == 0) {
+      TRACE("archive dumped: %s", archive->path);
+      archive_touch(archive->path, archive->app, archive_base_name(archive),
+                    false);
+      yj_archive_gc(0, NULL, NULL);
+      return;
+    }
+    unlink(archive->tmp);
+  } else if (archive->mode == ARCHIVE_BASE) {
+    if (stat(archive->conf, &st) == 0 && st.st_size > 0 &&
+        file_exists(archive->java)) {
+      snprintf(opt_list, sizeof(opt_list), "-XX:SharedClassListFile=%s",
+               archive->conf);
+      snprintf(opt_out, sizeof(opt_out), "-XX:SharedArchiveFile=%s",
+               archive->tmp);
+      opts[0] = "-Xshare:dump";
+      opts[1] = opt_list;
+      opts[2] = opt_out;
+      archive_build(args, opts, 3, archive->base_len, archive->base);
+      return;
+    }
+    unlink(archive->conf);
+  } else if (archive->mode == ARCHIVE_RECORD) {
+    if (stat(archive->conf, &st) == 0 && st.st_size > 0 &&
+        file_exists(archive->java)) {
+      snprintf(opt_list, sizeof(opt_list), "-XX:AOTConfiguration=%s",
+               archive->conf);
+      snprintf(opt_out, sizeof(opt_out), "-XX:AOTCache=%s", archive->tmp);
+      opts[0] = "-XX:AOTMode=create";
+      opts[1] = opt_list;
+      opts[2] = opt_out;
+      archive_build(args, opts, 3, args->classpathes_len, archive->path);
+      return;
+    }
+    unlink(archive->conf);
+  }
+}
+
+// assembling an archive from what the launch recorded takes a while, the
+// runtime's java does it detached from the launch. cp_len class path
+// entries are given to it, the application jar for -jar launches.
+//
+// The launch may be an in-process vm with its threads still running, so
+// everything is prepared before fork() and the children only make async
+// signal safe calls. The store is bounded before the new archive arrives,
+// the launch that writes the next one bounds it again.
+void archive_build(struct yj_run_args *args, char **opts, int opts_len,
+                   int cp_len, const char *path) {
+  struct yj_archive *archive = args->archive;
+  char meta_path[PATH_MAX + 8];
+  const char *app = path == archive->base ? NULL : archive->app;
+  char **argv;
+  char *cp = NULL;
+  size_t argc = 0, len = 2;
+  int status;
+  pid_t pid;
+
+  argv = calloc(args->vmopts_len + opts_len + 4, sizeof(char *));
+  if (args->app_jar == NULL) {
+    for (int i = 0; i < cp_len; i++) {
+      len += strlen(args->classpathes[i]) + 1;
+    }
+    cp = malloc(len);
+  }
+  if (argv == NULL || (args->app_jar == NULL && cp == NULL)) {
+    SAFE_FREE(argv);
+    SAFE_FREE(cp);
+    unlink(archive->conf);
+    return;
+  }
+  argv[argc++] = archive->java;
+  for (int i = 0; i < args->vmopts_len; i++) {
+    argv[argc++] = args->vmopts[i];
+  }
+  for (int i = 0; i < opts_len; i++) {
+    argv[argc++] = opts[i];
+  }
+  argv[argc++] = "-cp";
+  if (args->app_jar != NULL) {
+    argv[argc++] = args->app_jar;
+  } else {
+    size_t pos = 0;
+    for (int i = 0; i < cp_len; i++) {
+      pos += sprintf(cp + pos, "%s%s", i > 0 ? ":" : "", args->classpathes[i]);
+    }
+    if (cp_len == 0) {
+      strcpy(cp, ".");
+    }
+    argv[argc++] = cp;
+  }
+  snprintf(meta_path, sizeof(meta_path), "%s%s", path, ARCHIVE_META_EXT);
+  yj_archive_gc(0, NULL, NULL);
+
+  fflush(NULL);
+  if ((pid = fork()) < 0) {
+    unlink(archive->conf);
+  } else if (pid > 0) {
+    waitpid(pid, &status, 0);
+  }
+  if (pid != 0) {
+    free(cp);
+    free(argv);
+    return;
+  }
+
+  // the intermediate child leaves at once, the launcher does not wait
+  if (fork() != 0) {
+    _exit(0);
+  }
+  setsid();
+
+  if ((pid = fork()) == 0) {
+    int null = open("/dev/null", O_RDWR);
+    dup2(null, STDIN_FILENO);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    execv(argv[0], argv);
+    _exit(127);
+  }
+
+  if (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+      WEXITSTATUS(status) == 0 && rename(archive->tmp, path) == 0) {
+    archive_touch_meta(meta_path, app, NULL, false);
+  } else {
+    unlink(archive->tmp);
+  }
+  unlink(archive->conf);
+  _exit(0);
+}
+
+// <archive>.meta, the hit count and last use of an archive. Updated under
+// a lock, launches of the same application may race on it.
+bool archive_touch(const char *path, const char *app, const char *base,
+                   bool hit) {
+  char meta_path[PATH_MAX + 8];
+
+  snprintf(meta_path, sizeof(meta_path), "%s%s", path, ARCHIVE_META_EXT);
+  return archive_touch_meta(meta_path, app, base, hit);
+}
+
+// async signal safe, archive_build calls it after fork()
+bool archive_touch_meta(const char *meta_path, const char *app,
+                        const char *base, bool hit) {
+  struct archive_meta meta = {0};
+  long now = time_epoch_us();
+  int fd;
+
+  if ((fd = open(meta_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+    return false;
+  }
+  flock(fd, LOCK_EX);
+  if (pread(fd, &meta, sizeof(meta), 0) != sizeof(meta) ||
+      meta.magic != ARCHIVE_META_MAGIC ||
+      meta.version != ARCHIVE_META_VERSION) {
+    memset(&meta, 0, sizeof(meta));
+    meta.magic = ARCHIVE_META_MAGIC;
+    meta.version = ARCHIVE_META_VERSION;
+    meta.created_us = now;
+  }
+  if (hit) {
+    meta.hits++;
+  } else {
+    meta.created_us = now;
+  }
+  meta.used_us = now;
+  if (app != NULL) {
+    strncpy(meta.app, app, sizeof(meta.app) - 1);
+    meta.app[sizeof(meta.app) - 1] = '\0';
+  }
+  if (base != NULL) {
+    strncpy(meta.base, base, sizeof(meta.base) - 1);
+    meta.base[sizeof(meta.base) - 1] = '\0';
+  }
+  bool ok = pwrite(fd, &meta, sizeof(meta), 0) == sizeof(meta);
+  flock(fd, LOCK_UN);
+  close(fd);
+  return ok;
+}
+
+bool archive_read_meta(const char *path, struct archive_meta *meta) {
+  char meta_path[PATH_MAX + 8];
+  int fd;
+  bool ok;
+
+  snprintf(meta_path, sizeof(meta_path), "%s%s", path, ARCHIVE_META_EXT);
+  if ((fd = open(meta_path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return false;
+  }
+  ok = read(fd, meta, sizeof(*meta)) == sizeof(*meta) &&
+       meta->magic == ARCHIVE_META_MAGIC &&
+       meta->version == ARCHIVE_META_VERSION;
+  close(fd);
+  return ok;
+}
+
+// archive.max_size of the configuration, 512m, 2g...
+long long archive_max_size() {
+  char value[64] = {0};
+  size_t size;
+
+  if (config_get("archive.max_size", value, sizeof(value)) &&
+      arg_parse_size(value, &size)) {
+    return size;
+  }
+  return ARCHIVE_MAX_SIZE;
+}
+
+int archive_cmp_used(const void *a, const void *b) {
+  const struct yj_archive_info *x = a, *y = b;
+  return x->used_us < y->used_us ? -1 : (x->used_us > y->used_us ? 1 : 0);
+}
+
+// add up Rss/Pss/Shared of every process mapping an archive of the store
+void archive_sharing(struct yj_archive_info *infos, size_t len) {
+#ifdef __linux__
+  char path[PATH_MAX], line[PATH_MAX + 128];
+  struct yj_archive_info *cur;
+  struct dirent *ent;
+  DIR *proc;
+  FILE *smaps;
+  bool *seen;
+
+  // archives of a process are counted once, however often mapped
+  if ((seen = calloc(len == 0 ? 1 : len, sizeof(bool))) == NULL) {
+    return;
+  }
+  if ((proc = opendir("/proc")) == NULL) {
+    free(seen);
+    return;
+  }
+  while ((ent = readdir(proc)) != NULL) {
+    if (!isdigit((unsigned char)ent->d_name[0])) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "/proc/%s/smaps", ent->d_name);
+    if ((smaps = fopen(path, "re")) == NULL) {
+      continue;
+    }
+
+    memset(seen, 0, (len == 0 ? 1 : len) * sizeof(bool));
+    cur = NULL;
+    while (fgets(line, sizeof(line), smaps) != NULL) {
+      long kb;
+      char *name;
+
+      // a mapping starts with its address range, its fields follow
+      if (isxdigit((unsigned char)line[0]) && strchr(line, '-') != NULL &&
+          strchr(line, '-') < strchr(line, ' ')) {
+        cur = NULL;
+        if ((name = strchr(line, '/')) == NULL) {
+          continue;
+        }
+        name[strcspn(name, "\n")] = '\0';
+        for (size_t i = 0; i < len; i++) {
+          if (strcmp(infos[i].path, name) == 0) {
+            cur = &infos[i];
+            if (!seen[i]) {
+              seen[i] = true;
+              cur->procs++;
+            }
+            break;
+          }
+        }
+      } else if (cur == NULL) {
+        continue;
+      } else if (sscanf(line, "Rss: %ld kB", &kb) == 1) {
+        cur->rss_kb += kb;
+      } else if (sscanf(line, "Pss: %ld kB", &kb) == 1) {
+        cur->pss_kb += kb;
+      } else if (sscanf(line, "Shared_Clean: %ld kB", &kb) == 1 ||
+                 sscanf(line, "Shared_Dirty: %ld kB", &kb) == 1) {
+        cur->shared_kb += kb;
+      }
+    }
+    fclose(smaps);
+  }
+  closedir(proc);
+  free(seen);
+#endif
+}
+
+yj_result yj_archive_store(char *path, size_t maxlen, long long *max_size) {
+  if (path == NULL || !cache_path(ARCHIVE_DIR, path, maxlen, false)) {
+    return YJ_ERR_NULL;
+  }
+  if (max_size != NULL) {
+    *max_size = archive_max_size();
+  }
+  return YJ_OK;
+}
+
+yj_result yj_archive_list(struct yj_archive_info **out, size_t *out_len,
+                          bool sharing) {
+  char dir[PATH_MAX] = {0};
+  char path[PATH_MAX * 2];
+  struct yj_archive_info *infos = NULL;
+  struct archive_meta meta;
+  size_t len = 0, max = 0;
+  struct dirent *ent;
+  struct stat st;
+  DIR *d;
+
+  if (out == NULL || out_len == NULL) {
+    return YJ_ERR_NULL;
+  }
+  *out = NULL;
+  *out_len = 0;
+  if (!cache_path(ARCHIVE_DIR, dir, PATH_MAX, false)) {
+    return YJ_ERR_NULL;
+  }
+  if ((d = opendir(dir)) == NULL) {
+    return YJ_OK;
+  }
+
+  while ((ent = readdir(d)) != NULL) {
+    size_t name_len = strlen(ent->d_name);
+    struct yj_archive_info *info;
+    bool aot = name_len > 4 && strcmp(ent->d_name + name_len - 4, ".aot") == 0;
+
+    if (!aot &&
+        !(name_len > 4 && strcmp(ent->d_name + name_len - 4, ".jsa") == 0)) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s%c%s", dir, FILE_PATH_SEPRATOR,
+             ent->d_name);
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+
+    if (len >= max) {
+      struct yj_archive_info *more =
+          realloc(infos, (max + 16) * sizeof(struct yj_archive_info));
+      if (more == NULL) {
+        break;
+      }
+      infos = more;
+      max += 16;
+    }
+    info = &infos[len++];
+    memset(info, 0, sizeof(struct yj_archive_info));
+    info->path = strdup(path);
+    info->size = st.st_size;
+    info->kind = aot ? YJ_ARCHIVE_AOT
+                     : (strncmp(ent->d_name, ARCHIVE_BASE_PREFIX,
+                                strlen(ARCHIVE_BASE_PREFIX)) == 0
+                            ? YJ_ARCHIVE_BASE
+                            : YJ_ARCHIVE_CDS);
+    // archives of an older launcher have no meta, their mtime stands in
+    info->created_us = info->used_us =
+        stat_mtime_ns(&st) / 1000;
+    if (archive_read_meta(path, &meta)) {
+      info->hits = meta.hits;
+      info->created_us = meta.created_us;
+      info->used_us = meta.used_us;
+      if (meta.app[0] != '\0') {
+        info->app = strndup(meta.app, sizeof(meta.app));
+      }
+      if (meta.base[0] != '\0') {
+        info->base = strndup(meta.base, sizeof(meta.base));
+      }
+    }
+  }
+  closedir(d);
+
+  if (sharing) {
+    archive_sharing(infos, len);
+  }
+  *out = infos;
+  *out_len = len;
+  return YJ_OK;
+}
+
+yj_result yj_free_archive_info(struct yj_archive_info *info) {
+  if (info == NULL) {
+    return YJ_ERR_NULL;
+  }
+  SAFE_FREE(info->path);
+  SAFE_FREE(info->app);
+  SAFE_FREE(info->base);
+  return YJ_OK;
+}
+
+yj_result yj_archive_gc(long long max_size, size_t *removed,
+                        long long *freed) {
+  char dir[PATH_MAX] = {0};
+  char path[PATH_MAX * 2];
+  struct yj_archive_info *infos;
+  long long total = 0;
+  size_t len, count = 0;
+  long long bytes = 0;
+  long now = time_epoch_us();
+  struct dirent *ent;
+  struct stat st;
+  DIR *d;
+
+  if (max_size <= 0) {
+    max_size = archive_max_size();
+  }
+  if (!cache_path(ARCHIVE_DIR, dir, PATH_MAX, false) ||
+      yj_archive_list(&infos, &len, false) != YJ_OK) {
+    return YJ_ERR_NULL;
+  }
+
+  // leftovers of launches which never finished
+  if ((d = opendir(dir)) != NULL) {
+    while ((ent = readdir(d)) != NULL) {
+      if (strstr(ent->d_name, ".tmp") == NULL &&
+          strstr(ent->d_name, ".classlist") == NULL &&
+          strstr(ent->d_name, ".aotconf") == NULL) {
+        continue;
+      }
+      snprintf(path, sizeof(path), "%s%c%s", dir, FILE_PATH_SEPRATOR,
+               ent->d_name);
+      if (stat(path, &st) == 0 &&
+          now - stat_mtime_ns(&st) / 1000 > ARCHIVE_STALE_US &&
+          unlink(path) == 0) {
+        count++;
+        bytes += st.st_size;
+      }
+    }
+    closedir(d);
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    total += infos[i].size;
+  }
+  // a base goes with the top layers on it, they can not map without it
+  qsort(infos, len, sizeof(struct yj_archive_info), archive_cmp_used);
+  for (size_t i = 0; i < len && total > max_size; i++) {
+    const char *name;
+
+    if (infos[i].path == NULL) {
+      continue;
+    }
+    name = strrchr(infos[i].path, FILE_PATH_SEPRATOR);
+    name = name == NULL ? infos[i].path : name + 1;
+    for (size_t j = 0; infos[i].kind == YJ_ARCHIVE_BASE && j < len; j++) {
+      if (j != i && infos[j].path != NULL && infos[j].base != NULL &&
+          strcmp(infos[j].base, name) == 0 && archive_evict(&infos[j])) {
+        total -= infos[j].size;
+        bytes += infos[j].size;
+        count++;
+      }
+    }
+    if (archive_evict(&infos[i])) {
+      total -= infos[i].size;
+      bytes += infos[i].size;
+      count++;
+    }
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    yj_free_archive_info(&infos[i]);
+  }
+  free(infos);
+  if (removed != NULL) {
+    *removed = count;
+  }
+  if (freed != NULL) {
+    *freed = bytes;
+  }
+  return YJ_OK;
+}
+
+// remove an archive and its meta, the path is cleared once it is gone
+bool archive_evict(struct yj_archive_info *info) {
+  char path[PATH_MAX + 8];
+
+  if (unlink(info->path) != 0) {
+    return false;
+  }
+  TRACE("archive evicted: %s", info->path);
+  snprintf(path, sizeof(path), "%s%s", info->path, ARCHIVE_META_EXT);
+  unlink(path);
+  SAFE_FREE(info->path);
+  return true;
+}
+
+// PREFETCH
+// Page cache prefetch of the files a launch reads while the vm starts. The
+// pages of libjvm, lib/modules, the CDS archives and the class path which
+// startup brought into the page cache are recorded once it is done; later
+// launches of the same files ask the kernel for those ranges from
+// background threads while the vm binds and boots. A file whose pages were
+// all cached already shows nothing and is recorded by a later launch, a
+// changed file drops its ranges until recorded again. Linux only.
+
+// the files of a launch, the profile is keyed by their paths
+bool prefetch_start(struct yj_java_runtime *runtime,
+                    struct yj_run_args *args) {
+  struct yj_prefetch *pf;
+  char path[PATH_MAX + 32];
+  char name[64];
+  char *env, *slash;
+  uint64_t h = 0xcbf29ce484222325ULL;
+  size_t len;
+
+#ifndef __linux__
+  return false;
+#endif
+  if ((env = getenv("YAJAVA_PREFETCH")) != NULL && strcmp(env, "off") == 0) {
+    return false;
+  }
+  if (args->prefetch != NULL || runtime->libjvm_path == NULL) {
+    return false;
+  }
+
+  if ((pf = calloc(1, sizeof(struct yj_prefetch))) == NULL) {
+    return false;
+  }
+  if ((pf->files = calloc(args->classpathes_len + 6, sizeof(char *))) ==
+      NULL) {
+    free(pf);
+    return false;
+  }
+  pf->files[pf->files_len++] = strdup(runtime->libjvm_path);
+  snprintf(path, sizeof(path), "%s%clib%cmodules", runtime->home,
+           FILE_PATH_SEPRATOR, FILE_PATH_SEPRATOR);
+  pf->files[pf->files_len++] = strdup(path);
+  snprintf(path, sizeof(path), "%s", runtime->libjvm_path);
+  if ((slash = strrchr(path, FILE_PATH_SEPRATOR)) != NULL) {
+    snprintf(slash + 1, sizeof(path) - (slash + 1 - path), "classes.jsa");
+    pf->files[pf->files_len++] = strdup(path);
+  }
+  if (args->archive != NULL && args->archive->mode == ARCHIVE_USE) {
+    pf->files[pf->files_len++] = strdup(args->archive->path);
+  }
+  if (args->archive != NULL && args->archive->base[0] != '\0') {
+    pf->files[pf->files_len++] = strdup(args->archive->base);
+  }
+  if (args->app_jar != NULL) {
+    pf->files[pf->files_len++] = strdup(args->app_jar);
+  }
+  for (int i = 0; i < args->classpathes_len; i++) {
+    pf->files[pf->files_len++] = strdup(args->classpathes[i]);
+  }
+
+  // only what has pages to cache, a profile lists the same files
+  len = pf->files_len;
+  pf->files_len = 0;
+  for (size_t i = 0; i < len; i++) {
+    struct stat st;
+    if (pf->files[i] != NULL && stat(pf->files[i], &st) == 0 &&
+        S_ISREG(st.st_mode) && st.st_size > 0) {
+      h = plan_hash(h, pf->files[i], strlen(pf->files[i]) + 1);
+      pf->files[pf->files_len++] = pf->files[i];
+    } else {
+      free(pf->files[i]);
+    }
+  }
+  pf->key = h;
+  snprintf(name, sizeof(name), "%s%c%016llx", PREFETCH_DIR, FILE_PATH_SEPRATOR,
+           (unsigned long long)pf->key);
+  if (!cache_path(name, pf->path, PATH_MAX, true)) {
+    prefetch_free(pf);
+    free(pf);
+    return false;
+  }
+  args->prefetch = pf;
+
+  // without a fresh profile of every file, this launch records it
+  pf->profile = file_read_all(pf->path, PREFETCH_MAX_PROFILE,
+                              &pf->profile_len);
+  if (!prefetch_valid(pf->profile, pf->profile_len)) {
+    SAFE_FREE(pf->profile);
+    pf->stale = true;
+    prefetch_snapshot(pf);
+    TRACE("prefetch profile missing: %s", pf->path);
+    return true;
+  }
+
+  struct prefetch_header *header = (struct prefetch_header *)pf->profile;
+  pf->stale = header->files_len != pf->files_len;
+  if (pf->stale) {
+    prefetch_snapshot(pf); // before the threads bring pages in
+  }
+  pf->threads_len = header->files_len < PREFETCH_THREADS
+                        ? header->files_len
+                        : PREFETCH_THREADS;
+  pf->issue_start_us = time_now_us();
+  for (size_t i = 0; i < pf->threads_len; i++) {
+    if (pthread_create(&pf->threads[i], NULL, prefetch_thread, pf) != 0) {
+      pf->threads_len = i;
+      break;
+    }
+  }
+  return true;
+}
+
+bool prefetch_valid(const char *profile, size_t len) {
+  struct prefetch_header *header = (struct prefetch_header *)profile;
+  struct prefetch_file *files;
+  size_t need;
+
+  if (profile == NULL || len < sizeof(*header) ||
+      header->magic != PREFETCH_MAGIC || header->version != PREFETCH_VERSION ||
+      header->page_size == 0) {
+    return false;
+  }
+  need = sizeof(*header) +
+         (size_t)header->files_len * sizeof(struct prefetch_file) +
+         (size_t)header->ranges_len * sizeof(struct prefetch_range) +
+         header->strings_len;
+  if (need != len) {
+    return false;
+  }
+  files = (struct prefetch_file *)(header + 1);
+  for (uint32_t i = 0; i < header->files_len; i++) {
+    if (files[i].path >= header->strings_len ||
+        (uint64_t)files[i].ranges_start + files[i].ranges_len >
+            header->ranges_len) {
+      return false;
+    }
+  }
+  return profile[len - 1] == '\0';
+}
+
+// the pages of each file in the page cache before the launch reads any
+void prefetch_snapshot(struct yj_prefetch *pf) {
+  size_t page_size = sysconf(_SC_PAGESIZE);
+
+  if (pf->cached != NULL ||
+      (pf->cached = calloc(pf->files_len, sizeof(struct prefetch_cached))) ==
+          NULL) {
+    return;
+  }
+  for (size_t i = 0; i < pf->files_len; i++) {
+    struct stat st;
+    int fd;
+
+    if ((fd = open(pf->files[i], O_RDONLY | O_CLOEXEC)) < 0) {
+      continue;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      pf->cached[i].vec = prefetch_mincore(fd, st.st_size, page_size);
+      pf->cached[i].size = st.st_size;
+    }
+    close(fd);
+  }
+}
+
+// a byte per page of the file, the low bit set when it is cached
+unsigned char *prefetch_mincore(int fd, off_t size, size_t page_size) {
+#ifdef __linux__
+  size_t pages = (size + page_size - 1) / page_size;
+  unsigned char *vec;
+  void *map;
+
+  if ((map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    return NULL;
+  }
+  if ((vec = calloc(pages, 1)) != NULL && mincore(map, size, (void *)vec) != 0) {
+    SAFE_FREE(vec);
+  }
+  munmap(map, size);
+  return vec;
+#else
+  return NULL;
+#endif
+}
+
+// the pages cached now which were not before, as ranges of pages. Ranges
+// closer than PREFETCH_GAP are merged, out has room for the most there can
+// be: pages / (PREFETCH_GAP + 2) + 1
+size_t prefetch_ranges(const unsigned char *now, const unsigned char *before,
+                       size_t pages, struct prefetch_range *out) {
+  struct prefetch_range *cur = NULL;
+  size_t len = 0;
+
+  for (size_t p = 0; p < pages; p++) {
+    if (!(now[p] & 1) || (before != NULL && (before[p] & 1))) {
+      continue;
+    }
+    if (cur != NULL && p - (cur->page + cur->pages) <= PREFETCH_GAP) {
+      cur->pages = p - cur->page + 1;
+    } else {
+      cur = &out[len++];
+      cur->page = p;
+      cur->pages = 1;
+    }
+  }
+  return len;
+}
+
+// takes files of the profile one after another, for each of them the
+// resident pages are counted first: what was cold before the prefetch
+void *prefetch_thread(void *data) {
+  struct yj_prefetch *pf = data;
+  struct prefetch_header *header = (struct prefetch_header *)pf->profile;
+  struct prefetch_file *files = (struct prefetch_file *)(header + 1);
+  struct prefetch_range *ranges =
+      (struct prefetch_range *)(files + header->files_len);
+  const char *strings = (const char *)(ranges + header->ranges_len);
+  uint32_t i;
+
+  while ((i = __atomic_fetch_add(&pf->next, 1, __ATOMIC_RELAXED)) <
+         header->files_len) {
+    struct prefetch_file *file = &files[i];
+    struct stat st;
+    size_t pages = 0, cold = 0;
+    int fd;
+
+    if ((fd = open(strings + file->path, O_RDONLY | O_CLOEXEC)) < 0) {
+      __atomic_store_n(&pf->stale, true, __ATOMIC_RELAXED);
+      continue;
+    }
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size != file->size ||
+        stat_mtime_ns(&st) != file->mtime_ns) {
+      TRACE("prefetch skips changed file: %s", strings + file->path);
+      __atomic_store_n(&pf->stale, true, __ATOMIC_RELAXED);
+      close(fd);
+      continue;
+    }
+
+    for (uint32_t r = 0; r < file->ranges_len; r++) {
+      struct prefetch_range *range = &ranges[file->ranges_start + r];
+      off_t off = (off_t)range->page * header->page_size;
+      off_t len = (off_t)range->pages * header->page_size;
+      pages += range->pages;
+      cold += range->pages - prefetch_resident(fd, off, len, st.st_size,
+                                               header->page_size);
+#ifdef __linux__
+      posix_fadvise(fd, off, len, POSIX_FADV_WILLNEED);
+#endif
+    }
+    close(fd);
+
+    __atomic_fetch_add(&pf->pages, pages, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pf->cold_pages, cold, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pf->ranges, file->ranges_len, __ATOMIC_RELAXED);
+  }
+  return NULL;
+}
+
+// pages of [off, off + len) in the page cache
+size_t prefetch_resident(int fd, off_t off, off_t len, off_t size,
+                         size_t page_size) {
+  unsigned char *vec;
+  size_t pages, resident = 0;
+  void *map;
+
+  if (off >= size) {
+    return len / page_size; // gone with the file, nothing to read
+  }
+  if (off + len > size) {
+    len = size - off;
+  }
+  pages = (len + page_size - 1) / page_size;
+#ifdef __linux__
+  map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, off);
+  if (map == MAP_FAILED) {
+    return 0;
+  }
+  vec = calloc(pages, 1);
+  if (vec != NULL && mincore(map, len, (void *)vec) == 0) {
+    for (size_t i = 0; i < pages; i++) {
+      resident += vec[i] & 1;
+    }
+  }
+  free(vec);
+  munmap(map, len);
+#endif
+  return resident;
+}
+
+// the entry of an unchanged file in the profile read at start, or NULL
+const struct prefetch_file *prefetch_old_file(struct yj_prefetch *pf,
+                                              const char *path,
+                                              struct stat *st) {
+  struct prefetch_header *header = (struct prefetch_header *)pf->profile;
+  struct prefetch_file *files;
+  const char *strings;
+
+  if (header == NULL) {
+    return NULL;
+  }
+  files = (struct prefetch_file *)(header + 1);
+  strings = (const char *)((struct prefetch_range *)(files + header->files_len) +
+                           header->ranges_len);
+  for (uint32_t i = 0; i < header->files_len; i++) {
+    if (strcmp(strings + files[i].path, path) == 0) {
+      return files[i].size == (uint64_t)st->st_size &&
+                     files[i].mtime_ns == stat_mtime_ns(st) &&
+                     files[i].ranges_len > 0
+                 ? &files[i]
+                 : NULL;
+    }
+  }
+  return NULL;
+}
+
+// waits for the issuing threads, and books the vm creation time as a cold
+// or a warm start: cold when a tenth of the profile was not cached
+void prefetch_join(struct yj_run_args *args, long create_us) {
+  struct yj_prefetch *pf = args->prefetch;
+  struct prefetch_header header;
+  bool cold;
+  int fd;
+
+  if (pf == NULL || pf->joined) {
+    return;
+  }
+  pf->joined = true;
+  for (size_t i = 0; i < pf->threads_len; i++) {
+    pthread_join(pf->threads[i], NULL);
+  }
+  pf->issue_us = time_now_us() - pf->issue_start_us;
+  if (pf->profile == NULL) {
+    if (args->prefetch_stats) {
+      fprintf(stderr, "prefetch %016llx: no profile yet, create vm %.3fms\n",
+              (unsigned long long)pf->key, create_us / 1000.0);
+    }
+    return;
+  }
+
+  cold = pf->cold_pages * 10 > pf->pages;
+  if ((fd = open(pf->path, O_RDWR | O_CLOEXEC)) >= 0) {
+    flock(fd, LOCK_EX);
+    if (pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        header.magic == PREFETCH_MAGIC) {
+      if (cold) {
+        header.cold_n++;
+        header.cold_us += create_us;
+      } else {
+        header.warm_n++;
+        header.warm_us += create_us;
+      }
+      pwrite(fd, &header, sizeof(header), 0);
+      memcpy(pf->profile, &header, sizeof(header));
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+  }
+
+  if (args->prefetch_stats) {
+    struct prefetch_header *h = (struct prefetch_header *)pf->profile;
+    fprintf(stderr,
+            "prefetch %016llx: %u files, %zu ranges, %.1fMB, %zu%% cold, "
+            "issued %.3fms; create vm %.3fms (%s); cold avg %.3fms (%u), "
+            "warm avg %.3fms (%u)\n",
+            (unsigned long long)pf->key, h->files_len, pf->ranges,
+            pf->pages * (double)h->page_size / (1024 * 1024),
+            pf->pages == 0 ? 0 : pf->cold_pages * 100 / pf->pages,
+            pf->issue_us / 1000.0, create_us / 1000.0, cold ? "cold" : "warm",
+            h->cold_n == 0 ? 0 : h->cold_us / 1000.0 / h->cold_n, h->cold_n,
+            h->warm_n == 0 ? 0 : h->warm_us / 1000.0 / h->warm_n, h->warm_n);
+  }
+}
+
+// what startup read is what is cached now and was not before it, ranges
+// close to each other are merged. Written aside and renamed over, timings
+// are carried over.
+bool prefetch_record(struct yj_run_args *args) {
+  struct yj_prefetch *pf = args->prefetch;
+  struct prefetch_header header = {0};
+  struct prefetch_file *files;
+  struct prefetch_range *ranges = NULL;
+  char tmp_path[PATH_MAX + 8];
+  char *pool;
+  size_t pool_max = 1;
+  uint32_t pool_len = 1, ranges_len = 0;
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  bool ok = false;
+  int fd;
+
+  if (pf == NULL || !__atomic_load_n(&pf->stale, __ATOMIC_RELAXED) ||
+      pf->recorded) {
+    return false;
+  }
+  pf->recorded = true;
+
+  for (size_t i = 0; i < pf->files_len; i++) {
+    pool_max += strlen(pf->files[i]) + 1;
+  }
+  pool = calloc(pool_max, sizeof(char));
+  files = calloc(pf->files_len, sizeof(struct prefetch_file));
+  if (pool == NULL || files == NULL) {
+    SAFE_FREE(pool);
+    SAFE_FREE(files);
+    return false;
+  }
+
+  for (size_t i = 0; i < pf->files_len; i++) {
+    struct prefetch_file *file = &files[header.files_len];
+    struct prefetch_cached *before =
+        pf->cached != NULL ? &pf->cached[i] : NULL;
+    const struct prefetch_file *old;
+    struct prefetch_range *more;
+    unsigned char *vec = NULL;
+    struct stat st;
+    size_t pages, len = 0;
+    int fd;
+
+    if ((fd = open(pf->files[i], O_RDONLY | O_CLOEXEC)) < 0) {
+      continue;
+    }
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      continue;
+    }
+    // without a snapshot there is no telling what startup read
+    if (before != NULL && before->vec != NULL && st.st_size == before->size) {
+      vec = prefetch_mincore(fd, st.st_size, page_size);
+    }
+    close(fd);
+
+    pages = (st.st_size + page_size - 1) / page_size;
+    old = prefetch_old_file(pf, pf->files[i], &st);
+    more = realloc(ranges, (ranges_len + pages / (PREFETCH_GAP + 2) + 1 +
+                            (old != NULL ? old->ranges_len : 0)) *
+                               sizeof(struct prefetch_range));
+    if (more == NULL) {
+      free(vec);
+      continue;
+    }
+    ranges = more;
+    if (vec != NULL) {
+      len = prefetch_ranges(vec, before->vec, pages, ranges + ranges_len);
+      free(vec);
+    }
+    // nothing new seen, what an earlier launch recorded still holds
+    if (len == 0 && old != NULL) {
+      struct prefetch_header *h = (struct prefetch_header *)pf->profile;
+      struct prefetch_range *old_ranges =
+          (struct prefetch_range *)((struct prefetch_file *)(h + 1) +
+                                    h->files_len);
+      len = old->ranges_len;
+      memcpy(ranges + ranges_len, old_ranges + old->ranges_start,
+             len * sizeof(struct prefetch_range));
+    }
+    if (len == 0) {
+      continue;
+    }
+
+    file->size = st.st_size;
+    file->mtime_ns = stat_mtime_ns(&st);
+    file->path = index_put_str(pool, &pool_len, pf->files[i]);
+    file->ranges_start = ranges_len;
+    file->ranges_len = len;
+    ranges_len += len;
+    header.files_len++;
+  }
+
+  // the timings so far
+  if (pf->profile != NULL) {
+    struct prefetch_header *old = (struct prefetch_header *)pf->profile;
+    header.cold_n = old->cold_n;
+    header.cold_us = old->cold_us;
+    header.warm_n = old->warm_n;
+    header.warm_us = old->warm_us;
+  }
+  header.magic = PREFETCH_MAGIC;
+  header.version = PREFETCH_VERSION;
+  header.page_size = page_size;
+  header.ranges_len = ranges_len;
+  header.strings_len = pool_len;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", pf->path);
+  if ((fd = mkstemp(tmp_path)) >= 0) {
+    fchmod(fd, 0644);
+    ok = file_write_all(fd, &header, sizeof(header)) &&
+         file_write_all(fd, files,
+                        header.files_len * sizeof(struct prefetch_file)) &&
+         file_write_all(fd, ranges,
+                        ranges_len * sizeof(struct prefetch_range)) &&
+         file_write_all(fd, pool, pool_len) &&
+         rename(tmp_path, pf->path) == 0;
+    close(fd);
+    if (!ok) {
+      unlink(tmp_path);
+    }
+  }
+  TRACE("prefetch profile written: %s, %u files, %u ranges, %d", pf->path,
+        header.files_len, ranges_len, ok);
+
+  free(ranges);
+  free(files);
+  free(pool);
+  return ok;
+}
+
+void prefetch_free(struct yj_prefetch *pf) {
+  if (pf == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < pf->files_len; i++) {
+    SAFE_FREE(pf->files[i]);
+    if (pf->cached != NULL) {
+      SAFE_FREE(pf->cached[i].vec);
+    }
+  }
+  SAFE_FREE(pf->files);
+  SAFE_FREE(pf->cached);
+  SAFE_FREE(pf->profile);
+}
+
+// PRELOAD
+// Parallel class loading of --preload. The first launch of an application
+// records its startup class list with -XX:DumpLoadedClassList; later
+// launches load those classes from helper threads while the main thread
+// runs the main class. The list is grouped by package, a helper takes the
+// next package in order of first use and loads its classes in list order,
+// so the classes of one jar are read by one thread. Only the classes of
+// the builtin loaders are listed, each of them is loaded through the
+// system class loader, which delegates to the loader that defined it in
+// the recording. Helpers stop once main returns, the list is exhausted or
+// after PRELOAD_MAX_US.
+
+// the class list of the runtime and class path, parsed while the vm is
+// created, or the recording of it
+bool preload_prepare(struct yj_java_runtime *runtime,
+                     struct yj_run_args *args) {
+  struct yj_preload *pl;
+  char name[64];
+  char *env;
+  uint64_t h = 0xcbf29ce484222325ULL;
+  const char *app =
+      args->app_jar != NULL ? args->app_jar : args->app_main_class;
+
+  if (!args->preload && !args->preload_stats) {
+    return false;
+  }
+  if ((env = getenv("YAJAVA_PRELOAD")) != NULL && strcmp(env, "off") == 0) {
+    return false;
+  }
+  // HotSpot only, the class list of a pack is its load order already
+  if (args->preloader != NULL || args->packing || app == NULL ||
+      (runtime->features & YJ_FEAT_OPENJ9) != 0) {
+    return false;
+  }
+
+  h = plan_hash(h, runtime->home, strlen(runtime->home) + 1);
+  h = plan_hash(h, app, strlen(app) + 1);
+  for (int i = 0; i < args->classpathes_len; i++) {
+    h = plan_hash(h, args->classpathes[i], strlen(args->classpathes[i]) + 1);
+  }
+
+  if ((pl = calloc(1, sizeof(struct yj_preload))) == NULL) {
+    return false;
+  }
+  pl->key = h;
+  pl->stats = args->preload_stats;
+  snprintf(name, sizeof(name), "%s%c%016llx", PRELOAD_DIR, FILE_PATH_SEPRATOR,
+           (unsigned long long)pl->key);
+  if (!cache_path(name, pl->path, PATH_MAX, true)) {
+    free(pl);
+    return false;
+  }
+  args->preloader = pl;
+
+  pl->list = file_read_all(pl->path, PRELOAD_MAX_LIST, &pl->list_len);
+  if (pl->list != NULL && preload_parse(pl)) {
+    return true;
+  }
+  preload_free(pl);
+
+  // a base archive records its own class list with the same option
+  if (args->archive != NULL && args->archive->mode != ARCHIVE_USE &&
+      args->archive->mode != ARCHIVE_DUMP) {
+    TRACE("preload: class list recorded by a later launch");
+    return true;
+  }
+  snprintf(pl->tmp, sizeof(pl->tmp), "%s.%d", pl->path, (int)getpid());
+  pl->record = true;
+  TRACE("preload: record the class list %s", pl->path);
+  return true;
+}
+
+// `java/lang/Object` lines, `java/lang/Object id: 0` since 17. Lambda form
+// (@) lines and classes of other loaders (source:) are left out.
+bool preload_parse(struct yj_preload *pl) {
+  char *line = pl->list, *end = pl->list + pl->list_len;
+  size_t cap = 1024, start;
+
+  if ((pl->classes = malloc(cap * sizeof(struct preload_class))) == NULL) {
+    return false;
+  }
+  while (line < end) {
+    char *eol = memchr(line, '\n', end - line);
+    char *dot = NULL;
+    size_t len;
+
+    if (eol == NULL) {
+      break; // cut short, the rest is left out
+    }
+    *eol = '\0';
+    len = strcspn(line, " \t\r");
+    if (len == 0 || line[0] == '#' || line[0] == '@' ||
+        strstr(line + len, "source:") != NULL) {
+      line = eol + 1;
+      continue;
+    }
+    line[len] = '\0';
+    for (char *c = line; *c != '\0'; c++) {
+      if (*c == '/') {
+        *c = '.';
+        dot = c;
+      }
+    }
+    if (pl->classes_len == cap) {
+      struct preload_class *classes =
+          realloc(pl->classes, cap * 2 * sizeof(struct preload_class));
+      if (classes == NULL) {
+        return false;
+      }
+      pl->classes = classes;
+      cap *= 2;
+    }
+    pl->classes[pl->classes_len].name = line;
+    pl->classes[pl->classes_len].package_len = dot == NULL ? 0 : dot - line;
+    pl->classes[pl->classes_len].index = pl->classes_len;
+    pl->classes_len++;
+    line = eol + 1;
+  }
+  if (pl->classes_len == 0) {
+    return false;
+  }
+
+  // packages, each in list order, in order of their first class
+  qsort(pl->classes, pl->classes_len, sizeof(struct preload_class),
+        preload_class_cmp);
+  if ((pl->groups = malloc(pl->classes_len * sizeof(struct preload_group))) ==
+      NULL) {
+    return false;
+  }
+  start = 0;
+  for (uint32_t i = 1; i <= pl->classes_len; i++) {
+    struct preload_class *a = &pl->classes[start], *b = &pl->classes[i];
+    if (i < pl->classes_len && a->package_len == b->package_len &&
+        memcmp(a->name, b->name, a->package_len) == 0) {
+      continue;
+    }
+    pl->groups[pl->groups_len].start = start;
+    pl->groups[pl->groups_len].len = i - start;
+    pl->groups[pl->groups_len].first = a->index;
+    pl->groups_len++;
+    start = i;
+  }
+  qsort(pl->groups, pl->groups_len, sizeof(struct preload_group),
+        preload_group_cmp);
+  TRACE("preload: %u classes in %u packages", pl->classes_len,
+        pl->groups_len);
+  return true;
+}
+
+int preload_class_cmp(const void *a, const void *b) {
+  const struct preload_class *x = a, *y = b;
+  uint32_t len = x->package_len < y->package_len ? x->package_len
+                                                 : y->package_len;
+  int c = memcmp(x->name, y->name, len);
+
+  if (c != 0) {
+    return c;
+  }
+  if (x->package_len != y->package_len) {
+    return x->package_len < y->package_len ? -1 : 1;
+  }
+  return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+int preload_group_cmp(const void *a, const void *b) {
+  const struct preload_group *x = a, *y = b;
+  return x->first < y->first ? -1 : (x->first > y->first);
+}
+
+// the recording launch dumps its class list, never part of the launch plan
+bool preload_vm_args(struct yj_preload *pl, JavaVMInitArgs *out) {
+  char buf[sizeof(pl->tmp) + 32];
+
+  if (pl == NULL || !pl->record) {
+    return true;
+  }
+  snprintf(buf, sizeof(buf), "-XX:DumpLoadedClassList=%s", pl->tmp);
+  return jvm_args_add(out, strdup(buf));
+}
+
+// helpers for the list, one less than the cpus by default: main runs too
+bool preload_start(struct yj_run_args *args, JavaVM *vm) {
+  struct yj_preload *pl = args->preloader;
+  uint32_t left;
+  long threads;
+
+  if (pl == NULL || pl->classes_len == 0) {
+    return false;
+  }
+  threads = env_long("YAJAVA_PRELOAD_THREADS",
+                     sysconf(_SC_NPROCESSORS_ONLN) - 1);
+  if (threads > PRELOAD_THREADS) {
+    threads = PRELOAD_THREADS;
+  }
+  if (threads > (long)pl->groups_len) {
+    threads = pl->groups_len;
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  pl->vm = vm;
+  pl->start_us = time_now_us();
+  pl->running = threads;
+  for (long i = 0; i < threads; i++) {
+    if (pthread_create(&pl->threads[i], NULL, preload_thread, pl) != 0) {
+      // the started ones may all be done already, none of them reported
+      left = __atomic_sub_fetch(&pl->running, threads - i, __ATOMIC_ACQ_REL);
+      if (left == 0 && i > 0) {
+        preload_report(pl);
+      }
+      break;
+    }
+    pl->threads_len++;
+  }
+  TRACE("preload: %zu helper threads", pl->threads_len);
+  return pl->threads_len > 0;
+}
+
+// a daemon thread of the vm while it loads. Class.forName without
+// initialization loads, reflecting on the constructors links: nothing of
+// the application runs on a helper.
+void *preload_thread(void *data) {
+  struct yj_preload *pl = data;
+  jclass class_class, loader_class;
+  jmethodID for_name, get_loader, constructors;
+  jobject loader = NULL;
+  JNIEnv *env;
+  uint32_t g;
+
+  if ((*pl->vm)->AttachCurrentThreadAsDaemon(pl->vm, (void **)&env, NULL) !=
+      JNI_OK) {
+    goto done;
+  }
+  class_class = (*env)->FindClass(env, "java/lang/Class");
+  loader_class = (*env)->FindClass(env, "java/lang/ClassLoader");
+  if (class_class == NULL || loader_class == NULL) {
+    goto detach;
+  }
+  for_name = (*env)->GetStaticMethodID(
+      env, class_class, "forName",
+      "(Ljava/lang/String;ZLjava/lang/ClassLoader;)Ljava/lang/Class;");
+  constructors =
+      (*env)->GetMethodID(env, class_class, "getDeclaredConstructors",
+                          "()[Ljava/lang/reflect/Constructor;");
+  get_loader = (*env)->GetStaticMethodID(env, loader_class,
+                                         "getSystemClassLoader",
+                                         "()Ljava/lang/ClassLoader;");
+  if (for_name == NULL || constructors == NULL || get_loader == NULL ||
+      (loader = (*env)->CallStaticObjectMethod(env, loader_class,
+                                               get_loader)) == NULL) {
+    goto detach;
+  }
+
+  while ((g = __atomic_fetch_add(&pl->next, 1, __ATOMIC_RELAXED)) <
+         pl->groups_len) {
+    struct preload_group *group = &pl->groups[g];
+    uint32_t loaded = 0, failed = 0;
+    long start = time_now_us();
+
+    for (uint32_t i = group->start; i < group->start + group->len; i++) {
+      jstring name;
+      jobject cls, ctors;
+
+      if (__atomic_load_n(&pl->state, __ATOMIC_RELAXED) != PRELOAD_RUNNING) {
+        break;
+      }
+      name = (*env)->NewStringUTF(env, pl->classes[i].name);
+      cls = name == NULL ? NULL
+                         : (*env)->CallStaticObjectMethod(
+                               env, class_class, for_name, name, JNI_FALSE,
+                               loader);
+      if (cls != NULL && !(*env)->ExceptionCheck(env)) {
+        ctors = (*env)->CallObjectMethod(env, cls, constructors);
+        if (ctors != NULL) {
+          (*env)->DeleteLocalRef(env, ctors);
+        }
+      }
+      if ((*env)->ExceptionCheck(env)) {
+        (*env)->ExceptionClear(env);
+      }
+      if (cls != NULL) {
+        (*env)->DeleteLocalRef(env, cls);
+        loaded++;
+      } else {
+        failed++;
+      }
+      if (name != NULL) {
+        (*env)->DeleteLocalRef(env, name);
+      }
+    }
+
+    __atomic_fetch_add(&pl->loaded, loaded, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pl->failed, failed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pl->busy_us, time_now_us() - start, __ATOMIC_RELAXED);
+    if (time_now_us() - pl->start_us > PRELOAD_MAX_US) {
+      preload_stop(pl, PRELOAD_TIMEOUT);
+    }
+    if (__atomic_load_n(&pl->state, __ATOMIC_RELAXED) != PRELOAD_RUNNING) {
+      break;
+    }
+  }
+
+detach:
+  if (loader != NULL) {
+    (*env)->DeleteLocalRef(env, loader);
+  }
+  (*pl->vm)->DetachCurrentThread(pl->vm);
+done:
+  // the last one out reports
+  if (__atomic_sub_fetch(&pl->running, 1, __ATOMIC_ACQ_REL) == 0) {
+    preload_report(pl);
+  }
+  return NULL;
+}
+
+// the first reason to stop wins
+void preload_stop(struct yj_preload *pl, int state) {
+  int running = PRELOAD_RUNNING;
+  __atomic_compare_exchange_n(&pl->state, &running, state, false,
+                              __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// main reached the readiness point, the helpers are done before the vm is
+// destroyed
+void preload_join(struct yj_run_args *args) {
+  struct yj_preload *pl = args->preloader;
+
+  if (pl == NULL || pl->joined) {
+    return;
+  }
+  pl->joined = true;
+  preload_stop(pl, PRELOAD_READY);
+  for (size_t i = 0; i < pl->threads_len; i++) {
+    pthread_join(pl->threads[i], NULL);
+  }
+  if (pl->threads_len == 0) {
+    preload_report(pl);
+  }
+}
+
+// what the helpers loaded is class loading the main thread was spared. A
+// list which mostly fails to load is out of date, the next launch records
+// it again.
+void preload_report(struct yj_preload *pl) {
+  static const char *states[] = {[PRELOAD_RUNNING] = "list exhausted",
+                                 [PRELOAD_READY] = "main returned",
+                                 [PRELOAD_TIMEOUT] = "time limit"};
+  int state = __atomic_load_n(&pl->state, __ATOMIC_RELAXED);
+  uint32_t failed = __atomic_load_n(&pl->failed, __ATOMIC_RELAXED);
+
+  if (pl->record || pl->classes_len == 0) {
+    if (pl->stats) {
+      fprintf(stderr, "preload %016llx: %s\n", (unsigned long long)pl->key,
+              pl->record ? "recording the class list"
+                         : "no class list yet, recorded by a later launch");
+    }
+    return;
+  }
+  if (failed * 2 > pl->classes_len) {
+    TRACE("preload: class list out of date, %u failed", failed);
+    unlink(pl->path);
+  }
+  if (pl->stats) {
+    fprintf(stderr,
+            "preload %016llx: %u classes in %u packages, %zu threads, "
+            "loaded %u, failed %u; %.3fms of class loading off the main "
+            "thread in %.3fms (%s)\n",
+            (unsigned long long)pl->key, pl->classes_len, pl->groups_len,
+            pl->threads_len, __atomic_load_n(&pl->loaded, __ATOMIC_RELAXED),
+            failed,
+            __atomic_load_n(&pl->busy_us, __ATOMIC_RELAXED) / 1000.0,
+            (time_now_us() - pl->start_us) / 1000.0, states[state]);
+  }
+}
+
+// keep the class list of the recording launch, once the vm is gone
+void preload_finish(struct yj_run_args *args) {
+  struct yj_preload *pl = args->preloader;
+  struct stat st;
+
+  if (pl == NULL || !pl->record) {
+    return;
+  }
+  pl->record = false;
+  if (stat(pl->tmp, &st) == 0 && st.st_size > 0 &&
+      rename(pl->tmp, pl->path) == 0) {
+    TRACE("preload: class list written: %s", pl->path);
+    return;
+  }
+  unlink(pl->tmp);
+}
+
+void preload_free(struct yj_preload *pl) {
+  if (pl == NULL) {
+    return;
+  }
+  SAFE_FREE(pl->list);
+  SAFE_FREE(pl->classes);
+  SAFE_FREE(pl->groups);
+  pl->list_len = 0;
+  pl->classes_len = 0;
+  pl->groups_len = 0;
+}
+
+// SOURCE
+// Single-file source programs, `yajava Foo.java` and #! scripts. The stock
+// launcher compiles the file in memory on every launch; here javac of the
+// runtime compiles it once into source/<path>-<content> of the cache,
+// keyed by the content, the runtime version and the options javac sees.
+// Launches of an unchanged file put that directory on the class path and
+// run its first top-level class. Without javac, on compile errors and for
+// implicitly declared classes the stock source launcher runs instead.
+
+bool source_prepare(struct yj_java_runtime *runtime,
+                    struct yj_run_args *args) {
+  char main_class[SOURCE_NAME_MAX], pub[SOURCE_NAME_MAX];
+  char name[80], path[PATH_MAX], real[PATH_MAX];
+  uint64_t key = 0xcbf29ce484222325ULL, path_key = key;
+  const char *file, *simple;
+  char *src, *env;
+  size_t len;
+
+  if (args->app_source == NULL || args->app_main_class != NULL) {
+    return true;
+  }
+  if ((src = file_read_all(args->app_source, SOURCE_MAX, &len)) == NULL) {
+    fprintf(stderr, "error: can not read source file %s\n", args->app_source);
+    return false;
+  }
+  if (((env = getenv("YAJAVA_SOURCE_CACHE")) != NULL &&
+       strcmp(env, "off") == 0) ||
+      !source_types(src, len, main_class, pub, SOURCE_NAME_MAX)) {
+    free(src);
+    return source_stock(runtime, args);
+  }
+
+  // what javac is given decides the classes
+  key = plan_hash(key, src, len);
+  key = plan_hash(key, runtime->home, strlen(runtime->home) + 1);
+  if (runtime->full_version != NULL) {
+    key = plan_hash(key, runtime->full_version,
+                    strlen(runtime->full_version) + 1);
+  }
+  if (args->source_release != NULL) {
+    key = plan_hash(key, args->source_release,
+                    strlen(args->source_release) + 1);
+  }
+  for (int i = 0; i < args->vmopts_len; i++) {
+    if (strcmp(args->vmopts[i], "--enable-preview") == 0) {
+      key = plan_hash(key, "--enable-preview", 17);
+    }
+  }
+  for (int i = 0; i < args->classpathes_len; i++) {
+    key = plan_hash(key, args->classpathes[i],
+                    strlen(args->classpathes[i]) + 1);
+  }
+  for (int i = 0; i < args->module_pathes_len; i++) {
+    key = plan_hash(key, args->module_pathes[i],
+                    strlen(args->module_pathes[i]) + 1);
+  }
+  for (int i = 0; i < args->add_modules_len; i++) {
+    key = plan_hash(key, args->add_modules[i],
+                    strlen(args->add_modules[i]) + 1);
+  }
+  file = realpath(args->app_source, real) != NULL ? real : args->app_source;
+  path_key = plan_hash(path_key, file, strlen(file) + 1);
+
+  snprintf(name, sizeof(name), "%s%c%016llx-%016llx", SOURCE_DIR,
+           FILE_PATH_SEPRATOR, (unsigned long long)path_key,
+           (unsigned long long)key);
+  if (!cache_path(name, path, PATH_MAX, true)) {
+    free(src);
+    return source_stock(runtime, args);
+  }
+  if (!file_is_dir(path)) {
+    simple = strrchr(main_class, '.');
+    simple = simple == NULL ? main_class : simple + 1;
+    if (!source_compile(runtime, args, src, len, pub[0] ? pub : simple,
+                        path)) {
+      free(src);
+      return source_stock(runtime, args);
+    }
+    source_clean(path);
+  }
+  free(src);
+  TRACE("source %s: %s from %s", args->app_source, main_class, path);
+
+  // behind the class path, the in-memory classes of the stock launcher
+  // are found after it too
+  if (args->classpathes_len == 0) {
+    arg_list_add(args, &args->classpathes, &args->classpathes_len,
+                 arena_strdup(&args->arena, "."));
+  }
+  arg_list_add(args, &args->classpathes, &args->classpathes_len,
+               arena_strdup(&args->arena, path));
+  args->app_main_class = arena_strdup(&args->arena, main_class);
+  return true;
+}
+
+// the first top-level type of a source file, the class the source launcher
+// runs, and the public one, which names the file for javac. A method or a
+// field outside of any type makes an implicitly declared class, there is
+// none to run then.
+bool source_types(const char *src, size_t len, char *main_class, char *pub,
+                  size_t maxlen) {
+  char package[SOURCE_NAME_MAX] = {0};
+  bool type = false, public = false, header = false;
+  int depth = 0, words = 0;
+  size_t i = 0;
+
+  main_class[0] = '\0';
+  pub[0] = '\0';
+  if (len >= 2 && src[0] == '#' && src[1] == '!') {
+    while (i < len && src[i] != '\n') {
+      i++;
+    }
+  }
+
+  while (i < len) {
+    size_t next = source_skip(src, i, len), start = i;
+    char c = src[i];
+
+    if (next != i) {
+      i = next;
+      continue;
+    }
+    if (c == '@' && depth == 0) {
+      i = source_annotation(src, i, len);
+      continue;
+    }
+    if (c == '{') {
+      depth++;
+      header = false;
+      words = 0;
+    } else if (c == '}') {
+      depth--;
+      words = 0;
+    } else if (depth == 0 && !header && (c == '(' || (c == ';' && words > 0))) {
+      main_class[0] = '\0';
+      return false;
+    } else if (c == ';' && depth == 0) {
+      public = false;
+    }
+    if (!isalpha((unsigned char)c) && c != '_' && c != '$') {
+      i++;
+      continue;
+    }
+    while (i < len && (isalnum((unsigned char)src[i]) || src[i] == '_' ||
+                       src[i] == '$')) {
+      i++;
+    }
+    if (depth != 0) {
+      continue;
+    }
+    words++;
+
+    if (type) {
+      if (main_class[0] == '\0') {
+        snprintf(main_class, maxlen, "%s%s%.*s", package,
+                 package[0] ? "." : "", (int)(i - start), src + start);
+      }
+      if (public && pub[0] == '\0') {
+        snprintf(pub, maxlen, "%.*s", (int)(i - start), src + start);
+      }
+      type = public = false;
+    } else if (source_word(src, start, i, "class") ||
+               source_word(src, start, i, "interface") ||
+               source_word(src, start, i, "enum") ||
+               source_word(src, start, i, "record")) {
+      type = header = true;
+    } else if (source_word(src, start, i, "public")) {
+      public = true;
+    } else if (source_word(src, start, i, "package") &&
+               main_class[0] == '\0') {
+      size_t n = 0;
+      while (i < len && src[i] != ';' && n + 1 < sizeof(package)) {
+        if ((next = source_skip(src, i, len)) != i) {
+          i = next;
+        } else if (!isspace((unsigned char)src[i++])) {
+          package[n++] = src[i - 1];
+        }
+      }
+      package[n] = '\0';
+      words = 0;
+      i += i < len && src[i] == ';';
+    } else if (source_word(src, start, i, "import")) {
+      while (i < len && src[i] != ';') {
+        i++;
+      }
+      words = 0;
+      i += i < len;
+    }
+  }
+  return main_class[0] != '\0';
+}
+
+// past an annotation and its arguments at i, not past @interface
+size_t source_annotation(const char *src, size_t i, size_t len) {
+  size_t start = ++i, next;
+  int parens = 0;
+
+  while (i < len && (isalnum((unsigned char)src[i]) || src[i] == '_' ||
+                     src[i] == '$' || src[i] == '.')) {
+    i++;
+  }
+  if (source_word(src, start, i, "interface")) {
+    return start;
+  }
+  while (i < len && ((next = source_skip(src, i, len)) != i ||
+                     isspace((unsigned char)src[i]))) {
+    i = next != i ? next : i + 1;
+  }
+  while (i < len && (parens > 0 || src[i] == '(')) {
+    if ((next = source_skip(src, i, len)) != i) {
+      i = next;
+      continue;
+    }
+    parens += src[i] == '(' ? 1 : src[i] == ')' ? -1 : 0;
+    i++;
+  }
+  return i;
+}
+
+bool source_word(const char *src, size_t start, size_t end, const char *word) {
+  return end - start == strlen(word) &&
+         memcmp(src + start, word, end - start) == 0;
+}
+
+// past a comment or a literal at i, i when there is none
+size_t source_skip(const char *src, size_t i, size_t len) {
+  char c = src[i];
+
+  if (c == '/' && i + 1 < len && src[i + 1] == '/') {
+    while (i < len && src[i] != '\n') {
+      i++;
+    }
+    return i;
+  }
+  if (c == '/' && i + 1 < len && src[i + 1] == '*') {
+    for (i += 2; i + 1 < len && !(src[i] == '*' && src[i + 1] == '/'); i++) {
+    }
+    return i + 2 < len ? i + 2 : len;
+  }
+  if (c == '"' && i + 2 < len && src[i + 1] == '"' && src[i + 2] == '"') {
+    for (i += 3; i + 2 < len; i++) { // text block
+      if (src[i] == '\\') {
+        i++;
+      } else if (src[i] == '"' && src[i + 1] == '"' && src[i + 2] == '"') {
+        return i + 3;
+      }
+    }
+    return len;
+  }
+  if (c == '"' || c == '\'') {
+    for (i++; i < len && src[i] != c && src[i] != '\n'; i++) {
+      if (src[i] == '\\') {
+        i++;
+      }
+    }
+    return i < len ? i + 1 : len;
+  }
+  return i;
+}
+
+// javac into a directory next to the cache entry, renamed to it once
+// compiled. Its warnings are shown like the stock launcher shows them, on
+// errors the stock launcher runs and reports them.
+bool source_compile(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                    const char *src, size_t len, const char *name,
+                    const char *path) {
+  char javac[PATH_MAX], work[PATH_MAX + 8], classes[PATH_MAX + 16];
+  char log[PATH_MAX + 24], file[PATH_MAX + SOURCE_NAME_MAX + 16];
+  const char *base = strrchr(args->app_source, FILE_PATH_SEPRATOR);
+  char *argv[24], *cp = NULL, *mp = NULL, *mods = NULL, *output;
+  size_t argc = 0, name_len = strlen(name), skip = 0, out_len;
+  bool ok = false;
+  int status, fd;
+  pid_t pid;
+
+  snprintf(javac, PATH_MAX, "%s%cbin%cjavac", runtime->home,
+           FILE_PATH_SEPRATOR, FILE_PATH_SEPRATOR);
+  if (access(javac, X_OK) != 0) {
+    TRACE("source: no javac in %s", runtime->home);
+    return false;
+  }
+  snprintf(work, sizeof(work), "%s.XXXXXX", path);
+  if (mkdtemp(work) == NULL) {
+    return false;
+  }
+  snprintf(classes, sizeof(classes), "%s%cclasses", work, FILE_PATH_SEPRATOR);
+  snprintf(log, sizeof(log), "%s%cjavac.log", work, FILE_PATH_SEPRATOR);
+  mkdir(classes, 0755);
+
+  // javac takes X.java with public class X, a script is copied with its #!
+  // line blanked, the line numbers of diagnostics stay
+  base = base == NULL ? args->app_source : base + 1;
+  if (src[0] != '#' && strncmp(base, name, name_len) == 0 &&
+      strcmp(base + name_len, ".java") == 0) {
+    snprintf(file, sizeof(file), "%s", args->app_source);
+  } else {
+    snprintf(file, sizeof(file), "%s%c%s.java", work, FILE_PATH_SEPRATOR,
+             name);
+    if (len >= 2 && src[0] == '#' && src[1] == '!') {
+      while (skip < len && src[skip] != '\n') {
+        skip++;
+      }
+    }
+    if ((fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) <
+            0 ||
+        !file_write_all(fd, src + skip, len - skip)) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      file_remove_tree(work);
+      return false;
+    }
+    close(fd);
+  }
+
+  // the options of the stock launcher
+  argv[argc++] = javac;
+  argv[argc++] = "-d";
+  argv[argc++] = classes;
+  argv[argc++] = "-proc:none";
+  argv[argc++] = "-Xdiags:verbose";
+  argv[argc++] = "-Xlint:deprecation";
+  argv[argc++] = "-Xlint:unchecked";
+  argv[argc++] = "-Xlint:-options";
+  if ((cp = source_join(args->classpathes, args->classpathes_len, ':')) !=
+      NULL) {
+    argv[argc++] = "-cp";
+    argv[argc++] = cp;
+  }
+  if ((mp = source_join(args->module_pathes, args->module_pathes_len, ':')) !=
+      NULL) {
+    argv[argc++] = "--module-path";
+    argv[argc++] = mp;
+  }
+  if ((mods = source_join(args->add_modules, args->add_modules_len, ',')) !=
+      NULL) {
+    argv[argc++] = "--add-modules";
+    argv[argc++] = mods;
+  }
+  if (args->source_release != NULL) {
+    argv[argc++] = "--release";
+    argv[argc++] = args->source_release;
+  }
+  for (int i = 0; i < args->vmopts_len; i++) {
+    if (strcmp(args->vmopts[i], "--enable-preview") == 0) {
+      argv[argc++] = "--enable-preview";
+      break;
+    }
+  }
+  argv[argc++] = file;
+  argv[argc] = NULL;
+
+  TRACE("source: compile %s", file);
+  fflush(NULL);
+  if ((pid = fork()) == 0) {
+    int out = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(out, STDOUT_FILENO);
+    dup2(out, STDERR_FILENO);
+    execv(argv[0], argv);
+    _exit(127);
+  }
+  ok = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+       WEXITSTATUS(status) == 0;
+
+  if (ok && (output = file_read_all(log, SOURCE_MAX, &out_len)) != NULL) {
+    fwrite(output, 1, out_len, stderr);
+    free(output);
+  }
+  // a concurrent launch may have compiled it first
+  ok = ok && (rename(classes, path) == 0 || file_is_dir(path));
+  file_remove_tree(work);
+  SAFE_FREE(cp);
+  SAFE_FREE(mp);
+  SAFE_FREE(mods);
+  return ok;
+}
+
+char *source_join(char **values, int len, char sep) {
+  size_t size = 0, pos = 0;
+  char *joined;
+
+  if (len == 0) {
+    return NULL;
+  }
+  for (int i = 0; i < len; i++) {
+    size += strlen(values[i]) + 1;
+  }
+  joined = malloc(size);
+  for (int i = 0; i < len; i++) {
+    size_t n = strlen(values[i]);
+    memcpy(joined + pos, values[i], n);
+    pos += n;
+    joined[pos++] = sep;
+  }
+  joined[pos - 1] = '\0';
+  return joined;
+}
+
+// the classes of earlier contents of the same file, path is
+// source/<path>-<content>
+void source_clean(const char *path) {
+  char dir_path[PATH_MAX], child[PATH_MAX];
+  const char *name = strrchr(path, FILE_PATH_SEPRATOR) + 1;
+  size_t prefix = strchr(name, '-') - name + 1;
+  struct dirent *entry;
+  DIR *dir;
+
+  snprintf(dir_path, PATH_MAX, "%.*s", (int)(name - path - 1), path);
+  if ((dir = opendir(dir_path)) == NULL) {
+    return;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    // work directories of other launches have a suffix
+    if (strncmp(entry->d_name, name, prefix) == 0 &&
+        strcmp(entry->d_name, name) != 0 &&
+        strchr(entry->d_name, '.') == NULL) {
+      if (snprintf(child, PATH_MAX, "%s%c%s", dir_path, FILE_PATH_SEPRATOR,
+                   entry->d_name) >= PATH_MAX) {
+        continue;
+      }
+      TRACE("source: drop %s", child);
+      file_remove_tree(child);
+    }
+  }
+  closedir(dir);
+}
+
+// java's own source launcher, compiling in memory on every launch
+bool source_stock(struct yj_java_runtime *runtime, struct yj_run_args *args) {
+  char **app_args;
+
+  if (runtime->major_version < 11) {
+    fprintf(stderr, "error: %s needs javac, or java 11 or later\n",
+            args->app_source);
+    return false;
+  }
+  arg_list_add(args, &args->vmopts, &args->vmopts_len,
+               arena_strdup(&args->arena, "--add-modules=ALL-DEFAULT"));
+  if (args->source_release != NULL) {
+    size_t len = strlen(args->source_release) + 30;
+    char *prop = arena_alloc(&args->arena, len);
+    snprintf(prop, len, "-Djdk.internal.javac.source=%s",
+             args->source_release);
+    arg_list_add(args, &args->sys_props, &args->sys_props_len, prop);
+  }
+
+  // the source file is the first argument of the launcher class
+  app_args = arena_alloc(&args->arena,
+                         (args->app_args_len + 1) * sizeof(char *));
+  app_args[0] = args->app_source;
+  for (int i = 0; i < args->app_args_len; i++) {
+    app_args[i + 1] = args->app_args[i];
+  }
+  args->app_args = app_args;
+  args->app_args_len++;
+  args->app_main_class = arena_strdup(
+      &args->arena,
+      runtime->major_version >= 22 ? SOURCE_LAUNCHER_22 : SOURCE_LAUNCHER);
+  TRACE("source: %s through %s", args->app_source, args->app_main_class);
+  return true;
+}
+
+// MODULES
+// --list-modules, --describe-module and --validate-modules of the system
+// modules are answered from lib/modules of the runtime, without a vm: the
+// module-info.class of each module is read from the jimage and decoded
+// here. Upgrade module paths, module paths and --limit-modules change what
+// the vm sees, those go to LauncherHelper as with the stock launcher.
+bool modules_answer(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                    int *exit_code) {
+  struct modules_image image;
+  bool ok = true;
+
+  if (!args->list_modules && !args->describe_module &&
+      !args->validate_modules) {
+    return false;
+  }
+  if (args->module_pathes_len > 0 || args->upgrade_module_pathes_len > 0) {
+    return false;
+  }
+  for (int i = 0; i < args->vmopts_len; i++) {
+    if (strncmp(args->vmopts[i], "--limit-modules", 15) == 0) {
+      return false;
+    }
+  }
+  if (!modules_load(runtime, &image)) {
+    return false;
+  }
+
+  if (args->list_modules) {
+    modules_list(&image);
+  } else if (args->describe_module) {
+    struct module_info key = {0}, *mi;
+
+    snprintf(key.name, sizeof(key.name), "%s",
+             args->module_name == NULL ? "" : args->module_name);
+    mi = bsearch(&key, image.mods, image.len, sizeof(struct module_info),
+                 module_info_cmp);
+    if (mi == NULL) {
+      fprintf(stderr, "error: module %s not found\n", key.name);
+      ok = false;
+    } else {
+      ok = modules_describe(mi);
+    }
+  } else {
+    ok = modules_validate(&image);
+  }
+
+  modules_free(&image);
+  fflush(stdout);
+  *exit_code = ok ? 0 : 1;
+  return true;
+}
+
+// every module of the image, false if one does not decode
+bool modules_load(struct yj_java_runtime *runtime, struct modules_image *mi) {
+  char path[PATH_MAX];
+  struct jimage_location loc;
+  uint32_t index = 0;
+  size_t cap = 0;
+  TRACE_ONLY(long start = time_now_us();)
+
+  memset(mi, 0, sizeof(struct modules_image));
+  if (runtime->home == NULL ||
+      (runtime->major_version > 0 && runtime->major_version < 9)) {
+    return false;
+  }
+  snprintf(path, sizeof(path), "%s%clib%cmodules", runtime->home,
+           FILE_PATH_SEPRATOR, FILE_PATH_SEPRATOR);
+  if (!jimage_open(&mi->img, path)) {
+    return false;
+  }
+
+  while (jimage_next(&mi->img, &index, &loc)) {
+    unsigned char *buf;
+    size_t len;
+
+    if (loc.module[0] == '\0' || loc.parent[0] != '\0' ||
+        strcmp(loc.base, "module-info") != 0 ||
+        strcmp(loc.extension, "class") != 0) {
+      continue;
+    }
+    if (mi->len == cap) {
+      struct module_info *mods;
+      cap = cap == 0 ? 128 : cap * 2;
+      mods = realloc(mi->mods, cap * sizeof(struct module_info));
+      if (mods == NULL) {
+        modules_free(mi);
+        return false;
+      }
+      mi->mods = mods;
+    }
+    if ((buf = jimage_read(&mi->img, &loc, &len)) == NULL ||
+        !module_info_parse(buf, len, &mi->mods[mi->len])) {
+      TRACE("module-info of %s can not be read", loc.module);
+      free(buf);
+      modules_free(mi);
+      return false;
+    }
+    if (strcmp(mi->mods[mi->len].name, loc.module) != 0) {
+      TRACE("module-info of %s names %s", loc.module, mi->mods[mi->len].name);
+    }
+    mi->len++;
+  }
+  if (mi->len == 0) {
+    modules_free(mi);
+    return false;
+  }
+
+  qsort(mi->mods, mi->len, sizeof(struct module_info), module_info_cmp);
+  TRACE("%zu modules read from %s in %ld us", mi->len, path,
+        time_now_us() - start);
+  return true;
+}
+
+void modules_free(struct modules_image *mi) {
+  for (size_t i = 0; i < mi->len; i++) {
+    module_info_free(&mi->mods[i]);
+  }
+  SAFE_FREE(mi->mods);
+  jimage_close(&mi->img);
+  mi->len = 0;
+}
+
+int module_info_cmp(const void *a, const void *b) {
+  return strcmp(((const struct module_info *)a)->name,
+                ((const struct module_info *)b)->name);
+}
+
+int module_package_cmp(const void *a, const void *b) {
+  return strcmp(((const struct module_package *)a)->name,
+                ((const struct module_package *)b)->name);
+}
+
+// name@version, by name as LauncherHelper sorts the system modules
+void modules_list(struct modules_image *mi) {
+  for (size_t i = 0; i < mi->len; i++) {
+    struct module_info *m = &mi->mods[i];
+
+    printf("%s%s%s%s\n", m->name, m->version[0] != '\0' ? "@" : "",
+           m->version, (m->flags & MODULE_ACC_OPEN) ? " open" : "");
+  }
+}
+
+// the modifiers of a directive, " static transitive" ..., sorted by name
+// as LauncherHelper prints them
+void modules_flags_str(uint16_t flags, bool requires, char *out,
+                       size_t maxlen) {
+  snprintf(out, maxlen, "%s%s%s%s",
+           (flags & MODULE_ACC_MANDATED) ? " mandated" : "",
+           requires && (flags & MODULE_ACC_STATIC_PHASE) ? " static" : "",
+           (flags & MODULE_ACC_SYNTHETIC) ? " synthetic" : "",
+           requires && (flags & MODULE_ACC_TRANSITIVE) ? " transitive" : "");
+}
+
+// the directives in the order of LauncherHelper.describeModule: exports to
+// all sorted, requires, uses, provides, qualified exports, opens, then the
+// packages neither exported nor opened
+bool modules_describe(struct module_info *mi) {
+  struct module_reader r = {mi->attr, mi->attr + mi->attr_len, false};
+  struct module_reader requires, exports, opens, uses, provides, pos;
+  uint16_t requires_len, exports_len, opens_len, uses_len, provides_len;
+  uint16_t packages_len = 0;
+  char name[MODULES_NAME_MAX], mods[64];
+  char **exported, **lines, **packages = NULL;
+  size_t lines_len = 0;
+  bool ok = false;
+
+  // module name, flags and version, decoded already
+  module_skip(&r, 6);
+  requires_len = module_u2(&r);
+  requires = r;
+  module_skip(&r, (size_t)requires_len * 6);
+  exports_len = module_u2(&r);
+  exports = r;
+  for (int i = 0; i < exports_len; i++) {
+    module_skip(&r, 4);
+    module_skip(&r, (size_t)module_u2(&r) * 2);
+  }
+  opens_len = module_u2(&r);
+  opens = r;
+  for (int i = 0; i < opens_len; i++) {
+    module_skip(&r, 4);
+    module_skip(&r, (size_t)module_u2(&r) * 2);
+  }
+  uses_len = module_u2(&r);
+  uses = r;
+  module_skip(&r, (size_t)uses_len * 2);
+  provides_len = module_u2(&r);
+  provides = r;
+  if (r.err) {
+    fprintf(stderr, "error: module-info of %s is malformed\n", mi->name);
+    return false;
+  }
+
+  printf("%s%s%s%s\n", mi->name, mi->version[0] != '\0' ? "@" : "",
+         mi->version, (mi->flags & MODULE_ACC_OPEN) ? " open" : "");
+
+  // the packages exported or opened, and the exports to all
+  exported = calloc(exports_len + opens_len + 1, sizeof(char *));
+  lines = calloc(exports_len + 1, sizeof(char *));
+  if (exported == NULL || lines == NULL) {
+    goto err;
+  }
+  pos = exports;
+  for (int i = 0; i < exports_len + opens_len; i++) {
+    uint16_t package, flags, to_len;
+
+    pos = i == exports_len ? opens : pos;
+    package = module_u2(&pos);
+    flags = module_u2(&pos);
+    to_len = module_u2(&pos);
+    module_skip(&pos, (size_t)to_len * 2);
+    module_info_str(mi, package, name, sizeof(name));
+    if ((exported[i] = strdup(name)) == NULL) {
+      goto err;
+    }
+    if (i < exports_len && to_len == 0) {
+      modules_flags_str(flags, false, mods, sizeof(mods));
+      lines[lines_len] = malloc(strlen(name) + strlen(mods) + 1);
+      if (lines[lines_len] == NULL) {
+        goto err;
+      }
+      sprintf(lines[lines_len++], "%s%s", name, mods);
+    }
+  }
+  qsort(lines, lines_len, sizeof(char *), wildcard_cmp);
+  for (size_t i = 0; i < lines_len; i++) {
+    printf("exports %s\n", lines[i]);
+  }
+
+  for (int i = 0; i < requires_len; i++) {
+    uint16_t module = module_u2(&requires), flags = module_u2(&requires);
+
+    module_skip(&requires, 2);
+    module_info_str(mi, module, name, sizeof(name));
+    modules_flags_str(flags, true, mods, sizeof(mods));
+    printf("requires %s%s\n", name, mods);
+  }
+
+  for (int i = 0; i < uses_len; i++) {
+    module_info_str(mi, module_u2(&uses), name, sizeof(name));
+    printf("uses %s\n", name);
+  }
+
+  for (int i = 0; i < provides_len; i++) {
+    uint16_t service = module_u2(&provides), with_len = module_u2(&provides);
+    char **with = module_info_names(mi, &provides, with_len);
+
+    if (with == NULL) {
+      goto err;
+    }
+    module_info_str(mi, service, name, sizeof(name));
+    printf("provides %s with", name);
+    for (int j = 0; j < with_len; j++) {
+      printf(" %s", with[j]);
+    }
+    printf("\n");
+    modules_free_names(with, with_len);
+  }
+
+  // qualified exports, then opens
+  pos = exports;
+  for (int i = 0; i < exports_len + opens_len; i++) {
+    uint16_t flags, to_len;
+    char **to;
+
+    pos = i == exports_len ? opens : pos;
+    module_skip(&pos, 2);
+    flags = module_u2(&pos);
+    to_len = module_u2(&pos);
+    if ((to = module_info_names(mi, &pos, to_len)) == NULL) {
+      goto err;
+    }
+    if (i >= exports_len) {
+      modules_flags_str(flags, false, mods, sizeof(mods));
+      printf("%sopens %s%s%s", to_len > 0 ? "qualified " : "", exported[i],
+             mods, to_len > 0 ? " to" : "");
+    } else if (to_len > 0) {
+      printf("qualified exports %s to", exported[i]);
+    }
+    for (int j = 0; j < to_len; j++) {
+      printf(" %s", to[j]);
+    }
+    if (i >= exports_len || to_len > 0) {
+      printf("\n");
+    }
+    modules_free_names(to, to_len);
+  }
+
+  qsort(exported, exports_len + opens_len, sizeof(char *), wildcard_cmp);
+  if (mi->packages != NULL) {
+    pos.p = mi->packages;
+    pos.end = mi->packages + mi->packages_len;
+    pos.err = false;
+    packages_len = module_u2(&pos);
+    if ((packages = module_info_names(mi, &pos, packages_len)) == NULL) {
+      goto err;
+    }
+    qsort(packages, packages_len, sizeof(char *), wildcard_cmp);
+  }
+  for (int i = 0; i < packages_len; i++) {
+    if (bsearch(&packages[i], exported, exports_len + opens_len,
+                sizeof(char *), wildcard_cmp) == NULL) {
+      printf("contains %s\n", packages[i]);
+    }
+  }
+  ok = true;
+
+err:
+  if (!ok) {
+    fprintf(stderr, "error: out of memory describing %s\n", mi->name);
+  }
+  modules_free_names(packages, packages_len);
+  modules_free_names(exported, exports_len + opens_len);
+  modules_free_names(lines, lines_len);
+  return ok;
+}
+
+// the checks of the boot layer: a package in one module only, required
+// modules present. Nothing is printed for a consistent image.
+bool modules_validate(struct modules_image *mi) {
+  struct module_package *packages = NULL;
+  size_t len = 0, cap = 0;
+  char name[MODULES_NAME_MAX];
+  bool ok = true, oom = false;
+
+  for (size_t i = 0; i < mi->len; i++) {
+    struct module_info *m = &mi->mods[i];
+    struct module_reader r = {m->attr, m->attr + m->attr_len, false};
+    struct module_reader pos = {m->packages, m->packages + m->packages_len,
+                                false};
+    uint16_t requires_len, packages_len;
+
+    module_skip(&r, 6);
+    requires_len = module_u2(&r);
+    for (int j = 0; j < requires_len && !r.err; j++) {
+      struct module_info key = {0};
+      uint16_t module = module_u2(&r), flags = module_u2(&r);
+
+      module_skip(&r, 2);
+      if (!module_info_str(m, module, key.name, sizeof(key.name))) {
+        r.err = true;
+      } else if (!(flags & MODULE_ACC_STATIC_PHASE) &&
+                 bsearch(&key, mi->mods, mi->len, sizeof(struct module_info),
+                         module_info_cmp) == NULL) {
+        printf("module %s requires %s, which is not found\n", m->name,
+               key.name);
+        ok = false;
+      }
+    }
+    if (r.err) {
+      printf("module %s: malformed module-info.class\n", m->name);
+      ok = false;
+    }
+
+    packages_len = m->packages == NULL ? 0 : module_u2(&pos);
+    for (int j = 0; j < packages_len && !pos.err; j++) {
+      if (!module_info_str(m, module_u2(&pos), name, sizeof(name))) {
+        break;
+      }
+      if (len == cap) {
+        size_t grown_cap = cap == 0 ? 1024 : cap * 2;
+        struct module_package *grown =
+            realloc(packages, grown_cap * sizeof(struct module_package));
+        if (grown == NULL) {
+          oom = true;
+          goto err;
+        }
+        packages = grown;
+        cap = grown_cap;
+      }
+      if ((packages[len].name = strdup(name)) == NULL) {
+        oom = true;
+        goto err;
+      }
+      packages[len].module = m->name;
+      len++;
+    }
+  }
+
+  qsort(packages, len, sizeof(struct module_package), module_package_cmp);
+  for (size_t i = 1; i < len; i++) {
+    if (strcmp(packages[i - 1].name, packages[i].name) == 0) {
+      printf("package %s is in both module %s and module %s\n",
+             packages[i].name, packages[i - 1].module, packages[i].module);
+      ok = false;
+    }
+  }
+
+err:
+  if (oom) {
+    fprintf(stderr, "error: out of memory validating modules\n");
+    ok = false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    free(packages[i].name);
+  }
+  free(packages);
+  return ok;
+}
+
+uint16_t module_u2(struct module_reader *r) {
+  uint16_t v;
+
+  if (r->err || r->end - r->p < 2) {
+    r->err = true;
+    return 0;
+  }
+  v = r->p[0] << 8 | r->p[1];
+  r->p += 2;
+  return v;
+}
+
+uint32_t module_u4(struct module_reader *r) {
+  uint32_t hi = module_u2(r);
+  return hi << 16 | module_u2(r);
+}
+
+void module_skip(struct module_reader *r, size_t n) {
+  if (r->err || (size_t)(r->end - r->p) < n) {
+    r->err = true;
+    return;
+  }
+  r->p += n;
+}
+
+// the constant pool, then the Module and ModulePackages attributes of the
+// class. The fields, methods and other attributes are skipped.
+bool module_info_parse(unsigned char *buf, size_t len, struct module_info *mi) {
+  struct module_reader r = {buf, buf + len, false};
+  uint16_t count;
+  char attr[32];
+
+  memset(mi, 0, sizeof(struct module_info));
+  mi->buf = buf;
+  mi->len = len;
+  if (module_u4(&r) != 0xcafebabe) {
+    return false;
+  }
+  module_skip(&r, 4);
+
+  mi->pool_len = module_u2(&r);
+  mi->pool = calloc(mi->pool_len + 1, sizeof(uint32_t));
+  for (int i = 1; i < mi->pool_len && !r.err; i++) {
+    mi->pool[i] = r.p - buf;
+    switch (r.p < r.end ? *r.p++ : 0) {
+    case MODULE_CP_UTF8:
+      module_skip(&r, module_u2(&r));
+      break;
+    case MODULE_CP_CLASS:
+    case 8: // String
+    case 16: // MethodType
+    case MODULE_CP_MODULE:
+    case MODULE_CP_PACKAGE:
+      module_skip(&r, 2);
+      break;
+    case 15: // MethodHandle
+      module_skip(&r, 3);
+      break;
+    case 3: // Integer, Float, the refs, NameAndType, (Invoke)Dynamic
+    case 4:
+    case 9:
+    case 10:
+    case 11:
+    case 12:
+    case 17:
+    case 18:
+      module_skip(&r, 4);
+      break;
+    case 5: // Long and Double take two entries
+    case 6:
+      module_skip(&r, 8);
+      i++;
+      break;
+    default:
+      r.err = true;
+    }
+  }
+
+  // access flags, this and super class, no interfaces
+  if (!(module_u2(&r) & MODULE_ACC_MODULE)) {
+    module_info_free(mi);
+    return false;
+  }
+  module_skip(&r, 4);
+  module_skip(&r, (size_t)module_u2(&r) * 2);
+  for (int k = 0; k < 2; k++) { // fields and methods
+    count = module_u2(&r);
+    for (int i = 0; i < count && !r.err; i++) {
+      module_skip(&r, 6);
+      for (int j = module_u2(&r); j > 0 && !r.err; j--) {
+        module_skip(&r, 2);
+        module_skip(&r, module_u4(&r));
+      }
+    }
+  }
+
+  count = module_u2(&r);
+  for (int i = 0; i < count && !r.err; i++) {
+    uint16_t name = module_u2(&r);
+    uint32_t attr_len = module_u4(&r);
+    const unsigned char *start = r.p;
+
+    module_skip(&r, attr_len);
+    if (r.err || !module_info_str(mi, name, attr, sizeof(attr))) {
+      continue;
+    }
+    if (strcmp(attr, "Module") == 0) {
+      mi->attr = start;
+      mi->attr_len = attr_len;
+    } else if (strcmp(attr, "ModulePackages") == 0) {
+      mi->packages = start;
+      mi->packages_len = attr_len;
+    }
+  }
+
+  // module name, flags and version
+  if (!r.err && mi->attr != NULL) {
+    struct module_reader m = {mi->attr, mi->attr + mi->attr_len, false};
+    uint16_t name = module_u2(&m), version;
+
+    mi->flags = module_u2(&m);
+    version = module_u2(&m);
+    if (!m.err && module_info_str(mi, name, mi->name, sizeof(mi->name))) {
+      if (version != 0) {
+        module_info_str(mi, version, mi->version, sizeof(mi->version));
+      }
+      return true;
+    }
+  }
+  module_info_free(mi);
+  return false;
+}
+
+// a Utf8 constant, or the name of a Module, Package or Class constant. The
+// internal names of packages and classes are returned with dots.
+bool module_info_str(struct module_info *mi, uint16_t index, char *out,
+                     size_t maxlen) {
+  const unsigned char *p;
+  bool internal = false;
+  size_t len;
+
+  out[0] = '\0';
+  if (index == 0 || index >= mi->pool_len) {
+    return false;
+  }
+  p = mi->buf + mi->pool[index];
+  if (p[0] == MODULE_CP_CLASS || p[0] == MODULE_CP_MODULE ||
+      p[0] == MODULE_CP_PACKAGE) {
+    internal = p[0] != MODULE_CP_MODULE;
+    index = p[1] << 8 | p[2];
+    if (index == 0 || index >= mi->pool_len) {
+      return false;
+    }
+    p = mi->buf + mi->pool[index];
+  }
+  if (p[0] != MODULE_CP_UTF8) {
+    return false;
+  }
+
+  len = p[1] << 8 | p[2];
+  len = len < maxlen ? len : maxlen - 1;
+  memcpy(out, p + 3, len);
+  out[len] = '\0';
+  for (size_t i = 0; internal && i < len; i++) {
+    out[i] = out[i] == '/' ? '.' : out[i];
+  }
+  return true;
+}
+
+// u2 constant indexes, the strings they name
+char **module_info_names(struct module_info *mi, struct module_reader *r,
+                         uint16_t len) {
+  char **names = calloc(len + 1, sizeof(char *));
+  char name[MODULES_NAME_MAX];
+
+  for (int i = 0; names != NULL && i < len; i++) {
+    module_info_str(mi, module_u2(r), name, sizeof(name));
+    if ((names[i] = strdup(name)) == NULL) {
+      modules_free_names(names, i);
+      return NULL;
+    }
+  }
+  return names;
+}
+
+void modules_free_names(char **names, size_t len) {
+  for (size_t i = 0; names != NULL && i < len; i++) {
+    free(names[i]);
+  }
+  free(names);
+}
+
+void module_info_free(struct module_info *mi) {
+  SAFE_FREE(mi->buf);
+  SAFE_FREE(mi->pool);
+  mi->attr = NULL;
+  mi->packages = NULL;
+}
+
+// ARGFILE
+// @argfiles and JDK_JAVA_OPTIONS, by the rules of the stock launcher. An
+// argfile is mapped privately and tokenized in place, the arguments point
+// into the mapping: unquoting only shrinks a token, its nul goes where the
+// delimiter was. The mapping has one zero byte past the end of the file for
+// the nul of the last token.
+
+// options followed by a value, the value is never a main class or argfile
+static const char *argfile_value_opts[] = {
+    "-cp",          "-classpath",    "--class-path",
+    "--classpath",  "-p",            "--module-path",
+    "--upgrade-module-path",         "--add-modules",
+    "--enable-native-access",        "--limit-modules",
+    "--add-exports", "--add-opens",  "--add-reads",
+    "--patch-module", "--describe-module", "-d",
+    "--source"};
+
+// options which end the launcher options, not allowed in JDK_JAVA_OPTIONS
+static const char *argfile_terminal_opts[] = {
+    "-jar",         "-m",      "--module",   "--dry-run", "-h",
+    "-?",           "-help",   "--help",     "-X",        "--help-extra",
+    "-version",     "--version", "-fullversion", "--full-version"};
+
+bool argfile_is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+bool argfile_add(struct yj_cmdline *cmd, char *arg) {
+  if (cmd->argc + 1 >= cmd->maxlen) {
+    int maxlen = cmd->maxlen == 0 ? 64 : cmd->maxlen * 2;
+    char **argv = realloc(cmd->argv, maxlen * sizeof(char *));
+    if (argv == NULL) {
+      return false;
+    }
+    cmd->argv = argv;
+    cmd->maxlen = maxlen;
+  }
+  cmd->argv[cmd->argc++] = arg;
+  cmd->argv[cmd->argc] = NULL;
+  return true;
+}
+
+// follows the launcher options up to the main class, -jar or the module;
+// arguments of the application are not expanded
+void argfile_check(struct argfile_state *st, const char *arg) {
+  if (st->main) {
+    return;
+  }
+  if (st->value) {
+    st->value = false;
+    st->main = st->terminal;
+    return;
+  }
+  if (arg[0] != '-') {
+    st->main = true;
+  } else if (arg_match((char *)arg, "-jar", "-m")) {
+    st->value = st->terminal = true;
+  } else if (arg_match_start((char *)arg, "--module")) {
+    st->value = st->terminal = strcmp(arg, "--module") == 0;
+    st->main = !st->value && arg[8] == '=';
+  } else {
+    for (int i = 0; i < sizeof(argfile_value_opts) / sizeof(char *); i++) {
+      if (strcmp(arg, argfile_value_opts[i]) == 0) {
+        st->value = true;
+        break;
+      }
+    }
+  }
+}
+
+// the next argument of an argfile, NULL at the end. Whitespace separates
+// arguments, `#` at the start of one comments out the rest of the line.
+// Quotes group, within them `\` escapes, and ends a line to continue it on
+// the next one, without its leading whitespace.
+char *argfile_next(char **pos, char *end) {
+  char *r = *pos, *w, *token;
+  char quote = 0;
+
+  while (r < end && (argfile_is_space(*r) || *r == '#')) {
+    if (*r == '#') {
+      while (r < end && *r != '\n' && *r != '\r') {
+        r++;
+      }
+    } else {
+      r++;
+    }
+  }
+  if (r >= end) {
+    *pos = end;
+    return NULL;
+  }
+
+  token = w = r;
+  while (r < end) {
+    if (quote == 0) {
+      if (argfile_is_space(*r)) {
+        break;
+      } else if (*r == '"' || *r == '\'') {
+        quote = *r++;
+      } else {
+        *w++ = *r++;
+      }
+    } else if (*r == quote) {
+      quote = 0;
+      r++;
+    } else if (*r == '\n' || *r == '\r') {
+      break; // an open quote ends with the line
+    } else if (*r == '\\' && r + 1 < end) {
+      switch (*++r) {
+      case 'n':
+        *w++ = '\n';
+        r++;
+        break;
+      case 'r':
+        *w++ = '\r';
+        r++;
+        break;
+      case 't':
+        *w++ = '\t';
+        r++;
+        break;
+      case 'f':
+        *w++ = '\f';
+        r++;
+        break;
+      case '\r':
+      case '\n':
+        r += r[0] == '\r' && r + 1 < end && r[1] == '\n' ? 2 : 1;
+        while (r < end && (*r == ' ' || *r == '\t' || *r == '\f')) {
+          r++;
+        }
+        break;
+      default:
+        *w++ = *r++;
+        break;
+      }
+    } else {
+      *w++ = *r++;
+    }
+  }
+
+  *pos = r < end ? r + 1 : end;
+  *w = '\0';
+  return token;
+}
+
+// the arguments of path, added to cmd
+yj_result argfile_expand(const char *path, struct yj_cmdline *cmd,
+                         struct argfile_state *st) {
+  struct yj_argfile *file;
+  struct stat st_file;
+  char *map, *pos, *arg;
+  size_t len;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 ||
+      fstat(fd, &st_file) != 0 || !S_ISREG(st_file.st_mode)) {
+    fprintf(stderr, "Error: could not open `%s'\n", path);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return YJ_ERR_NO_FILE;
+  }
+  len = st_file.st_size;
+
+  // zeroed memory one byte longer than the file, the file mapped over it
+  map = mmap(NULL, len + 1, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map != MAP_FAILED && len > 0 &&
+      mmap(map, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+           0) == MAP_FAILED) {
+    munmap(map, len + 1);
+    map = MAP_FAILED;
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Error: could not open `%s'\n", path);
+    return YJ_ERR_NO_FILE;
+  }
+
+  if ((file = calloc(1, sizeof(struct yj_argfile))) == NULL) {
+    munmap(map, len + 1);
+    fprintf(stderr, "Error: could not open `%s'\n", path);
+    return YJ_ERR_NO_FILE;
+  }
+  file->buf = map;
+  file->len = len + 1;
+  file->mapped = true;
+  file->next = cmd->files;
+  cmd->files = file;
+
+  TRACE("argfile %s: %zu bytes", path, len);
+  pos = map;
+  while ((arg = argfile_next(&pos, map + len)) != NULL) {
+    argfile_check(st, arg);
+    if (!argfile_add(cmd, arg)) {
+      return YJ_ERR_NULL;
+    }
+  }
+  return YJ_OK;
+}
+
+// the next argument of JDK_JAVA_OPTIONS, quotes group, no escapes
+char *argfile_env_next(char **pos, bool *unmatched) {
+  char *r = *pos, *w, *token;
+
+  while (*r != '\0' && argfile_is_space(*r)) {
+    r++;
+  }
+  if (*r == '\0') {
+    *pos = r;
+    return NULL;
+  }
+
+  token = w = r;
+  while (*r != '\0' && !argfile_is_space(*r)) {
+    if (*r == '"' || *r == '\'') {
+      char quote = *r++;
+      while (*r != '\0' && *r != quote) {
+        *w++ = *r++;
+      }
+      if (*r == '\0') {
+        *unmatched = true;
+        return NULL;
+      }
+      r++;
+    } else {
+      *w++ = *r++;
+    }
+  }
+
+  *pos = *r == '\0' ? r : r + 1;
+  *w = '\0';
+  return token;
+}
+
+// JDK_JAVA_OPTIONS ahead of the command line, launcher options only
+yj_result argfile_env(struct yj_cmdline *cmd, struct argfile_state *st) {
+  struct yj_argfile *file;
+  bool unmatched = false;
+  char *env, *pos, *arg;
+  int first;
+  yj_result res;
+
+  if ((env = getenv("JDK_JAVA_OPTIONS")) == NULL || *env == '\0') {
+    return YJ_OK;
+  }
+  fprintf(stderr, "NOTE: Picked up JDK_JAVA_OPTIONS: %s\n", env);
+
+  if ((file = calloc(1, sizeof(struct yj_argfile))) == NULL ||
+      (file->buf = pos = strdup(env)) == NULL) {
+    free(file);
+    fprintf(stderr, "Error: could not read JDK_JAVA_OPTIONS\n");
+    return YJ_ERR_NULL;
+  }
+  file->next = cmd->files;
+  cmd->files = file;
+
+  while ((arg = argfile_env_next(&pos, &unmatched)) != NULL) {
+    first = cmd->argc;
+    if (arg[0] == '@' && arg[1] != '@') {
+      if ((res = argfile_expand(arg + 1, cmd, st)) != YJ_OK) {
+        return res;
+      }
+    } else {
+      arg += arg[0] == '@';
+      argfile_check(st, arg);
+      if (!argfile_add(cmd, arg)) {
+        return YJ_ERR_NULL;
+      }
+    }
+
+    for (int i = first; i < cmd->argc; i++) {
+      for (int j = 0; j < sizeof(argfile_terminal_opts) / sizeof(char *);
+           j++) {
+        if (arg_match(cmd->argv[i], (char *)argfile_terminal_opts[j])) {
+          fprintf(stderr, "Error: Option %s in JDK_JAVA_OPTIONS is not "
+                          "allowed in this context\n",
+                  cmd->argv[i]);
+          return YJ_ERR_ARGS;
+        }
+      }
+    }
+    if (st->main) {
+      fprintf(stderr, "Error: Cannot specify main class in environment "
+                      "variable JDK_JAVA_OPTIONS\n");
+      return YJ_ERR_ARGS;
+    }
+  }
+  if (unmatched) {
+    fprintf(stderr, "Error: Unmatched quote in environment variable "
+                    "JDK_JAVA_OPTIONS\n");
+    return YJ_ERR_ARGS;
+  }
+  return YJ_OK;
+}
+
+// WILDCARD
+// `lib/*` class path entries, like the stock launcher: the files of the
+// directory ending with .jar or .JAR, not recursive. They are sorted by
+// name so a launch does not depend on the order of the directory. Listing
+// a directory of hundreds of jars is kept per directory in the cache and
+// used again while the mtime of the directory is unchanged.
+
+bool wildcard_is(const char *entry) {
+  size_t len = strlen(entry);
+  return len > 0 && entry[len - 1] == '*' &&
+         (len == 1 || entry[len - 2] == FILE_PATH_SEPRATOR);
+}
+
+bool wildcard_is_jar(const char *name) {
+  size_t len = strlen(name);
+  return len > 4 && (strcmp(name + len - 4, ".jar") == 0 ||
+                     strcmp(name + len - 4, ".JAR") == 0);
+}
+
+int wildcard_cmp(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// the jars are added to the class path of args, unless seen already. An
+// unreadable directory expands to nothing, as with the stock launcher. The
+// directory is kept in args, launch plans depend on it.
+bool wildcard_expand(const char *entry, struct set *seen,
+                     struct yj_run_args *args) {
+  char dir[PATH_MAX] = {0};
+  char path[PATH_MAX * 2];
+  char **names = NULL;
+  size_t len = 0, prefix_len = strlen(entry) - 1;
+  struct stat st;
+  int fd;
+
+  snprintf(dir, PATH_MAX, "%.*s", (int)prefix_len, entry);
+  if (prefix_len == 0) {
+    dir[0] = '.';
+  }
+  arg_list_add(args, &args->wildcard_dirs, &args->wildcard_dirs_len,
+               arena_strdup(&args->arena, dir));
+  if ((fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+    TRACE("class path wildcard of no directory: %s", entry);
+    return false;
+  }
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+
+  if (!wildcard_cache_load(dir, &st, &names, &len)) {
+    if (!wildcard_scan(fd, &names, &len)) {
+      close(fd);
+      return false;
+    }
+    qsort(names, len, sizeof(char *), wildcard_cmp);
+    wildcard_cache_store(dir, &st, names, len);
+  }
+  close(fd);
+
+  for (size_t i = 0; i < len; i++) {
+    snprintf(path, sizeof(path), "%.*s%s", (int)prefix_len, entry, names[i]);
+    char *copy = arena_strdup(&args->arena, path);
+    if (set_add(seen, copy)) {
+      arg_list_add(args, &args->classpathes, &args->classpathes_len, copy);
+    }
+    free(names[i]);
+  }
+  free(names);
+  TRACE("class path wildcard %s: %zu jars", entry, len);
+  return true;
+}
+
+// a directory entry which is a jar file, links are followed
+bool wildcard_accept(int dirfd, const char *name, unsigned char type) {
+  struct stat st;
+
+  if (name[0] == '.' || !wildcard_is_jar(name) || type == DT_DIR) {
+    return false;
+  }
+  if (type == DT_REG) {
+    return true;
+  }
+  return fstatat(dirfd, name, &st, 0) == 0 && S_ISREG(st.st_mode);
+}
+
+#ifdef __linux__
+struct wildcard_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+#endif
+
+// the jar names of a directory. On linux straight from getdents64, large
+// buffers and no per entry library calls.
+bool wildcard_scan(int dirfd, char ***out, size_t *out_len) {
+  char **names = NULL;
+  size_t len = 0, max = 0;
+
+#ifdef __linux__
+  char *buf = malloc(WILDCARD_DENTS_BUF);
+  long n;
+
+  while ((n = syscall(SYS_getdents64, dirfd, buf, WILDCARD_DENTS_BUF)) > 0) {
+    for (long pos = 0; pos < n;) {
+      struct wildcard_dirent64 *d = (struct wildcard_dirent64 *)(buf + pos);
+      pos += d->d_reclen;
+      if (!wildcard_accept(dirfd, d->d_name, d->d_type)) {
+        continue;
+      }
+      if (len >= max) {
+        max = max == 0 ? 64 : max * 2;
+        names = realloc(names, max * sizeof(char *));
+      }
+      names[len++] = strdup(d->d_name);
+    }
+  }
+  free(buf);
+  if (n < 0) {
+    for (size_t i = 0; i < len; i++) {
+      free(names[i]);
+    }
+    free(names);
+    return false;
+  }
+#else
+  struct dirent *d;
+  DIR *dir = fdopendir(dup(dirfd));
+
+  if (dir == NULL) {
+    return false;
+  }
+  while ((d = readdir(dir)) != NULL) {
+    if (!wildcard_accept(dirfd, d->d_name, d->d_type)) {
+      continue;
+    }
+    if (len >= max) {
+      max = max == 0 ? 64 : max * 2;
+      names = realloc(names, max * sizeof(char *));
+    }
+    names[len++] = strdup(d->d_name);
+  }
+  closedir(dir);
+#endif
+
+  *out = names;
+  *out_len = len;
+  return true;
+}
+
+// cache/wildcard/<hash of the directory>
+//   [header][names, nul separated]
+bool wildcard_cache_file(const char *dir, char *out, size_t maxlen,
+                         bool create) {
+  char real[PATH_MAX] = {0};
+  char name[64];
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  if (realpath(dir, real) == NULL) {
+    return false;
+  }
+  h = plan_hash(h, real, strlen(real));
+  snprintf(name, sizeof(name), "%s%c%016llx", WILDCARD_DIR,
+           FILE_PATH_SEPRATOR, (unsigned long long)h);
+  return cache_path(name, out, maxlen, create);
+}
+
+bool wildcard_cache_load(const char *dir, struct stat *st, char ***out,
+                         size_t *out_len) {
+  char path[PATH_MAX] = {0};
+  struct wildcard_header *header;
+  const char *p, *end;
+  char *buf, **names;
+  size_t len;
+
+  if (!wildcard_cache_file(dir, path, PATH_MAX, false) ||
+      (buf = file_read_all(path, WILDCARD_MAX_CACHE, &len)) == NULL) {
+    return false;
+  }
+  header = (struct wildcard_header *)buf;
+  if (len < sizeof(*header) || header->magic != WILDCARD_MAGIC ||
+      header->version != WILDCARD_VERSION || header->dev != st->st_dev ||
+      header->ino != st->st_ino || header->mtime_ns != stat_mtime_ns(st) ||
+      len != sizeof(*header) + header->strings_len ||
+      (header->strings_len > 0 && buf[len - 1] != '\0')) {
+    free(buf);
+    return false;
+  }
+
+  names = calloc(header->count + 1, sizeof(char *));
+  p = buf + sizeof(*header);
+  end = buf + len;
+  *out_len = 0;
+  while (*out_len < header->count && p < end) {
+    names[(*out_len)++] = strdup(p);
+    p += strlen(p) + 1;
+  }
+  *out = names;
+  free(buf);
+  TRACE("class path wildcard cached: %s", dir);
+  return true;
+}
+
+// a directory changed within the current second may change again without
+// a new mtime on coarse clocks, it is listed again next time
+void wildcard_cache_store(const char *dir, struct stat *st, char **names,
+                          size_t len) {
+  char path[PATH_MAX] = {0};
+  char tmp_path[PATH_MAX + 8];
+  struct wildcard_header header = {0};
+  bool ok = false;
+  int fd;
+
+  if (time_epoch_us() / 1000000 <= stat_mtime_ns(st) / 1000000000 ||
+      !wildcard_cache_file(dir, path, PATH_MAX, true)) {
+    return;
+  }
+
+  header.magic = WILDCARD_MAGIC;
+  header.version = WILDCARD_VERSION;
+  header.count = len;
+  header.dev = st->st_dev;
+  header.ino = st->st_ino;
+  header.mtime_ns = stat_mtime_ns(st);
+  for (size_t i = 0; i < len; i++) {
+    header.strings_len += strlen(names[i]) + 1;
+  }
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+  if ((fd = mkstemp(tmp_path)) < 0) {
+    return;
+  }
+  fchmod(fd, 0644);
+  ok = file_write_all(fd, &header, sizeof(header));
+  for (size_t i = 0; i < len && ok; i++) {
+    ok = file_write_all(fd, names[i], strlen(names[i]) + 1);
+  }
+  ok = ok && rename(tmp_path, path) == 0;
+  close(fd);
+  if (!ok) {
+    unlink(tmp_path);
+  }
+}
+
+// CLASSPATH
+// Every class path entry is checked before the vm is created, a stat each.
+// Long class paths are checked from a few threads, on network file systems
+// a stat is a round trip. The directories of a checked class path are kept
+// in the cache: while none of them changed, no entry can have gone and the
+// check is skipped. Class paths with links are checked every time.
+bool classpath_check(char **paths, size_t len) {
+  struct classpath_check check = {0};
+  char path[PATH_MAX] = {0};
+  pthread_t threads[CLASSPATH_THREADS];
+  size_t threads_len = 0;
+  uint64_t key;
+
+  if (len == 0) {
+    return true;
+  }
+  key = classpath_key(paths, len);
+  if (classpath_cache_file(key, path, PATH_MAX, false) &&
+      classpath_cache_fresh(path, key)) {
+    TRACE("class path unchanged: %zu entries", len);
+    return true;
+  }
+
+  check.paths = paths;
+  check.len = len;
+  check.missing = len;
+  if (len >= CLASSPATH_PARALLEL_MIN) {
+    for (; threads_len < CLASSPATH_THREADS; threads_len++) {
+      if (pthread_create(&threads[threads_len], NULL, classpath_thread,
+                         &check) != 0) {
+        break;
+      }
+    }
+  }
+  classpath_thread(&check);
+  for (size_t i = 0; i < threads_len; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  if (check.missing < len) {
+    printf("path not found: %s\n", paths[check.missing]);
+    return false;
+  }
+  if (!check.links && classpath_cache_file(key, path, PATH_MAX, true)) {
+    classpath_cache_store(path, key, paths, len);
+  }
+  return true;
+}
+
+// the first missing entry is reported, as with a check in order
+void *classpath_thread(void *data) {
+  struct classpath_check *check = data;
+  struct stat st;
+  size_t i, missing;
+
+  while ((i = __atomic_fetch_add(&check->next, 1, __ATOMIC_RELAXED)) <
+         check->len) {
+    if (lstat(check->paths[i], &st) == 0) {
+      // the directory of a link does not change with its target
+      if (!S_ISLNK(st.st_mode)) {
+        continue;
+      }
+      check->links = true;
+      if (stat(check->paths[i], &st) == 0) {
+        continue;
+      }
+    }
+    missing = __atomic_load_n(&check->missing, __ATOMIC_RELAXED);
+    while (i < missing &&
+           !__atomic_compare_exchange_n(&check->missing, &missing, i, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+  }
+  return NULL;
+}
+
+uint64_t classpath_key(char **paths, size_t len) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  uint32_t version = CLASSPATH_VERSION;
+  char cwd[PATH_MAX] = {0};
+
+  h = plan_hash(h, &version, sizeof(version));
+  if (getcwd(cwd, PATH_MAX) != NULL) {
+    h = plan_hash(h, cwd, strlen(cwd) + 1);
+  }
+  for (size_t i = 0; i < len; i++) {
+    h = plan_hash(h, paths[i], strlen(paths[i]) + 1);
+  }
+  return h;
+}
+
+// the directory holding an entry, `.` for a plain name
+void classpath_dir_of(const char *path, char *out, size_t maxlen) {
+  const char *sep = strrchr(path, FILE_PATH_SEPRATOR);
+
+  if (sep == NULL) {
+    snprintf(out, maxlen, ".");
+  } else if (sep == path) {
+    snprintf(out, maxlen, "%c", FILE_PATH_SEPRATOR);
+  } else {
+    snprintf(out, maxlen, "%.*s", (int)(sep - path), path);
+  }
+}
+
+// cache/classpath/<key>
+//   [header][classpath_dir ...][paths of the directories]
+bool classpath_cache_file(uint64_t key, char *out, size_t maxlen,
+                          bool create) {
+  char name[64];
+
+  snprintf(name, sizeof(name), "%s%c%016llx", CLASSPATH_DIR,
+           FILE_PATH_SEPRATOR, (unsigned long long)key);
+  return cache_path(name, out, maxlen, create);
+}
+
+bool classpath_cache_fresh(const char *path, uint64_t key) {
+  struct classpath_header *header;
+  struct classpath_dir *dirs;
+  const char *strings;
+  struct stat st;
+  bool fresh = false;
+  size_t len;
+  char *buf;
+
+  if ((buf = file_read_all(path, CLASSPATH_MAX_CACHE, &len)) == NULL) {
+    return false;
+  }
+  header = (struct classpath_header *)buf;
+  if (len < sizeof(*header) || header->magic != CLASSPATH_MAGIC ||
+      header->version != CLASSPATH_VERSION || header->key != key ||
+      header->strings_len == 0 ||
+      len != sizeof(*header) +
+                 (size_t)header->dirs_len * sizeof(struct classpath_dir) +
+                 header->strings_len ||
+      buf[len - 1] != '\0') {
+    free(buf);
+    return false;
+  }
+
+  dirs = (struct classpath_dir *)(header + 1);
+  strings = (const char *)(dirs + header->dirs_len);
+  fresh = true;
+  for (uint32_t i = 0; i < header->dirs_len && fresh; i++) {
+    fresh = dirs[i].path < header->strings_len &&
+            stat(strings + dirs[i].path, &st) == 0 &&
+            (uint64_t)st.st_dev == dirs[i].dev &&
+            (uint64_t)st.st_ino == dirs[i].ino &&
+            stat_mtime_ns(&st) == dirs[i].mtime_ns;
+  }
+  free(buf);
+  return fresh;
+}
+
+// not kept while a directory changed within the current second, the next
+// change may not move its mtime
+void classpath_cache_store(const char *path, uint64_t key, char **paths,
+                           size_t len) {
+  struct classpath_header header = {0};
+  struct classpath_dir *dirs;
+  char tmp_path[PATH_MAX + 8];
+  char dir[PATH_MAX];
+  char **names;
+  struct set seen;
+  struct stat st;
+  uint32_t pool_len = 1;
+  size_t pool_max = 1;
+  time_t now = time_epoch_us() / 1000000;
+  char *pool;
+  bool ok = false;
+  int fd;
+
+  names = calloc(len, sizeof(char *));
+  set_init(&seen, 16);
+  for (size_t i = 0; i < len; i++) {
+    classpath_dir_of(paths[i], dir, PATH_MAX);
+    names[header.dirs_len] = strdup(dir);
+    if (set_add(&seen, names[header.dirs_len])) {
+      pool_max += strlen(dir) + 1;
+      header.dirs_len++;
+    } else {
+      free(names[header.dirs_len]);
+    }
+  }
+  set_free(&seen);
+
+  dirs = calloc(header.dirs_len, sizeof(struct classpath_dir));
+  pool = calloc(pool_max, sizeof(char));
+  for (uint32_t i = 0; i < header.dirs_len; i++) {
+    if (stat(names[i], &st) != 0 ||
+        stat_mtime_ns(&st) / 1000000000 >= now) {
+      goto done;
+    }
+    dirs[i].dev = st.st_dev;
+    dirs[i].ino = st.st_ino;
+    dirs[i].mtime_ns = stat_mtime_ns(&st);
+    dirs[i].path = index_put_str(pool, &pool_len, names[i]);
+  }
+
+  header.magic = CLASSPATH_MAGIC;
+  header.version = CLASSPATH_VERSION;
+  header.key = key;
+  header.strings_len = pool_len;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+  if ((fd = mkstemp(tmp_path)) >= 0) {
+    fchmod(fd, 0644);
+    ok = file_write_all(fd, &header, sizeof(header)) &&
+         file_write_all(fd, dirs,
+                        header.dirs_len * sizeof(struct classpath_dir)) &&
+         file_write_all(fd, pool, pool_len) && rename(tmp_path, path) == 0;
+    close(fd);
+    if (!ok) {
+      unlink(tmp_path);
+    }
+  }
+
+done:
+  for (uint32_t i = 0; i < header.dirs_len; i++) {
+    free(names[i]);
+  }
+  free(names);
+  free(dirs);
+  free(pool);
+}
+
+// PACK
+// `yajava pack` merges the jars of a class path into one uncompressed jar,
+// the classes a recording run loaded first, in the order it loaded them.
+// Class loading then reads one file front to back instead of inflating from
+// many jars. Launches with the same class path use the pack while none of
+// its sources changed, otherwise the class path as given.
+//
+// Entries resolve as on the class path, the first jar holding a name wins.
+// Service files are concatenated, ServiceLoader reads all of them. Signed
+// and multi-release jars are not merged: they stay on the class path behind
+// the pack and shadow the entries of later jars. Directories stay too, the
+// jars after one that follows a merged jar are not merged.
+yj_result yj_pack(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                  int *exit_code, struct yj_pack_info *info) {
+  char log_path[PATH_MAX] = {0};
+  char jar_path[PATH_MAX] = {0};
+  char index_path[PATH_MAX] = {0};
+  char tmp_path[PATH_MAX + 8];
+  struct pack pk = {0};
+  struct zip_writer w;
+  struct zip_entry entry;
+  struct stat *sts = NULL, st;
+  size_t opt_len, total = 0;
+  int len, first, fd;
+  char *opt, *class_path = NULL;
+  bool ok = false;
+  yj_result res;
+  uint64_t key;
+
+  if (runtime == NULL || args == NULL || exit_code == NULL || info == NULL) {
+    return YJ_ERR_NULL;
+  }
+  memset(info, 0, sizeof(struct yj_pack_info));
+  len = args->classpathes_len;
+  if (args->app_jar != NULL || args->app_module != NULL || len == 0) {
+    printf("pack: a class path is needed, -jar and modules are not packed\n");
+    return YJ_ERR_ARGS;
+  }
+  if (runtime->major_version < 9) {
+    printf("pack: java %s has no -Xlog:class+load, 9 or later is needed\n",
+           runtime->full_version);
+    return YJ_ERR_RUNTIME;
+  }
+  key = pack_key(args->classpathes, len);
+  if (!pack_file(key, PACK_LOG_EXT, log_path, PATH_MAX, true) ||
+      !pack_file(key, PACK_JAR_EXT, jar_path, PATH_MAX, false) ||
+      !pack_file(key, PACK_INDEX_EXT, index_path, PATH_MAX, false)) {
+    return YJ_ERR_NO_FILE;
+  }
+
+  // the recording run, on the class path as given
+  unlink(log_path);
+  opt_len = strlen(log_path) + 64;
+  opt = arena_alloc(&args->arena, opt_len);
+  snprintf(opt, opt_len, "-Xlog:class+load=info:file=%s::filecount=0",
+           log_path);
+  arg_list_add(args, &args->vmopts, &args->vmopts_len, opt);
+  args->packing = true;
+  if ((res = yj_run_fork(runtime, args, exit_code)) != YJ_OK) {
+    return res;
+  }
+  res = YJ_ERR_NO_FILE;
+
+  sts = calloc(len, sizeof(struct stat));
+  if ((first = pack_open(&pk, args->classpathes, len, sts)) == -2) {
+    goto done;
+  }
+  if (first < 0) {
+    printf("pack: no jar of the class path can be merged\n");
+    goto done;
+  }
+  for (int i = 0; i < len; i++) {
+    total += pk.jars[i].entries;
+  }
+
+  pk.slots_len = 16;
+  while (pk.slots_len < total * 2) {
+    pk.slots_len *= 2;
+  }
+  pk.slots = calloc(pk.slots_len, sizeof(uint32_t));
+  pk.entries = calloc(total + 1, sizeof(struct pack_entry));
+  for (int i = 0; i < len; i++) {
+    size_t pos = 0;
+    while (pk.jars[i].map != NULL && zip_next(&pk.jars[i], &pos, &entry)) {
+      pack_insert(&pk, i, &entry);
+    }
+  }
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", jar_path);
+  if ((fd = mkstemp(tmp_path)) < 0) {
+    goto done;
+  }
+  fchmod(fd, 0644);
+  close(fd);
+
+  // the manifest first, as JarInputStream expects it, then the classes in
+  // load order and everything else in class path order
+  ok = zip_writer_open(&w, tmp_path) &&
+       zip_writer_add(&w, "META-INF/", 9, "", 0) &&
+       zip_writer_add(&w, "META-INF/MANIFEST.MF", 20, PACK_MANIFEST,
+                      strlen(PACK_MANIFEST)) &&
+       pack_put_ordered(&pk, &w, log_path);
+  for (size_t i = 0; ok && i < pk.len; i++) {
+    ok = pack_put(&pk, &w, &pk.entries[i]);
+  }
+  info->entries = w.entries;
+  ok = zip_writer_close(&w) && ok && rename(tmp_path, jar_path) == 0;
+  if (!ok) {
+    printf("pack: failed to write %s\n", jar_path);
+    unlink(tmp_path);
+    goto done;
+  }
+
+  class_path = pack_class_path(&pk, args->classpathes, first, jar_path);
+  for (int i = 0; i < len; i++) {
+    if (pk.merged[i]) {
+      info->jars++;
+    } else {
+      info->kept++;
+    }
+  }
+  if (class_path == NULL ||
+      !pack_write_index(index_path, key, &pk, args->classpathes, sts,
+                        jar_path, class_path)) {
+    printf("pack: failed to write %s\n", index_path);
+    goto done;
+  }
+
+  if (stat(jar_path, &st) == 0) {
+    info->size = st.st_size;
+  }
+  info->path = strdup(jar_path);
+  info->ordered = pk.ordered;
+  res = YJ_OK;
+
+done:
+  unlink(log_path);
+  for (size_t i = 0; i < pk.jars_len; i++) {
+    zip_close(&pk.jars[i]);
+  }
+  free(pk.jars);
+  free(pk.merged);
+  free(pk.entries);
+  free(pk.slots);
+  free(sts);
+  free(class_path);
+  return res;
+}
+
+yj_result yj_free_pack_info(struct yj_pack_info *info) {
+  if (info == NULL) {
+    return YJ_ERR_NULL;
+  }
+  SAFE_FREE(info->path);
+  return YJ_OK;
+}
+
+uint64_t pack_key(char **paths, size_t len) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  uint32_t version = PACK_VERSION;
+  char cwd[PATH_MAX] = {0};
+
+  h = plan_hash(h, &version, sizeof(version));
+  if (getcwd(cwd, PATH_MAX) != NULL) {
+    h = plan_hash(h, cwd, strlen(cwd) + 1);
+  }
+  for (size_t i = 0; i < len; i++) {
+    h = plan_hash(h, paths[i], strlen(paths[i]) + 1);
+  }
+  return h;
+}
+
+// cache/packs/<key>.jar, <key>.idx
+bool pack_file(uint64_t key, const char *ext, char *out, size_t maxlen,
+               bool create) {
+  char name[64];
+
+  snprintf(name, sizeof(name), "%s%c%016llx%s", PACK_DIR, FILE_PATH_SEPRATOR,
+           (unsigned long long)key, ext);
+  return cache_path(name, out, maxlen, create);
+}
+
+// the jars in class path order, each stat taken before it is read; the
+// index of the first merged jar, -1 without one, -2 for a missing path
+int pack_open(struct pack *pk, char **paths, int len, struct stat *sts) {
+  int first = -1;
+  bool stop = false;
+
+  pk->jars_len = len;
+  pk->jars = calloc(len, sizeof(struct zip));
+  pk->merged = calloc(len, sizeof(bool));
+  for (int i = 0; i < len; i++) {
+    if (stat(paths[i], &sts[i]) != 0) {
+      printf("path not found: %s\n", paths[i]);
+      return -2;
+    }
+    if (stop || !S_ISREG(sts[i].st_mode) || !zip_open(&pk->jars[i], paths[i])) {
+      stop = first >= 0;
+      continue;
+    }
+    pk->merged[i] = pack_mergeable(&pk->jars[i]);
+    if (pk->merged[i] && first < 0) {
+      first = i;
+    }
+  }
+  return first;
+}
+
+// the pack in place of the first merged jar, the others kept in order
+char *pack_class_path(struct pack *pk, char **paths, int first,
+                      const char *jar) {
+  size_t cp_max = strlen(jar) + 2, cp_len = 0;
+  char *class_path;
+
+  for (size_t i = 0; i < pk->jars_len; i++) {
+    cp_max += strlen(paths[i]) + 1;
+  }
+  if ((class_path = calloc(cp_max, sizeof(char))) == NULL) {
+    return NULL;
+  }
+  for (size_t i = 0; i < pk->jars_len; i++) {
+    if (!pk->merged[i] || (int)i == first) {
+      cp_len += snprintf(class_path + cp_len, cp_max - cp_len, "%s%s",
+                         cp_len > 0 ? CLASSPATH_SEPRATOR : "",
+                         (int)i == first ? jar : paths[i]);
+    }
+  }
+  return class_path;
+}
+
+// the class path of a fresh pack of the first len entries, NULL without
+char *pack_lookup(struct yj_run_args *args, int len) {
+  struct pack_header *header;
+  struct pack_source *sources;
+  const char *strings;
+  char path[PATH_MAX] = {0};
+  char *env, *buf, *cp = NULL;
+  uint64_t key;
+  bool fresh;
+  size_t n;
+
+  if (args->packing || len <= 0 ||
+      ((env = getenv("YAJAVA_PACK")) != NULL && strcmp(env, "off") == 0)) {
+    return NULL;
+  }
+  key = pack_key(args->classpathes, len);
+  if (!pack_file(key, PACK_INDEX_EXT, path, PATH_MAX, false)) {
+    return NULL;
+  }
+
+  // a launch plan input also while missing, a new pack replaces the plan
+  args->pack = arena_strdup(&args->arena, path);
+  if ((buf = file_read_all(path, PACK_MAX_INDEX, &n)) == NULL) {
+    return NULL;
+  }
+  header = (struct pack_header *)buf;
+  if (n < sizeof(*header) || header->magic != PACK_MAGIC ||
+      header->version != PACK_VERSION || header->key != key ||
+      header->strings_len == 0 || header->class_path >= header->strings_len ||
+      n != sizeof(*header) +
+               (size_t)header->sources_len * sizeof(struct pack_source) +
+               header->strings_len ||
+      buf[n - 1] != '\0') {
+    TRACE("invalid pack index: %s", path);
+    free(buf);
+    return NULL;
+  }
+
+  sources = (struct pack_source *)(header + 1);
+  strings = (const char *)(sources + header->sources_len);
+  fresh = true;
+  for (uint32_t i = 0; i < header->sources_len && fresh; i++) {
+    struct stat st;
+    fresh = sources[i].path < header->strings_len &&
+            stat(strings + sources[i].path, &st) == 0 &&
+            (sources[i].dir ||
+             (stat_mtime_ns(&st) == sources[i].mtime_ns &&
+              (uint64_t)st.st_size == sources[i].size));
+    if (!fresh) {
+      TRACE("pack stale, %s changed", strings + sources[i].path);
+    }
+  }
+  if (fresh) {
+    cp = strdup(strings + header->class_path);
+    TRACE("pack hit: %s", cp);
+  }
+  free(buf);
+  return cp;
+}
+
+// signature files would not match the merged jar, versioned entries only
+// resolve in a multi-release jar
+bool pack_mergeable(struct zip *zip) {
+  struct zip_entry entry;
+  char value[16];
+  char *manifest;
+  size_t pos = 0;
+  bool ok = true;
+
+  while (ok && zip_next(zip, &pos, &entry)) {
+    ok = !(entry.name_len > 12 && memcmp(entry.name, "META-INF/", 9) == 0 &&
+           memchr(entry.name + 9, '/', entry.name_len - 9) == NULL &&
+           strncasecmp(entry.name + entry.name_len - 3, ".SF", 3) == 0);
+  }
+  if (ok && zip_find(zip, "META-INF/MANIFEST.MF", &entry) &&
+      (manifest = zip_read(zip, &entry, NULL)) != NULL) {
+    ok = !jar_manifest_value(manifest, "Multi-Release", value,
+                             sizeof(value)) ||
+         strcasecmp(value, "true") != 0;
+    free(manifest);
+  }
+  return ok;
+}
+
+// entries of the sources the pack does not carry, it has its own manifest
+bool pack_skip(const char *name, size_t len) {
+  static const char *names[] = {"META-INF/", "META-INF/MANIFEST.MF",
+                                "META-INF/INDEX.LIST", "module-info.class"};
+
+  for (size_t i = 0; i < sizeof(names) / sizeof(char *); i++) {
+    if (len == strlen(names[i]) && memcmp(name, names[i], len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct pack_entry *pack_find(struct pack *pk, const char *name, size_t len) {
+  size_t mask = pk->slots_len - 1;
+  size_t i = plan_hash(0xcbf29ce484222325ULL, name, len) & mask;
+
+  for (; pk->slots[i] != 0; i = (i + 1) & mask) {
+    struct pack_entry *e = &pk->entries[pk->slots[i] - 1];
+    if (e->entry.name_len == len && memcmp(e->entry.name, name, len) == 0) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+void pack_insert(struct pack *pk, uint32_t jar, struct zip_entry *entry) {
+  bool service = entry->name_len > strlen(PACK_SERVICES) &&
+                 memcmp(entry->name, PACK_SERVICES,
+                        strlen(PACK_SERVICES)) == 0;
+  struct pack_entry *e = pack_find(pk, entry->name, entry->name_len);
+  size_t mask = pk->slots_len - 1;
+  size_t i;
+
+  // service files of kept jars are read from them, they shadow nothing
+  if (service && !pk->merged[jar]) {
+    return;
+  }
+  if (e != NULL && !(service && !e->kept)) {
+    return;
+  }
+
+  pk->entries[pk->len].entry = *entry;
+  pk->entries[pk->len].jar = jar;
+  pk->entries[pk->len].next = -1;
+  pk->entries[pk->len].kept = !pk->merged[jar];
+  if (e != NULL) {
+    // appended to the first one when it is written
+    while (e->next >= 0) {
+      e = &pk->entries[e->next];
+    }
+    e->next = pk->len;
+    pk->entries[pk->len++].written = true;
+    return;
+  }
+
+  i = plan_hash(0xcbf29ce484222325ULL, entry->name, entry->name_len) & mask;
+  while (pk->slots[i] != 0) {
+    i = (i + 1) & mask;
+  }
+  pk->slots[i] = ++pk->len;
+}
+
+bool pack_put(struct pack *pk, struct zip_writer *w, struct pack_entry *e) {
+  size_t len, more_len;
+  char *data, *more;
+  bool ok;
+
+  if (e->written || e->kept) {
+    return true;
+  }
+  e->written = true;
+  if (pack_skip(e->entry.name, e->entry.name_len)) {
+    return true;
+  }
+  if ((data = zip_read(&pk->jars[e->jar], &e->entry, &len)) == NULL) {
+    return false;
+  }
+
+  for (int32_t next = e->next; next >= 0; next = pk->entries[next].next) {
+    struct pack_entry *n = &pk->entries[next];
+    if ((more = zip_read(&pk->jars[n->jar], &n->entry, &more_len)) == NULL) {
+      free(data);
+      return false;
+    }
+    data = realloc(data, len + more_len + 2);
+    if (len > 0 && data[len - 1] != '\n') {
+      data[len++] = '\n';
+    }
+    memcpy(data + len, more, more_len);
+    len += more_len;
+    free(more);
+  }
+
+  ok = zip_writer_add(w, e->entry.name, e->entry.name_len, data, len);
+  free(data);
+  return ok;
+}
+
+// -Xlog:class+load lines, `[0.011s][info][class,load] java.lang.Object
+// source: ...`, classes outside the merged jars are not found
+bool pack_put_ordered(struct pack *pk, struct zip_writer *w,
+                      const char *log_path) {
+  char name[PATH_MAX];
+  char *buf, *line, *end;
+  size_t len, n;
+  bool ok = true;
+
+  if ((buf = file_read_all(log_path, PACK_MAX_LOG, &len)) == NULL) {
+    printf("pack: no classes were recorded\n");
+    return false;
+  }
+
+  for (line = buf; ok && line < buf + len; line = end + 1) {
+    struct pack_entry *e;
+    char *p = line;
+
+    if ((end = memchr(line, '\n', buf + len - line)) == NULL) {
+      end = buf + len;
+    }
+    while (p < end && *p == '[' && (p = memchr(p, ']', end - p)) != NULL) {
+      for (p++; p < end && *p == ' '; p++) {
+      }
+    }
+    if (p == NULL || (n = strcspn(p, " \n")) == 0 || p + n > end ||
+        n + 7 > sizeof(name)) {
+      continue;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      name[i] = p[i] == '.' ? '/' : p[i];
+    }
+    memcpy(name + n, ".class", 7);
+    if ((e = pack_find(pk, name, n + 6)) != NULL && !e->written &&
+        !e->kept) {
+      ok = pack_put(pk, w, e);
+      pk->ordered++;
+    }
+  }
+  free(buf);
+  return ok;
+}
+
+// the sources and the pack itself, stats of directories are not compared
+bool pack_write_index(const char *path, uint64_t key, struct pack *pk,
+                      char **paths, struct stat *sts, const char *jar,
+                      const char *class_path) {
+  struct pack_header header = {0};
+  struct pack_source *sources;
+  char tmp_path[PATH_MAX + 8];
+  size_t pool_max = strlen(jar) + strlen(class_path) + 3;
+  uint32_t pool_len = 1;
+  struct stat st;
+  char *pool;
+  bool ok = false;
+  int fd;
+
+  if (stat(jar, &st) != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < pk->jars_len; i++) {
+    pool_max += strlen(paths[i]) + 1;
+  }
+  sources = calloc(pk->jars_len + 1, sizeof(struct pack_source));
+  pool = calloc(pool_max, sizeof(char));
+  for (size_t i = 0; i <= pk->jars_len; i++) {
+    struct stat *s = i < pk->jars_len ? &sts[i] : &st;
+    sources[i].path =
+        index_put_str(pool, &pool_len, i < pk->jars_len ? paths[i] : jar);
+    sources[i].dir = S_ISDIR(s->st_mode);
+    if (!sources[i].dir) {
+      sources[i].mtime_ns = stat_mtime_ns(s);
+      sources[i].size = s->st_size;
+    }
+  }
+
+  header.magic = PACK_MAGIC;
+  header.version = PACK_VERSION;
+  header.key = key;
+  header.sources_len = pk->jars_len + 1;
+  header.class_path = index_put_str(pool, &pool_len, class_path);
+  header.strings_len = pool_len;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+  if ((fd = mkstemp(tmp_path)) >= 0) {
+    fchmod(fd, 0644);
+    ok = file_write_all(fd, &header, sizeof(header)) &&
+         file_write_all(fd, sources,
+                        header.sources_len * sizeof(struct pack_source)) &&
+         file_write_all(fd, pool, pool_len) && rename(tmp_path, path) == 0;
+    close(fd);
+    if (!ok) {
+      unlink(tmp_path);
+    }
+  }
+  free(sources);
+  free(pool);
+  return ok;
+}
+
+// CLASSINDEX
+// The application class loader looks a class up in every jar of the class
+// path in order, with a thousand jars most lookups probe hundreds of them.
+// With --class-index a class path of jars gets an index of which jars hold
+// each package, built from the central directories from a few threads, and
+// the bundled IndexClassLoader as system class loader: it maps the index and
+// reads a class straight from the jars of its package. The index is built
+// again when a jar changed; without the loader jar nothing changes. It is
+// opt-in, as getSystemClassLoader no longer returns the stock loader, and
+// left out with an archive, whose classes only the stock loaders share.
+// loader is the loader jar to append to the class path, empty unless true.
+bool classindex_prepare(struct yj_java_runtime *runtime,
+                        struct yj_run_args *args, int len, char *loader,
+                        size_t maxlen) {
+  char path[PATH_MAX] = {0};
+  uint64_t key;
+  char *env;
+
+  loader[0] = '\0';
+  if (!args->class_index_loader || args->archive != NULL ||
+      args->javagents_len > 0 ||
+      ((env = getenv("YAJAVA_CLASS_INDEX")) != NULL &&
+       strcmp(env, "off") == 0)) {
+    return false;
+  }
+
+  // agents need a system class loader which takes their jars, an own one
+  // replaces the index
+  for (int i = 0; i < args->sys_props_len; i++) {
+    if (strncmp(args->sys_props[i], "-Djava.system.class.loader=", 27) == 0) {
+      return false;
+    }
+  }
+  // directories would lose their place in the lookup order
+  for (int i = 0; i < len; i++) {
+    if (!wildcard_is_jar(args->classpathes[i])) {
+      return false;
+    }
+  }
+  if (!classindex_loader_jar(runtime, loader, maxlen)) {
+    loader[0] = '\0';
+    return false;
+  }
+
+  key = classpath_key(args->classpathes, len);
+  if (!classindex_file(key, path, PATH_MAX, true) ||
+      (!classindex_fresh(path, key, args->classpathes, len) &&
+       !classindex_build(path, key, args->classpathes, len))) {
+    loader[0] = '\0';
+    return false;
+  }
+  TRACE("class index: %s", path);
+  args->class_index = arena_strdup(&args->arena, path);
+  return true;
+}
+
+// next to the launcher, or in share/yajava of its prefix, and only for
+// runtimes which load the class version it was compiled to
+bool classindex_loader_jar(struct yj_java_runtime *runtime, char *out,
+                           size_t maxlen) {
+  char exe[PATH_MAX] = {0};
+  char *slash;
+  int release;
+
+  if (readlink("/proc/self/exe", exe, PATH_MAX - 1) <= 0 ||
+      (slash = strrchr(exe, FILE_PATH_SEPRATOR)) == NULL) {
+    return false;
+  }
+  *slash = '\0';
+  snprintf(out, maxlen, "%s%c%s", exe, FILE_PATH_SEPRATOR,
+           CLASSINDEX_LOADER_JAR);
+  if (!file_is_file(out)) {
+    snprintf(out, maxlen, "%s%c..%cshare%cyajava%c%s", exe,
+             FILE_PATH_SEPRATOR, FILE_PATH_SEPRATOR, FILE_PATH_SEPRATOR,
+             FILE_PATH_SEPRATOR, CLASSINDEX_LOADER_JAR);
+  }
+  release = jar_class_release_in(out, CLASSINDEX_LOADER_CLASS);
+  if (release <= 0 || release > runtime->major_version) {
+    TRACE("no class index loader for java %d: %s", runtime->major_version,
+          out);
+    return false;
+  }
+  return true;
+}
+
+// cache/classindex/<key>
+bool classindex_file(uint64_t key, char *out, size_t maxlen, bool create) {
+  char name[64];
+
+  snprintf(name, sizeof(name), "%s%c%016llx", CLASSINDEX_DIR,
+           FILE_PATH_SEPRATOR, (unsigned long long)key);
+  return cache_path(name, out, maxlen, create);
+}
+
+bool classindex_fresh(const char *path, uint64_t key, char **paths,
+                      size_t len) {
+  struct classindex_header header;
+  struct classindex_jar *jars;
+  struct stat st;
+  bool fresh;
+  int fd;
+
+  // the jars follow the header, the rest is for the loader
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return false;
+  }
+  if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+      header.magic != CLASSINDEX_MAGIC ||
+      header.version != CLASSINDEX_VERSION || header.key != key ||
+      header.jars_len != len) {
+    close(fd);
+    return false;
+  }
+  jars = calloc(len, sizeof(struct classindex_jar));
+  fresh = read(fd, jars, len * sizeof(struct classindex_jar)) ==
+          (ssize_t)(len * sizeof(struct classindex_jar));
+  close(fd);
+
+  for (size_t i = 0; i < len && fresh; i++) {
+    fresh = stat(paths[i], &st) == 0 &&
+            stat_mtime_ns(&st) == jars[i].mtime_ns &&
+            (uint64_t)st.st_size == jars[i].size;
+    if (!fresh) {
+      TRACE("class index stale, %s changed", paths[i]);
+    }
+  }
+  free(jars);
+  return fresh;
+}
+
+// packages are numbered in class path order of their first jar, each lists
+// its jars in class path order
+bool classindex_build(const char *path, uint64_t key, char **paths,
+                      size_t len) {
+  struct classindex_header header = {0};
+  struct classindex_scan scan = {0};
+  struct classindex_jar *jars;
+  struct classindex_package *packages;
+  pthread_t threads[CLASSINDEX_THREADS];
+  size_t threads_len = 0, total = 0, pool_max = 1;
+  uint32_t *slots, *refs, *filled, pool_len = 1, mask;
+  char tmp_path[PATH_MAX + 8];
+  char **names;
+  char *pool;
+  bool ok = false;
+  int fd;
+
+  scan.paths = paths;
+  scan.len = len;
+  scan.jars = calloc(len, sizeof(struct classindex_scan_jar));
+  for (; threads_len < CLASSINDEX_THREADS; threads_len++) {
+    if (pthread_create(&threads[threads_len], NULL, classindex_thread,
+                       &scan) != 0) {
+      break;
+    }
+  }
+  classindex_thread(&scan);
+  for (size_t i = 0; i < threads_len; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    total += scan.jars[i].len;
+    pool_max += strlen(paths[i]) + 1;
+  }
+  header.slots_len = 16;
+  while (header.slots_len < total * 2) {
+    header.slots_len *= 2;
+  }
+  mask = header.slots_len - 1;
+  slots = calloc(header.slots_len, sizeof(uint32_t));
+  packages = calloc(total + 1, sizeof(struct classindex_package));
+  names = calloc(total + 1, sizeof(char *));
+  refs = calloc(total + 1, sizeof(uint32_t));
+  filled = calloc(total + 1, sizeof(uint32_t));
+  jars = calloc(len, sizeof(struct classindex_jar));
+
+  // number the packages, count their jars
+  for (size_t i = 0; i < len; i++) {
+    scan.jars[i].ids = calloc(scan.jars[i].len + 1, sizeof(uint32_t));
+    for (size_t j = 0; j < scan.jars[i].len; j++) {
+      char *name = scan.jars[i].packages[j];
+      size_t name_len = strlen(name);
+      uint32_t hash = classindex_hash(name, name_len), k;
+
+      for (k = hash & mask; slots[k] != 0; k = (k + 1) & mask) {
+        if (packages[slots[k] - 1].hash == hash &&
+            strcmp(names[slots[k] - 1], name) == 0) {
+          break;
+        }
+      }
+      if (slots[k] == 0) {
+        names[header.packages_len] = name;
+        packages[header.packages_len].hash = hash;
+        packages[header.packages_len].name_len = name_len;
+        slots[k] = ++header.packages_len;
+        pool_max += name_len + 1;
+      }
+      packages[slots[k] - 1].refs_len++;
+      scan.jars[i].ids[j] = slots[k] - 1;
+      if (names[slots[k] - 1] != name) {
+        free(name);
+      }
+    }
+  }
+  for (uint32_t p = 0; p < header.packages_len; p++) {
+    packages[p].refs = header.refs_len;
+    header.refs_len += packages[p].refs_len;
+  }
+  // the jars of each package, in class path order
+  for (size_t i = 0; i < len; i++) {
+    for (size_t j = 0; j < scan.jars[i].len; j++) {
+      uint32_t p = scan.jars[i].ids[j];
+      refs[packages[p].refs + filled[p]++] = i;
+    }
+  }
+
+  pool = calloc(pool_max, sizeof(char));
+  for (size_t i = 0; i < len; i++) {
+    jars[i].mtime_ns = stat_mtime_ns(&scan.jars[i].st);
+    jars[i].size = scan.jars[i].st.st_size;
+    jars[i].path = index_put_str(pool, &pool_len, paths[i]);
+  }
+  for (uint32_t p = 0; p < header.packages_len; p++) {
+    packages[p].name = index_put_str(pool, &pool_len, names[p]);
+  }
+
+  header.magic = CLASSINDEX_MAGIC;
+  header.version = CLASSINDEX_VERSION;
+  header.key = key;
+  header.jars_len = len;
+  header.strings_len = pool_len;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+  if ((fd = mkstemp(tmp_path)) >= 0) {
+    fchmod(fd, 0644);
+    ok = file_write_all(fd, &header, sizeof(header)) &&
+         file_write_all(fd, jars, len * sizeof(struct classindex_jar)) &&
+         file_write_all(fd, slots, header.slots_len * sizeof(uint32_t)) &&
+         file_write_all(fd, packages,
+                        header.packages_len *
+                            sizeof(struct classindex_package)) &&
+         file_write_all(fd, refs, header.refs_len * sizeof(uint32_t)) &&
+         file_write_all(fd, pool, pool_len) && rename(tmp_path, path) == 0;
+    close(fd);
+    if (!ok) {
+      unlink(tmp_path);
+    }
+  }
+
+  for (uint32_t p = 0; p < header.packages_len; p++) {
+    free(names[p]);
+  }
+  for (size_t i = 0; i < len; i++) {
+    free(scan.jars[i].packages);
+    free(scan.jars[i].ids);
+  }
+  free(scan.jars);
+  free(slots);
+  free(packages);
+  free(names);
+  free(refs);
+  free(filled);
+  free(jars);
+  free(pool);
+  return ok;
+}
+
+// the packages of the classes of each jar, versioned entries of
+// multi-release jars are left to the parent loader
+void *classindex_thread(void *data) {
+  struct classindex_scan *scan = data;
+  struct zip_entry entry;
+  struct zip zip;
+  struct set seen;
+  size_t i, pos, cap;
+
+  while ((i = __atomic_fetch_add(&scan->next, 1, __ATOMIC_RELAXED)) <
+         scan->len) {
+    struct classindex_scan_jar *jar = &scan->jars[i];
+    if (stat(scan->paths[i], &jar->st) != 0 ||
+        !zip_open(&zip, scan->paths[i])) {
+      continue;
+    }
+
+    set_init(&seen, 16);
+    cap = 16;
+    jar->packages = calloc(cap, sizeof(char *));
+    pos = 0;
+    while (zip_next(&zip, &pos, &entry)) {
+      const char *slash;
+      char *name;
+
+      if (entry.name_len <= 6 ||
+          memcmp(entry.name + entry.name_len - 6, ".class", 6) != 0 ||
+          (entry.name_len > 9 && memcmp(entry.name, "META-INF/", 9) == 0)) {
+        continue;
+      }
+      for (slash = entry.name + entry.name_len - 1;
+           slash > entry.name && *slash != '/'; slash--) {
+      }
+      if (slash == entry.name) {
+        continue;
+      }
+
+      // entries of a package mostly follow each other
+      if (jar->len > 0 &&
+          strlen(jar->packages[jar->len - 1]) == (size_t)(slash - entry.name) &&
+          memcmp(jar->packages[jar->len - 1], entry.name,
+                 slash - entry.name) == 0) {
+        continue;
+      }
+      name = strndup(entry.name, slash - entry.name);
+      if (!set_add(&seen, name)) {
+        free(name);
+        continue;
+      }
+      if (jar->len == cap) {
+        cap *= 2;
+        jar->packages = realloc(jar->packages, cap * sizeof(char *));
+      }
+      jar->packages[jar->len++] = name;
+    }
+    set_free(&seen);
+    zip_close(&zip);
+  }
+  return NULL;
+}
+
+// FNV-1a, IndexClassLoader hashes the same way
+uint32_t classindex_hash(const char *s, size_t len) {
+  uint32_t h = 0x811c9dc5U;
+
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 0x01000193U;
+  }
+  return h;
+}
+
+// WHICH
+// `yajava which-class`: the class path a launch passes in java.class.path,
+// -cp with its wildcards expanded or the -jar with its Class-Path, indexed
+// from the central directories of its jars on a few threads, and the
+// packages of the runtime from its jimage. A package of a runtime module
+// is never loaded from the class path. Class names are answered with the
+// entry providing them and the entries they shadow; without names the
+// duplicate classes, split packages and entries which contribute nothing
+// are reported.
+yj_result yj_which_class(struct yj_java_runtime *runtime,
+                         struct yj_run_args *args, char **names, int len,
+                         int *exit_code) {
+  struct which_index wi;
+  long start = time_now_us();
+  bool found = true;
+
+  if (runtime == NULL || args == NULL || exit_code == NULL) {
+    return YJ_ERR_NULL;
+  }
+  *exit_code = 1;
+  if (!which_build(runtime, args, &wi)) {
+    which_free(&wi);
+    return YJ_ERR_NO_FILE;
+  }
+  fprintf(stderr, "%zu classes in %zu class path entries, indexed in %.1fms\n",
+          wi.unique, wi.entries_len, (time_now_us() - start) / 1000.0);
+
+  if (len == 0) {
+    which_report(&wi);
+  }
+  for (int i = 0; i < len; i++) {
+    which_answer(&wi, names[i], &found);
+  }
+  *exit_code = found ? 0 : 1;
+  which_free(&wi);
+  return YJ_OK;
+}
+
+// the entries of java.class.path, as arg_build_java_opts passes them
+void which_class_path(struct yj_run_args *args, struct which_index *wi) {
+  char *cp = NULL, *save = NULL, *path;
+  size_t cap = 2;
+
+  if (args->app_jar != NULL) {
+    jar_read_manifest(args);
+    if (args->manifest != NULL) {
+      cp = jar_expand_class_path(args->app_jar, args->manifest->class_path);
+    }
+    cp = cp == NULL ? strdup(args->app_jar) : cp;
+    for (char *p = cp; *p != '\0'; p++) {
+      cap += *p == CLASSPATH_SEPRATOR[0];
+    }
+    wi->entries = calloc(cap, sizeof(struct which_entry));
+    for (path = strtok_r(cp, CLASSPATH_SEPRATOR, &save); path != NULL;
+         path = strtok_r(NULL, CLASSPATH_SEPRATOR, &save)) {
+      wi->entries[wi->entries_len++].path = strdup(path);
+    }
+    free(cp);
+    return;
+  }
+
+  wi->entries = calloc(args->classpathes_len + 1, sizeof(struct which_entry));
+  for (int i = 0; i < args->classpathes_len; i++) {
+    if (args->classpathes[i] == NULL || args->classpathes[i][0] == '\0') {
+      break;
+    }
+    wi->entries[wi->entries_len++].path = strdup(args->classpathes[i]);
+  }
+  // the default of the vm
+  if (wi->entries_len == 0) {
+    wi->entries[wi->entries_len++].path = strdup(".");
+  }
+}
+
+// the entries are scanned in parallel and merged in class path order, the
+// first entry with a class provides it
+bool which_build(struct yj_java_runtime *runtime, struct yj_run_args *args,
+                 struct which_index *wi) {
+  pthread_t threads[WHICH_THREADS];
+  size_t threads_len = 0, total = 0;
+  char path[PATH_MAX];
+
+  memset(wi, 0, sizeof(struct which_index));
+  which_class_path(args, wi);
+  for (; threads_len < WHICH_THREADS && threads_len + 1 < wi->entries_len;
+       threads_len++) {
+    if (pthread_create(&threads[threads_len], NULL, which_thread, wi) != 0) {
+      break;
+    }
+  }
+  which_thread(wi);
+  for (size_t i = 0; i < threads_len; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  snprintf(path, sizeof(path), "%s%clib%cmodules", runtime->home,
+           FILE_PATH_SEPRATOR, FILE_PATH_SEPRATOR);
+  if (runtime->major_version >= 9 && !jimage_open(&wi->image, path)) {
+    TRACE("no jimage of the runtime: %s", path);
+  }
+
+  for (size_t i = 0; i < wi->entries_len; i++) {
+    total += wi->entries[i].len;
+  }
+  wi->slots_len = 16;
+  while (wi->slots_len < total * 2) {
+    wi->slots_len *= 2;
+  }
+  wi->package_slots_len = wi->slots_len;
+  wi->slots = calloc(wi->slots_len, sizeof(uint32_t));
+  wi->package_slots = calloc(wi->package_slots_len, sizeof(uint32_t));
+  wi->classes = calloc(total + 1, sizeof(struct which_class));
+  wi->packages = calloc(total + 1, sizeof(struct which_package));
+
+  for (size_t i = 0; i < wi->entries_len; i++) {
+    struct which_entry *entry = &wi->entries[i];
+
+    for (size_t j = 0; j < entry->len; j++) {
+      const char *name = entry->classes[j], *slash = strrchr(name, '/');
+      size_t mask = wi->slots_len - 1, k;
+      struct which_package *pkg;
+      struct which_class *c, *first;
+
+      k = plan_hash(0xcbf29ce484222325ULL, name, strlen(name)) & mask;
+      while (wi->slots[k] != 0 &&
+             strcmp(wi->classes[wi->slots[k] - 1].name, name) != 0) {
+        k = (k + 1) & mask;
+      }
+      first = wi->slots[k] == 0 ? NULL : &wi->classes[wi->slots[k] - 1];
+      // twice in one jar
+      if (first != NULL && wi->classes[first->last].entry == i) {
+        continue;
+      }
+
+      pkg = which_package(wi, name, slash == NULL ? 0 : slash - name);
+      if (pkg->len == 0 || pkg->entries[pkg->len - 1] != i) {
+        if ((pkg->len & (pkg->len - 1)) == 0) {
+          size_t cap = pkg->len == 0 ? 1 : pkg->len * 2;
+          pkg->entries = realloc(pkg->entries, cap * sizeof(uint32_t));
+        }
+        pkg->entries[pkg->len++] = i;
+      }
+      pkg->classes++;
+
+      c = &wi->classes[wi->classes_len];
+      c->name = name;
+      c->entry = i;
+      c->module = pkg->module;
+      c->last = wi->classes_len;
+      if (first == NULL) {
+        wi->slots[k] = ++wi->classes_len;
+        wi->unique++;
+        entry->provided += c->module == NULL;
+      } else {
+        c->shadowed = true;
+        wi->classes[first->last].next = ++wi->classes_len;
+        first->last = c->last;
+      }
+    }
+  }
+  return true;
+}
+
+struct which_package *which_package(struct which_index *wi,
+                                    const char *name, size_t len) {
+  size_t mask = wi->package_slots_len - 1, k;
+  struct which_package *pkg;
+
+  k = plan_hash(0xcbf29ce484222325ULL, name, len) & mask;
+  while (wi->package_slots[k] != 0) {
+    pkg = &wi->packages[wi->package_slots[k] - 1];
+    if (strncmp(pkg->name, name, len) == 0 && pkg->name[len] == '\0') {
+      return pkg;
+    }
+    k = (k + 1) & mask;
+  }
+
+  pkg = &wi->packages[wi->packages_len];
+  pkg->name = strndup(name, len);
+  if (len > 0) {
+    pkg->module = jimage_package_module(&wi->image, pkg->name);
+  }
+  wi->package_slots[k] = ++wi->packages_len;
+  return pkg;
+}
+
+uint32_t which_find(struct which_index *wi, const char *name) {
+  size_t mask = wi->slots_len - 1, k;
+
+  k = plan_hash(0xcbf29ce484222325ULL, name, strlen(name)) & mask;
+  while (wi->slots[k] != 0) {
+    if (strcmp(wi->classes[wi->slots[k] - 1].name, name) == 0) {
+      return wi->slots[k];
+    }
+    k = (k + 1) & mask;
+  }
+  return 0;
+}
+
+void *which_thread(void *data) {
+  struct which_index *wi = data;
+  char path[PATH_MAX];
+  size_t i, cap;
+
+  while ((i = __atomic_fetch_add(&wi->next, 1, __ATOMIC_RELAXED)) <
+         wi->entries_len) {
+    struct which_entry *entry = &wi->entries[i];
+
+    if (file_is_dir(entry->path)) {
+      size_t len = snprintf(path, sizeof(path), "%s", entry->path);
+
+      entry->found = true;
+      cap = 0;
+      while (len > 1 && path[len - 1] == FILE_PATH_SEPRATOR) {
+        path[--len] = '\0';
+      }
+      which_scan_dir(entry, path, len + 1, &cap);
+    } else {
+      which_scan_jar(entry);
+    }
+  }
+  return NULL;
+}
+
+// classes outside META-INF, versioned entries of multi-release jars are
+// left out as the class index leaves them out
+void which_scan_jar(struct which_entry *entry) {
+  struct zip_entry ze;
+  struct zip zip;
+  size_t pos = 0, cap = 0;
+
+  entry->found = file_exists(entry->path);
+  if (!zip_open(&zip, entry->path)) {
+    return;
+  }
+  while (zip_next(&zip, &pos, &ze)) {
+    if (ze.name_len > 6 &&
+        memcmp(ze.name + ze.name_len - 6, ".class", 6) == 0 &&
+        (ze.name_len < 9 || memcmp(ze.name, "META-INF/", 9) != 0)) {
+      which_add_class(entry, ze.name, ze.name_len - 6, &cap);
+    } else if (which_is_resource(ze.name, ze.name_len)) {
+      entry->resources++;
+    }
+  }
+  zip_close(&zip);
+}
+
+// path is the directory to scan, base where the class names start in it
+void which_scan_dir(struct which_entry *entry, char *path, size_t base,
+                    size_t *cap) {
+  size_t len = strlen(path);
+  struct dirent *dent;
+  struct stat st;
+  DIR *dir;
+
+  if ((dir = opendir(path)) == NULL) {
+    return;
+  }
+  while ((dent = readdir(dir)) != NULL) {
+    size_t name_len = strlen(dent->d_name);
+
+    if (strcmp(dent->d_name, ".") == 0 || strcmp(dent->d_name, "..") == 0 ||
+        len + name_len + 2 > PATH_MAX) {
+      continue;
+    }
+    path[len] = FILE_PATH_SEPRATOR;
+    memcpy(path + len + 1, dent->d_name, name_len + 1);
+    if (stat(path, &st) != 0) {
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      if (len + 1 > base || strcmp(dent->d_name, "META-INF") != 0) {
+        which_scan_dir(entry, path, base, cap);
+      }
+    } else if (name_len > 6 &&
+               strcmp(dent->d_name + name_len - 6, ".class") == 0) {
+      which_add_class(entry, path + base, len + 1 + name_len - 6 - base, cap);
+    } else if (which_is_resource(path + base, strlen(path + base))) {
+      entry->resources++;
+    }
+  }
+  path[len] = '\0';
+  closedir(dir);
+}
+
+// what a jar adds besides classes: files outside META-INF, and the
+// services which ServiceLoader reads from every jar
+bool which_is_resource(const char *name, size_t len) {
+  return len > 0 && name[len - 1] != '/' &&
+         (len < 9 || memcmp(name, "META-INF/", 9) != 0 ||
+          (len > 18 && memcmp(name, "META-INF/services/", 18) == 0));
+}
+
+void which_add_class(struct which_entry *entry, const char *name, size_t len,
+                     size_t *cap) {
+  if (len == 11 && memcmp(name, "module-info", 11) == 0) {
+    return;
+  }
+  if (entry->len == *cap) {
+    *cap = *cap == 0 ? 64 : *cap * 2;
+    entry->classes = realloc(entry->classes, *cap * sizeof(char *));
+  }
+  entry->classes[entry->len++] = strndup(name, len);
+}
+
+void which_dotted(const char *name, char *out, size_t maxlen) {
+  snprintf(out, maxlen, "%s", name);
+  for (char *p = out; *p != '\0'; p++) {
+    *p = *p == '/' ? '.' : *p;
+  }
+}
+
+// com.example.Main, com/example/Main or com/example/Main.class
+void which_answer(struct which_index *wi, const char *query, bool *found) {
+  char name[WHICH_NAME_MAX], class_file[WHICH_NAME_MAX + 8];
+  struct jimage_location loc;
+  const char *module = NULL;
+  char *slash;
+  uint32_t c;
+  size_t len;
+
+  snprintf(name, sizeof(name), "%s", query);
+  len = strlen(name);
+  if (len > 6 && strcmp(name + len - 6, ".class") == 0) {
+    name[len - 6] = '\0';
+  }
+  if (strchr(name, '/') == NULL) {
+    for (char *p = name; *p != '\0'; p++) {
+      *p = *p == '.' ? '/' : *p;
+    }
+  }
+
+  c = which_find(wi, name);
+  if ((slash = strrchr(name, '/')) != NULL) {
+    *slash = '\0';
+    module = jimage_package_module(&wi->image, name);
+    *slash = '/';
+  }
+  snprintf(class_file, sizeof(class_file), "%s.class", name);
+
+  if (module != NULL && jimage_find_class(&wi->image, class_file, &loc)) {
+    printf("%s jrt:/%s\n", query, module);
+  } else if (module != NULL) {
+    printf("%s not found, its package is in module %s\n", query, module);
+    *found = false;
+  } else if (c != 0) {
+    printf("%s %s\n", query, wi->entries[wi->classes[c - 1].entry].path);
+    c = wi->classes[c - 1].next;
+  } else {
+    printf("%s not found\n", query);
+    *found = false;
+  }
+  for (; c != 0; c = wi->classes[c - 1].next) {
+    printf("  %s %s\n", module != NULL ? "not loaded from" : "shadows",
+           wi->entries[wi->classes[c - 1].entry].path);
+  }
+}
+
+void which_report(struct which_index *wi) {
+  size_t duplicates = 0, split = 0, unused = 0;
+  char name[WHICH_NAME_MAX];
 
-  assert(sys_cls != NULL);
-  assert(get_prop_m != NULL);
+  // duplicate classes, with the entry providing them
+  for (size_t i = 0; i < wi->classes_len; i++) {
+    struct which_class *c = &wi->classes[i];
 
-  jstring jkey = (*env)->NewStringUTF(env, key);
-  jstring jvalue =
-      (*env)->CallStaticObjectMethod(env, sys_cls, get_prop_m, jkey);
+    if (c->shadowed || c->next == 0 || c->module != NULL) {
+      continue;
+    }
+    which_dotted(c->name, name, sizeof(name));
+    printf("duplicate %s: %s, shadows", name, wi->entries[c->entry].path);
+    for (uint32_t n = c->next; n != 0; n = wi->classes[n - 1].next) {
+      printf(" %s", wi->entries[wi->classes[n - 1].entry].path);
+    }
+    printf("\n");
+    duplicates++;
+  }
 
-  char *value = NULL;
+  for (size_t i = 0; i < wi->packages_len; i++) {
+    struct which_package *pkg = &wi->packages[i];
 
-  if (jvalue != NULL) {
-    jvm_unwrap_str(env, jvalue, &value);
-    (*env)->DeleteLocalRef(env, jvalue);
+    which_dotted(pkg->name, name, sizeof(name));
+    if (pkg->module != NULL) {
+      for (uint32_t j = 0; j < pkg->len; j++) {
+        printf("shadowed package %s of %s: in module %s of the runtime\n",
+               name, wi->entries[pkg->entries[j]].path, pkg->module);
+      }
+    } else if (pkg->len > 1) {
+      printf("split package %s:", name);
+      for (uint32_t j = 0; j < pkg->len; j++) {
+        printf(" %s", wi->entries[pkg->entries[j]].path);
+      }
+      printf("\n");
+      split++;
+    }
   }
-  (*env)->DeleteLocalRef(env, jkey);
 
-  return value;
-}
+  for (size_t i = 0; i < wi->entries_len; i++) {
+    struct which_entry *entry = &wi->entries[i];
 
-bool jvm_retrive_version(JNIEnv *env, char **out) {
-  char *version_str = jvm_get_sys_props(env, "java.version");
-  if (version_str == NULL) {
-    return false;
+    if (!entry->found) {
+      printf("not found %s\n", entry->path);
+    } else if (entry->provided == 0 && entry->resources == 0) {
+      printf("unused %s: %s\n", entry->path,
+             entry->len == 0 ? "no classes or resources"
+                             : "every class is shadowed");
+      unused++;
+    }
   }
-  *out = version_str;
-  return true;
+  fflush(stdout);
+  fprintf(stderr, "%zu duplicate classes, %zu split packages, %zu unused "
+                  "entries\n",
+          duplicates, split, unused);
 }
 
-int jvm_runtime_compare(const void *a, const void *b) {
-  if (a == NULL) {
-    return -1;
+void which_free(struct which_index *wi) {
+  for (size_t i = 0; i < wi->entries_len; i++) {
+    for (size_t j = 0; j < wi->entries[i].len; j++) {
+      free(wi->entries[i].classes[j]);
+    }
+    free(wi->entries[i].classes);
+    free(wi->entries[i].path);
   }
-
-  if (b == NULL) {
-    return 1;
+  for (size_t i = 0; i < wi->packages_len; i++) {
+    free(wi->packages[i].name);
+    free(wi->packages[i].entries);
   }
+  SAFE_FREE(wi->entries);
+  SAFE_FREE(wi->classes);
+  SAFE_FREE(wi->slots);
+  SAFE_FREE(wi->packages);
+  SAFE_FREE(wi->package_slots);
+  jimage_close(&wi->image);
+  wi->entries_len = 0;
+  wi->packages_len = 0;
+}
 
-  const struct yj_java_runtime *r1 = a;
-  const struct yj_java_runtime *r2 = b;
+// CACHE
+// per-user cache directory, $YAJAVA_CACHE_DIR > $XDG_CACHE_HOME > ~/.cache
+bool cache_path(const char *name, char *out, size_t maxlen, bool create) {
+  char dir[PATH_MAX] = {0};
+  char *env;
+
+  if ((env = getenv("YAJAVA_CACHE_DIR")) != NULL && strlen(env) > 0) {
+    snprintf(dir, PATH_MAX, "%s", env);
+  } else if ((env = getenv("XDG_CACHE_HOME")) != NULL && strlen(env) > 0) {
+    snprintf(dir, PATH_MAX, "%s%c%s", env, FILE_PATH_SEPRATOR,
+             CACHE_DIR_NAME);
+  } else if ((env = getenv("HOME")) != NULL && strlen(env) > 0) {
+    snprintf(dir, PATH_MAX, "%s%c.cache%c%s", env, FILE_PATH_SEPRATOR,
+             FILE_PATH_SEPRATOR, CACHE_DIR_NAME);
+  } else {
+    return false;
+  }
 
-  // compare major version
-  int m1 = r1->major_version;
-  int m2 = r2->major_version;
+  if (name == NULL) {
+    if (snprintf(out, maxlen, "%s", dir) >= (int)maxlen) {
+      return false;
+    }
+  } else if (snprintf(out, maxlen, "%s%c%s", dir, FILE_PATH_SEPRATOR, name) >=
+             (int)maxlen) {
+    return false;
+  }
 
-  if (m1 == m2) {
-    return strcmp(r1->full_version, r2->full_version);
+  // the name may live in a sub directory, e.g. plans/<key>
+  if (create) {
+    char parent[PATH_MAX] = {0};
+    char *slash;
+    snprintf(parent, PATH_MAX, "%s", out);
+    if (name != NULL && (slash = strrchr(parent, FILE_PATH_SEPRATOR)) != NULL) {
+      *slash = '\0';
+    }
+    return file_mkdirs(parent, 0755);
   }
+  return true;
+}
 
-  return m1 - m2;
+// MISC
+long time_now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-bool jvm_opt_arr_add(struct jvm_opt_arr *arr, char *opt, char *extra) {
+long time_now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-  if (arr == NULL || opt == NULL) {
-    return false;
-  }
+// wall clock, for what outlives the process
+long time_epoch_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-  if (arr->maxlen <= arr->len) {
-    arr->maxlen += 5;
-    arr->opts = realloc(arr->opts, arr->maxlen * sizeof(JavaVMOption));
+bool str_icontains(const char *s, const char *sub) {
+  size_t len = strlen(sub);
+  for (; *s != '\0'; s++) {
+    if (strncasecmp(s, sub, len) == 0) {
+      return true;
+    }
   }
+  return len == 0;
+}
 
-  JavaVMOption *o = &arr->opts[arr->len++];
-  o->optionString = opt;
-  o->extraInfo = extra;
+long env_long(const char *name, long def) {
+  char *v = getenv(name), *end = NULL;
+  long n;
 
-  return true;
+  if (v == NULL || strlen(v) == 0) {
+    return def;
+  }
+  n = strtol(v, &end, 10);
+  return (end == NULL || *end != '\0') ? def : n;
 }
 
 // FILE
@@ -1055,33 +9544,21 @@ bool file_exists(const char *path) {
   return true;
 }
 
-bool file_abs(struct dirent *dir, const char *base, char *out, size_t maxlen) {
-
-  char path[PATH_MAX] = {0};
-  char tmp_path[PATH_MAX] = {0};
-  size_t path_len = 0;
-  snprintf(path, PATH_MAX, "%s%c%s", base, FILE_PATH_SEPRATOR, dir->d_name);
-
-  TRACE("orig: %s", path);
+bool file_is_dir(const char *path) {
 
-  memcpy(tmp_path, path, PATH_MAX);
-  if (realpath(tmp_path, path) == NULL) {
+  struct stat st;
+  if (path == NULL) {
     return false;
   }
-  TRACE("abs: %s", path);
 
-  path_len = strlen(path);
-  if (maxlen < path_len) {
+  if (stat(path, &st) != 0) {
     return false;
   }
 
-  memcpy(out, path, path_len);
-  out[path_len] = '\0';
-  return true;
+  return S_ISDIR(st.st_mode);
 }
 
-bool file_is_dir(const char *path) {
-
+bool file_is_file(const char *path) {
   struct stat st;
   if (path == NULL) {
     return false;
@@ -1091,20 +9568,165 @@ bool file_is_dir(const char *path) {
     return false;
   }
 
-  return S_ISDIR(st.st_mode);
+  return S_ISREG(st.st_mode);
 }
 
-bool file_is_file(const char *path) {
+// the modification time in nanoseconds since the epoch
+int64_t stat_mtime_ns(const struct stat *st) {
+#ifdef __APPLE__
+  return (int64_t)st->st_mtimespec.tv_sec * 1000000000 +
+         st->st_mtimespec.tv_nsec;
+#else
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+char *file_read_all(const char *path, size_t maxlen, size_t *out_len) {
   struct stat st;
-  if (path == NULL) {
+  char *buf;
+  ssize_t n;
+  int fd;
+
+  if (path == NULL || (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return NULL;
+  }
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      (size_t)st.st_size > maxlen) {
+    close(fd);
+    return NULL;
+  }
+
+  buf = malloc(st.st_size + 1);
+  n = read(fd, buf, st.st_size);
+  close(fd);
+
+  if (n < 0) {
+    free(buf);
+    return NULL;
+  }
+  buf[n] = '\0';
+  if (out_len != NULL) {
+    *out_len = n;
+  }
+  return buf;
+}
+
+bool file_write_all(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool file_mkdirs(const char *path, mode_t mode) {
+  char buf[PATH_MAX] = {0};
+  size_t len = strlen(path);
+
+  if (len == 0 || len >= PATH_MAX) {
     return false;
   }
+  memcpy(buf, path, len);
 
-  if (stat(path, &st) != 0) {
+  for (char *p = buf + 1; *p != '\0'; p++) {
+    if (*p == FILE_PATH_SEPRATOR) {
+      *p = '\0';
+      if (mkdir(buf, mode) != 0 && errno != EEXIST) {
+        return false;
+      }
+      *p = FILE_PATH_SEPRATOR;
+    }
+  }
+  return mkdir(buf, mode) == 0 || errno == EEXIST;
+}
+
+// a directory and what is in it, symbolic links are removed, not followed
+bool file_remove_tree(const char *path) {
+  char child[PATH_MAX];
+  struct dirent *entry;
+  struct stat st;
+  bool ok = true;
+  DIR *dir;
+
+  if (lstat(path, &st) != 0) {
+    return false;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    return unlink(path) == 0;
+  }
+  if ((dir = opendir(path)) == NULL) {
     return false;
   }
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    if (snprintf(child, PATH_MAX, "%s%c%s", path, FILE_PATH_SEPRATOR,
+                 entry->d_name) >= PATH_MAX) {
+      ok = false;
+      continue;
+    }
+    ok = file_remove_tree(child) && ok;
+  }
+  closedir(dir);
+  return rmdir(path) == 0 && ok;
+}
 
-  return S_ISREG(st.st_mode);
+// ARENA
+// The strings and arrays of parsed arguments, in a block sized from the
+// command line. Wildcards of the class path may add chunks, arena_free
+// releases all of them.
+struct yj_arena *arena_new(size_t cap) {
+  struct yj_arena *arena = malloc(sizeof(struct yj_arena) + cap);
+
+  if (arena != NULL) {
+    arena->next = NULL;
+    arena->len = 0;
+    arena->cap = cap;
+  }
+  return arena;
+}
+
+void *arena_alloc(struct yj_arena **arena, size_t size) {
+  struct yj_arena *chunk = *arena;
+  void *p;
+
+  size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  if (chunk == NULL || chunk->len + size > chunk->cap) {
+    size_t cap = chunk == NULL ? ARENA_MIN : chunk->cap * 2;
+    if ((chunk = arena_new(cap > size ? cap : size)) == NULL) {
+      return NULL;
+    }
+    chunk->next = *arena;
+    *arena = chunk;
+  }
+  p = chunk->data + chunk->len;
+  chunk->len += size;
+  return p;
+}
+
+char *arena_strdup(struct yj_arena **arena, const char *s) {
+  size_t len = strlen(s) + 1;
+  char *copy = arena_alloc(arena, len);
+
+  if (copy != NULL) {
+    memcpy(copy, s, len);
+  }
+  return copy;
+}
+
+void arena_free(struct yj_arena *arena) {
+  while (arena != NULL) {
+    struct yj_arena *next = arena->next;
+    free(arena);
+    arena = next;
+  }
 }
 
 // LIST
@@ -1187,6 +9809,52 @@ bool list_compare_str(void *list_data, void *user_data) {
   return strcmp(list_data, user_data) == 0;
 }
 
+// SET
+// open addressing set of strings, the strings are not copied
+void set_init(struct set *set, size_t hint) {
+  set->len = 0;
+  set->cap = 16;
+  while (set->cap < hint * 2) {
+    set->cap *= 2;
+  }
+  set->slots = calloc(set->cap, sizeof(char *));
+}
+
+void set_free(struct set *set) {
+  SAFE_FREE(set->slots);
+  set->len = 0;
+  set->cap = 0;
+}
+
+bool set_add(struct set *set, const char *s) {
+  size_t mask, i;
+
+  // below half full
+  if ((set->len + 1) * 2 > set->cap) {
+    struct set grown;
+    set_init(&grown, set->len + 1);
+    for (size_t j = 0; j < set->cap; j++) {
+      if (set->slots[j] != NULL) {
+        set_add(&grown, set->slots[j]);
+      }
+    }
+    free(set->slots);
+    *set = grown;
+  }
+
+  mask = set->cap - 1;
+  i = plan_hash(0xcbf29ce484222325ULL, s, strlen(s)) & mask;
+  while (set->slots[i] != NULL) {
+    if (strcmp(set->slots[i], s) == 0) {
+      return false;
+    }
+    i = (i + 1) & mask;
+  }
+  set->slots[i] = s;
+  set->len++;
+  return true;
+}
+
 // ARG
 // parsing arguments
 bool arg_match_any(char *s, ...) {
@@ -1224,6 +9892,294 @@ bool arg_match_start(char *s, char *start) {
   return strncmp(s, start, strlen(start)) == 0;
 }
 
+// like java: a .java file, or any file with --source. A script starting
+// with #! is one too, `#!/usr/bin/env yajava` passes no --source.
+bool arg_is_source(struct yj_run_args *args, const char *arg) {
+  size_t len = strlen(arg);
+  char head[2];
+  bool script;
+  int fd;
+
+  if (args->source_release != NULL) {
+    return true;
+  }
+  if (len > 5 && strcmp(arg + len - 5, ".java") == 0 && file_is_file(arg)) {
+    return true;
+  }
+  if (strchr(arg, FILE_PATH_SEPRATOR) == NULL ||
+      (fd = open(arg, O_RDONLY | O_CLOEXEC)) < 0) {
+    return false;
+  }
+  script = read(fd, head, 2) == 2 && head[0] == '#' && head[1] == '!';
+  close(fd);
+  return script;
+}
+
+// the options of the stock launcher and of yajava, found by a perfect hash
+// of their names in arg_slots. test/test_arg.c checks the slots and prints
+// new ones, with a seed, when an option is added.
+// clang-format off
+#define ARG_OPT(name, kind, flags, field, len_field, value)                    \
+  {name, sizeof(name) - 1, kind, flags, offsetof(struct yj_run_args, field),  \
+   offsetof(struct yj_run_args, len_field), value}
+#define ARG_FLAG(name, field) ARG_OPT(name, ARG_BOOL, 0, field, field, 0)
+#define ARG_PRINT(name, field, value)                                          \
+  ARG_OPT(name, ARG_SET, 0, field, field, value)
+#define ARG_APP(name, field)                                                   \
+  ARG_OPT(name, ARG_STR, ARG_F_VALUE | ARG_F_TERMINAL, field, field, 0)
+#define ARG_CP(name)                                                           \
+  ARG_OPT(name, ARG_CLASSPATH, ARG_F_VALUE, classpathes, classpathes_len, 0)
+#define ARG_DESC(name)                                                         \
+  ARG_OPT(name, ARG_DESCRIBE, ARG_F_VALUE, module_name, module_name, 0)
+#define ARG_LIST_OF(name, flags, field)                                        \
+  ARG_OPT(name, ARG_LIST, flags, field, field##_len, 0)
+#define ARG_VM(name, kind, flags)                                              \
+  ARG_OPT(name, kind, flags, vmopts, vmopts_len, 0)
+static const struct arg_opt arg_opts[] = {
+    ARG_APP("-jar", app_jar),
+    ARG_APP("-m", app_module),
+    ARG_APP("--module", app_module),
+    ARG_CP("-cp"),
+    ARG_CP("-classpath"),
+    ARG_CP("--class-path"),
+    ARG_CP("--classpath"),
+    ARG_LIST_OF("-p", ARG_F_VALUE, module_pathes),
+    ARG_LIST_OF("--module-path", ARG_F_VALUE, module_pathes),
+    ARG_LIST_OF("--upgrade-module-path", ARG_F_VALUE, upgrade_module_pathes),
+    ARG_LIST_OF("--add-modules", ARG_F_VALUE, add_modules),
+    ARG_LIST_OF("--enable-native-access", ARG_F_VALUE, native_access_modules),
+    ARG_VM("--limit-modules", ARG_VM_LONG, ARG_F_VALUE),
+    ARG_VM("--add-exports", ARG_VM_LONG, ARG_F_VALUE),
+    ARG_VM("--add-opens", ARG_VM_LONG, ARG_F_VALUE),
+    ARG_VM("--add-reads", ARG_VM_LONG, ARG_F_VALUE),
+    ARG_VM("--patch-module", ARG_VM_LONG, ARG_F_VALUE),
+    ARG_VM("--illegal-access", ARG_VM_LONG, ARG_F_VALUE),
+    ARG_FLAG("--list-modules", list_modules),
+    ARG_FLAG("--validate-modules", validate_modules),
+    ARG_DESC("-d"),
+    ARG_DESC("--describe-module"),
+    ARG_FLAG("--show-module-resolution", show_module_resolution),
+    ARG_LIST_OF("-agentlib", ARG_F_SUFFIX, agentlibs),
+    ARG_LIST_OF("-agentpath", ARG_F_SUFFIX, agentpathes),
+    ARG_LIST_OF("-javaagent", ARG_F_SUFFIX, javagents),
+    ARG_OPT("-splash", ARG_STR, ARG_F_SUFFIX, splash, splash, 0),
+    ARG_VM("-verbose", ARG_VERBOSE, ARG_F_SUFFIX),
+    ARG_VM("-ea", ARG_VM_OPT, ARG_F_SUFFIX),
+    ARG_VM("-enableassertions", ARG_VM_OPT, ARG_F_SUFFIX),
+    ARG_VM("-da", ARG_VM_OPT, ARG_F_SUFFIX),
+    ARG_VM("-disableassertions", ARG_VM_OPT, ARG_F_SUFFIX),
+    ARG_VM("-esa", ARG_VM_OPT, 0),
+    ARG_VM("-enablesystemassertions", ARG_VM_OPT, 0),
+    ARG_VM("-dsa", ARG_VM_OPT, 0),
+    ARG_VM("-disablesystemassertions", ARG_VM_OPT, 0),
+    ARG_VM("-client", ARG_IGNORE, 0),
+    ARG_VM("-server", ARG_IGNORE, 0),
+    ARG_VM("-d64", ARG_IGNORE, 0),
+    ARG_VM("--disable-@files", ARG_IGNORE, 0),
+    ARG_PRINT("-?", print_help, YA_PRINT_HELP | YA_PRINT_ERR),
+    ARG_PRINT("-h", print_help, YA_PRINT_HELP | YA_PRINT_ERR),
+    ARG_PRINT("-help", print_help, YA_PRINT_HELP | YA_PRINT_ERR),
+    ARG_PRINT("--help", print_help, YA_PRINT_HELP | YA_PRINT_OUT),
+    ARG_PRINT("-X", print_help, YA_PRINT_HELP | YA_PRINT_ERR),
+    ARG_PRINT("--help-extra", print_help, YA_PRINT_HELP | YA_PRINT_OUT),
+    ARG_PRINT("-version", print_version, YA_PRINT_VERSION | YA_PRINT_ERR),
+    ARG_PRINT("--version", print_version, YA_PRINT_VERSION | YA_PRINT_OUT),
+    ARG_PRINT("-showversion", print_version,
+              YA_PRINT_VERSION | YA_PRINT_ERR | YA_PRINT_CONTINUE),
+    ARG_PRINT("--show-version", print_version,
+              YA_PRINT_VERSION | YA_PRINT_OUT | YA_PRINT_CONTINUE),
+    ARG_FLAG("--dry-run", dry_run),
+    ARG_FLAG("--in-process", in_process),
+    ARG_FLAG("--metrics", print_metrics),
+    ARG_FLAG("--plan-stats", plan_stats),
+    ARG_FLAG("--auto-archive", auto_archive),
+    ARG_FLAG("--prefetch-stats", prefetch_stats),
+    ARG_FLAG("--preload", preload),
+    ARG_FLAG("--preload-stats", preload_stats),
+    ARG_FLAG("--class-index", class_index_loader),
+    ARG_OPT("--source", ARG_STR, ARG_F_VALUE, source_release, source_release,
+            0),
+};
+// clang-format on
+#undef ARG_OPT
+#undef ARG_FLAG
+#undef ARG_PRINT
+#undef ARG_APP
+#undef ARG_CP
+#undef ARG_DESC
+#undef ARG_LIST_OF
+#undef ARG_VM
+
+// slot of an option name, the index of arg_opts + 1
+static const unsigned char arg_slots[ARG_SLOTS] = {
+     0, 50, 37, 59,  0,  0,  0,  0,  0,  0,  0,  0, 36,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0, 55,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0, 23,  0,  0,  0, 42,  0,  0,  0,  0,  0,
+     0,  0,  0, 49,  0,  0,  0,  0,  0,  0,  4, 34,  0, 26, 29, 44,
+     0,  0, 54,  0, 53,  0,  0, 56,  0,  0, 25,  0,  0, 20,  0,  0,
+     0,  0, 22,  0, 27,  0,  0, 28,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0, 46, 16,  0,  0,  0,  0,  0,  0, 58,  0,  0, 15,  0,  0,
+     0,  0,  0,  6, 52,  0,  0,  0,  0, 12,  0,  0,  0,  0,  0, 51,
+     0, 11, 38,  0,  0,  0, 19,  0, 10, 30,  0, 13,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0, 40,  0,  9,  0,  0, 43,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0, 35,  0,  0,  3,  0,  0,  1,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 45,  0,  0,  0, 33, 39,
+     0,  0,  8,  0, 48,  0,  0,  0,  0,  7,  0, 18,  0,  0,  0,  0,
+     0, 57,  0, 41,  0, 14,  0, 17,  0,  0,  0,  0,  0, 60,  0,  0,
+     0,  0, 32,  0,  5,  0, 21, 31,  0,  0,  0, 24,  0,  0, 47,  0,
+};
+
+uint32_t arg_hash(const char *s, size_t len, uint32_t seed) {
+  uint32_t h = seed;
+
+  // FNV-1a, the high half folded in
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 16777619U;
+  }
+  return h ^ (h >> 16);
+}
+
+const char *arg_opt_name(size_t i) {
+  return i < sizeof(arg_opts) / sizeof(struct arg_opt) ? arg_opts[i].name
+                                                        : NULL;
+}
+
+const struct arg_opt *arg_lookup(const char *name, size_t len) {
+  uint32_t h = arg_hash(name, len, ARG_SEED);
+  unsigned char slot = arg_slots[h & (ARG_SLOTS - 1)];
+  const struct arg_opt *opt;
+
+  if (slot == 0) {
+    return NULL;
+  }
+  opt = &arg_opts[slot - 1];
+  return opt->len == len && memcmp(opt->name, name, len) == 0 ? opt : NULL;
+}
+
+// arrays in the arena grow by doubling, at ARG_LIST_MIN, twice that...
+void arg_list_add(struct yj_run_args *args, char ***list, int *len, char *s) {
+  int n = *len;
+
+  if (n == 0 || (n >= ARG_LIST_MIN && (n & (n - 1)) == 0)) {
+    int cap = n == 0 ? ARG_LIST_MIN : n * 2;
+    char **grown = arena_alloc(&args->arena, cap * sizeof(char *));
+    if (n > 0) {
+      memcpy(grown, *list, n * sizeof(char *));
+    }
+    *list = grown;
+  }
+  (*list)[(*len)++] = s;
+}
+
+// entries of a -cp value, wildcards expanded, duplicates within it dropped
+void arg_add_classpath(struct yj_run_args *args, const char *value) {
+  char *str = arena_strdup(&args->arena, value);
+  char *saveptr, *token;
+  struct set seen;
+
+  set_init(&seen, 16);
+  for (token = strtok_r(str, CLASSPATH_SEPRATOR, &saveptr); token != NULL;
+       token = strtok_r(NULL, CLASSPATH_SEPRATOR, &saveptr)) {
+    if (wildcard_is(token)) {
+      wildcard_expand(token, &seen, args);
+    } else if (set_add(&seen, token)) {
+      TRACE("add classpath: %s", token);
+      arg_list_add(args, &args->classpathes, &args->classpathes_len, token);
+    }
+  }
+  set_free(&seen);
+}
+
+// an option of cur_arg, its value is taken from the next argument or after
+// `=` of a long option. Options not known here are left to the vm, like the
+// stock launcher does.
+int arg_parse_option(struct arg_ctx *ctx) {
+  struct yj_run_args *args = ctx->args;
+  struct yj_arena **arena = &args->arena;
+  char *arg = ctx->cur_arg, *value = NULL, *field;
+  const struct arg_opt *opt = NULL;
+  size_t key_len;
+
+  // -D and -X options, the most of a long command line
+  if (arg[1] == 'D') {
+    arg_list_add(args, &args->sys_props, &args->sys_props_len,
+                 arena_strdup(arena, arg));
+    return YJ_OK;
+  } else if (arg[1] == 'X' && arg[2] != '\0') {
+    arg_list_add(args, &args->vmopts, &args->vmopts_len,
+                 arena_strdup(arena, arg));
+    return YJ_OK;
+  }
+
+  key_len = strcspn(arg, arg[1] == '-' ? "=" : ":");
+  if ((opt = arg_lookup(arg, key_len)) != NULL && arg[key_len] != '\0') {
+    if ((arg[key_len] == '=' && (opt->flags & ARG_F_VALUE)) ||
+        (arg[key_len] == ':' && (opt->flags & ARG_F_SUFFIX))) {
+      value = arg + key_len + 1;
+    } else {
+      opt = NULL;
+    }
+  }
+  if (opt == NULL) {
+    TRACE("option passed to the vm: %s", arg);
+    arg_list_add(args, &args->vmopts, &args->vmopts_len,
+                 arena_strdup(arena, arg));
+    return YJ_OK;
+  }
+  if (value == NULL && (opt->flags & ARG_F_VALUE)) {
+    if (!arg_has(ctx)) {
+      fprintf(stderr, "Error: %s requires a value\n", arg);
+      return YJ_ERR_ARGS;
+    }
+    value = arg_pop(ctx);
+  }
+
+  field = (char *)args + opt->field;
+  switch (opt->kind) {
+  case ARG_BOOL:
+    *(bool *)field = true;
+    break;
+  case ARG_SET:
+    *(int *)field = opt->value;
+    break;
+  case ARG_STR:
+    *(char **)field = value == NULL ? NULL : arena_strdup(arena, value);
+    break;
+  case ARG_LIST:
+    arg_list_add(args, (char ***)field, (int *)((char *)args + opt->len_field),
+                 arena_strdup(arena, opt->flags & ARG_F_SUFFIX ? arg : value));
+    break;
+  case ARG_CLASSPATH:
+    arg_add_classpath(args, value);
+    break;
+  case ARG_VM_LONG: {
+    char *opt_str = arena_alloc(arena, opt->len + strlen(value) + 2);
+    sprintf(opt_str, "%s=%s", opt->name, value);
+    arg_list_add(args, &args->vmopts, &args->vmopts_len, opt_str);
+    break;
+  }
+  case ARG_VERBOSE:
+    args->verbose_class |= value == NULL || strcmp(value, "class") == 0;
+    args->verbose_gc |= value != NULL && strcmp(value, "gc") == 0;
+    args->verbose_jni |= value != NULL && strcmp(value, "jni") == 0;
+    args->verbose_module |= value != NULL && strcmp(value, "module") == 0;
+    // fall through
+  case ARG_VM_OPT:
+    arg_list_add(args, &args->vmopts, &args->vmopts_len,
+                 arena_strdup(arena, arg));
+    break;
+  case ARG_DESCRIBE:
+    args->describe_module = true;
+    args->module_name = arena_strdup(arena, value);
+    break;
+  }
+
+  ctx->terminal = (opt->flags & ARG_F_TERMINAL) != 0;
+  return YJ_OK;
+}
+
 int arg_parse_classpathes(char *in, struct list *list) {
 
   if (in == NULL || list == NULL) {
@@ -1231,8 +10187,10 @@ int arg_parse_classpathes(char *in, struct list *list) {
   }
 
   char *to_free, *str, *saveptr, *token, *buf;
-  int i = 0;
-  int token_len = 0;
+  struct set seen;
+
+  set_init(&seen, list->len);
+  list_each(char *data, list, idx, { set_add(&seen, data); });
 
   to_free = str = strdup(in);
   while (true) {
@@ -1242,12 +10200,14 @@ int arg_parse_classpathes(char *in, struct list *list) {
       break;
 
     buf = strdup(token);
-    if (!list_contains(list, token, list_compare_str)) {
+    if (set_add(&seen, buf)) {
       list_add(list, buf);
+    } else {
+      free(buf);
     }
-    i++;
   }
 
+  set_free(&seen);
   free(to_free);
   return YJ_OK;
 }
@@ -1263,6 +10223,14 @@ bool arg_build_java_opts(struct yj_java_runtime *runtime,
   static const char format[] = "-Djava.class.path=%s";
   static const int format_len = 18;
 
+  // modular applications need a java 9 or later
+  if (args->app_module != NULL && runtime->major_version > 0 &&
+      runtime->major_version < 9) {
+    fprintf(stderr, "error: -m %s needs java 9 or later, java %s found\n",
+            args->app_module, runtime->full_version);
+    return false;
+  }
+
   struct jvm_opt_arr opts = {0};
 
   char *cp = NULL;
@@ -1275,44 +10243,68 @@ bool arg_build_java_opts(struct yj_java_runtime *runtime,
       return false;
     }
 
-    int jar_len = strlen(args->app_jar);
+    // with the Class-Path of the manifest, unless LauncherHelper reads it
+    const char *jar_cp = args->app_jar;
+    if (jar_read_manifest(args) && args->manifest->native) {
+      jar_cp = args->manifest->java_class_path;
+    }
+
+    int jar_len = strlen(jar_cp);
     cp_len = format_len + jar_len + 1;
     cp = malloc((cp_len) * sizeof(char));
-    snprintf(cp, cp_len, format, args->app_jar);
+    snprintf(cp, cp_len, format, jar_cp);
   } else if (args->classpathes != NULL && args->classpathes_len > 0) {
 
     // calculate the totoal classpath string's length
-    for (int i = 0; i < args->classpathes_len; i++) {
-      char *path = args->classpathes[i];
-      size_t path_len = strlen(path);
-      if (path == NULL || path_len == 0 || path_len > PATH_MAX) {
+    int len = 0;
+    for (; len < args->classpathes_len; len++) {
+      char *path = args->classpathes[len];
+      size_t path_len = path == NULL ? 0 : strlen(path);
+      if (path_len == 0 || path_len > PATH_MAX) {
         break;
       }
-
-      // check file exists
-      if (!file_exists(path)) {
-        printf("path not found: %s\n", path);
-        return false;
-      }
-
       cp_len += path_len + 1;
     }
 
-    cp = malloc((cp_len + format_len + 1) * sizeof(char));
+    // check files exist
+    if (!classpath_check(args->classpathes, len)) {
+      return false;
+    }
 
-    memcpy(cp, format, format_len * sizeof(char));
-    size_t pos = format_len;
-    for (int i = 0; i < args->classpathes_len; i++) {
-      char *path = args->classpathes[i];
-      size_t path_len = strlen(path);
-      if (path == NULL || path_len == 0 || path_len > PATH_MAX) {
-        break;
+    // a fresh pack of the class path stands in for it, long ones load
+    // through the class index, its loader last
+    char *packed = pack_lookup(args, len);
+    char loader[PATH_MAX] = {0};
+    if (packed != NULL) {
+      cp_len = format_len + strlen(packed) + 1;
+      cp = malloc(cp_len * sizeof(char));
+      snprintf(cp, cp_len, format, packed);
+      free(packed);
+    } else {
+      size_t loader_len = 0;
+      if (classindex_prepare(runtime, args, len, loader, PATH_MAX)) {
+        loader_len = strlen(loader);
+        cp_len += loader_len + 1;
+      }
+      cp = malloc((cp_len + format_len + 1) * sizeof(char));
+
+      memcpy(cp, format, format_len * sizeof(char));
+      size_t pos = format_len;
+      for (int i = 0; i < len; i++) {
+        char *path = args->classpathes[i];
+        size_t path_len = strlen(path);
+        if (i > 0) {
+          cp[pos++] = ':';
+        }
+        memcpy(cp + pos, path, path_len);
+        pos += path_len;
       }
-      if (i > 0) {
+      if (loader_len > 0) {
         cp[pos++] = ':';
+        memcpy(cp + pos, loader, loader_len);
+        pos += loader_len;
       }
-      memcpy(cp + pos, path, path_len);
-      pos += path_len;
+      cp[pos] = '\0';
     }
   }
 
@@ -1331,6 +10323,23 @@ bool arg_build_java_opts(struct yj_java_runtime *runtime,
     }
   }
 
+  if (args->class_index != NULL) {
+    jvm_opt_arr_add(&opts,
+                    strdup("-Djava.system.class.loader=" CLASSINDEX_LOADER),
+                    NULL);
+    size_t len = strlen(args->class_index) + 22;
+    char *prop = malloc(len);
+    snprintf(prop, len, "-Dyajava.class.index=%s", args->class_index);
+    jvm_opt_arr_add(&opts, prop, NULL);
+  }
+
+  // Add-Opens and Add-Exports of the manifest
+  if (args->manifest != NULL && args->manifest->native &&
+      runtime->major_version >= 9) {
+    jar_add_module_opts(args->manifest->add_opens, "--add-opens", &opts);
+    jar_add_module_opts(args->manifest->add_exports, "--add-exports", &opts);
+  }
+
   if (args->vmopts != NULL && args->vmopts_len) {
     for (int i = 0; i < args->vmopts_len; i++) {
       char *props = args->vmopts[i];
@@ -1342,6 +10351,40 @@ bool arg_build_java_opts(struct yj_java_runtime *runtime,
     }
   }
 
+  // module options, the vm takes them as --name=value. jdk.module.main is
+  // set as the stock launcher sets it, the vm then uses the module graph
+  // archived in CDS instead of resolving the modules on each launch.
+  if (args->app_module != NULL) {
+    size_t len = strcspn(args->app_module, "/");
+    char *prop = malloc(len + 19);
+    snprintf(prop, len + 19, "-Djdk.module.main=%.*s", (int)len,
+             args->app_module);
+    jvm_opt_arr_add(&opts, prop, NULL);
+  }
+  if (args->validate_modules) {
+    jvm_opt_arr_add(&opts, strdup("-Djdk.module.validation=true"), NULL);
+  }
+  arg_add_vm_opts(&opts, "--module-path", args->module_pathes,
+                  args->module_pathes_len);
+  arg_add_vm_opts(&opts, "--upgrade-module-path", args->upgrade_module_pathes,
+                  args->upgrade_module_pathes_len);
+  arg_add_vm_opts(&opts, "--add-modules", args->add_modules,
+                  args->add_modules_len);
+  arg_add_vm_opts(&opts, "--enable-native-access",
+                  args->native_access_modules, args->native_access_modules_len);
+
+  // agents as they were given
+  arg_add_vm_opts(&opts, NULL, args->agentlibs, args->agentlibs_len);
+  arg_add_vm_opts(&opts, NULL, args->agentpathes, args->agentpathes_len);
+  arg_add_vm_opts(&opts, NULL, args->javagents, args->javagents_len);
+
+  // metrics, archives and class lists, also when the application calls
+  // System.exit()
+  if (args->in_process && (args->print_metrics || args->archive != NULL ||
+                          args->preloader != NULL)) {
+    jvm_opt_arr_add(&opts, strdup("exit"), (void *)jvm_exit_hook);
+  }
+
   TRACE("build arg jni version: 0x%x", runtime->jni_version);
   out->nOptions = opts.len;
   out->options = opts.opts;
@@ -1353,26 +10396,57 @@ bool arg_build_java_opts(struct yj_java_runtime *runtime,
   return true;
 }
 
-inline bool arg_is_long(char *arg) {
-  return strlen(arg) > 2 && arg[0] == '-' && arg[1] == '-';
+// name=value for each of the values, or the values as they are
+void arg_add_vm_opts(struct jvm_opt_arr *opts, const char *name, char **values,
+                     int len) {
+  for (int i = 0; i < len; i++) {
+    size_t opt_len = SAFE_STRLEN(name) + strlen(values[i]) + 2;
+    char *opt = malloc(opt_len);
+    if (name == NULL) {
+      memcpy(opt, values[i], opt_len - 1);
+    } else {
+      snprintf(opt, opt_len, "%s=%s", name, values[i]);
+    }
+    jvm_opt_arr_add(opts, opt, NULL);
+  }
 }
 
-inline char *arg_pop(struct arg_ctx *ctx) { return ctx->argv[ctx->consumed++]; }
+// 512k, 1m, 1g or plain bytes
+bool arg_parse_size(const char *s, size_t *out) {
+  char *end = NULL;
+  unsigned long long n = strtoull(s, &end, 10);
 
-inline void arg_back(struct arg_ctx *ctx) {
-  if (ctx->consumed > 0) {
-    ctx->consumed--;
+  if (end == s) {
+    return false;
+  }
+  switch (*end) {
+  case 'k':
+  case 'K':
+    n *= 1024;
+    end++;
+    break;
+  case 'm':
+  case 'M':
+    n *= 1024 * 1024;
+    end++;
+    break;
+  case 'g':
+  case 'G':
+    n *= 1024 * 1024 * 1024;
+    end++;
+    break;
+  }
+  if (*end != '\0') {
+    return false;
   }
+  *out = n;
+  return true;
 }
 
-inline char *arg_pop_value(struct arg_ctx *ctx) {
-  if (arg_is_long(ctx->cur_arg)) {
-    char *v = strchr(ctx->cur_arg, '=');
-    if (v != NULL) {
-      return v + 1;
-    }
-  }
-  return arg_pop(ctx);
+inline bool arg_is_long(char *arg) {
+  return strlen(arg) > 2 && arg[0] == '-' && arg[1] == '-';
 }
 
+inline char *arg_pop(struct arg_ctx *ctx) { return ctx->argv[ctx->consumed++]; }
+
 inline bool arg_has(struct arg_ctx *ctx) { return ctx->consumed < ctx->argc; }
@@ -16,12 +16,61 @@
 #define YA_PRINT_CONTINUE 0x04 // 00000100
 #define YA_PRINT_EXT 0x08      // 00001000
 
+// garbage collectors of a runtime, yj_java_runtime::gcs
+#define YJ_GC_SERIAL 0x01
+#define YJ_GC_PARALLEL 0x02
+#define YJ_GC_G1 0x04
+#define YJ_GC_CMS 0x08
+#define YJ_GC_ZGC 0x10
+#define YJ_GC_SHENANDOAH 0x20
+#define YJ_GC_EPSILON 0x40
+
+// vm features of a runtime, yj_java_runtime::features
+#define YJ_FEAT_CDS 0x01       // ships a default CDS archive
+#define YJ_FEAT_AOT_CACHE 0x02 // -XX:AOTCache, JEP 483
+#define YJ_FEAT_JFR 0x04       // flight recorder
+#define YJ_FEAT_NMT 0x08       // native memory tracking
+#define YJ_FEAT_OPENJ9 0x10    // an OpenJ9 vm instead of HotSpot
+
+// kinds of yj_archive_info
+#define YJ_ARCHIVE_CDS 1  // dynamic archive of an application
+#define YJ_ARCHIVE_BASE 2 // static archive shared by applications
+#define YJ_ARCHIVE_AOT 3  // AOT cache of an application
+
 typedef int yj_result;
 
+struct yj_plan;     // a cached launch plan, see yj_plan_load
+struct yj_archive;  // the CDS/AOT archive of a launch, see --auto-archive
+struct yj_prefetch; // page cache prefetch of a launch
+struct yj_preload;  // startup class list of a launch, see --preload
+struct yj_argfile;  // an @argfile the arguments of yj_cmdline point into
+struct yj_arena;    // the strings and arrays of yj_run_args
+
+// main attributes of the manifest of a -jar application
+struct yj_manifest {
+  char *main_class;
+  char *class_path; // Class-Path, space separated relative urls
+  char *add_opens;  // module/package ...
+  char *add_exports;
+  char *launcher_agent;
+  char *java_class_path; // the jar and Class-Path, for -Djava.class.path
+  bool native;           // the main class loads without LauncherHelper
+};
+
+// a command line with JDK_JAVA_OPTIONS and @argfiles expanded
+struct yj_cmdline {
+  int argc;
+  char **argv;
+  int maxlen;
+  struct yj_argfile *files;
+};
+
 struct yj_run_args {
   // parameters
   int classpathes_len;
   char **classpathes;
+  int wildcard_dirs_len; // directories of `dir/*` class path entries
+  char **wildcard_dirs;
   int module_pathes_len;
   char **module_pathes;
   int upgrade_module_pathes_len;
@@ -46,6 +95,8 @@ struct yj_run_args {
   char *app_module;
   char *app_jar;
   char *app_main_class;
+  char *app_source;     // a single-file source program, `yajava Foo.java`
+  char *source_release; // --source, the release it is compiled for
   int app_args_len;
   char **app_args;
 
@@ -55,6 +106,15 @@ struct yj_run_args {
   bool verbose_module;
   bool verbose_gc;
   bool verbose_jni;
+  bool in_process;     // create the vm in the launcher process
+  bool print_metrics;  // report process metrics on exit
+  bool plan_stats;     // report launch plan hit or miss
+  bool auto_archive;   // record and use a CDS/AOT archive of the application
+  bool prefetch_stats; // report page cache prefetch and vm creation time
+  bool packing;        // the recording run of yj_pack, class path as given
+  bool preload;        // load the startup classes on helper threads
+  bool preload_stats;  // report what the helpers loaded, implies preload
+  bool class_index_loader; // load the class path through a class index
 
   // actions
   bool list_modules;
@@ -67,6 +127,15 @@ struct yj_run_args {
   int print_version;
 
   bool print_module_resolution;
+
+  struct yj_plan *plan;         // launch plan of the command line, if enabled
+  struct yj_archive *archive;   // archive used or written by the launch
+  struct yj_prefetch *prefetch; // page cache prefetch, unless disabled
+  struct yj_preload *preloader; // class list of --preload
+  struct yj_manifest *manifest; // of app_jar, once read
+  char *pack;                   // pack index of the class path, see yj_pack
+  char *class_index;            // of a long class path, for the loader
+  struct yj_arena *arena;       // released by yj_free_run_args
 };
 
 struct yj_java_init_fn {
@@ -84,8 +153,58 @@ struct yj_java_runtime {
   int major_version;
   jint jni_version;
   char *full_version;
+  char *vendor;
+  char *arch;            // OS_ARCH, x86_64, aarch64...
+  unsigned int gcs;      // YJ_GC_*
+  unsigned int features; // YJ_FEAT_*
+  char *props;           // cached version properties, `key = value` lines
+};
+
+struct yj_discovery_root {
+  char *path;
+  size_t found;    // homes found under this root
+  long elapsed_us; // time spent scanning this root
+};
+
+struct yj_discovery {
+  struct yj_discovery_root *roots;
+  size_t roots_len;
+  int max_depth; // directory levels below each root
+};
+
+// a class path merged by yj_pack
+struct yj_pack_info {
+  char *path;     // the packed jar
+  int jars;       // jars merged into it
+  int kept;       // class path entries left as they are
+  size_t entries; // of the packed jar
+  size_t ordered; // classes laid out in load order
+  long long size;
+};
+
+// an archive of the --auto-archive store
+struct yj_archive_info {
+  char *path;
+  char *app;  // the application it was recorded for, NULL for a base
+  char *base; // file name of the base layer of a top layer, or NULL
+  int kind;   // YJ_ARCHIVE_*
+  long long size;
+  unsigned long long hits;
+  long created_us; // wall clock
+  long used_us;
+
+  // page sharing of the processes mapping it, from /proc/<pid>/smaps
+  int procs;
+  long rss_kb;
+  long pss_kb;
+  long shared_kb;
 };
 
+YJ_PUBLIC yj_result yj_expand_cmdline(int argc, char **argv,
+                                      struct yj_cmdline *out);
+
+YJ_PUBLIC yj_result yj_free_cmdline(struct yj_cmdline *cmd);
+
 YJ_PUBLIC yj_result yj_parse_run_args(int argc, char **argv,
                                       struct yj_run_args *args);
 
@@ -97,15 +216,68 @@ YJ_PUBLIC yj_result yj_run(struct yj_java_runtime *runtime,
 YJ_PUBLIC yj_result yj_run_async(struct yj_java_runtime *runtime,
                                  struct yj_run_args *args);
 
+YJ_PUBLIC yj_result yj_run_fork(struct yj_java_runtime *runtime,
+                                struct yj_run_args *args, int *exit_code);
+
+YJ_PUBLIC yj_result yj_run_in_process(struct yj_java_runtime *runtime,
+                                      struct yj_run_args *args,
+                                      int *exit_code);
+
+YJ_PUBLIC yj_result yj_plan_load(int argc, char **argv,
+                                 struct yj_run_args *args,
+                                 struct yj_java_runtime *runtime);
+
 YJ_PUBLIC yj_result yj_create_runtime(char *home,
                                       struct yj_java_runtime *runtime);
 
 YJ_PUBLIC yj_result yj_find_runtime(struct yj_java_runtime *runtime);
 
+YJ_PUBLIC yj_result yj_find_runtime_for(struct yj_run_args *args,
+                                       struct yj_java_runtime *runtime);
+
+YJ_PUBLIC yj_result yj_select_runtime(const char *constraint,
+                                      struct yj_java_runtime *runtime);
+
 YJ_PUBLIC yj_result yj_free_runtime(struct yj_java_runtime * runtime);
 
 YJ_PUBLIC yj_result yj_java_discovery(char *base_path,
                                       struct yj_java_runtime **out,
                                       size_t *out_len);
 
+YJ_PUBLIC yj_result yj_java_discovery_roots(struct yj_discovery *discovery,
+                                            struct yj_java_runtime **out,
+                                            size_t *out_len);
+
+YJ_PUBLIC yj_result yj_discovery_defaults(struct yj_discovery *discovery);
+
+YJ_PUBLIC yj_result yj_free_discovery(struct yj_discovery *discovery);
+
+// records the class load order of a run and merges the class path into
+// one uncompressed jar, used by later launches with the same class path
+YJ_PUBLIC yj_result yj_pack(struct yj_java_runtime *runtime,
+                            struct yj_run_args *args, int *exit_code,
+                            struct yj_pack_info *info);
+
+YJ_PUBLIC yj_result yj_free_pack_info(struct yj_pack_info *info);
+
+// which entry of the class path of args provides each of the names, the
+// runtime included; without names its duplicate classes, split packages
+// and entries which contribute nothing
+YJ_PUBLIC yj_result yj_which_class(struct yj_java_runtime *runtime,
+                                   struct yj_run_args *args, char **names,
+                                   int len, int *exit_code);
+
+YJ_PUBLIC yj_result yj_archive_store(char *path, size_t maxlen,
+                                     long long *max_size);
+
+YJ_PUBLIC yj_result yj_archive_list(struct yj_archive_info **out,
+                                    size_t *out_len, bool sharing);
+
+// evict least recently used archives down to max_size, <= 0 for the
+// configured archive.max_size
+YJ_PUBLIC yj_result yj_archive_gc(long long max_size, size_t *removed,
+                                  long long *freed);
+
+YJ_PUBLIC yj_result yj_free_archive_info(struct yj_archive_info *info);
+
 #endif /* YAJAVA_H */
@@ -0,0 +1,391 @@
+#include "zip.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#define ZIP_EOCD_SIG 0x06054b50
+#define ZIP_EOCD_LEN 22
+#define ZIP_EOCD64_SIG 0x06064b50
+#define ZIP_EOCD64_LOC_SIG 0x07064b50
+#define ZIP_EOCD64_LOC_LEN 20
+#define ZIP_CEN_SIG 0x02014b50
+#define ZIP_CEN_LEN 46
+#define ZIP_LOC_SIG 0x04034b50
+#define ZIP_LOC_LEN 30
+#define ZIP_MAX_COMMENT 0xffff
+#define ZIP64_EXTRA_ID 0x0001
+#define ZIP64_MAGIC 0xffffffff
+
+// little endian readers
+#define ZIP_U16(p) ((uint16_t)((p)[0] | ((p)[1] << 8)))
+#define ZIP_U32(p) ((uint32_t)ZIP_U16(p) | ((uint32_t)ZIP_U16((p) + 2) << 16))
+#define ZIP_U64(p) ((uint64_t)ZIP_U32(p) | ((uint64_t)ZIP_U32((p) + 4) << 32))
+
+bool zip_open(struct zip *zip, const char *path) {
+  const unsigned char *eocd = NULL, *p;
+  struct stat st;
+  void *map;
+  int fd;
+
+  memset(zip, 0, sizeof(struct zip));
+  if (path == NULL || (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+    return false;
+  }
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      st.st_size < ZIP_EOCD_LEN) {
+    close(fd);
+    return false;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  zip->map = map;
+  zip->size = st.st_size;
+
+  // end of central directory, followed by an optional comment
+  for (p = zip->map + zip->size - ZIP_EOCD_LEN;
+       p >= zip->map && p + ZIP_MAX_COMMENT + ZIP_EOCD_LEN >= zip->map + zip->size;
+       p--) {
+    if (ZIP_U32(p) == ZIP_EOCD_SIG &&
+        p + ZIP_EOCD_LEN + ZIP_U16(p + 20) <= zip->map + zip->size) {
+      eocd = p;
+      break;
+    }
+  }
+  if (eocd == NULL) {
+    TRACE("not a zip file: %s", path);
+    zip_close(zip);
+    return false;
+  }
+
+  uint64_t entries = ZIP_U16(eocd + 10);
+  uint64_t cd_size = ZIP_U32(eocd + 12);
+  uint64_t cd_offset = ZIP_U32(eocd + 16);
+
+  // zip64, the locator sits right before the end record
+  if (eocd - zip->map >= ZIP_EOCD64_LOC_LEN &&
+      ZIP_U32(eocd - ZIP_EOCD64_LOC_LEN) == ZIP_EOCD64_LOC_SIG) {
+    uint64_t off = ZIP_U64(eocd - ZIP_EOCD64_LOC_LEN + 8);
+    if (off + 56 <= zip->size && ZIP_U32(zip->map + off) == ZIP_EOCD64_SIG) {
+      entries = ZIP_U64(zip->map + off + 32);
+      cd_size = ZIP_U64(zip->map + off + 40);
+      cd_offset = ZIP_U64(zip->map + off + 48);
+    }
+  }
+
+  if (cd_offset + cd_size > zip->size) {
+    TRACE("invalid central directory: %s", path);
+    zip_close(zip);
+    return false;
+  }
+
+  zip->cd = zip->map + cd_offset;
+  zip->cd_size = cd_size;
+  zip->entries = entries;
+  return true;
+}
+
+void zip_close(struct zip *zip) {
+  if (zip->map != NULL) {
+    munmap((void *)zip->map, zip->size);
+  }
+  memset(zip, 0, sizeof(struct zip));
+}
+
+bool zip_next(struct zip *zip, size_t *pos, struct zip_entry *entry) {
+  const unsigned char *p, *extra, *end;
+  size_t name_len, extra_len, comment_len;
+
+  if (zip->cd == NULL || *pos + ZIP_CEN_LEN > zip->cd_size) {
+    return false;
+  }
+
+  p = zip->cd + *pos;
+  if (ZIP_U32(p) != ZIP_CEN_SIG) {
+    return false;
+  }
+
+  name_len = ZIP_U16(p + 28);
+  extra_len = ZIP_U16(p + 30);
+  comment_len = ZIP_U16(p + 32);
+  if (*pos + ZIP_CEN_LEN + name_len + extra_len + comment_len > zip->cd_size) {
+    return false;
+  }
+
+  entry->name = (const char *)p + ZIP_CEN_LEN;
+  entry->name_len = name_len;
+  entry->method = ZIP_U16(p + 10);
+  entry->crc = ZIP_U32(p + 16);
+  entry->csize = ZIP_U32(p + 20);
+  entry->usize = ZIP_U32(p + 24);
+  entry->local_offset = ZIP_U32(p + 42);
+
+  // zip64 extended information, only the fields which overflowed are present
+  extra = p + ZIP_CEN_LEN + name_len;
+  end = extra + extra_len;
+  while (extra + 4 <= end) {
+    uint16_t id = ZIP_U16(extra), len = ZIP_U16(extra + 2);
+    const unsigned char *v = extra + 4;
+    if (v + len > end) {
+      break;
+    }
+    if (id == ZIP64_EXTRA_ID) {
+      if (entry->usize == ZIP64_MAGIC && v + 8 <= extra + 4 + len) {
+        entry->usize = ZIP_U64(v);
+        v += 8;
+      }
+      if (entry->csize == ZIP64_MAGIC && v + 8 <= extra + 4 + len) {
+        entry->csize = ZIP_U64(v);
+        v += 8;
+      }
+      if (entry->local_offset == ZIP64_MAGIC && v + 8 <= extra + 4 + len) {
+        entry->local_offset = ZIP_U64(v);
+      }
+      break;
+    }
+    extra += 4 + len;
+  }
+
+  *pos += ZIP_CEN_LEN + name_len + extra_len + comment_len;
+  return true;
+}
+
+bool zip_entry_is(struct zip_entry *entry, const char *name) {
+  return entry->name_len == strlen(name) &&
+         memcmp(entry->name, name, entry->name_len) == 0;
+}
+
+bool zip_find(struct zip *zip, const char *name, struct zip_entry *entry) {
+  size_t pos = 0;
+  size_t len = strlen(name);
+
+  while (zip_next(zip, &pos, entry)) {
+    if (entry->name_len == len && memcmp(entry->name, name, len) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const unsigned char *zip_data(struct zip *zip, struct zip_entry *entry) {
+  const unsigned char *p;
+
+  if (entry->local_offset + ZIP_LOC_LEN > zip->size) {
+    return NULL;
+  }
+
+  p = zip->map + entry->local_offset;
+  if (ZIP_U32(p) != ZIP_LOC_SIG) {
+    return NULL;
+  }
+
+  // the local header may carry a different extra field than the central one
+  p += ZIP_LOC_LEN + ZIP_U16(p + 26) + ZIP_U16(p + 28);
+  if (p + entry->csize > zip->map + zip->size) {
+    return NULL;
+  }
+  return p;
+}
+
+// inflate up to len bytes of a deflated entry
+static size_t zip_inflate(const unsigned char *data, size_t csize, void *buf,
+                          size_t len) {
+  z_stream zs;
+  size_t out;
+  int res;
+
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+    return 0;
+  }
+
+  zs.next_in = (Bytef *)data;
+  zs.avail_in = csize;
+  zs.next_out = buf;
+  zs.avail_out = len;
+  res = inflate(&zs, Z_FINISH);
+  out = len - zs.avail_out;
+  inflateEnd(&zs);
+
+  // Z_BUF_ERROR: ran out of output space, expected for partial reads
+  if (res != Z_STREAM_END && res != Z_OK && res != Z_BUF_ERROR) {
+    return 0;
+  }
+  return out;
+}
+
+size_t zip_read_head(struct zip *zip, struct zip_entry *entry, void *buf,
+                     size_t len) {
+  const unsigned char *data = zip_data(zip, entry);
+
+  if (data == NULL) {
+    return 0;
+  }
+  if (len > entry->usize) {
+    len = entry->usize;
+  }
+
+  if (entry->method == ZIP_STORED) {
+    len = len > entry->csize ? entry->csize : len;
+    memcpy(buf, data, len);
+    return len;
+  } else if (entry->method == ZIP_DEFLATED) {
+    return zip_inflate(data, entry->csize, buf, len);
+  }
+  return 0;
+}
+
+char *zip_read(struct zip *zip, struct zip_entry *entry, size_t *out_len) {
+  char *buf;
+  size_t len;
+
+  buf = malloc(entry->usize + 1);
+  if (buf == NULL) {
+    return NULL;
+  }
+
+  len = zip_read_head(zip, entry, buf, entry->usize);
+  if (len != entry->usize) {
+    free(buf);
+    return NULL;
+  }
+
+  buf[len] = '\0';
+  if (out_len != NULL) {
+    *out_len = len;
+  }
+  return buf;
+}
+
+// little endian writers
+static void zip_put16(unsigned char *p, uint16_t v) {
+  p[0] = v & 0xff;
+  p[1] = v >> 8;
+}
+
+static void zip_put32(unsigned char *p, uint32_t v) {
+  zip_put16(p, v & 0xffff);
+  zip_put16(p + 2, v >> 16);
+}
+
+static void zip_put64(unsigned char *p, uint64_t v) {
+  zip_put32(p, v & 0xffffffff);
+  zip_put32(p + 4, v >> 32);
+}
+
+bool zip_writer_open(struct zip_writer *w, const char *path) {
+  memset(w, 0, sizeof(struct zip_writer));
+  w->file = fopen(path, "wb");
+  return w->file != NULL;
+}
+
+bool zip_writer_add(struct zip_writer *w, const char *name, size_t name_len,
+                    const void *data, size_t len) {
+  unsigned char loc[ZIP_LOC_LEN], *cen;
+  uint32_t crc;
+
+  // STORED entries larger than 4G or past 4G of archive are not needed
+  if (w->file == NULL || name_len > 0xffff || len >= ZIP64_MAGIC ||
+      w->offset >= ZIP64_MAGIC) {
+    return false;
+  }
+  if (w->cd_len + ZIP_CEN_LEN + name_len > w->cd_cap) {
+    size_t cap = w->cd_cap == 0 ? 64 * 1024 : w->cd_cap * 2;
+    while (cap < w->cd_len + ZIP_CEN_LEN + name_len) {
+      cap *= 2;
+    }
+    if ((cen = realloc(w->cd, cap)) == NULL) {
+      return false;
+    }
+    w->cd = cen;
+    w->cd_cap = cap;
+  }
+
+  crc = crc32(crc32(0L, Z_NULL, 0), data, len);
+
+  // a fixed timestamp, 1980-01-01, keeps the archive reproducible
+  memset(loc, 0, ZIP_LOC_LEN);
+  zip_put32(loc, ZIP_LOC_SIG);
+  zip_put16(loc + 4, 10); // version needed
+  zip_put16(loc + 8, ZIP_STORED);
+  zip_put16(loc + 12, 0x21);
+  zip_put32(loc + 14, crc);
+  zip_put32(loc + 18, len);
+  zip_put32(loc + 22, len);
+  zip_put16(loc + 26, name_len);
+
+  cen = w->cd + w->cd_len;
+  memset(cen, 0, ZIP_CEN_LEN);
+  zip_put32(cen, ZIP_CEN_SIG);
+  zip_put16(cen + 4, 20); // version made by
+  memcpy(cen + 6, loc + 4, 26);
+  zip_put32(cen + 42, w->offset);
+  memcpy(cen + ZIP_CEN_LEN, name, name_len);
+
+  if (fwrite(loc, ZIP_LOC_LEN, 1, w->file) != 1 ||
+      fwrite(name, 1, name_len, w->file) != name_len ||
+      (len > 0 && fwrite(data, 1, len, w->file) != len)) {
+    return false;
+  }
+  w->cd_len += ZIP_CEN_LEN + name_len;
+  w->offset += ZIP_LOC_LEN + name_len + len;
+  w->entries++;
+  return true;
+}
+
+bool zip_writer_close(struct zip_writer *w) {
+  unsigned char end[56 + ZIP_EOCD64_LOC_LEN + ZIP_EOCD_LEN], *p = end;
+  bool zip64 = w->entries >= 0xffff || w->offset >= ZIP64_MAGIC ||
+               w->cd_len >= ZIP64_MAGIC;
+  bool ok = w->file != NULL;
+
+  if (ok && w->cd_len > 0) {
+    ok = fwrite(w->cd, 1, w->cd_len, w->file) == w->cd_len;
+  }
+
+  memset(end, 0, sizeof(end));
+  if (zip64) {
+    // zip64 end record and its locator, the counts overflow the end record
+    zip_put32(p, ZIP_EOCD64_SIG);
+    zip_put64(p + 4, 44);
+    zip_put16(p + 12, 45);
+    zip_put16(p + 14, 45);
+    zip_put64(p + 24, w->entries);
+    zip_put64(p + 32, w->entries);
+    zip_put64(p + 40, w->cd_len);
+    zip_put64(p + 48, w->offset);
+    p += 56;
+    zip_put32(p, ZIP_EOCD64_LOC_SIG);
+    zip_put64(p + 8, w->offset + w->cd_len);
+    zip_put32(p + 16, 1);
+    p += ZIP_EOCD64_LOC_LEN;
+  }
+  zip_put32(p, ZIP_EOCD_SIG);
+  zip_put16(p + 8, zip64 ? 0xffff : w->entries);
+  zip_put16(p + 10, zip64 ? 0xffff : w->entries);
+  zip_put32(p + 12, zip64 ? ZIP64_MAGIC : w->cd_len);
+  zip_put32(p + 16, zip64 ? ZIP64_MAGIC : w->offset);
+  p += ZIP_EOCD_LEN;
+
+  if (ok) {
+    ok = fwrite(end, 1, p - end, w->file) == (size_t)(p - end);
+  }
+  if (w->file != NULL && fclose(w->file) != 0) {
+    ok = false;
+  }
+  free(w->cd);
+  memset(w, 0, sizeof(struct zip_writer));
+  return ok;
+}
@@ -0,0 +1,69 @@
+#ifndef ZIP_H
+#define ZIP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+
+struct zip {
+  const unsigned char *map;
+  size_t size;
+  const unsigned char *cd; // central directory
+  size_t cd_size;
+  uint64_t entries;
+};
+
+struct zip_entry {
+  const char *name; // not nul-terminated, points into the mapping
+  size_t name_len;
+  uint16_t method;
+  uint32_t crc;
+  uint64_t csize;
+  uint64_t usize;
+  uint64_t local_offset;
+};
+
+bool zip_open(struct zip *zip, const char *path);
+
+void zip_close(struct zip *zip);
+
+// iterate the central directory, *pos starts at 0
+bool zip_next(struct zip *zip, size_t *pos, struct zip_entry *entry);
+
+bool zip_find(struct zip *zip, const char *name, struct zip_entry *entry);
+
+// pointer to the (possibly compressed) data of the entry in the mapping
+const unsigned char *zip_data(struct zip *zip, struct zip_entry *entry);
+
+// read (and inflate) the entry, nul-terminated, free() the result
+char *zip_read(struct zip *zip, struct zip_entry *entry, size_t *out_len);
+
+// read at most len bytes from the start of the entry
+size_t zip_read_head(struct zip *zip, struct zip_entry *entry, void *buf,
+                     size_t len);
+
+bool zip_entry_is(struct zip_entry *entry, const char *name);
+
+// writes an uncompressed (STORED) zip, entries in the order they are added
+struct zip_writer {
+  FILE *file;
+  uint64_t offset;        // of the next local header
+  unsigned char *cd;      // central directory, written by zip_writer_close
+  size_t cd_len;
+  size_t cd_cap;
+  uint64_t entries;
+};
+
+bool zip_writer_open(struct zip_writer *w, const char *path);
+
+bool zip_writer_add(struct zip_writer *w, const char *name, size_t name_len,
+                    const void *data, size_t len);
+
+// writes the central directory, false if anything failed since the open
+bool zip_writer_close(struct zip_writer *w);
+
+#endif /* ZIP_H */